@@ -30,7 +30,7 @@
 #include <ctime>
 #include <array>
 #include "yaml.h"
-#include "tiger.h"
+#include "hash.h"
 
 /** Defined to avoid conflicts.
  * Defined to avoid the inclusion of an conflicting gl.h
@@ -89,7 +89,9 @@ inline std::string ConcatPath (const std::string &str, Args... args)
 template<typename... Args>
 inline std::string MakePath (Args... args)
 {
-	return ConcatPath (config["basedir"].as<std::string> (), args...);
+	// only read access, so that it is safe to use from worker threads
+	const YAML::Node &constconfig = config;
+	return ConcatPath (constconfig["basedir"].as<std::string> (), args...);
 }
 
 /** Read a file into memory.
@@ -130,8 +132,57 @@ float ComputeWeight (unsigned long n, unsigned long k);
  */
 void ComputeWeightOffsets (std::vector<float> &data, GLuint size);
 
+/** Shader features.
+ * Bits of the feature mask of a program variant. Each feature in the
+ * mask is expanded into a preprocessor definition when the program is
+ * compiled, so that the shaders are specialized instead of branching
+ * on uniforms at runtime.
+ */
+class ShaderFeatures
+{
+public:
+	 /** DIFFUSEMAP */
+	 static constexpr GLuint DiffuseMap = 0x01;
+	 /** NORMALMAP */
+	 static constexpr GLuint NormalMap = 0x02;
+	 /** SPECULARMAP */
+	 static constexpr GLuint SpecularMap = 0x04;
+	 /** PARAMETERMAP */
+	 static constexpr GLuint ParameterMap = 0x08;
+	 /** HEIGHTMAP */
+	 static constexpr GLuint HeightMap = 0x10;
+	 /** DISPLACEMENTMAP */
+	 static constexpr GLuint DisplacementMap = 0x20;
+	 /** TILE_BASED */
+	 static constexpr GLuint TileBased = 0x40;
+	 /** CLUSTERED */
+	 static constexpr GLuint Clustered = 0x80;
+	 /** Number of features. */
+	 static constexpr GLuint Count = 8;
+};
+
+/** Load program binary.
+ * Loads a cached program binary.
+ * \param program Program object, into which to load the binary.
+ * \param filename Filename of the program binary.
+ * \param hash Hash of the program sources the binary has to match.
+ * \returns Whether the binary was loaded successfully.
+ */
+bool LoadProgramBinary (gl::Program &program, const std::string &filename,
+												uint64_t *hash);
+
+/** Save program binary.
+ * Stores the binary of a linked program.
+ * \param program Linked program object.
+ * \param filename Filename of the program binary.
+ * \param hash Hash of the program sources.
+ */
+void SaveProgramBinary (gl::Program &program, const std::string &filename,
+												uint64_t *hash);
+
 /** Load program.
- * Loads a program.
+ * Loads a program. Include directives in the source files are
+ * expanded, see ShaderCache::Resolve.
  * \param program Program object, into which to load the program.
  * \param filename Filename of a program binary to be used if possible.
  * \param type Shader type.
@@ -139,25 +190,38 @@ void ComputeWeightOffsets (std::vector<float> &data, GLuint size);
  * \param filenames Array of source files used to compile the program,
  *                  if loading a binary is not possible or the binary
  *                  is not up to date.
- * \returns Whether the program binary was loaded successfully.
+ * \param features Shader features of the program variant. If not zero,
+ *                 the feature mask is appended to the filename of the
+ *                 program binary.
+ * \returns Whether the program binary was loaded or a build was
+ *          submitted successfully. Compile and link errors are only
+ *          reported by ShaderCache::Finish.
  */
 bool LoadProgram (gl::Program &program, const std::string &filename,
 									GLenum type, const std::string &definitions,
-									const std::vector<std::string> &filenames);
+									const std::vector<std::string> &filenames,
+									GLuint features = 0);
 
 /** Load program.
- * Loads a program.
+ * Loads a program. Include directives in the source files are
+ * expanded, see ShaderCache::Resolve.
  * \param program Program object, into which to load the program.
  * \param filename Filename of a program binary to be used if possible.
  * \param definitions Preprocessor definitions for each source file.
  * \param sources Array of type/source files-pairs used to compile
  *                the program, if loading a binary is not possible or
  *                the binary is not up to date.
- * \returns Whether the program binary was loaded successfully.
+ * \param features Shader features of the program variant. If not zero,
+ *                 the feature mask is appended to the filename of the
+ *                 program binary.
+ * \returns Whether the program binary was loaded or a build was
+ *          submitted successfully. Compile and link errors are only
+ *          reported by ShaderCache::Finish.
  */
 bool LoadProgram (gl::Program &program, const std::string &filename,
 									const std::vector<std::string> &definitions,
 									const std::vector<std::pair<GLenum,
-									std::string>> &filenames);
+									std::string>> &filenames,
+									GLuint features = 0);
 
 #endif /* COMMON_H */
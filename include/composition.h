@@ -20,6 +20,23 @@
 #include <common.h>
 #include <gbuffer.h>
 #include <glow.h>
+#include <lightclusters.h>
+
+/** Light culling modes.
+ * Determine which lights are evaluated for a pixel.
+ */
+class LightCulling
+{
+public:
+	 /** All lights are evaluated for every pixel. */
+	 static constexpr GLuint None = 0;
+	 /** Lights are culled per screen tile on the GPU. */
+	 static constexpr GLuint TileBased = 1;
+	 /** Lights are assigned to froxels on the CPU or the GPU. */
+	 static constexpr GLuint Clustered = 2;
+	 /** Number of modes. */
+	 static constexpr GLuint Count = 3;
+};
 
 /** Composition class.
  * This class handles the composition of the gbuffer data into
@@ -40,10 +57,29 @@ public:
 		*/
 	 bool Init (void);
 	 /** Per-frame subroutine.
-		* Handles all per-frame computations required for the composition.
+		* Composes the gbuffer data into the screen and glow map textures.
 		* \param timefactor The fraction of seconds since the last frame.
 		*/
 	 void Frame (float timefactor);
+	 /** Light culling.
+		* With tile-based light culling, determines the depth range of
+		* each tile and the lights affecting it. With clustered light
+		* culling, assigns the lights to the froxels. Not used if light
+		* culling is disabled.
+		*/
+	 void CullLights (void);
+	 /** Downsample glow.
+		* Generates the mipmaps of the glow map and blurs the downsampled
+		* glow map horizontally. Only has an effect if the glow size is
+		* larger than zero.
+		*/
+	 void DownsampleGlow (void);
+	 /** Apply glow.
+		* Blurs the downsampled glow map vertically and adds it to the
+		* screen texture. Only has an effect if the glow size is larger
+		* than zero.
+		*/
+	 void ApplyGlow (void);
 	 /** Get shadow alpha.
 		* Obtains the transparency factor of the shadows.
 		* \returns shadow transparency factor.
@@ -189,29 +225,28 @@ public:
 	 void SetupSunPosition (void);
 	 void SetSkyLuminosity (GLfloat l);
 	 GLfloat GetSkyLuminosity (void);
-	 /** Check, whether rendering is tile-based.
-		* Returns true, if tile-based light culling is currently used,
-		* false, if not.
-		*/
-	 bool GetTileBased (void);
-	 /** Enable or disable tile-based light culling.
-		* Enables or disables tile-based light culling. Tile-based
-		* light culling results in a major speedup in most situations
-		* with around 16 lights or more.
-		* \param tb state of tile-based light culling
-		*/
-	 void SetTileBased (bool tb);
+	 /** Get light culling mode.
+		* \returns The light culling mode, one of the LightCulling values.
+		*/
+	 GLuint GetLightCulling (void);
+	 /** Set light culling mode.
+		* Selects how the lights affecting a pixel are determined.
+		* Tile-based light culling results in a major speedup in most
+		* situations with around 16 lights or more, but is limited to
+		* 1024 lights. Clustered light culling also takes the depth of
+		* the pixels into account and scales to many thousand lights.
+		* \param mode Light culling mode, one of the LightCulling values.
+		*/
+	 void SetLightCulling (GLuint mode);
 	 /** Get glow.
 		* Returns a reference to the internal glow effect class.
 		* \returns a referene to the Glow class
 		*/
 	 Glow &GetGlow (void);
-	 /** dummy texture.
-		* Dummy texture. Necessary, because a framebuffer has to have
-		* at least one attachment.
+	 /** Get light clusters.
+		* \returns The light clusters used by clustered light culling.
 		*/
-	 gl::Texture dummy;
-
+	 LightClusters &GetLightClusters (void);
 	 /** Sun parameters.
 		* Uniform parameters of the sun.
 		*/
@@ -243,9 +278,10 @@ private:
 		*/
 	 Glow glow;
 	 /** Glow map.
-		* A texture storing the parts of the screen that is supposed to glow.
+		* Transient texture resource storing the parts of the screen that
+		* are supposed to glow.
 		*/
-	 gl::Texture glowmap;
+	 GLuint glowmap;
 	 /** Shadow alpha.
 		* This value specifies the degree of transparency of the shadows.
 		*/
@@ -254,7 +290,6 @@ private:
 		* Pixels with a luminance greater than this threshold will be
 		* written to the glow map.
 		*/
-	 gl::SmartUniform<bool> tile_based;
 	 gl::SmartUniform<GLfloat> luminance_threshold;
 	 gl::SmartUniform<GLfloat> screenlimit;
 	 gl::SmartUniform<glm::mat4> shadowmat;
@@ -274,9 +309,18 @@ private:
 
 	 gl::Framebuffer framebuffer;
 	 gl::ProgramPipeline pipeline;
-	 gl::Program fprogram;
+	 /** Composition programs.
+		* One variant for each light culling mode.
+		*/
+	 gl::Program fprograms[LightCulling::Count];
+	 /** Light culling mode.
+		*/
+	 GLuint lightculling;
+	 /** Light clusters.
+		* Froxel light lists used by clustered light culling.
+		*/
+	 LightClusters clusters;
 
-	 gl::Framebuffer clearfb;
 	 gl::Framebuffer lightcullfb;
 	 gl::ProgramPipeline lightcullpipeline;
 	 gl::Program lightcullprog;
@@ -285,7 +329,6 @@ private:
 
 	 gl::Texture lightbuffertex;
 
-	 gl::Framebuffer minmaxdepthfb;
 	 gl::ProgramPipeline minmaxdepthpipeline;
 	 gl::Program minmaxdepthprog;
 	 gl::Texture mindepthtex;
@@ -20,7 +20,11 @@
 #include <common.h>
 
 /** Culling class.
- * This class handles frustum culling.
+ * This class handles frustum culling. Every pass that renders the
+ * scene from a different point of view uses its own culling context.
+ * A context that renders shadow casters can additionally be given the
+ * view frustum of the receivers, so that casters whose shadow cannot
+ * reach any visible receiver are skipped.
  */
 class Culling
 {
@@ -61,6 +65,23 @@ public:
 		* \returns The model view matrix currently in use by this class.
 		*/
 	 const glm::mat4 &GetModelViewMatrix (void);
+	 /** Set the receiver frustum.
+		* Enables caster-receiver culling. A bounding sphere is then only
+		* visible, if it is swept away from the light until the far plane
+		* of the light and the swept volume intersects the receiver frustum.
+		* \param mat Matrix transforming from the view space of this
+		*            context into the clip space of the receivers.
+		* \param perspective Whether the light is a point light located at
+		*                    the origin of the view space of this context.
+		*                    Otherwise the light shines along the negative
+		*                    z axis.
+		* \param range Distance of the far plane of the light.
+		*/
+	 void SetReceiverFrustum (const glm::mat4 &mat, bool perspective,
+														float range);
+	 /** Disable caster-receiver culling.
+		*/
+	 void ClearReceiverFrustum (void);
 	 /** Per-frame initialization.
 		* Initializes the culling class every frame.
 		*/
@@ -78,6 +99,17 @@ private:
 		* Stores the model view matrix used for culling.
 		*/
 	 glm::mat4 mvmat;
+	 /** Receiver frustum.
+		* Planes of the receiver frustum in the view space of this context
+		* and the parameters of the light used for caster-receiver culling.
+		*/
+	 struct
+	 {
+			bool enabled;
+			bool perspective;
+			float range;
+			glm::vec4 planes[6];
+	 } receivers;
 };
 
 #endif /* !defined CULLING_H */
@@ -0,0 +1,226 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef FILESYSTEM_H
+#define FILESYSTEM_H
+
+#include <common.h>
+#include <streambuf>
+#include <istream>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/** Mapped file class.
+ * A read only memory mapping of a whole file.
+ */
+class MappedFile
+{
+public:
+	 MappedFile (void);
+	 MappedFile (const MappedFile&) = delete;
+	 ~MappedFile (void);
+	 MappedFile &operator= (const MappedFile&) = delete;
+	 /** Map a file.
+		* \param filename Filename of the file to map.
+		* \returns Whether the file was mapped successfully.
+		*/
+	 bool Open (const std::string &filename);
+	 /** Unmap the file.
+		*/
+	 void Close (void);
+	 const char *GetData (void) const;
+	 size_t GetSize (void) const;
+private:
+	 const char *data;
+	 size_t size;
+#ifdef _WIN32
+	 HANDLE file;
+	 HANDLE mapping;
+#endif
+};
+
+/** File system class.
+ * Virtual file system all assets are read through. Files are looked
+ * up in a pack file first, if one is configured, and then in the
+ * plain directory tree. Pack files contain all files of the base
+ * directory in a single archive with a hashed directory, so that
+ * finding a file doesn't need any system calls. Their entries are
+ * aligned to pages and served straight from a memory mapping of the
+ * archive, unless they are compressed. Files of the directory tree are
+ * memory mapped individually.
+ */
+class FileSystem
+{
+public:
+	 /** File.
+		* Contents of an opened file. The data stays valid until the file
+		* is closed or destroyed.
+		*/
+	 class File
+	 {
+	 public:
+			File (void);
+			File (const File&) = delete;
+			~File (void);
+			File &operator= (const File&) = delete;
+			/** Close the file.
+			 */
+			void Close (void);
+			const char *GetData (void) const;
+			size_t GetSize (void) const;
+			/** Get stream.
+			 * \returns An input stream reading the file contents from
+			 *          memory, positioned at the start of the file.
+			 */
+			std::istream &GetStream (void);
+	 private:
+			/** Stream buffer.
+			 * Read only stream buffer on the file contents.
+			 */
+			class Buffer : public std::streambuf
+			{
+			public:
+				 void Set (const char *data, size_t size);
+			protected:
+				 pos_type seekoff (off_type off, std::ios_base::seekdir dir,
+													 std::ios_base::openmode which);
+				 pos_type seekpos (pos_type pos, std::ios_base::openmode which);
+			};
+			void Set (const char *data, size_t size);
+			const char *data;
+			size_t size;
+			/** Mapping of a file of the directory tree. */
+			MappedFile mapping;
+			/** Decompressed contents of a pack file entry. */
+			std::vector<char> buffer;
+			Buffer streambuffer;
+			std::istream stream;
+			friend class FileSystem;
+	 };
+	 /** Pack file header.
+		*/
+	 struct PackHeader
+	 {
+			char magic[8];
+			uint32_t version;
+			/** Number of directory buckets, a power of two. */
+			uint32_t numbuckets;
+			/** Offset of the directory. */
+			uint64_t directory;
+			/** Offset of the file names. */
+			uint64_t strings;
+			/** Size of the file names. */
+			uint64_t stringsize;
+	 };
+	 /** Pack file directory entry.
+		* The directory is a hash table with linear probing.
+		*/
+	 struct PackEntry
+	 {
+			/** Hash of the path. */
+			uint64_t hash;
+			/** Offset of the data, aligned to PackAlignment. */
+			uint64_t offset;
+			/** Size of the file. */
+			uint64_t size;
+			/** Size of the stored data. */
+			uint64_t storedsize;
+			/** Path relative to the base directory as offset into the
+			 * file names, or None for empty buckets. */
+			uint32_t name;
+			uint32_t flags;
+	 };
+	 /** Pack entry flags.
+		*/
+	 class Flags
+	 {
+		 public:
+		 /** The data is compressed with zlib. */
+		 static constexpr uint32_t Compressed = 0x1;
+	 };
+	 static constexpr uint32_t None = 0xFFFFFFFF;
+	 static constexpr uint64_t PackAlignment = 4096;
+
+	 FileSystem (void);
+	 ~FileSystem (void);
+	 /** Initialization.
+		* Opens the pack file given in the configuration, if any.
+		* \returns Whether the initialization was successful.
+		*/
+	 bool Init (void);
+	 /** Open a file.
+		* Files inside the base directory are looked up in the pack file
+		* first. May be called from any thread.
+		* \param filename Filename as obtained from MakePath.
+		* \param file Returns the file contents.
+		* \returns Whether the file was opened successfully.
+		*/
+	 bool Open (const std::string &filename, File &file) const;
+	 /** Get file status.
+		* Files of the pack file report the modification time of the
+		* pack file. May be called from any thread.
+		* \param filename Filename as obtained from MakePath.
+		* \param size Returns the size of the file.
+		* \param mtime Returns the modification time of the file.
+		* \returns Whether the file exists.
+		*/
+	 bool Stat (const std::string &filename, uint64_t &size,
+							int64_t &mtime) const;
+	 /** Hash a path.
+		* \param path Path relative to the base directory using forward
+		*             slashes.
+		* \returns The 64 bit FNV-1a hash of the path.
+		*/
+	 static uint64_t Hash (const std::string &path);
+private:
+	 /** Find a pack file entry.
+		* \param path Path relative to the base directory using forward
+		*             slashes.
+		* \returns The entry, NULL if the pack doesn't contain the file.
+		*/
+	 const PackEntry *Find (const std::string &path) const;
+	 /** Load a pack file entry.
+		* \param entry Pack file entry.
+		* \param file Returns the file contents.
+		* \returns Whether the entry was loaded successfully.
+		*/
+	 bool Load (const PackEntry &entry, File &file) const;
+	 /** Get path inside the pack file.
+		* \param filename Filename as obtained from MakePath.
+		* \param path Returns the path relative to the base directory
+		*             using forward slashes.
+		* \returns Whether the file lies inside the base directory.
+		*/
+	 bool GetPackPath (const std::string &filename, std::string &path) const;
+	 MappedFile pack;
+	 const PackEntry *directory;
+	 uint32_t numbuckets;
+	 const char *strings;
+	 uint64_t stringsize;
+	 /** Modification time of the pack file.
+		*/
+	 int64_t packtime;
+	 /** Base directory followed by a directory separator.
+		*/
+	 std::string basedir;
+};
+
+/** Global file system object.
+ */
+extern FileSystem filesystem;
+
+#endif /* !defined FILESYSTEM_H */
@@ -27,6 +27,8 @@ public:
 	 ~GBuffer (void);
 	 bool Init (void);
 	 void Render (Geometry &geometry);
+	 void RenderTransparency (Geometry &geometry);
+	 void RenderSRAA (Geometry &geometry);
 
 	 gl::Texture colorbuffer;
 	 gl::Texture normalbuffer;
@@ -59,13 +61,13 @@ private:
 	 gl::Framebuffer transparencyfb;
 	 gl::Framebuffer transparencyclearfb;
 
-	 gl::Program program;
-	 gl::Program transparencyprog;
-	 gl::Program sraaprog;
+	 Permutations program;
+	 Permutations transparencyprog;
+	 Permutations sraaprog;
 	 gl::Sampler depthsampler;
 
-	 gl::Program quadtessprog;
-	 gl::Program triangletessprog;
+	 Permutations quadtessprog;
+	 Permutations triangletessprog;
 
 	 gl::Buffer counter;
 };
@@ -20,42 +20,122 @@
 #include <common.h>
 #include "model/model.h"
 #include "model/material.h"
+#include "renderqueue.h"
+#include "scenesnapshot.h"
+#include "permutations.h"
 #include <map>
+#include <set>
+#include <functional>
+
+class Occlusion;
+class Culling;
 
 class Geometry
 {
 public:
+	 /** Geometry pass descriptor.
+		* Describes which meshes a geometry pass draws, the vertex layout
+		* it draws them with and which culling tests apply.
+		*/
+	 struct Pass
+	 {
+			/** Mesh categories drawn by the pass, see Model::Meshes.
+			 */
+			GLuint meshes;
+			/** Vertex layout, see RenderQueue::Layout.
+			 */
+			GLuint layout;
+			/** Shadow map pass.
+			 * Only shadow casters are drawn and the shadow map
+			 * tessellation settings apply.
+			 */
+			bool shadowmap;
+			/** Whether instances are tested against the occlusion buffers.
+			 */
+			bool occlusion;
+
+			static const Pass GBuffer;
+			static const Pass GBufferTransparency;
+			static const Pass GBufferSRAA;
+			static const Pass GBufferQuadTess;
+			static const Pass GBufferTriangleTess;
+			static const Pass ShadowMap;
+			static const Pass ShadowMapQuadTess;
+			static const Pass ShadowMapTriangleTess;
+	 };
+
 	 Geometry (void);
 	 ~Geometry (void);
-	 bool Init (void);
-	 void Render (GLuint pass, const gl::Program &program,
-								const glm::mat4 &viewmat);
-	 const Material &GetMaterial (const std::string &name);
-	 void SetProjMatrix (const glm::mat4 &projmat);
+	 /** Initialization.
+		* Loads the scene, either from a scene snapshot or from the
+		* scene description.
+		* \param snapshot Up to date scene snapshot, NULL to read the
+		*                 scene description.
+		* \returns Whether the initialization was successful.
+		*/
+	 bool Init (const SceneSnapshot *snapshot = NULL);
+	 /** Export the scene.
+		* Adds the nodes, models and materials of the scene to a scene
+		* snapshot.
+		* \param writer Scene snapshot writer.
+		*/
+	 void Export (SceneSnapshot::Writer &writer) const;
+	 void Render (const Pass &pass, const Permutations &program,
+								const glm::mat4 &viewmat, Culling &culling);
+	 void Enqueue (const Pass &pass, const Permutations &program,
+								 const glm::mat4 &viewmat, Culling &culling);
+	 void Flush (void);
+	 void RasterizeOccluders (Occlusion &occlusion, const glm::mat4 &viewmat);
+	 /** Get material.
+		* Obtains a material of the scene by name. The materials are
+		* created on the main thread while the scene is loaded.
+		* \param name Name of the material.
+		* \returns The material or NULL if there is no such material.
+		*/
+	 const Material *GetMaterial (const std::string &name) const;
+	 /** Get shader features.
+		* Obtains the feature masks of the program variants needed
+		* to draw the materials of the scene.
+		* \returns The shader features of all materials.
+		*/
+	 std::set<GLuint> GetFeatures (void) const;
 	 const glm::vec3 &GetBoxMin (void);
 	 const glm::vec3 &GetBoxMax (void);
 	 GLuint GetTessLevel (void) const;
 	 void SetTessLevel (GLuint l);
 	 float GetDisplacement (void) const;
 	 void SetDisplacement (float d);
-
-	 class Pass
-	 {
-		 public:
-		 static constexpr GLuint GBuffer = 0x00000000;
-		 static constexpr GLuint GBufferTransparency = 0x10000000;
-		 static constexpr GLuint GBufferSRAA = 0x20000000;
-		 static constexpr GLuint GBufferQuadTess = 0x30000000;
-		 static constexpr GLuint GBufferTriangleTess = 0x40000000;
-		 static constexpr GLuint ShadowMap = 0x50000000;
-		 static constexpr GLuint ShadowMapQuadTess = 0x60000000;
-		 static constexpr GLuint ShadowMapTriangleTess = 0x70000000;
-		 static constexpr GLuint Mask = 0xF0000000;
-	 };
+	 bool GetAdaptiveTessellation (const Pass &pass) const;
+	 void SetAdaptiveTessellation (const Pass &pass, bool a);
+	 float GetPixelsPerEdge (const Pass &pass) const;
+	 void SetPixelsPerEdge (const Pass &pass, float p);
+	 float GetCurvatureBias (void) const;
+	 void SetCurvatureBias (float b);
+	 bool GetPatchCulling (void) const;
+	 void SetPatchCulling (bool c);
 
 private:
-	 void Render (GLuint model, glm::mat4 &mvmat,
-								glm::mat3 &orientation);
+	 /** Load the scene description.
+		* Reads scene.yaml and the models it references.
+		* \returns Whether the scene was loaded successfully.
+		*/
+	 bool LoadScene (void);
+	 /** Load a scene snapshot.
+		* Creates the materials and models stored in a scene snapshot.
+		* \param snapshot Scene snapshot.
+		* \returns Whether the scene was loaded successfully.
+		*/
+	 bool LoadSnapshot (const SceneSnapshot &snapshot);
+	 /** Load materials.
+		* Parses the description files of the materials that don't exist
+		* yet on the thread pool and creates the materials once all of
+		* them are parsed.
+		* \param names Names of the materials.
+		* \returns Whether the materials were loaded successfully.
+		*/
+	 bool LoadMaterials (const std::set<std::string> &names);
+	 void AddInstance (Culling &culling, GLuint model, glm::mat4 &mvmat,
+										 glm::mat3 &orientation);
 
 	 class Node {
 	 public:
@@ -63,9 +143,21 @@ private:
 			~Node (void);
 			void Load (std::map<std::string, GLuint> &names,
 								 const YAML::Node &desc);
-			void Render (Geometry *geometry,
-									 glm::mat4 mvmat,
-									 glm::mat3 orientation);
+			/** Load node from a scene snapshot.
+			 * \param snapshot Scene snapshot.
+			 * \param index Index of the node in the snapshot.
+			 * \returns Index of the node following the subtree of this node.
+			 */
+			GLuint Load (const SceneSnapshot &snapshot, GLuint index);
+			/** Export node.
+			 * Adds the node and its subtree to a scene snapshot.
+			 * \param writer Scene snapshot writer.
+			 */
+			void Export (SceneSnapshot::Writer &writer) const;
+			void Traverse (const std::function<void (GLuint, glm::mat4&,
+																							 glm::mat3&)> &func,
+										 glm::mat4 mvmat,
+										 glm::mat3 orientation);
 	 private:
 			std::vector<Node> children;
 			std::vector<GLuint> models;
@@ -79,12 +171,25 @@ private:
 
 	 std::vector<Model> models;
 
+	 /** Visible instances.
+		* Instances of each model that are visible in the current pass.
+		*/
+	 std::vector<std::vector<RenderQueue::Instance>> instances;
+
+	 /** Geometry arena.
+		* Vertex and index data of all meshes.
+		*/
+	 Arena arena;
+
+	 /** Render queue.
+		* Draws queued with Enqueue until the next Flush.
+		*/
+	 RenderQueue queue;
+
 	 gl::Sampler sampler;
 	 std::map<std::string, Material*> materials;
 
-	 GLuint pass;
-	 const gl::Program *program;
-	 gl::Program bboxprogram;
+	 const Pass *pass;
 
 	 glm::vec3 boxmin;
 	 glm::vec3 boxmax;
@@ -93,6 +198,28 @@ private:
 	 GLint maxTessLevel;
 	 float displacement;
 
+	 /** Adaptive tessellation.
+		* Settings for the tessellated geometry of the gbuffer (index 0)
+		* and of the shadow map (index 1). In adaptive mode the edges of
+		* a patch are subdivided so that each segment covers about
+		* pixelsperedge pixels, limited by tessLevel.
+		*/
+	 struct
+	 {
+			bool enabled;
+			float pixelsperedge;
+	 } adaptivetess[2];
+	 /** Curvature bias.
+		* Factor by which the curvature of a patch increases its inner
+		* tessellation levels in adaptive mode.
+		*/
+	 float curvaturebias;
+	 /** Patch culling.
+		* Whether the tessellation control shaders discard patches outside
+		* the view frustum and patches facing away from the viewer.
+		*/
+	 bool patchculling;
+
 	 friend class Model;
 	 friend class Mesh;
 };
@@ -35,14 +35,19 @@ public:
 	 /** Initialization.
 		* Initializes the glow class.
 		* \param screenmap Screenmap to blend the glow map into.
-		* \param glowmap Glowmap to use.
+		* \param glowmap Transient texture resource of the glow map to use.
 		* \param mipmap_level Specifies which mipmap level of the glow map to use.
 		* \returns Whether the initialization was successful.
 		*/
-	 bool Init (gl::Texture &screenmap, gl::Texture &glowmap,
+	 bool Init (gl::Texture &screenmap, GLuint glowmap,
 							GLuint mipmap_level);
+	 /** Downsample glow map.
+		* Downsamples the glow map and blurs it horizontally.
+		*/
+	 void Downsample (void);
 	 /** Apply glow effect.
-		* Applies the glow effect.
+		* Blurs the downsampled glow map vertically and blends
+		* it into the screen map.
 		*/
 	 void Apply (void);
 	 /** Get glow size.
@@ -118,7 +123,11 @@ private:
 	 gl::Buffer buffer;
 	 gl::Texture buffertex;
 
-	 gl::Texture map, map2;
+	 /** Blur targets.
+		* Transient texture resources for the horizontally and
+		* the fully blurred glow map.
+		*/
+	 GLuint map, map2;
 
 	 gl::Framebuffer blendfb;
 	 gl::Program blendprog;
@@ -126,7 +135,7 @@ private:
 
 	 GLuint size;
 
-	 gl::Texture *glowmap;
+	 GLuint glowmap;
 };
 
 #endif /* !defined GLOW_H */
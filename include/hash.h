@@ -0,0 +1,92 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+#include <memory>
+
+/** Hash function interface.
+ * Interface of the content hashes used as keys of the program binary,
+ * shader and scene caches. Digests are three 64-bit words, hashes with
+ * shorter digests leave the remaining words zero.
+ */
+class Hash
+{
+public:
+	 virtual ~Hash (void);
+	 /** Reset.
+		* Starts a new hash.
+		*/
+	 virtual void reset (void) = 0;
+	 /** Consume data.
+		* \param ptr Data to hash.
+		* \param len Length of the data in bytes.
+		*/
+	 virtual void consume (const void *ptr, uint64_t len) = 0;
+	 /** Finalize.
+		* Has to be called after all data is consumed.
+		*/
+	 virtual void finalize (void) = 0;
+	 /** Get digest.
+		* \param res Returns the digest.
+		*/
+	 virtual void get (uint64_t res[3]) = 0;
+	 /** Create hash.
+		* Creates a hash object of the algorithm selected by the "hash"
+		* configuration option, "fast" for FastHash, which is the default,
+		* or "tiger2" for Tiger2.
+		* \returns The hash object.
+		*/
+	 static std::unique_ptr<Hash> Create (void);
+};
+
+/** Fast hash class.
+ * A non-cryptographic 128-bit hash. The input is processed in stripes
+ * of 64 bytes, each of which is added to eight independent 64-bit
+ * accumulators using 32x32 bit multiplications, which maps directly
+ * to SSE2. The accumulators are scrambled after every 1KB block and
+ * folded into the digest by finalize.
+ */
+class FastHash : public Hash
+{
+public:
+	 FastHash (void);
+	 ~FastHash (void);
+	 void reset (void);
+	 void consume (const void *ptr, uint64_t len);
+	 void finalize (void);
+	 void get (uint64_t res[3]);
+private:
+	 /** Accumulate a stripe.
+		* \param stripe 64 bytes of input.
+		*/
+	 void accumulate (const uint8_t *stripe);
+	 /** Scramble the accumulators.
+		*/
+	 void scramble (void);
+	 uint64_t acc[8];
+	 uint64_t result[2];
+	 uint8_t temp[64];
+	 uint8_t templen;
+	 /** Number of stripes in the current block.
+		*/
+	 uint8_t stripes;
+	 uint64_t length;
+};
+
+#endif /* !defined HASH_H */
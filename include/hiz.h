@@ -0,0 +1,138 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HIZ_H
+#define HIZ_H
+
+#include <common.h>
+
+/** Hierarchical-Z class.
+ * This class builds a maximum depth pyramid from the depth buffer
+ * of the gbuffer, reads a coarse level of it back to the CPU
+ * asynchronously and reprojects it to the current camera, so that
+ * occluded objects can be rejected before they are drawn.
+ */
+class HiZ
+{
+public:
+	 /** Constructor.
+		*/
+	 HiZ (void);
+	 /** Destructor.
+		*/
+	 ~HiZ (void);
+	 /** Initialization.
+		* Initializes the hierarchical-Z class.
+		* \returns Whether the initialization was successful.
+		*/
+	 bool Init (void);
+	 /** Per-frame initialization.
+		* Fetches the result of the last readback, if it is available,
+		* and reprojects the depth pyramid to the current camera.
+		*/
+	 void Frame (void);
+	 /** Build the depth pyramid.
+		* Builds the depth pyramid from the depth buffer of the gbuffer
+		* and schedules an asynchronous readback of its coarse level.
+		* Has to be called after the gbuffer has been rendered.
+		*/
+	 void Build (void);
+	 /** Occlusion query.
+		* Checks whether an axis aligned bounding box is hidden
+		* behind the depth stored in the reprojected depth pyramid.
+		* \param mvpmat Model view projection matrix of the box.
+		* \param min Minimum corner of the bounding box.
+		* \param max Maximum corner of the bounding box.
+		* \returns Whether the box is known to be occluded.
+		*/
+	 bool IsOccluded (const glm::mat4 &mvpmat, const glm::vec3 &min,
+										const glm::vec3 &max) const;
+	 /** Check whether hierarchical-Z culling is enabled.
+		* \returns Whether hierarchical-Z culling is enabled.
+		*/
+	 bool GetEnabled (void) const;
+	 /** Enable or disable hierarchical-Z culling.
+		* \param e Whether to enable hierarchical-Z culling.
+		*/
+	 void SetEnabled (bool e);
+private:
+	 /** Reproject.
+		* Reprojects the last read back depth values to the
+		* current camera and builds the CPU side depth hierarchy.
+		*/
+	 void Reproject (void);
+	 /** Depth pyramid.
+		* One R32F texture per level, each storing the maximum depth
+		* of the corresponding 2x2 texels of the previous level.
+		*/
+	 std::vector<gl::Texture> levels;
+	 /** Framebuffers.
+		* One framebuffer per level of the depth pyramid.
+		*/
+	 std::vector<gl::Framebuffer> framebuffers;
+	 /** Fragment shader program.
+		* Shader program that reduces a level of the pyramid.
+		*/
+	 gl::Program program;
+	 /** Program pipeline.
+		* Program pipeline used for the reduction passes.
+		*/
+	 gl::ProgramPipeline pipeline;
+	 /** Readback buffer.
+		* Pixel buffer object the coarse level is read back to.
+		*/
+	 gl::Buffer readbackbuffer;
+	 /** Readback fence.
+		* Fence signaled once the readback has finished.
+		*/
+	 GLsync fence;
+	 /** Readback level.
+		* Level of the depth pyramid that is read back to the CPU.
+		*/
+	 GLuint readbacklevel;
+	 /** Readback dimensions.
+		* Width and height of the level that is read back.
+		*/
+	 GLuint width, height;
+	 /** Pending view projection matrix.
+		* View projection matrix used to render the depth values
+		* of the currently pending readback.
+		*/
+	 glm::mat4 pendingvpmat;
+	 /** Inverse view projection matrix.
+		* Inverse of the view projection matrix used to render the depth
+		* values of the last completed readback.
+		*/
+	 glm::mat4 invvpmat;
+	 /** Read back depth.
+		* Depth values of the last completed readback.
+		*/
+	 std::vector<GLfloat> depth;
+	 /** CPU depth hierarchy.
+		* Maximum depth hierarchy reprojected to the current camera.
+		*/
+	 std::vector<std::vector<GLfloat>> hierarchy;
+	 /** Validity flag.
+		* Whether there is valid depth information for the current frame.
+		*/
+	 bool valid;
+	 /** Enable flag.
+		* Whether hierarchical-Z culling is enabled.
+		*/
+	 bool enabled;
+};
+
+#endif /* !defined HIZ_H */
@@ -0,0 +1,249 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LIGHTCLUSTERS_H
+#define LIGHTCLUSTERS_H
+
+#include <common.h>
+#include "light.h"
+#include "camera.h"
+
+/** Light clusters class.
+ * Assigns the lights to clusters on the CPU. The view frustum is split
+ * into a grid of froxels, i.e. screen space tiles that are divided into
+ * exponentially spaced depth slices. For each froxel a compact list of
+ * the lights that may affect it is built: a light is assigned, if its
+ * range intersects the bounding box of the froxel and its spot cone
+ * intersects the bounding sphere of the froxel. The depth slices are
+ * processed in parallel by the thread pool and the lights are tested
+ * four at a time using SSE, if available. Alternatively the light lists
+ * are built on the GPU by a compute shader with one work group per
+ * froxel, which writes them to the same buffers as shader storage. The
+ * result is stored in two texture buffers, a grid with the offset and
+ * the number of lights of each froxel and the light indices the
+ * offsets refer to.
+ */
+class LightClusters
+{
+public:
+	 /** Constructor.
+		*/
+	 LightClusters (void);
+	 /** Destructor.
+		*/
+	 ~LightClusters (void);
+	 /** Initialization.
+		* Determines the dimensions of the froxel grid, creates the
+		* texture buffers and loads the compute shader.
+		* \returns Whether the initialization was successful.
+		*/
+	 bool Init (void);
+	 /** Assign lights.
+		* Assigns the lights to the froxels and uploads the light lists.
+		* If the light lists are built on the GPU, the lights are read
+		* from the light buffer of the renderer instead and the light
+		* lists are only complete after a shader storage barrier.
+		* \param camera Camera the froxels are computed for.
+		* \param lights Array of lights.
+		* \param numlights Number of lights.
+		*/
+	 void Build (const Camera &camera, const Light *lights, GLuint numlights);
+	 /** Check whether the light lists are built on the GPU.
+		* \returns Whether the light lists are built on the GPU.
+		*/
+	 bool GetGPU (void) const;
+	 /** Select where the light lists are built.
+		* \param g Whether to build the light lists on the GPU.
+		*/
+	 void SetGPU (bool g);
+	 /** Get tile size.
+		* \returns The width and height of a tile in pixels.
+		*/
+	 GLuint GetTileSize (void) const;
+	 /** Get number of tiles in horizontal direction.
+		* \returns The number of tiles in horizontal direction.
+		*/
+	 GLuint GetNumTilesX (void) const;
+	 /** Get number of tiles in vertical direction.
+		* \returns The number of tiles in vertical direction.
+		*/
+	 GLuint GetNumTilesY (void) const;
+	 /** Get number of depth slices.
+		* \returns The number of depth slices.
+		*/
+	 GLuint GetNumSlices (void) const;
+	 /** Get grid texture.
+		* Texture buffer with the offset into the index texture and the
+		* number of lights of each froxel, stored as RG32UI. The froxel
+		* of tile (x, y) in slice z has the index
+		* (z * tilesy + y) * tilesx + x.
+		* \returns The grid texture.
+		*/
+	 const gl::Texture &GetGridTexture (void) const;
+	 /** Get index texture.
+		* Texture buffer with the light indices of all froxels,
+		* stored as R32UI.
+		* \returns The index texture.
+		*/
+	 const gl::Texture &GetIndexTexture (void) const;
+private:
+	 /** Light bounds.
+		* View space bounds of a set of lights as structure of arrays,
+		* padded to a multiple of four with lights that never intersect.
+		*/
+	 struct Bounds
+	 {
+			/** Resize the arrays.
+			 * \param n Number of lights, not including the padding.
+			 */
+			void Resize (GLuint n);
+			/** Pad the arrays.
+			 * Fills the arrays up to the next multiple of four.
+			 */
+			void Pad (void);
+			/** Copy a light.
+			 * \param i Index to copy the light to.
+			 * \param from Bounds to copy the light from.
+			 * \param j Index of the light in from.
+			 */
+			void Copy (GLuint i, const Bounds &from, GLuint j);
+			/** Number of lights, not including the padding. */
+			GLuint count;
+			std::vector<GLfloat> x, y, z, radius;
+			/** Normalized spot direction, zero if the spot cone
+			 * is wider than a half space. */
+			std::vector<GLfloat> dirx, diry, dirz;
+			/** Cosine and sine of the spot angle, zero if the spot cone
+			 * is wider than a half space. */
+			std::vector<GLfloat> cosine, sine;
+			std::vector<GLuint> index;
+	 };
+	 /** Depth slice.
+		* Light lists and temporary storage of a depth slice.
+		*/
+	 struct Slice
+	 {
+			/** Number of lights of each froxel of the slice. */
+			std::vector<GLuint> counts;
+			/** Light indices of all froxels of the slice. */
+			std::vector<GLuint> indices;
+			/** Lights intersecting the slice. */
+			Bounds lights;
+			/** Lights intersecting the current row of tiles. */
+			Bounds row;
+	 };
+	 /** Build a depth slice.
+		* Builds the light lists of all froxels of a depth slice.
+		* \param z Index of the depth slice.
+		*/
+	 void BuildSlice (GLuint z);
+	 /** Filter lights.
+		* Selects the lights whose range intersects a bounding box.
+		* \param in Lights to test.
+		* \param min Minimum corner of the bounding box.
+		* \param max Maximum corner of the bounding box.
+		* \param out Returns the lights intersecting the box.
+		*/
+	 static void Filter (const Bounds &in, const glm::vec3 &min,
+											 const glm::vec3 &max, Bounds &out);
+	 /** Assign lights to a froxel.
+		* Appends the indices of the lights that intersect a froxel,
+		* testing both their range and their spot cone.
+		* \param in Lights to test.
+		* \param min Minimum corner of the bounding box of the froxel.
+		* \param max Maximum corner of the bounding box of the froxel.
+		* \param indices Vector to append the light indices to.
+		* \returns The number of lights that were appended.
+		*/
+	 static GLuint Assign (const Bounds &in, const glm::vec3 &min,
+												 const glm::vec3 &max, std::vector<GLuint> &indices);
+	 /** Build the light lists on the GPU.
+		* Dispatches the compute shader with one work group per froxel.
+		* \param camera Camera the froxels are computed for.
+		*/
+	 void Dispatch (const Camera &camera);
+	 /** Read back the counter.
+		* Reads the counter of an earlier dispatch, once it is available,
+		* grows the index buffer to the number of indices it needed and
+		* logs froxels that exceeded the maximum number of lights.
+		*/
+	 void ReadBack (void);
+	 /** Tile size.
+		* Width and height of a tile in pixels.
+		*/
+	 GLuint tilesize;
+	 /** Grid dimensions.
+		* Number of tiles in horizontal and vertical direction and
+		* number of depth slices.
+		*/
+	 GLuint tilesx, tilesy, numslices;
+	 /** Tile boundaries.
+		* Normalized device coordinates of the tile boundaries, scaled
+		* by the projection, so that multiplying them with the view
+		* space depth yields view space coordinates.
+		*/
+	 std::vector<GLfloat> boundsx, boundsy;
+	 /** Slice boundaries.
+		* View space depth of the slice boundaries.
+		*/
+	 std::vector<GLfloat> depths;
+	 /** All lights in view space.
+		*/
+	 Bounds lights;
+	 std::vector<Slice> slices;
+	 gl::Buffer grid;
+	 gl::Buffer indices;
+	 /** Size of the index buffer in number of indices.
+		*/
+	 GLuint capacity;
+	 gl::Texture gridtex;
+	 gl::Texture indextex;
+	 /** Whether the light lists are built on the GPU.
+		*/
+	 bool gpu;
+	 /** Whether the buffers were last written by the compute shader.
+		* Updating them from the CPU requires a barrier in that case.
+		*/
+	 bool written;
+	 /** Maximum number of lights of a froxel built on the GPU.
+		* Further lights are dropped and the froxels are logged. The light
+		* lists built on the CPU have no such limit.
+		*/
+	 GLuint maxlights;
+	 /** Counter of the compute shader.
+		* Number of indices needed by all froxels, number of froxels
+		* exceeding maxlights and the largest number of lights of such
+		* a froxel.
+		*/
+	 gl::Buffer counter;
+	 /** Copy of the counter for reading it back.
+		*/
+	 gl::Buffer readback;
+	 /** Readback fence.
+		* Signaled once the copy of the counter is available.
+		*/
+	 GLsync fence;
+	 /** Largest number of lights of a froxel that was logged.
+		*/
+	 GLuint reported;
+	 /** Light buffer of the renderer.
+		*/
+	 gl::Texture lighttex;
+	 gl::Program program;
+	 gl::ProgramPipeline pipeline;
+};
+
+#endif /* !defined LIGHTCLUSTERS_H */
@@ -0,0 +1,159 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <common.h>
+#include <oglp/oglp.h>
+
+/** Indirect draw command.
+ * Layout of a single command in the draw indirect buffer as
+ * expected by glMultiDrawElementsIndirect.
+ */
+struct DrawElementsIndirectCommand
+{
+	 GLuint count;
+	 GLuint instanceCount;
+	 GLuint firstIndex;
+	 GLint baseVertex;
+	 GLuint baseInstance;
+};
+
+/** Geometry arena.
+ * Holds the vertex and index data of all meshes in a few large buffers.
+ * Meshes append their data while they are loaded and only remember
+ * their base vertex and first index, so that all meshes of the same
+ * vertex format share a single vertex array object and can be drawn
+ * with a single indirect draw call.
+ */
+class Arena
+{
+public:
+	 /** Constructor.
+		*/
+	 Arena (void);
+	 /** Destructor.
+		*/
+	 ~Arena (void);
+	 /** Add triangle vertices.
+		* Appends the vertices of a triangle mesh to the arena.
+		* \param count Number of vertices.
+		* \param positions Vertex positions.
+		* \param normals Vertex normals.
+		* \param tangents Vertex tangents.
+		* \param texcoords Texture coordinates.
+		* \returns Base vertex of the appended vertices.
+		*/
+	 GLint AddTriangleVertices (GLuint count, const glm::vec3 *positions,
+															const glm::vec3 *normals,
+															const glm::vec3 *tangents,
+															const glm::vec2 *texcoords);
+	 /** Add patch vertices.
+		* Appends the control points of a patch mesh to the arena.
+		* \param count Number of control points.
+		* \param positions Control point positions.
+		* \param texcoords Texture coordinates.
+		* \returns Base vertex of the appended control points.
+		*/
+	 GLint AddPatchVertices (GLuint count, const glm::vec3 *positions,
+													 const glm::vec2 *texcoords);
+	 /** Add patch data.
+		* Appends per-patch data of a patch mesh to the arena.
+		* \param count Number of patches.
+		* \param curvature Curvature of each patch, as computed by libpchm.
+		* \param cones Normal cone of each patch as axis and half angle,
+		*              NULL if the patches must never be backface culled.
+		* \returns Index of the first appended patch.
+		*/
+	 GLint AddPatchData (GLuint count, const GLfloat *curvature,
+											 const glm::vec4 *cones);
+	 /** Add indices.
+		* Appends indices to the shared index buffer.
+		* \param count Number of indices.
+		* \param indices Indices relative to the base vertex of the mesh.
+		* \returns Position of the first appended index.
+		*/
+	 GLuint AddIndices (GLuint count, const GLuint *indices);
+	 /** Upload.
+		* Uploads the collected data to the GPU, sets up the vertex
+		* array objects and releases the CPU side copies. Has to be
+		* called once after all meshes are loaded.
+		*/
+	 void Upload (void);
+	 /** Bind triangle vertex format.
+		* Binds the vertex array and the index buffer for triangle meshes.
+		*/
+	 void BindTriangles (void) const;
+	 /** Bind depth only vertex format.
+		* Binds a vertex array for triangle meshes that only sources
+		* the positions, and the index buffer.
+		*/
+	 void BindDepthOnly (void) const;
+	 /** Bind patch vertex format.
+		* Binds the vertex array and the index buffer for patch meshes
+		* and the per-patch data to texture units 8 and 9.
+		*/
+	 void BindPatches (void) const;
+private:
+	 /** Triangle vertices.
+		* CPU side copy of the triangle vertex data until it is uploaded.
+		*/
+	 struct
+	 {
+			std::vector<glm::vec3> positions;
+			std::vector<glm::vec3> normals;
+			std::vector<glm::vec3> tangents;
+			std::vector<glm::vec2> texcoords;
+	 } triangles;
+	 /** Patch vertices.
+		* CPU side copy of the patch control points until they are uploaded.
+		*/
+	 struct
+	 {
+			std::vector<glm::vec3> positions;
+			std::vector<glm::vec2> texcoords;
+			/** Curvature of each patch. */
+			std::vector<GLfloat> curvature;
+			/** Normal cone of each patch. */
+			std::vector<glm::vec4> cones;
+	 } patches;
+	 /** Indices.
+		* CPU side copy of the index data until it is uploaded.
+		*/
+	 std::vector<GLuint> indices;
+	 /** Vertex buffers.
+		* Triangle positions, normals, tangents and texture coordinates
+		* followed by patch positions and texture coordinates.
+		*/
+	 gl::Buffer buffers[6];
+	 /** Index buffer.
+		* Indices of all meshes.
+		*/
+	 gl::Buffer indexbuffer;
+	 /** Patch data.
+		* Buffers and buffer textures with the curvature and the normal
+		* cone of each patch.
+		*/
+	 gl::Buffer patchbuffer, conebuffer;
+	 gl::Texture patchtex, conetex;
+	 /** Vertex arrays.
+		* Vertex array objects for the different vertex formats.
+		*/
+	 gl::VertexArray trianglearray, depthonlyarray, patcharray;
+};
+
+#endif /* !defined ARENA_H */
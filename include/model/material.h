@@ -19,6 +19,7 @@
 
 #include <common.h>
 #include <oglp/oglp.h>
+#include "texturecache.h"
 
 class Material
 {
@@ -29,23 +30,81 @@ public:
 	 ~Material (void);
 	 Material &operator= (Material &&material);
 	 Material &operator= (const Material&) = delete;
-	 void Use (const gl::Program &program) const;
+	 /** Use material.
+		* Binds the textures of the material, once they are all resident.
+		*/
+	 void Use (void) const;
+	 /** Get shader features.
+		* Obtains the feature mask of the program variant the material has
+		* to be drawn with. The textures of a material are only used once
+		* all of them are resident, so that only the variant chosen at load
+		* time and the variant without textures are needed.
+		* \returns The shader features of the material.
+		*/
+	 GLuint GetFeatures (void) const;
+	 /** Get all shader features.
+		* \returns The shader features of the material, once all of its
+		*          textures are resident.
+		*/
+	 GLuint GetAllFeatures (void) const;
 	 bool IsTransparent (void) const;
 	 bool IsDoubleSided (void) const;
+	 /** Material description.
+		* Properties of a material as given in its description file.
+		*/
+	 struct Description
+	 {
+			bool transparent;
+			bool doublesided;
+			/** Texture filenames.
+			 * Filenames of the diffuse map, normal map, specular map,
+			 * parameter map, height map and displacement map relative
+			 * to the texture directory. Empty for unused textures.
+			 */
+			std::array<std::string, 6> textures;
+	 };
+	 /** Read material description.
+		* Parses the description file of a material. Doesn't access
+		* OpenGL or any shared state, so it can run on a worker thread.
+		* Errors are reported by throwing std::runtime_error.
+		* \param name Name of the material.
+		* \param desc Returns the material description.
+		*/
+	 static void Read (const std::string &name, Description &desc);
 private:
-	 bool Load (const std::string &name);
-	 gl::Texture diffuse;
-	 bool diffuse_enabled;
-	 gl::Texture normalmap;
-	 bool normalmap_enabled;
-	 gl::Texture specularmap;
-	 bool specularmap_enabled;
-	 gl::Texture parametermap;
-	 bool parametermap_enabled;
-	 gl::Texture heightmap;
-	 bool heightmap_enabled;
-	 gl::Texture displacementmap;
-	 bool displacementmap_enabled;
+	 /** Set up material.
+		* Stores the properties of the material and requests its textures
+		* from the texture cache. Has to be called on the main thread.
+		* \param desc Material description.
+		*/
+	 void Setup (const Description &desc);
+	 /** Request a texture.
+		* Obtains a texture from the texture cache. The texture stays
+		* disabled until its first level is resident.
+		* \param texture Returns the texture handle.
+		* \param filename Filename of the texture, empty for none.
+		*/
+	 void RequestTex (TextureCache::Handle &texture,
+										const std::string &filename);
+	 /** Check whether a texture can be used.
+		* \param texture Texture handle.
+		* \returns Whether the texture exists and is resident.
+		*/
+	 static bool IsResident (const TextureCache::Handle &texture);
+	 TextureCache::Handle diffuse;
+	 TextureCache::Handle normalmap;
+	 TextureCache::Handle specularmap;
+	 TextureCache::Handle parametermap;
+	 TextureCache::Handle heightmap;
+	 TextureCache::Handle displacementmap;
+	 /** Texture filenames.
+		* Kept for writing scene snapshots.
+		*/
+	 std::array<std::string, 6> textures;
+	 /** Shader features.
+		* Features for the textures the material has.
+		*/
+	 GLuint features;
 	 bool transparent;
 	 bool doublesided;
 	 friend class Scene;
@@ -19,9 +19,16 @@
 
 #include <common.h>
 #include <oglp/oglp.h>
+#include "arena.h"
+#include <memory>
+
+namespace pchm {
+class model;
+} /* namespace pchm */
 
 class Model;
 class Material;
+class Occlusion;
 
 class Mesh
 {
@@ -32,15 +39,35 @@ public:
 	 ~Mesh (void);
 	 Mesh &operator= (Mesh &&mesh);
 	 Mesh &operator= (const Mesh&) = delete;
-	 void Render (const gl::Program &program,
-								bool depthonly = false,
-								bool quads = true) const;
-	 bool Load (const std::string &filename,
-							const Material *mat,
-							glm::vec3 &min,
-							glm::vec3 &max,
-							bool cast_shadows);
+	 DrawElementsIndirectCommand GetDrawCommand (GLuint instancecount,
+																							 bool quads = true) const;
+	 GLint GetPatchOffset (bool quads = true) const;
+	 const Material *GetMaterial (void) const;
+	 /** Read mesh.
+		* Reads the mesh file and computes the bounds of the mesh.
+		* Doesn't access OpenGL, the geometry arena or the materials,
+		* so it can run on a worker thread. Errors are reported by
+		* throwing std::runtime_error.
+		* \param filename Filename of the mesh.
+		* \param cast_shadows Whether the mesh casts shadows.
+		* \param is_occluder Whether the mesh is used for occlusion culling.
+		*/
+	 void Read (const std::string &filename,
+							bool cast_shadows,
+							bool is_occluder = false);
+	 /** Upload mesh.
+		* Appends the data read by Read to the geometry arena and
+		* releases it. Has to be called on the main thread.
+		* \param mat Material of the mesh.
+		* \param min Minimum of the bounding box to extend.
+		* \param max Maximum of the bounding box to extend.
+		* \returns Whether the mesh was uploaded successfully.
+		*/
+	 bool Upload (const Material *mat, glm::vec3 &min, glm::vec3 &max);
+	 void RasterizeOccluder (Occlusion &occlusion,
+													 const glm::mat4 &mvmat) const;
 	 bool CastsShadow (void) const;
+	 bool IsOccluder (void) const;
 	 bool IsTransparent (void) const;
 	 bool IsTessellated (void) const;
 	 static GLuint culled;
@@ -68,17 +95,39 @@ private:
 			float radius;
 	 } bsphere;
 
+	 struct
+	 {
+			glm::vec3 min;
+			glm::vec3 max;
+	 } bbox;
+
+	 /** Mesh data.
+		* Data read by Read until it is uploaded.
+		*/
+	 std::unique_ptr<pchm::model> data;
+	 std::string filename;
+
+	 friend class Model;
+
 	 bool patches;
 
 	 Model &parent;
 
-	 gl::VertexArray vertexarray, depthonlyarray;
 	 GLuint trianglecount;
 	 GLuint quadcount;
 	 GLuint vertexcount;
-	 std::vector<gl::Buffer> buffers;
-	 gl::Buffer triangleindices;
-	 gl::Buffer quadindices;
+	 GLint basevertex;
+	 GLuint firsttriangle;
+	 GLuint firstquad;
+	 GLint firsttrianglepatch;
+	 GLint firstquadpatch;
+
+	 struct
+	 {
+			bool requested;
+			std::vector<glm::vec3> vertices;
+			std::vector<GLuint> indices;
+	 } occluder;
 };
 
 #endif /* !defined MESH_H */
@@ -20,7 +20,11 @@
 #include <common.h>
 #include "mesh.h"
 #include "material.h"
+#include "scenesnapshot.h"
+#include <set>
 class Geometry;
+class Occlusion;
+class Culling;
 
 class Model
 {
@@ -31,35 +35,94 @@ public:
 	 ~Model (void);
 	 Model &operator= (Model &&model);
 	 Model &operator= (const Model&) = delete;
-	 bool Load (const std::string &filename);
-	 void Render (GLuint pass, const gl::Program &program);
+	 /** Read model.
+		* Parses the model description and queues reading its meshes
+		* on the thread pool. Doesn't access OpenGL or the materials, so
+		* it can run on a worker thread. Errors are reported by throwing
+		* std::runtime_error. The model must not be moved until it is
+		* uploaded.
+		* \param filename Filename of the model description.
+		*/
+	 void Read (const std::string &filename);
+	 /** Read model from a scene snapshot.
+		* Queues reading the meshes of a model stored in a scene snapshot
+		* on the thread pool. The model must not be moved until it is
+		* uploaded.
+		* \param snapshot Scene snapshot.
+		* \param index Index of the model in the snapshot.
+		* \returns Whether the model was read successfully.
+		*/
+	 bool Read (const SceneSnapshot &snapshot, GLuint index);
+	 /** Export model.
+		* Adds the model and its meshes to a scene snapshot.
+		* \param writer Scene snapshot writer.
+		*/
+	 void Export (SceneSnapshot::Writer &writer) const;
+	 /** Get material names.
+		* Adds the names of the materials used by the meshes of the
+		* model to a set.
+		* \param names Set of material names.
+		*/
+	 void GetMaterials (std::set<std::string> &names) const;
+	 /** Upload model.
+		* Uploads the meshes of the model after the thread pool
+		* finished reading them and sorts them by category. The
+		* materials of the meshes have to be created before.
+		* \returns Whether the model was uploaded successfully.
+		*/
+	 bool Upload (void);
+	 /** Mesh categories.
+		* Categories of meshes a geometry pass can select.
+		*/
+	 class Meshes
+	 {
+		 public:
+		 static constexpr GLuint Opaque = 0x1;
+		 static constexpr GLuint Transparent = 0x2;
+		 static constexpr GLuint Patches = 0x4;
+	 };
+	 bool IsVisible (Culling &culling, bool occlusion,
+									 float displacement) const;
+	 void GetMeshes (GLuint categories, bool shadowcasters,
+									 std::vector<const Mesh*> &list) const;
+	 void RasterizeOccluders (Occlusion &occlusion,
+														const glm::mat4 &mvmat) const;
 	 static GLuint culled;
 private:
+	 /** Mesh source.
+		* Description of a mesh as given in the model file.
+		*/
+	 struct Source
+	 {
+			std::string filename;
+			std::string material;
+			bool shadows;
+			bool occluder;
+	 };
+	 /** Read meshes.
+		* Queues reading the meshes listed in sources on the thread pool.
+		*/
+	 void ReadMeshes (void);
+	 std::string filename;
+	 std::vector<Source> sources;
 	 std::vector<Material> materials;
 	 std::vector<Mesh> meshes;
 	 std::vector<Mesh> patches;
 	 std::vector<Mesh> transparent;
+	 /** Meshes that are not yet uploaded.
+		*/
+	 std::vector<Mesh> pending;
 	 friend class Material;
 	 friend class Mesh;
 	 struct
 	 {
 			glm::vec3 min, max;
-			gl::Buffer buffer;
-			gl::Buffer indices;
-			gl::VertexArray array;
 	 } bbox;
 	 struct
 	 {
 			glm::vec3 center;
 			GLfloat radius;
 	 } bsphere;
-	 std::map<GLuint, gl::Query> queries;
-#ifdef DEBUG
-	 struct
-	 {
-			std::string filename;
-	 } debug;
-#endif /* DEBUG */
 };
 
 #endif /* !defined MODEL_H */
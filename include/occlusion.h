@@ -0,0 +1,93 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <common.h>
+#include "occlusionbuffer.h"
+
+class Geometry;
+
+/** Occlusion class.
+ * This class handles software occlusion culling. The meshes marked as
+ * occluders are rasterized into a low resolution depth buffer on the
+ * CPU, which is then used to reject hidden objects before any draw
+ * call is issued for them.
+ */
+class Occlusion
+{
+public:
+	 /** Constructor.
+		*/
+	 Occlusion (void);
+	 /** Destructor.
+		*/
+	 ~Occlusion (void);
+	 /** Initialization.
+		* Initializes the occlusion culling class.
+		* \returns Whether the initialization was successful.
+		*/
+	 bool Init (void);
+	 /** Per-frame initialization.
+		* Clears the depth buffer and rasterizes all occluders
+		* of the given geometry from the perspective of the camera.
+		* \param geometry Geometry containing the occluders.
+		*/
+	 void Frame (Geometry &geometry);
+	 /** Rasterize occluder.
+		* Rasterizes a triangle mesh into the depth buffer.
+		* \param mvmat Model view matrix of the mesh.
+		* \param vertices Vertex positions of the mesh.
+		* \param indices Triangle indices of the mesh.
+		* \param trianglecount Number of triangles in the mesh.
+		*/
+	 void Rasterize (const glm::mat4 &mvmat, const glm::vec3 *vertices,
+									 const GLuint *indices, GLuint trianglecount);
+	 /** Occlusion query.
+		* Checks whether an axis aligned bounding box is hidden
+		* behind the rasterized occluders.
+		* \param mvpmat Model view projection matrix of the box.
+		* \param min Minimum corner of the bounding box.
+		* \param max Maximum corner of the bounding box.
+		* \returns Whether the box is known to be occluded.
+		*/
+	 bool IsOccluded (const glm::mat4 &mvpmat, const glm::vec3 &min,
+										const glm::vec3 &max) const;
+	 /** Check whether software occlusion culling is enabled.
+		* \returns Whether software occlusion culling is enabled.
+		*/
+	 bool GetEnabled (void) const;
+	 /** Enable or disable software occlusion culling.
+		* \param e Whether to enable software occlusion culling.
+		*/
+	 void SetEnabled (bool e);
+private:
+	 /** Occlusion buffer.
+		* Depth buffer the occluders are rasterized into.
+		*/
+	 OcclusionBuffer buffer;
+	 /** Validity flag.
+		* Whether the depth buffer is valid for the current frame.
+		*/
+	 bool valid;
+	 /** Enable flag.
+		* Whether software occlusion culling is enabled.
+		*/
+	 bool enabled;
+};
+
+#endif /* !defined OCCLUSION_H */
@@ -0,0 +1,112 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef OCCLUSIONBUFFER_H
+#define OCCLUSIONBUFFER_H
+
+#include <common.h>
+
+/** Occlusion buffer class.
+ * A low resolution depth buffer that triangles are rasterized into on
+ * the CPU, four pixels at a time using SSE, if available. The maximum
+ * depth of every tile is kept as a second level, so that the screen
+ * space bounding box of an object can be rejected quickly. The class
+ * does not depend on the renderer, so that it can be benchmarked on
+ * its own.
+ */
+class OcclusionBuffer
+{
+public:
+	 /** Constructor.
+		*/
+	 OcclusionBuffer (void);
+	 /** Destructor.
+		*/
+	 ~OcclusionBuffer (void);
+	 /** Initialization.
+		* Allocates the depth buffer. The dimensions are rounded up to
+		* a multiple of the tile size.
+		* \param w Width of the depth buffer.
+		* \param h Height of the depth buffer.
+		* \returns Whether the initialization was successful.
+		*/
+	 bool Init (GLuint w, GLuint h);
+	 /** Clear.
+		* Clears the depth buffer and sets the projection matrix used
+		* to rasterize the occluders.
+		* \param projmat Projection matrix.
+		*/
+	 void Clear (const glm::mat4 &projmat);
+	 /** Rasterize occluder.
+		* Rasterizes a triangle mesh into the depth buffer.
+		* \param mvmat Model view matrix of the mesh.
+		* \param vertices Vertex positions of the mesh.
+		* \param indices Triangle indices of the mesh.
+		* \param trianglecount Number of triangles in the mesh.
+		*/
+	 void Rasterize (const glm::mat4 &mvmat, const glm::vec3 *vertices,
+									 const GLuint *indices, GLuint trianglecount);
+	 /** Finish rasterization.
+		* Updates the maximum depth of all tiles. Has to be called after
+		* all occluders are rasterized and before the buffer is queried.
+		*/
+	 void Finish (void);
+	 /** Occlusion query.
+		* Checks whether an axis aligned bounding box is hidden
+		* behind the rasterized occluders.
+		* \param mvpmat Model view projection matrix of the box.
+		* \param min Minimum corner of the bounding box.
+		* \param max Maximum corner of the bounding box.
+		* \returns Whether the box is known to be occluded.
+		*/
+	 bool IsOccluded (const glm::mat4 &mvpmat, const glm::vec3 &min,
+										const glm::vec3 &max) const;
+private:
+	 /** Rasterize a triangle.
+		* Rasterizes a single triangle given in window coordinates.
+		* \param v0 First vertex.
+		* \param v1 Second vertex.
+		* \param v2 Third vertex.
+		*/
+	 void RasterizeTriangle (const glm::vec3 &v0, const glm::vec3 &v1,
+													 const glm::vec3 &v2);
+	 /** Tile size.
+		* Width and height of a tile of the hierarchical depth buffer.
+		*/
+	 static constexpr GLuint TileSize = 8;
+	 /** Dimensions.
+		* Width and height of the depth buffer.
+		*/
+	 GLuint width, height;
+	 /** Number of tiles.
+		* Number of tiles in horizontal and vertical direction.
+		*/
+	 GLuint tilesx, tilesy;
+	 /** Projection matrix.
+		* Projection matrix used to rasterize the occluders.
+		*/
+	 glm::mat4 projmat;
+	 /** Depth buffer.
+		* Window space depth of the nearest occluder for each pixel.
+		*/
+	 std::vector<GLfloat> depth;
+	 /** Tile depth.
+		* Maximum depth of each tile of the depth buffer.
+		*/
+	 std::vector<GLfloat> tiles;
+};
+
+#endif /* !defined OCCLUSIONBUFFER_H */
@@ -0,0 +1,82 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PERMUTATIONS_H
+#define PERMUTATIONS_H
+
+#include <common.h>
+#include <set>
+
+/** Program permutations class.
+ * A set of variants of a program, each compiled for a combination of
+ * the shader features the program supports. Which variants are needed
+ * is decided at load time, e.g. from the textures of the materials of
+ * the scene, and each draw selects its variant by a feature mask.
+ */
+class Permutations
+{
+public:
+	 /** Constructor.
+		*/
+	 Permutations (void);
+	 /** Destructor.
+		*/
+	 ~Permutations (void);
+	 /** Load variants.
+		* Loads a variant of the program for each feature mask. Features
+		* the program doesn't support are ignored, so that masks only
+		* differing in such features share a variant. The variant without
+		* any features is always loaded.
+		* \param filename Filename of the program binary, which the feature
+		*                 mask of each variant is appended to.
+		* \param supported Shader features the program supports.
+		* \param features Feature masks of the required variants.
+		* \param definitions Preprocessor definitions for each source file.
+		* \param filenames Array of type/source files-pairs used to compile
+		*                  the variants.
+		* \returns Whether all variants were loaded successfully.
+		*/
+	 bool Load (const std::string &filename, GLuint supported,
+							const std::set<GLuint> &features,
+							const std::vector<std::string> &definitions,
+							const std::vector<std::pair<GLenum, std::string>>
+							&filenames);
+	 /** Get variant.
+		* \param features Feature mask.
+		* \returns The variant for the supported features of the mask.
+		*/
+	 const gl::Program &Get (GLuint features) const;
+	 /** Set uniform.
+		* Sets a uniform in all variants.
+		* \param name Name of the uniform.
+		* \param value Value of the uniform.
+		*/
+	 template<typename T>
+	 void Set (const char *name, const T &value) const
+	 {
+		 for (const auto &variant : variants)
+				variant.second[name] = value;
+	 }
+private:
+	 GLuint supported;
+	 /** Variants by feature mask.
+		* A map, so that the programs keep their addresses while
+		* their builds are pending.
+		*/
+	 std::map<GLuint, gl::Program> variants;
+};
+
+#endif /* !defined PERMUTATIONS_H */
@@ -0,0 +1,126 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <common.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+/** Loading profiler class.
+ * Records how long the individual steps of loading the assets take,
+ * like parsing YAML files, reading meshes and textures, uploading data
+ * and compiling shaders. The timings can be written as a report,
+ * aggregated per category and per asset, and as a trace in the Chrome
+ * trace event format, that can be viewed in chrome://tracing.
+ */
+class Profiler
+{
+public:
+	 /** Scoped timer.
+		* Records the time from its construction to its destruction.
+		*/
+	 class Scope
+	 {
+	 public:
+			/** Constructor.
+			 * \param category Category of the step. Has to be a
+			 *                 string literal.
+			 * \param asset Name of the asset the step works on.
+			 */
+			Scope (const char *category, const std::string &asset);
+			Scope (const Scope&) = delete;
+			~Scope (void);
+			Scope &operator= (const Scope&) = delete;
+	 private:
+			const char *category;
+			std::string asset;
+			std::chrono::steady_clock::time_point start;
+	 };
+
+	 Profiler (void);
+	 ~Profiler (void);
+	 /** Initialization.
+		* Enables the profiler according to the configuration.
+		*/
+	 void Init (void);
+	 /** Check whether the profiler is recording.
+		*/
+	 bool IsEnabled (void) const;
+	 /** Record a step.
+		* May be called from any thread.
+		* \param category Category of the step.
+		* \param asset Name of the asset.
+		* \param start Start time of the step.
+		* \param end End time of the step.
+		*/
+	 void Record (const char *category, const std::string &asset,
+								std::chrono::steady_clock::time_point start,
+								std::chrono::steady_clock::time_point end);
+	 /** Finish profiling.
+		* Stops recording, logs the report and writes the trace file,
+		* if one is configured.
+		*/
+	 void Finish (void);
+	 /** Write a report.
+		* Writes the total time per category and the most expensive
+		* assets, both sorted by time.
+		* \param stream Stream to write the report to.
+		*/
+	 void Report (std::ostream &stream);
+	 /** Write a trace.
+		* \param filename Filename of the trace file.
+		* \returns Whether the trace was written successfully.
+		*/
+	 bool WriteTrace (const std::string &filename);
+private:
+	 /** Recorded step.
+		*/
+	 struct Event
+	 {
+			const char *category;
+			std::string asset;
+			/** Start time in microseconds since the profiler was
+			 * initialized. */
+			double start;
+			/** Duration in microseconds. */
+			double duration;
+			std::thread::id thread;
+	 };
+	 std::vector<Event> events;
+	 std::mutex mutex;
+	 std::chrono::steady_clock::time_point origin;
+	 /** Thread that initialized the profiler.
+		*/
+	 std::thread::id mainthread;
+	 std::atomic<bool> enabled;
+	 /** Trace filename.
+		* Empty if no trace is written.
+		*/
+	 std::string tracefile;
+	 /** Number of assets listed in the report.
+		*/
+	 GLuint numassets;
+};
+
+/** Global profiler object.
+ */
+extern Profiler profiler;
+
+#endif /* !defined PROFILER_H */
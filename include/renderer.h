@@ -28,6 +28,12 @@
 #include "light.h"
 #include "parameter.h"
 #include "culling.h"
+#include "hiz.h"
+#include "occlusion.h"
+#include "rendergraph.h"
+#include "threadpool.h"
+#include "texturestreamer.h"
+#include "texturecache.h"
 
 class Renderer
 {
@@ -61,6 +67,9 @@ public:
 #endif
 
 /* TODO: make as much as possible private */
+	 ThreadPool threadpool;
+	 TextureStreamer streamer;
+	 TextureCache textures;
 	 Geometry geometry;
 	 GBuffer gbuffer;
 	 ShadowMap shadowmap;
@@ -68,12 +77,34 @@ public:
 	 WindowGrid windowgrid;
 	 Composition composition;
 	 Culling culling;
+	 HiZ hiz;
+	 Occlusion occlusion;
 	 Camera camera;
 
 	 std::vector<Shadow> shadows;
 
+	 RenderGraph graph;
+
 private:
+	 void SetupRenderGraph (void);
+	 /** Load material parameters.
+		* Reads the material parameters from materials/parameters.yaml.
+		* \returns Whether the parameters were read successfully.
+		*/
+	 bool LoadParameters (void);
+	 /** Save scene snapshot.
+		* Writes the scene and the material parameters to a scene
+		* snapshot, so that the next start doesn't need to parse
+		* the scene description.
+		* \param filename Filename of the snapshot.
+		*/
+	 void SaveSnapshot (const std::string &filename);
+
 	 GLuint antialiasing;
+	 /** Time factor.
+		* The fraction of seconds since the last frame.
+		*/
+	 float timefactor;
 
 	 gl::Program opacityprogram;
 
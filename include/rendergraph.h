@@ -0,0 +1,253 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RENDERGRAPH_H
+#define RENDERGRAPH_H
+
+#include <common.h>
+#include <functional>
+#include <list>
+
+/** Render graph class.
+ * Describes a frame as a set of passes that declare which resources
+ * they read and write. Each frame the graph evaluates these
+ * declarations, culls the passes whose results are never used,
+ * orders the remaining passes by their dependencies and inserts the
+ * memory barriers required between incoherent writes and later reads.
+ *
+ * The order in which passes are added defines which version of a
+ * resource a pass sees: a read refers to the last write declared by
+ * an earlier pass.
+ *
+ * Textures that are only needed within a frame can be registered as
+ * transient resources. They are assigned textures from a pool based on
+ * the interval of passes they are used in, so that transient textures
+ * with disjoint lifetimes share memory.
+ */
+class RenderGraph
+{
+public:
+	 /** Constructor.
+		*/
+	 RenderGraph (void);
+	 /** Destructor.
+		*/
+	 ~RenderGraph (void);
+	 /** Resource access types.
+		* How a pass accesses a resource. Writes through images, atomic
+		* counters and shader storage buffers are incoherent and require
+		* a memory barrier before the result can be used by a later pass.
+		*/
+	 class Access
+	 {
+		 public:
+		 static constexpr GLuint Texture = 0;
+		 static constexpr GLuint RenderTarget = 1;
+		 static constexpr GLuint Image = 2;
+		 static constexpr GLuint AtomicCounter = 3;
+		 static constexpr GLuint PixelPack = 4;
+		 static constexpr GLuint ShaderStorage = 5;
+	 };
+	 /** Pass builder.
+		* Passed to the setup function of a pass to declare its resource
+		* accesses for the current frame.
+		*/
+	 class Builder
+	 {
+	 public:
+			/** Read a resource.
+			 * \param resource Resource to read.
+			 * \param access How the resource is read.
+			 */
+			void Read (GLuint resource, GLuint access = Access::Texture);
+			/** Write a resource.
+			 * \param resource Resource to write.
+			 * \param access How the resource is written.
+			 */
+			void Write (GLuint resource, GLuint access = Access::RenderTarget);
+			/** Side effect.
+			 * Marks the pass as having effects outside of the graph, so
+			 * that it is never culled.
+			 */
+			void SideEffect (void);
+	 private:
+			Builder (RenderGraph &graph, GLuint pass);
+			RenderGraph &graph;
+			GLuint pass;
+			friend class RenderGraph;
+	 };
+	 /** Transient texture description.
+		* Describes the storage of a transient texture.
+		*/
+	 struct TextureDesc
+	 {
+			GLuint width;
+			GLuint height;
+			GLuint levels;
+			GLenum format;
+	 };
+	 /** Get a resource.
+		* Obtains the identifier of a named resource, registering it
+		* if it doesn't exist yet.
+		* \param name Name of the resource.
+		* \returns Identifier of the resource.
+		*/
+	 GLuint GetResource (const std::string &name);
+	 /** Get a transient texture resource.
+		* Obtains the identifier of a named resource and marks it as
+		* transient texture. The contents of a transient texture are
+		* undefined at the beginning of each frame.
+		* \param name Name of the resource.
+		* \param desc Description of the texture storage.
+		* \returns Identifier of the resource.
+		*/
+	 GLuint GetResource (const std::string &name, const TextureDesc &desc);
+	 /** Get a transient texture.
+		* Obtains the texture assigned to a transient resource in the
+		* current frame. Only valid while the graph is executed and only
+		* for resources accessed by one of the executed passes.
+		* \param resource Transient texture resource.
+		* \returns The texture assigned to the resource.
+		*/
+	 gl::Texture &GetTexture (GLuint resource) const;
+	 /** Attach a transient texture.
+		* Attaches the texture assigned to a transient resource to a
+		* framebuffer, unless it is already attached.
+		* \param framebuffer Framebuffer to attach the texture to.
+		* \param attachment Attachment point.
+		* \param resource Transient texture resource.
+		*/
+	 void Attach (gl::Framebuffer &framebuffer, GLenum attachment,
+								GLuint resource);
+	 /** Add a pass.
+		* Adds a pass to the graph.
+		* \param name Name of the pass.
+		* \param setup Function declaring the resource accesses of the pass.
+		*              It is called once per frame and may declare nothing
+		*              if the pass has no work to do in that frame.
+		* \param execute Function executing the pass.
+		*/
+	 void AddPass (const std::string &name,
+								 const std::function<void (Builder&)> &setup,
+								 const std::function<void (void)> &execute);
+	 /** Mark an output.
+		* Marks a resource as result of the frame. Passes that don't
+		* contribute to an output or have side effects are culled.
+		* \param resource Resource that is a result of the frame.
+		*/
+	 void SetOutput (GLuint resource);
+	 /** Execute.
+		* Evaluates the pass declarations for the current frame and
+		* executes the resulting passes.
+		*/
+	 void Execute (void);
+	 /** Check whether a pass was executed.
+		* \param name Name of the pass.
+		* \returns Whether the pass was executed in the last frame.
+		*/
+	 bool IsExecuted (const std::string &name) const;
+private:
+	 /** Resource usage.
+		* A single declared access of a pass to a resource.
+		*/
+	 struct Usage
+	 {
+			GLuint resource;
+			GLuint access;
+	 };
+	 /** Pass.
+		* A pass and its declarations for the current frame.
+		*/
+	 struct Pass
+	 {
+			std::string name;
+			std::function<void (Builder&)> setup;
+			std::function<void (void)> execute;
+			std::vector<Usage> reads;
+			std::vector<Usage> writes;
+			bool sideeffect;
+			/** Passes producing the data this pass reads. */
+			std::vector<GLuint> dependencies;
+			/** Passes that have to run before this pass. */
+			std::vector<GLuint> predecessors;
+			/** Memory barrier bits required before the pass. */
+			GLbitfield barriers;
+			bool used;
+	 };
+	 /** Texture view.
+		* A view of a pooled texture with a different format or
+		* a different range of mipmap levels.
+		*/
+	 struct View
+	 {
+			gl::Texture texture;
+			GLenum format;
+			GLuint level;
+			GLuint levels;
+	 };
+	 /** Pooled texture.
+		* A texture with immutable storage that is assigned to
+		* transient resources.
+		*/
+	 struct PooledTexture
+	 {
+			gl::Texture texture;
+			TextureDesc desc;
+			/** Position in the execution order after which the
+			 * texture is no longer used in the current frame. */
+			GLint busy;
+			std::list<View> views;
+	 };
+	 /** Transient texture resource.
+		*/
+	 struct Transient
+	 {
+			TextureDesc desc;
+			/** Texture assigned in the current frame. */
+			gl::Texture *texture;
+	 };
+	 void Compile (void);
+	 void MarkUsed (GLuint pass);
+	 void AssignTransients (void);
+	 gl::Texture &GetView (PooledTexture &pooled, GLenum format,
+												 GLuint level, GLuint levels);
+	 static bool GetLevel (const PooledTexture &pooled,
+												 const TextureDesc &desc, GLuint &level);
+	 static GLuint GetViewClass (GLenum format);
+	 static GLuint GetTexelSize (GLenum format);
+	 static unsigned long GetSize (const TextureDesc &desc);
+	 static GLbitfield GetBarrierBits (GLuint access);
+	 static bool IsIncoherent (GLuint access);
+	 std::vector<Pass> passes;
+	 std::vector<std::string> resources;
+	 std::map<GLuint, Transient> transients;
+	 /** Texture pool.
+		* A list is used, so that the textures don't move in memory.
+		*/
+	 std::list<PooledTexture> pool;
+	 /** Attached textures.
+		* Transient textures currently attached to framebuffers.
+		*/
+	 std::map<std::pair<const gl::Framebuffer*, GLenum>,
+						const gl::Texture*> attachments;
+	 std::vector<GLuint> outputs;
+	 /** Execution order.
+		* Indices of the passes to execute in the current frame.
+		*/
+	 std::vector<GLuint> order;
+};
+
+#endif /* !defined RENDERGRAPH_H */
@@ -0,0 +1,140 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <common.h>
+#include "model/arena.h"
+#include "model/material.h"
+
+/** Render queue class.
+ * Collects the draws of one or more passes that render to the same
+ * target, sorts them by program, vertex layout, face culling state,
+ * material and front-to-back depth and submits them with as few state
+ * changes and indirect draw calls as possible.
+ */
+class RenderQueue
+{
+public:
+	 /** Constructor.
+		*/
+	 RenderQueue (void);
+	 /** Destructor.
+		*/
+	 ~RenderQueue (void);
+	 /** Initialization.
+		* Initializes the render queue.
+		* \returns Whether the initialization was successful.
+		*/
+	 bool Init (void);
+	 /** Per-instance data.
+		* Data passed to the shaders for each instance of a model,
+		* stored as seven RGBA32F texels in a buffer texture.
+		*/
+	 struct Instance
+	 {
+			glm::mat4 mvmat;
+			glm::vec4 normalmat[3];
+	 };
+	 /** Vertex layouts.
+		* Vertex layouts of the geometry arena a draw can source from.
+		*/
+	 class Layout
+	 {
+		 public:
+		 static constexpr GLuint Triangles = 0;
+		 static constexpr GLuint DepthOnly = 1;
+		 static constexpr GLuint TrianglePatches = 2;
+		 static constexpr GLuint QuadPatches = 3;
+	 };
+	 /** Clear.
+		* Removes all queued draws and instances.
+		*/
+	 void Clear (void);
+	 /** Add instances.
+		* Appends per-instance data to the queue.
+		* \param list Instances to append.
+		* \returns Offset of the first appended instance.
+		*/
+	 GLint AddInstances (const std::vector<Instance> &list);
+	 /** Add a draw.
+		* Queues a draw.
+		* \param program Shader program to draw with.
+		* \param layout Vertex layout of the draw.
+		* \param material Material to use, NULL if none is needed.
+		* \param doublesided Whether face culling has to be disabled.
+		* \param depth View space depth of the nearest instance.
+		* \param command Indirect draw command.
+		* \param instanceoffset Offset of the first instance of the draw.
+		* \param patchoffset Index of the first patch of the draw in the
+		*                    per-patch data of the geometry arena.
+		*/
+	 void Add (const gl::Program &program, GLuint layout,
+						 const Material *material, bool doublesided,
+						 GLfloat depth, const DrawElementsIndirectCommand &command,
+						 GLint instanceoffset, GLint patchoffset = 0);
+	 /** Submit.
+		* Sorts all queued draws and submits them.
+		* \param arena Geometry arena the draws source from.
+		*/
+	 void Submit (const Arena &arena);
+private:
+	 /** Queue item.
+		* A single queued draw.
+		*/
+	 struct Item
+	 {
+			uint64_t key;
+			const gl::Program *program;
+			const Material *material;
+			GLuint layout;
+			bool doublesided;
+			DrawElementsIndirectCommand command;
+			GLint instanceoffset;
+			GLint patchoffset;
+	 };
+	 /** Queued draws.
+		*/
+	 std::vector<Item> items;
+	 /** Queued instances.
+		*/
+	 std::vector<Instance> instances;
+	 /** Programs.
+		* Programs of the queued draws, the position in this list is
+		* used as program index in the sort key.
+		*/
+	 std::vector<const gl::Program*> programs;
+	 /** Materials.
+		* Materials of the queued draws and their index in the sort key.
+		*/
+	 std::map<const Material*, GLuint> materials;
+	 /** Instance buffer.
+		* Buffer and buffer texture for the per-instance data.
+		*/
+	 gl::Buffer instancebuffer;
+	 gl::Texture instancetex;
+	 /** Indirect draws.
+		* Draw commands and, for each command, the offset of its first
+		* instance and its first patch, which the shaders fetch using
+		* gl_DrawIDARB.
+		*/
+	 gl::Buffer indirectbuffer;
+	 gl::Buffer drawbuffer;
+	 gl::Texture drawtex;
+};
+
+#endif /* !defined RENDERQUEUE_H */
@@ -0,0 +1,201 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SCENESNAPSHOT_H
+#define SCENESNAPSHOT_H
+
+#include <common.h>
+#include "parameter.h"
+#include "filesystem.h"
+
+/** Scene snapshot class.
+ * A compiled binary form of the scene description. It contains the
+ * flattened node hierarchy, the model, mesh and material tables and the
+ * parameter table, so that startup doesn't need to parse the YAML files
+ * of the scene. The file is mapped into memory and the tables are used
+ * in place. It stores a content hash of all YAML files it was compiled
+ * from and is only used while it matches them.
+ */
+class SceneSnapshot
+{
+public:
+	 /** Table.
+		* Location of a table in the snapshot file.
+		*/
+	 struct Table
+	 {
+			uint32_t offset;
+			uint32_t count;
+	 };
+	 /** File header.
+		*/
+	 struct Header
+	 {
+			char magic[8];
+			uint32_t version;
+			uint32_t reserved;
+			uint64_t hash[3];
+			float boxmin[3];
+			float boxmax[3];
+			/** Input files, string offsets of paths relative
+			 * to the base directory. */
+			Table inputs;
+			/** String data. */
+			Table strings;
+			/** Nodes in depth first order. */
+			Table nodes;
+			/** Model indices referenced by the nodes. */
+			Table nodemodels;
+			Table models;
+			Table meshes;
+			Table materials;
+			Table parameters;
+			/** String offsets of the parameter names. */
+			Table parameternames;
+	 };
+	 /** Node.
+		* The children of a node directly follow it.
+		*/
+	 struct Node
+	 {
+			uint32_t numchildren;
+			uint32_t firstmodel;
+			uint32_t nummodels;
+			float translation[3];
+			/** Orientation quaternion as w, x, y, z. */
+			float orientation[4];
+	 };
+	 struct Model
+	 {
+			/** Filename of the model description. */
+			uint32_t filename;
+			uint32_t firstmesh;
+			uint32_t nummeshes;
+	 };
+	 struct Mesh
+	 {
+			uint32_t filename;
+			/** Name of the material. */
+			uint32_t material;
+			uint32_t flags;
+	 };
+	 struct Material
+	 {
+			uint32_t name;
+			uint32_t flags;
+			/** Texture filenames, None for unused slots. */
+			uint32_t textures[6];
+	 };
+	 /** Flags.
+		*/
+	 class Flags
+	 {
+		 public:
+		 static constexpr uint32_t Shadows = 0x1;
+		 static constexpr uint32_t Occluder = 0x2;
+		 static constexpr uint32_t Transparent = 0x1;
+		 static constexpr uint32_t DoubleSided = 0x2;
+	 };
+	 /** Invalid string offset.
+		*/
+	 static constexpr uint32_t None = 0xFFFFFFFF;
+
+	 /** Snapshot writer.
+		* Collects the tables of a snapshot and writes the file.
+		*/
+	 class Writer
+	 {
+	 public:
+			Writer (void);
+			~Writer (void);
+			/** Add a string.
+			 * \param str String to add.
+			 * \returns Offset of the string in the string table.
+			 */
+			uint32_t AddString (const std::string &str);
+			/** Add an input file.
+			 * \param path Path of a YAML file relative to the base directory.
+			 */
+			void AddInput (const std::string &path);
+			/** Save the snapshot.
+			 * Hashes the input files and writes the snapshot.
+			 * \param filename Filename of the snapshot.
+			 * \returns Whether the snapshot was written successfully.
+			 */
+			bool Save (const std::string &filename) const;
+			glm::vec3 boxmin;
+			glm::vec3 boxmax;
+			std::vector<Node> nodes;
+			std::vector<uint32_t> nodemodels;
+			std::vector<Model> models;
+			std::vector<Mesh> meshes;
+			std::vector<Material> materials;
+			std::vector<Parameter> parameters;
+			std::vector<uint32_t> parameternames;
+	 private:
+			std::vector<uint32_t> inputs;
+			std::string strings;
+			std::map<std::string, uint32_t> offsets;
+	 };
+
+	 /** Constructor.
+		*/
+	 SceneSnapshot (void);
+	 /** Destructor.
+		*/
+	 ~SceneSnapshot (void);
+	 /** Load a snapshot.
+		* Maps a snapshot into memory and checks whether it is up to date.
+		* \param filename Filename of the snapshot.
+		* \returns Whether the snapshot exists and matches its input files.
+		*/
+	 bool Load (const std::string &filename);
+	 /** Close the snapshot.
+		*/
+	 void Close (void);
+	 const Header &GetHeader (void) const;
+	 const char *GetString (uint32_t offset) const;
+	 const Node *GetNodes (void) const;
+	 const uint32_t *GetNodeModels (void) const;
+	 const Model *GetModels (void) const;
+	 const Mesh *GetMeshes (void) const;
+	 const Material *GetMaterials (void) const;
+	 const Parameter *GetParameters (void) const;
+	 const uint32_t *GetParameterNames (void) const;
+private:
+	 /** Hash the input files.
+		* \param inputs Paths of the input files relative to the base
+		*               directory.
+		* \param hash Returns the hash.
+		* \returns Whether all input files could be read.
+		*/
+	 static bool ComputeHash (const std::vector<std::string> &inputs,
+														uint64_t hash[3]);
+	 /** Check a table.
+		* \returns Whether the table lies within the file.
+		*/
+	 bool CheckTable (const Table &table, size_t size) const;
+	 template<typename T>
+	 const T *GetTable (const Table &table) const
+	 {
+		 return reinterpret_cast<const T*> (data + table.offset);
+	 }
+	 FileSystem::File file;
+	 const char *data;
+	 size_t length;
+};
+
+#endif /* !defined SCENESNAPSHOT_H */
@@ -0,0 +1,201 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SHADERCACHE_H
+#define SHADERCACHE_H
+
+#include <common.h>
+#include <memory>
+#include <set>
+
+/** Shader cache class.
+ * Keeps a manifest of the source files each program binary was built
+ * from, with their sizes and modification times, and the hash of the
+ * program. If none of the sources changed, the program binary can be
+ * checked without reading and hashing the sources again. Programs that
+ * have to be built are compiled and linked without waiting for the
+ * results, so that the driver can build them in parallel, using
+ * GL_KHR_parallel_shader_compile if available. The results are checked
+ * and the binaries saved by Finish. Shader sources may include other
+ * files, which are parsed and hashed only once for all programs built
+ * before the next call to Finish.
+ */
+class ShaderCache
+{
+public:
+	 /** Shader of a submitted program.
+		* The name is used in error messages.
+		*/
+	 typedef std::pair<std::string, std::unique_ptr<gl::Shader>> Shader;
+
+	 ShaderCache (void);
+	 ~ShaderCache (void);
+	 /** Initialization.
+		* Reads the manifest and enables parallel shader compilation.
+		*/
+	 void Init (void);
+	 /** Resolve shader sources.
+		* Reads the source files of a shader stage and expands their include
+		* directives. An include directive is a line of the form
+		* #include "path", with a path relative to the shader directory
+		* using forward slashes. Directives inside inactive conditional
+		* blocks are expanded as well. Each file is included at most once
+		* per stage.
+		* \param filenames Filenames of the source files of the stage.
+		* \param sources The resolved source of each file is appended.
+		* \param includes The filenames of all included files that are not
+		*                 contained yet are appended.
+		* \param hash Consumes the content hash of every file in the order
+		*             the files are resolved.
+		* \returns Whether all files were read successfully.
+		*/
+	 bool Resolve (const std::vector<std::string> &filenames,
+								 std::vector<std::string> &sources,
+								 std::vector<std::string> &includes, Hash &hash);
+	 /** Look up a program.
+		* \param filename Filename of the program binary.
+		* \param definitions Hash of the preprocessor definitions.
+		* \param sources Filenames of the source files.
+		* \param hash Returns the hash of the program.
+		* \returns Whether the program is in the manifest and none of its
+		*          sources and included files changed.
+		*/
+	 bool Lookup (const std::string &filename, const uint64_t *definitions,
+								const std::vector<std::string> &sources, uint64_t *hash);
+	 /** Update a program.
+		* Records the sources and the hash of a program in the manifest.
+		* \param filename Filename of the program binary.
+		* \param definitions Hash of the preprocessor definitions.
+		* \param sources Filenames of the source files.
+		* \param includes Filenames of the files included by the sources.
+		* \param hash Hash of the program.
+		*/
+	 void Update (const std::string &filename, const uint64_t *definitions,
+								const std::vector<std::string> &sources,
+								const std::vector<std::string> &includes,
+								const uint64_t *hash);
+	 /** Submit a program.
+		* Registers a program whose shaders were compiled and which was
+		* linked, without checking the results yet.
+		* \param program Program object. It has to stay valid until
+		*                Finish is called.
+		* \param filename Filename of the program binary.
+		* \param hash Hash of the program.
+		* \param shaders Shaders attached to the program.
+		*/
+	 void Submit (gl::Program &program, const std::string &filename,
+								const uint64_t *hash, std::vector<Shader> &&shaders);
+	 /** Finish all submitted programs.
+		* Waits for the driver to build the submitted programs, logs any
+		* errors, saves the program binaries and writes the manifest.
+		* \returns Whether all programs were built successfully.
+		*/
+	 bool Finish (void);
+private:
+	 /** Source file.
+		*/
+	 struct Source
+	 {
+			std::string filename;
+			uint64_t size;
+			int64_t mtime;
+	 };
+	 /** Manifest entry.
+		*/
+	 struct Entry
+	 {
+			uint64_t definitions[3];
+			uint64_t hash[3];
+			std::vector<Source> sources;
+			std::vector<Source> includes;
+	 };
+	 /** Parsed source file.
+		*/
+	 struct File
+	 {
+			/** Text between the include directives.
+			 * Contains one more element than includes. */
+			std::vector<std::string> parts;
+			/** Filenames of the included files in order. */
+			std::vector<std::string> includes;
+			/** Content hash. */
+			uint64_t hash[3];
+	 };
+	 /** Submitted program.
+		*/
+	 struct Pending
+	 {
+			gl::Program *program;
+			std::string filename;
+			uint64_t hash[3];
+			std::vector<Shader> shaders;
+	 };
+	 /** Parse a source file.
+		* \param filename Filename of the source file.
+		* \returns The parsed file, NULL if it could not be read.
+		*/
+	 const File *Parse (const std::string &filename);
+	 /** Expand a source file.
+		* Appends the source of a file with all includes expanded, unless
+		* the file was already included.
+		* \param filename Filename of the source file.
+		* \param source String to append the source to.
+		* \param included Files already included in the current stage.
+		* \param includes Filenames of included files, see Resolve.
+		* \param hash Consumes the content hashes, see Resolve.
+		* \returns Whether all files were read successfully.
+		*/
+	 bool Expand (const std::string &filename, std::string &source,
+								std::set<std::string> &included,
+								std::vector<std::string> &includes, Hash &hash);
+	 /** Get file status.
+		* Queries the size and modification time of a file, remembering
+		* the result until Finish is called.
+		* \param filename Filename of the file.
+		* \param source Returns the status of the file.
+		*/
+	 void Stat (const std::string &filename, Source &source);
+	 /** Check a recorded file status.
+		* \param source Recorded file status.
+		* \returns Whether the file didn't change.
+		*/
+	 bool Check (const Source &source);
+	 /** Read the manifest.
+		* \returns Whether the manifest was read successfully.
+		*/
+	 bool ReadManifest (void);
+	 /** Write the manifest.
+		*/
+	 void WriteManifest (void);
+	 std::map<std::string, Entry> manifest;
+	 /** Whether the manifest changed since it was read.
+		*/
+	 bool dirty;
+	 std::vector<Pending> pending;
+	 /** Parsed source files.
+		*/
+	 std::map<std::string, File> files;
+	 /** Status of the files queried since the last call to Finish.
+		*/
+	 std::map<std::string, Source> stats;
+	 std::string manifestfile;
+};
+
+/** Global shader cache object.
+ */
+extern ShaderCache shadercache;
+
+#endif /* !defined SHADERCACHE_H */
@@ -21,6 +21,7 @@
 #include "model/model.h"
 #include "geometry.h"
 #include "shadow.h"
+#include "culling.h"
 
 /** Shadow map class.
  * This class handles the creation of shadow maps.
@@ -63,9 +64,10 @@ private:
 		*/
 	 gl::Texture shadowmap;
 	 /** Temporary storage.
-		* A texture used as temporary storage for blurring the shadow map.
+		* Transient texture resource used as temporary storage for
+		* blurring the shadow map.
 		*/
-	 gl::Texture tmpstore;
+	 GLuint tmpstore;
 	 /** View matrix.
 		* The view matrix to render the scene from the perspective
 		* of the shadow caster.
@@ -76,8 +78,11 @@ private:
 		* of the shadow caster. Stored in a smart uniform wrapper.
 		*/
 	 gl::SmartUniform<glm::mat4> projmat;
-	 gl::SmartUniform<glm::mat4> quadtessprojmat;
-	 gl::SmartUniform<glm::mat4> triangletessprojmat;
+	 /** Culling context.
+		* Culls the shadow casters against the light frustum and
+		* against the view frustum of the camera.
+		*/
+	 Culling culling;
 	 /** Shadow map width.
 		*/
 	 GLuint width;
@@ -87,9 +92,9 @@ private:
 	 /** OpenGL shader.
 		* OpenGL shader program used to fill the shadow map.
 		*/
-	 gl::Program program;
-	 gl::Program quadtessprog;
-	 gl::Program triangletessprog;
+	 Permutations program;
+	 Permutations quadtessprog;
+	 Permutations triangletessprog;
 	 gl::Program vblurprog;
 	 gl::Program hblurprog;
 	 gl::Sampler sampler;
@@ -0,0 +1,77 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <common.h>
+#include <memory>
+#include <mutex>
+
+/** Texture cache class.
+ * Shares textures between all materials referencing the same file.
+ * The cache only holds weak references, so a texture is released once
+ * the last handle to it is gone.
+ */
+class TextureCache
+{
+public:
+	 /** Shared texture.
+		*/
+	 struct Texture
+	 {
+			/** OpenGL texture.
+			 * Created by the texture streamer on the thread owning the
+			 * OpenGL context when the first level arrives, so that handles
+			 * can be obtained on any thread. NULL until then. */
+			std::unique_ptr<gl::Texture> texture;
+			/** Whether the first level of the texture is resident.
+			 * Only written on the thread owning the OpenGL context. */
+			bool resident;
+	 };
+	 /** Texture handle.
+		*/
+	 typedef std::shared_ptr<Texture> Handle;
+	 /** Constructor.
+		*/
+	 TextureCache (void);
+	 /** Destructor.
+		*/
+	 ~TextureCache (void);
+	 /** Get a texture.
+		* Obtains a texture by filename. A texture that isn't cached yet is
+		* requested from the texture streamer. May be called from any thread.
+		* \param filename Filename of the KTX file.
+		* \returns A handle to the texture.
+		*/
+	 Handle Get (const std::string &filename);
+	 /** Get number of textures.
+		* \returns The number of textures currently alive.
+		*/
+	 GLuint GetNumTextures (void);
+private:
+	 /** Normalize a path.
+		* Removes redundant separators and "." and ".." components,
+		* so that different paths to the same file yield the same key.
+		* \param path Path to normalize.
+		* \returns The normalized path.
+		*/
+	 static std::string NormalizePath (const std::string &path);
+	 std::map<std::string, std::weak_ptr<Texture>> textures;
+	 std::mutex mutex;
+};
+
+#endif /* !defined TEXTURECACHE_H */
@@ -0,0 +1,222 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <common.h>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/** Texture streamer class.
+ * Loads KTX textures in the background, including precomputed mipmap
+ * chains, array textures and cube maps. Streaming threads read the
+ * mipmap levels of requested textures, starting with the smallest
+ * level, directly into a persistently mapped pixel unpack buffer that
+ * is used as ring buffer. Once per frame the uploads that are ready
+ * are issued up to a configurable budget, and the ring buffer space
+ * of uploads the GPU has finished is reclaimed using fences. Textures
+ * become usable as soon as their smallest level is resident and get
+ * sharper as more levels arrive.
+ */
+class TextureStreamer
+{
+public:
+	 /** Constructor.
+		*/
+	 TextureStreamer (void);
+	 /** Destructor.
+		* Stops the streaming threads.
+		*/
+	 ~TextureStreamer (void);
+	 /** Initialization.
+		* Creates the ring buffer and starts the streaming threads.
+		* \returns Whether the initialization was successful.
+		*/
+	 bool Init (void);
+	 /** Request a texture.
+		* Queues a texture for streaming. May be called from any thread.
+		* \param texture Returns the texture the data is loaded into. The
+		*                texture is created on the thread calling Update
+		*                when the first level arrives. The pointer has to
+		*                stay valid until the texture is completely loaded.
+		* \param filename Filename of the KTX file.
+		* \param resident Flag to set, once the first level of the texture
+		*                 is resident. Only written on the thread calling
+		*                 Update.
+		* \param owner Optional object owning the texture. It is kept alive
+		*              until the texture is completely loaded and released
+		*              on the thread calling Update.
+		*/
+	 void Request (std::unique_ptr<gl::Texture> &texture,
+								 const std::string &filename,
+								 bool &resident, const std::shared_ptr<void> &owner
+								 = std::shared_ptr<void> ());
+	 /** Per-frame update.
+		* Issues the uploads of data that is ready, up to the per frame
+		* budget, and reclaims ring buffer space of finished uploads.
+		* Has to be called on the thread owning the OpenGL context.
+		*/
+	 void Update (void);
+	 /** Check whether streaming is finished.
+		* \returns Whether all requested textures are completely loaded.
+		*/
+	 bool IsIdle (void);
+private:
+	 /** Requested texture.
+		*/
+	 struct Texture
+	 {
+			std::unique_ptr<gl::Texture> *texture;
+			std::string filename;
+			bool *resident;
+			std::shared_ptr<void> owner;
+			/** Texture target.
+			 * GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP or
+			 * GL_TEXTURE_CUBE_MAP_ARRAY. */
+			GLenum target;
+			GLenum internalformat;
+			GLenum format;
+			GLenum type;
+			GLsizei width;
+			GLsizei height;
+			/** Number of layers of array textures,
+			 * counting each face of cube map arrays. */
+			GLsizei depth;
+			GLuint levels;
+			/** Whether the storage of the texture is allocated. */
+			bool allocated;
+			/** Whether the mipmaps are generated after level 0 arrived,
+			 * because the file doesn't contain them. */
+			bool generatemipmap;
+	 };
+	 /** Pending upload.
+		* A single mipmap level in the ring buffer, including
+		* all layers and faces.
+		*/
+	 struct Upload
+	 {
+			std::shared_ptr<Texture> texture;
+			GLuint level;
+			GLsizei width;
+			GLsizei height;
+			GLuint size;
+			/** Offset of the data in the ring buffer. */
+			GLuint offset;
+			/** Ring buffer position after the data. */
+			GLuint end;
+			/** Whether the data has been written. */
+			bool ready;
+			/** Data of levels that are larger than the ring buffer. */
+			std::vector<char> overflow;
+	 };
+	 /** Upload fence.
+		* Fence after a batch of uploads and the ring buffer
+		* position up to which it frees space.
+		*/
+	 struct Fence
+	 {
+			GLsync sync;
+			GLuint end;
+	 };
+	 /** Streaming thread.
+		* Main loop of the streaming threads.
+		*/
+	 void Stream (void);
+	 /** Load a texture.
+		* Reads a KTX file and passes its levels to the ring buffer,
+		* starting with the smallest level.
+		* \param texture Requested texture.
+		* \returns Whether the texture was loaded successfully.
+		*/
+	 bool Load (const std::shared_ptr<Texture> &texture);
+	 /** Allocate an upload.
+		* Reserves ring buffer space for a mipmap level, blocking until
+		* enough space is available.
+		* \param texture Texture the level belongs to.
+		* \param level Mipmap level.
+		* \param size Size of the level data in bytes.
+		* \returns The upload, NULL if streaming was stopped.
+		*/
+	 Upload *Allocate (const std::shared_ptr<Texture> &texture,
+										 GLuint level, GLuint size);
+	 /** Get pointer to upload data.
+		* \param upload Upload as returned by Allocate.
+		* \returns Memory the level data has to be written to.
+		*/
+	 char *GetData (Upload *upload);
+	 /** Issue an upload.
+		* Copies the data of a mipmap level into the texture.
+		* \param upload Upload to issue.
+		* \param data Pointer to the data in client memory or offset into
+		*             the bound pixel unpack buffer.
+		*/
+	 void Issue (const Upload &upload, const GLvoid *data);
+	 /** Finish an upload.
+		* Marks an upload as written.
+		* \param upload Upload as returned by Allocate.
+		*/
+	 void Finish (Upload *upload);
+	 /** Ring buffer.
+		* Persistently mapped pixel unpack buffer.
+		*/
+	 gl::Buffer ring;
+	 char *ringptr;
+	 GLuint ringsize;
+	 /** Ring buffer head.
+		* Position of the next allocation.
+		*/
+	 GLuint head;
+	 /** Ring buffer tail.
+		* Start of the space still used by pending uploads.
+		*/
+	 GLuint tail;
+	 /** Per frame upload budget in bytes.
+		*/
+	 GLuint budget;
+	 std::deque<std::shared_ptr<Texture>> requests;
+	 /** Uploads in ring buffer order.
+		* A deque, so that references stay valid while elements
+		* are added at the end.
+		*/
+	 std::deque<Upload> uploads;
+	 std::deque<Fence> fences;
+	 /** Textures that failed to load.
+		* Logged and released by Update, so that their
+		* owners are released on the OpenGL thread.
+		*/
+	 std::vector<std::shared_ptr<Texture>> failed;
+	 /** Number of textures in the process of being read.
+		*/
+	 GLuint loading;
+	 std::vector<std::thread> threads;
+	 std::mutex mutex;
+	 /** Request condition.
+		* Signaled when a texture is requested or streaming is stopped.
+		*/
+	 std::condition_variable requested;
+	 /** Space condition.
+		* Signaled when ring buffer space is reclaimed or streaming
+		* is stopped.
+		*/
+	 std::condition_variable reclaimed;
+	 bool stop;
+};
+
+#endif /* !defined TEXTURESTREAMER_H */
@@ -0,0 +1,97 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <common.h>
+#include <functional>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+/** Thread pool class.
+ * A set of worker threads executing tasks that don't need access to
+ * the OpenGL context, like reading and decoding files. Tasks may add
+ * further tasks to the pool. Exceptions thrown by a task are passed on
+ * to the thread waiting for the pool.
+ */
+class ThreadPool
+{
+public:
+	 /** Constructor.
+		*/
+	 ThreadPool (void);
+	 /** Destructor.
+		* Finishes all pending tasks and joins the worker threads.
+		*/
+	 ~ThreadPool (void);
+	 /** Initialization.
+		* Starts the worker threads.
+		* \param numthreads Number of worker threads. If zero, one less than
+		*                   the number of hardware threads is used, as the
+		*                   thread waiting for the pool executes tasks as well.
+		*/
+	 void Init (GLuint numthreads = 0);
+	 /** Get number of threads.
+		* \returns The number of worker threads.
+		*/
+	 GLuint GetNumThreads (void) const;
+	 /** Run a task.
+		* Queues a task for execution on one of the worker threads.
+		* \param task Task to execute.
+		*/
+	 void Run (const std::function<void (void)> &task);
+	 /** Wait for all tasks.
+		* Executes queued tasks on the calling thread until all tasks,
+		* including those added while waiting, are finished. If a task
+		* threw an exception, the first such exception is rethrown.
+		*/
+	 void Wait (void);
+private:
+	 /** Worker thread.
+		* Main loop of the worker threads.
+		*/
+	 void Work (void);
+	 /** Execute a task.
+		* Executes a task taken from the queue and records any exception.
+		* Expects the mutex to be locked and unlocks it while the task runs.
+		* \param lock Lock on the mutex.
+		*/
+	 void Execute (std::unique_lock<std::mutex> &lock);
+	 std::vector<std::thread> threads;
+	 std::deque<std::function<void (void)>> tasks;
+	 std::mutex mutex;
+	 /** Task condition.
+		* Signaled when a task is queued or the pool is stopped.
+		*/
+	 std::condition_variable available;
+	 /** Completion condition.
+		* Signaled when the last running task finishes.
+		*/
+	 std::condition_variable finished;
+	 /** Number of tasks currently running.
+		*/
+	 GLuint active;
+	 bool stop;
+	 /** First exception thrown by a task since the last wait.
+		*/
+	 std::exception_ptr error;
+};
+
+#endif /* !defined THREADPOOL_H */
@@ -1,9 +1,9 @@
 #ifndef TIGER_H
 #define TIGER_H
 
-#include <stdint.h>
+#include "hash.h"
 
-class Tiger2
+class Tiger2 : public Hash
 {
 public:
 	 Tiger2 (void);
@@ -17,6 +17,8 @@
 #include "pchm.h"
 #include "mesh.h"
 #include <stdexcept>
+#include <algorithm>
+#include <cmath>
 
 namespace pchm {
 
@@ -33,6 +35,62 @@ void AddToList (const vertex_t &v, std::vector<vertex_t> &data,
 	indices.push_back (data.size () - 1);
 }
 
+/* Maximum distance of the control points of a patch from the plane
+ * through its corners, relative to the size of the patch. */
+float HullDeviation (const std::vector<glm::vec3> &positions,
+										 const unsigned int *indices, unsigned int count,
+										 const glm::vec3 &center, glm::vec3 normal, float size)
+{
+	if (size <= 0.0f || glm::length (normal) <= 0.0f)
+		 return 0.0f;
+	normal = glm::normalize (normal);
+
+	float deviation = 0.0f;
+	for (auto i = 0; i < count; i++)
+	{
+		float d = fabsf (glm::dot (positions[indices[i]] - center, normal));
+		deviation = std::max (deviation, d);
+	}
+	return deviation / size;
+}
+
+/* Cone around the given normals as axis and half angle. The cubic
+ * control nets the normals are derived from only approximate the
+ * Gregory patches, so the cone is widened by a small margin. */
+glm::vec4 NormalCone (const std::vector<glm::vec3> &normals)
+{
+	const float pi = 3.14159265f;
+	glm::vec3 axis (0, 0, 0);
+	for (const glm::vec3 &n : normals)
+		 axis += n;
+	if (normals.empty () || glm::length (axis) < 1e-6f)
+		 return glm::vec4 (0, 0, 1, pi);
+	axis = glm::normalize (axis);
+
+	float mincos = 1.0f;
+	for (const glm::vec3 &n : normals)
+		 mincos = std::min (mincos, glm::dot (axis, n));
+	float angle = acosf (std::max (-1.0f, std::min (mincos, 1.0f)));
+	return glm::vec4 (axis, std::min (angle + 0.05f, pi));
+}
+
+/* Adds the normalized cross products of all pairs of the given
+ * vectors to a list of normals. */
+void AddCrossProducts (std::vector<glm::vec3> &normals,
+											 const std::vector<glm::vec3> &a,
+											 const std::vector<glm::vec3> &b)
+{
+	for (const glm::vec3 &x : a)
+	{
+		for (const glm::vec3 &y : b)
+		{
+			glm::vec3 n = glm::cross (x, y);
+			if (glm::length (n) > 1e-12f)
+				 normals.push_back (glm::normalize (n));
+		}
+	}
+}
+
 void model::GeneratePatches (void)
 {
 	normals.clear ();
@@ -271,6 +329,138 @@ void model::GeneratePatches (void)
 			texcoords[i].push_back (v.texcoords[i]);
 		}
 	}
+
+	ComputeCurvature ();
+	ComputeNormalCones ();
+}
+
+void model::ComputeCurvature (void)
+{
+	trianglecurvature.clear ();
+	quadcurvature.clear ();
+	if (!patches)
+		 return;
+
+	for (auto p = 0; p < triangleindices.size () / 15; p++)
+	{
+		const unsigned int *indices = &triangleindices[p * 15];
+		const glm::vec3 &a = positions[indices[0]];
+		const glm::vec3 &b = positions[indices[5]];
+		const glm::vec3 &c = positions[indices[10]];
+		float size = std::max (glm::distance (a, b),
+													 std::max (glm::distance (b, c),
+																		 glm::distance (c, a)));
+		trianglecurvature.push_back (HullDeviation (positions, indices, 15,
+																								(a + b + c) / 3.0f,
+																								glm::cross (b - a, c - a),
+																								size));
+	}
+
+	for (auto p = 0; p < quadindices.size () / 20; p++)
+	{
+		const unsigned int *indices = &quadindices[p * 20];
+		const glm::vec3 &a = positions[indices[0]];
+		const glm::vec3 &b = positions[indices[3]];
+		const glm::vec3 &c = positions[indices[19]];
+		const glm::vec3 &d = positions[indices[16]];
+		float size = std::max (glm::distance (a, c), glm::distance (b, d));
+		quadcurvature.push_back (HullDeviation (positions, indices, 20,
+																						(a + b + c + d) / 4.0f,
+																						glm::cross (c - a, d - b),
+																						size));
+	}
+}
+
+void model::ComputeNormalCones (void)
+{
+	trianglecones.clear ();
+	quadcones.clear ();
+	if (!patches)
+		 return;
+
+	std::vector<glm::vec3> normals, d1, d2;
+
+	// The normal of a Bezier patch is a positive combination of the
+	// cross products of the control nets of its two partial derivatives,
+	// so these cross products bound the normals of the patch. The face
+	// points of each Gregory patch are averaged to obtain a cubic net.
+	for (auto p = 0; p < triangleindices.size () / 15; p++)
+	{
+		const unsigned int *indices = &triangleindices[p * 15];
+		glm::vec3 center (0, 0, 0);
+		for (unsigned int i : { 3, 4, 8, 9, 13, 14 })
+			 center += positions[indices[i]] / 6.0f;
+
+		// control net indexed by barycentric coordinates (i, j, k)
+		auto net = [&] (int i, int j, int k) -> glm::vec3 {
+			static const int map[4][4] = {
+				{ 10, 11, 7, 5 },
+				{ 12, -1, 6, -1 },
+				{ 1, 2, -1, -1 },
+				{ 0, -1, -1, -1 }
+			};
+			(void) k;
+			if (i == 1 && j == 1)
+				 return center;
+			return positions[indices[map[i][j]]];
+		};
+
+		d1.clear ();
+		d2.clear ();
+		for (int i = 0; i <= 2; i++)
+		{
+			for (int j = 0; i + j <= 2; j++)
+			{
+				int k = 2 - i - j;
+				// the evaluation shaders use the derivatives towards
+				// v and w relative to u as tangent frame
+				d1.push_back (net (i, j + 1, k) - net (i + 1, j, k));
+				d2.push_back (net (i, j, k + 1) - net (i + 1, j, k));
+			}
+		}
+		normals.clear ();
+		AddCrossProducts (normals, d1, d2);
+		trianglecones.push_back (NormalCone (normals));
+	}
+
+	for (auto p = 0; p < quadindices.size () / 20; p++)
+	{
+		const unsigned int *indices = &quadindices[p * 20];
+		glm::vec3 grid[4][4];
+		static const int map[4][4] = {
+			{ 0, 4, 10, 16 },
+			{ 1, -1, -1, 17 },
+			{ 2, -1, -1, 18 },
+			{ 3, 9, 15, 19 }
+		};
+		for (int u = 0; u < 4; u++)
+		{
+			for (int v = 0; v < 4; v++)
+			{
+				if (map[u][v] >= 0)
+					 grid[u][v] = positions[indices[map[u][v]]];
+			}
+		}
+		grid[1][1] = 0.5f * (positions[indices[5]] + positions[indices[6]]);
+		grid[2][1] = 0.5f * (positions[indices[7]] + positions[indices[8]]);
+		grid[1][2] = 0.5f * (positions[indices[11]] + positions[indices[12]]);
+		grid[2][2] = 0.5f * (positions[indices[13]] + positions[indices[14]]);
+
+		d1.clear ();
+		d2.clear ();
+		for (int i = 0; i < 4; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				// the evaluation shaders use cross (dP/dv, dP/du) as normal
+				d1.push_back (grid[i][j + 1] - grid[i][j]);
+				d2.push_back (grid[j + 1][i] - grid[j][i]);
+			}
+		}
+		normals.clear ();
+		AddCrossProducts (normals, d1, d2);
+		quadcones.push_back (NormalCone (normals));
+	}
 }
 
 } /* namespace pchm */
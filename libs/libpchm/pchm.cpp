@@ -33,6 +33,8 @@ typedef struct header
 } header_t;
 
 #define PCHM_FLAGS_GREGORY_PATCHES       0x0001
+#define PCHM_FLAGS_PATCH_CURVATURE       0x0002
+#define PCHM_FLAGS_NORMAL_CONES          0x0004
 
 #define PCHM_VERSION 0x0000
 
@@ -55,6 +57,12 @@ model::model (const model &m)
 													m.triangleindices.end ());
 	quadindices.assign (m.quadindices.begin (),
 											m.quadindices.end ());
+	trianglecurvature.assign (m.trianglecurvature.begin (),
+														m.trianglecurvature.end ());
+	quadcurvature.assign (m.quadcurvature.begin (),
+												m.quadcurvature.end ());
+	trianglecones.assign (m.trianglecones.begin (), m.trianglecones.end ());
+	quadcones.assign (m.quadcones.begin (), m.quadcones.end ());
 }
 
 model::model (model &&m)
@@ -62,6 +70,10 @@ model::model (model &&m)
 		tangents (std::move (m.tangents)), texcoords (std::move (m.texcoords)),
 		triangleindices (std::move (m.triangleindices)),
 		quadindices (std::move (m.quadindices)),
+		trianglecurvature (std::move (m.trianglecurvature)),
+		quadcurvature (std::move (m.quadcurvature)),
+		trianglecones (std::move (m.trianglecones)),
+		quadcones (std::move (m.quadcones)),
 		patches (m.patches)
 {																						
 	m.patches = false;
@@ -85,6 +97,12 @@ model &model::operator= (const model &m)
 													m.triangleindices.end ());
 	quadindices.assign (m.quadindices.begin (),
 											m.quadindices.end ());
+	trianglecurvature.assign (m.trianglecurvature.begin (),
+														m.trianglecurvature.end ());
+	quadcurvature.assign (m.quadcurvature.begin (),
+												m.quadcurvature.end ());
+	trianglecones.assign (m.trianglecones.begin (), m.trianglecones.end ());
+	quadcones.assign (m.quadcones.begin (), m.quadcones.end ());
 	patches = m.patches;
 }
 
@@ -96,6 +114,10 @@ model &model::operator= (model &&m)
 	texcoords = std::move (m.texcoords);
 	triangleindices = std::move (m.triangleindices);
 	quadindices = std::move (m.quadindices);
+	trianglecurvature = std::move (m.trianglecurvature);
+	quadcurvature = std::move (m.quadcurvature);
+	trianglecones = std::move (m.trianglecones);
+	quadcones = std::move (m.quadcones);
 	patches = m.patches;
 	m.patches = false;
 }
@@ -165,6 +187,43 @@ bool model::Load (std::istream &in)
 			if (in.gcount () != quadindices.size () * sizeof (unsigned int))
 				 return false;
 		}
+
+		if (header.flags & PCHM_FLAGS_PATCH_CURVATURE)
+		{
+			trianglecurvature.resize (header.trianglecount);
+			in.read (reinterpret_cast<char*> (trianglecurvature.data ()),
+							 trianglecurvature.size () * sizeof (float));
+			if (in.gcount () != trianglecurvature.size () * sizeof (float))
+				 return false;
+			quadcurvature.resize (header.quadcount);
+			in.read (reinterpret_cast<char*> (quadcurvature.data ()),
+							 quadcurvature.size () * sizeof (float));
+			if (in.gcount () != quadcurvature.size () * sizeof (float))
+				 return false;
+		}
+		else
+		{
+			// files written before the curvature was stored
+			ComputeCurvature ();
+		}
+
+		if (header.flags & PCHM_FLAGS_NORMAL_CONES)
+		{
+			trianglecones.resize (header.trianglecount);
+			in.read (reinterpret_cast<char*> (trianglecones.data ()),
+							 trianglecones.size () * sizeof (glm::vec4));
+			if (in.gcount () != trianglecones.size () * sizeof (glm::vec4))
+				 return false;
+			quadcones.resize (header.quadcount);
+			in.read (reinterpret_cast<char*> (quadcones.data ()),
+							 quadcones.size () * sizeof (glm::vec4));
+			if (in.gcount () != quadcones.size () * sizeof (glm::vec4))
+				 return false;
+		}
+		else
+		{
+			ComputeNormalCones ();
+		}
 	}
 	else
 	{
@@ -238,6 +297,16 @@ bool model::Save (std::ostream &out) const
 		header.quadcount = quadindices.size () / 4;
 	}
 	header.num_texcoords = texcoords.size ();
+	bool curvature = patches
+		 && trianglecurvature.size () == header.trianglecount
+		 && quadcurvature.size () == header.quadcount;
+	if (curvature)
+		 header.flags |= PCHM_FLAGS_PATCH_CURVATURE;
+	bool cones = patches
+		 && trianglecones.size () == header.trianglecount
+		 && quadcones.size () == header.quadcount;
+	if (cones)
+		 header.flags |= PCHM_FLAGS_NORMAL_CONES;
 
 	out.write (reinterpret_cast<char*> (&header), sizeof (header_t));
 	out.write (reinterpret_cast<const char*> (positions.data ()),
@@ -260,6 +329,20 @@ bool model::Save (std::ostream &out) const
 						 triangleindices.size () * sizeof (unsigned int));
 	out.write (reinterpret_cast<const char*> (quadindices.data ()),
 						 quadindices.size () * sizeof (unsigned int));
+	if (curvature)
+	{
+		out.write (reinterpret_cast<const char*> (trianglecurvature.data ()),
+							 trianglecurvature.size () * sizeof (float));
+		out.write (reinterpret_cast<const char*> (quadcurvature.data ()),
+							 quadcurvature.size () * sizeof (float));
+	}
+	if (cones)
+	{
+		out.write (reinterpret_cast<const char*> (trianglecones.data ()),
+							 trianglecones.size () * sizeof (glm::vec4));
+		out.write (reinterpret_cast<const char*> (quadcones.data ()),
+							 quadcones.size () * sizeof (glm::vec4));
+	}
 	if (out.fail ())
 		return false;
 
@@ -275,6 +358,10 @@ void model::Define (unsigned int vertices, unsigned int triangles,
 	positions.resize (vertices);
 	triangleindices.resize (triangles * 3);
 	quadindices.resize (quads * 4);
+	trianglecurvature.clear ();
+	quadcurvature.clear ();
+	trianglecones.clear ();
+	quadcones.clear ();
 	patches = false;
 }
 
@@ -380,4 +467,32 @@ const unsigned int *model::GetQuadIndices (void) const
 	return quadindices.data ();
 }
 
+const float *model::GetTriangleCurvature (void) const
+{
+	if (trianglecurvature.empty ())
+		 return NULL;
+	return trianglecurvature.data ();
+}
+
+const float *model::GetQuadCurvature (void) const
+{
+	if (quadcurvature.empty ())
+		 return NULL;
+	return quadcurvature.data ();
+}
+
+const glm::vec4 *model::GetTriangleCones (void) const
+{
+	if (trianglecones.empty ())
+		 return NULL;
+	return trianglecones.data ();
+}
+
+const glm::vec4 *model::GetQuadCones (void) const
+{
+	if (quadcones.empty ())
+		 return NULL;
+	return quadcones.data ();
+}
+
 } /* namespace pchm */
@@ -37,6 +37,8 @@ public:
 	 bool Patches (void) const;
 
 	 void GeneratePatches (void);
+	 void ComputeCurvature (void);
+	 void ComputeNormalCones (void);
 
 	 bool Load (const std::string &filename);
 	 bool Load (std::istream &in);
@@ -67,7 +69,11 @@ public:
 	 unsigned int GetNumQuads (void) const;
 	 const unsigned int *GetTriangleIndices (void) const;
 	 const unsigned int *GetQuadIndices (void) const;
-	 
+	 const float *GetTriangleCurvature (void) const;
+	 const float *GetQuadCurvature (void) const;
+	 const glm::vec4 *GetTriangleCones (void) const;
+	 const glm::vec4 *GetQuadCones (void) const;
+
 private:
 	 std::vector<glm::vec3> positions;
 	 std::vector<glm::vec3> normals;
@@ -77,6 +83,12 @@ private:
 	 std::vector<unsigned int> triangleindices;
 	 std::vector<unsigned int> quadindices;
 
+	 std::vector<float> trianglecurvature;
+	 std::vector<float> quadcurvature;
+
+	 std::vector<glm::vec4> trianglecones;
+	 std::vector<glm::vec4> quadcones;
+
 	 bool patches;
 };
 
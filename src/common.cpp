@@ -15,10 +15,24 @@
  * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <common.h>
+#include "filesystem.h"
+#include "profiler.h"
+#include "shadercache.h"
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <cstring>
 
+constexpr GLuint ShaderFeatures::DiffuseMap;
+constexpr GLuint ShaderFeatures::NormalMap;
+constexpr GLuint ShaderFeatures::SpecularMap;
+constexpr GLuint ShaderFeatures::ParameterMap;
+constexpr GLuint ShaderFeatures::HeightMap;
+constexpr GLuint ShaderFeatures::DisplacementMap;
+constexpr GLuint ShaderFeatures::TileBased;
+constexpr GLuint ShaderFeatures::Clustered;
+constexpr GLuint ShaderFeatures::Count;
+
 const char *glErrorString (GLenum err)
 {
 	switch (err)
@@ -63,19 +77,13 @@ std::string MakePath (const std::string &subdir,
 
 bool ReadFile (const std::string &filename, std::string &str)
 {
-	std::ifstream file (filename, std::ios::in);
-	if (!file.is_open ())
+	FileSystem::File file;
+	if (!filesystem.Open (filename, file))
 	{
 		(*logstream) << "Cannot open " << filename << std::endl;
 		return false;
 	}
-	str.clear ();
-	while (file.good ())
-	{
-		char buffer[256];
-		file.read (buffer, 256);
-		str.append (buffer, file.gcount ());
-	}
+	str.assign (file.GetData (), file.GetSize ());
 	return true;
 }
 
@@ -191,111 +199,240 @@ void SaveProgramBinary (gl::Program &program, const std::string &filename,
 	file.write (reinterpret_cast<char*> (&binary[0]), binary.size ());
 }
 
-bool LoadProgram (gl::Program &program, const std::string &filename,
-									GLenum type, const std::string &definitions,
-									const std::vector<std::string> &filenames)
+namespace {
+
+/** Hash preprocessor definitions.
+ * \param definitions Preprocessor definitions.
+ * \param features Shader features.
+ * \param hash Returns the hash.
+ */
+void HashDefinitions (const std::vector<std::string> &definitions,
+											GLuint features, uint64_t *hash)
 {
-	Tiger2 tiger2;
-	std::vector<std::string> sources;
-	if (!definitions.empty ())
+	std::unique_ptr<Hash> hashfn (Hash::Create ());
+	hashfn->consume (&features, sizeof (features));
+	for (const std::string &def : definitions)
+	{
+		uint64_t length = def.length ();
+		hashfn->consume (&length, sizeof (length));
+		hashfn->consume (def.data (), def.length ());
+	}
+	hashfn->finalize ();
+	hashfn->get (hash);
+}
+
+/** Get filename of a program variant.
+ * \param filename Filename of the program binary.
+ * \param features Shader features of the variant.
+ * \returns The filename with the feature mask inserted before the
+ *          extension.
+ */
+std::string GetVariantFilename (const std::string &filename, GLuint features)
+{
+	if (features == 0)
+		 return filename;
+
+	std::stringstream stream;
+	stream << "_" << std::hex << features;
+
+	std::string::size_type pos = filename.rfind ('.');
+	if (pos == std::string::npos
+			|| filename.find_first_of ("/\\", pos) != std::string::npos)
+		 pos = filename.length ();
+	return filename.substr (0, pos) + stream.str () + filename.substr (pos);
+}
+
+/** Add feature definitions.
+ * Inserts a preprocessor definition for each shader feature after
+ * the version directive of a shader.
+ * \param sources Source strings of the shader.
+ * \param features Shader features.
+ */
+void AddFeatures (std::vector<std::string> &sources, GLuint features)
+{
+	const char *names[ShaderFeatures::Count] = {
+		"DIFFUSEMAP", "NORMALMAP", "SPECULARMAP", "PARAMETERMAP",
+		"HEIGHTMAP", "DISPLACEMENTMAP", "TILE_BASED", "CLUSTERED"
+	};
+
+	std::string definitions;
+	for (GLuint i = 0; i < ShaderFeatures::Count; i++)
 	{
-		 sources.push_back (definitions);
-		 tiger2.consume (definitions.data (), definitions.length ());
+		if (features & (1 << i))
+			 definitions += std::string ("#define ") + names[i] + "\n";
 	}
-	for (const std::string &file : filenames)
+	if (definitions.empty ())
+		 return;
+
+	for (std::string &source : sources)
 	{
-		sources.emplace_back ();
-		if (!ReadFile (file, sources.back ()))
-			 return false;
-		tiger2.consume (sources.back ().data (), sources.back ().length ());
+		std::string::size_type pos = source.find ("#version");
+		if (pos == std::string::npos)
+			 continue;
+		pos = source.find ('\n', pos);
+		if (pos == std::string::npos)
+		{
+			source.push_back ('\n');
+			pos = source.length ();
+		}
+		else
+			 pos++;
+		source.insert (pos, definitions);
+		return;
 	}
+	sources.insert (sources.begin (), definitions);
+}
+
+} /* anonymous namespace */
 
+bool LoadProgram (gl::Program &program, const std::string &name,
+									GLenum type, const std::string &definitions,
+									const std::vector<std::string> &filenames,
+									GLuint features)
+{
+	const std::string filename (GetVariantFilename (name, features));
+	uint64_t defhash[3];
 	uint64_t hash[3];
-	tiger2.finalize ();
-	tiger2.get (hash);
+	HashDefinitions (std::vector<std::string> ({ definitions }), features,
+									 defhash);
 
-	if (LoadProgramBinary (program, filename, hash))
+	// sources that didn't change since the last
+	// build don't need to be read and hashed
 	{
-		return true;
+		Profiler::Scope scope ("shader binary", filename);
+		if (shadercache.Lookup (filename, defhash, filenames, hash)
+				&& LoadProgramBinary (program, filename, hash))
+			 return true;
 	}
 
-	program.Parameter (GL_PROGRAM_SEPARABLE, GL_TRUE);
-	gl::Shader obj (type);
-	obj.Source (sources);
-	if (!obj.Compile ())
+	std::vector<std::string> sources;
+	std::vector<std::string> includes;
 	{
-		(*logstream) << "Could not compile " << filename << ": "
-								 << obj.GetInfoLog () << std::endl;
-		return false;
+		Profiler::Scope scope ("shader hash", filename);
+		std::unique_ptr<Hash> hashfn (Hash::Create ());
+		hashfn->consume (&features, sizeof (features));
+		if (!definitions.empty ())
+		{
+			 sources.push_back (definitions);
+			 hashfn->consume (definitions.data (), definitions.length ());
+		}
+		// files shared by several programs are only read and hashed once
+		if (!shadercache.Resolve (filenames, sources, includes, *hashfn))
+			 return false;
+
+		hashfn->finalize ();
+		hashfn->get (hash);
 	}
-	program.Attach (obj);
 
-	if (!program.Link ())
 	{
-		(*logstream) << "Could not link " << filename << ": "
-								 << program.GetInfoLog () << std::endl;
-		return false;
+		Profiler::Scope scope ("shader binary", filename);
+		if (LoadProgramBinary (program, filename, hash))
+		{
+			shadercache.Update (filename, defhash, filenames, includes, hash);
+			return true;
+		}
 	}
 
-	SaveProgramBinary (program, filename, hash);
+	AddFeatures (sources, features);
+
+	// only submit the build, the results are checked
+	// once all programs are submitted
+	Profiler::Scope scope ("shader submit", filename);
+	program.Parameter (GL_PROGRAM_SEPARABLE, GL_TRUE);
+	std::vector<ShaderCache::Shader> shaders;
+	shaders.emplace_back (filename, std::unique_ptr<gl::Shader>
+												(new gl::Shader (type)));
+	gl::Shader &obj = *shaders.back ().second;
+	obj.Source (sources);
+	gl::CompileShader (obj.get ());
+	program.Attach (obj);
+	gl::LinkProgram (program.get ());
+
+	shadercache.Update (filename, defhash, filenames, includes, hash);
+	shadercache.Submit (program, filename, hash, std::move (shaders));
 
 	return true;
 }
 
-bool LoadProgram (gl::Program &program, const std::string &filename,
+bool LoadProgram (gl::Program &program, const std::string &name,
 									const std::vector<std::string> &definitions,
 									const std::vector<std::pair<GLenum, std::string>>
-									&filenames)
+									&filenames, GLuint features)
 {
-	Tiger2 tiger2;
-
-	for (const std::string &def : definitions)
-		 tiger2.consume (def.data (), def.length ());
+	const std::string filename (GetVariantFilename (name, features));
+	uint64_t defhash[3];
+	uint64_t hash[3];
+	HashDefinitions (definitions, features, defhash);
 
-	std::vector<std::string> sources;
+	std::vector<std::string> paths;
 	for (const std::pair<GLenum, std::string> &file : filenames)
+		 paths.push_back (file.second);
+
+	// sources that didn't change since the last
+	// build don't need to be read and hashed
 	{
-		sources.emplace_back ();
-		if (!ReadFile (file.second, sources.back ()))
-			 return false;
-		tiger2.consume (sources.back ().data (), sources.back ().length ());
+		Profiler::Scope scope ("shader binary", filename);
+		if (shadercache.Lookup (filename, defhash, paths, hash)
+				&& LoadProgramBinary (program, filename, hash))
+			 return true;
 	}
 
-	uint64_t hash[3];
-	tiger2.finalize ();
-	tiger2.get (hash);
+	std::vector<std::string> sources;
+	std::vector<std::string> includes;
+	{
+		Profiler::Scope scope ("shader hash", filename);
+		std::unique_ptr<Hash> hashfn (Hash::Create ());
+		hashfn->consume (&features, sizeof (features));
+
+		for (const std::string &def : definitions)
+			 hashfn->consume (def.data (), def.length ());
+
+		// each stage is resolved separately, so that
+		// every stage gets its own copy of the includes
+		for (const std::string &path : paths)
+		{
+			if (!shadercache.Resolve ({ path }, sources, includes, *hashfn))
+				 return false;
+		}
+
+		hashfn->finalize ();
+		hashfn->get (hash);
+	}
 
-	if (LoadProgramBinary (program, filename, hash))
 	{
-		return true;
+		Profiler::Scope scope ("shader binary", filename);
+		if (LoadProgramBinary (program, filename, hash))
+		{
+			shadercache.Update (filename, defhash, paths, includes, hash);
+			return true;
+		}
 	}
 
+	// only submit the build, the results are checked
+	// once all programs are submitted
+	Profiler::Scope scope ("shader submit", filename);
+	std::vector<ShaderCache::Shader> shaders;
 	for (auto i = 0; i < filenames.size (); i++)
 	{
-		gl::Shader obj (filenames[i].first);
+		shaders.emplace_back (filenames[i].second, std::unique_ptr<gl::Shader>
+													(new gl::Shader (filenames[i].first)));
+		gl::Shader &obj = *shaders.back ().second;
+		std::vector<std::string> stage;
 		if (i < definitions.size ())
-			 obj.Source (std::vector<std::string> ({ definitions[i], sources[i] }));
+			 stage = std::vector<std::string> ({ definitions[i], sources[i] });
 		else
-			 obj.Source (std::vector<std::string> ({ sources[i] }));
-		if (!obj.Compile ())
-		{
-			(*logstream) << "Could not compile " << filenames[i].second
-									 << ": " << obj.GetInfoLog () << std::endl;
-			return false;
-		}
+			 stage = std::vector<std::string> ({ sources[i] });
+		AddFeatures (stage, features);
+		obj.Source (stage);
+		gl::CompileShader (obj.get ());
 		program.Attach (obj);
 	}
 
 	program.Parameter (GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	gl::LinkProgram (program.get ());
 
-	if (!program.Link ())
-	{
-		(*logstream) << "Could not link " << filename << ": "
-								 << program.GetInfoLog () << std::endl;
-		return false;
-	}
-
-	SaveProgramBinary (program, filename, hash);
+	shadercache.Update (filename, defhash, paths, includes, hash);
+	shadercache.Submit (program, filename, hash, std::move (shaders));
 
 	return true;
 }
@@ -16,6 +16,12 @@
  */
 #include "composition.h"
 #include "renderer.h"
+#include <algorithm>
+
+constexpr GLuint LightCulling::None;
+constexpr GLuint LightCulling::TileBased;
+constexpr GLuint LightCulling::Clustered;
+constexpr GLuint LightCulling::Count;
 
 Composition::Composition (void)
 	: glow (),
@@ -29,6 +35,26 @@ Composition::~Composition (void)
 
 bool Composition::Init (void)
 {
+	{
+		std::string mode = config["lightculling"].as<std::string>
+			 ("tilebased");
+		if (!mode.compare ("none"))
+			 lightculling = LightCulling::None;
+		else if (!mode.compare ("tilebased"))
+			 lightculling = LightCulling::TileBased;
+		else if (!mode.compare ("clustered"))
+			 lightculling = LightCulling::Clustered;
+		else
+		{
+			(*logstream) << "Invalid light culling mode: " << mode
+									 << std::endl;
+			return false;
+		}
+	}
+
+	if (!clusters.Init ())
+		 return false;
+
 	{
 		std::stringstream stream;
 		stream << "#version 420 core" << std::endl;
@@ -46,19 +72,30 @@ bool Composition::Init (void)
 		stream << "#define NUM_TILES_Y "
 					 << (r->gbuffer.GetHeight () >> 5)
 					 << std::endl;
-		std::vector<std::string> sources;
-		const char *sourcefiles [] = {
-			"header.txt", "light.txt", "parameter.txt", "specular.txt",
-			"getpos.txt", "sky.txt", "shadow.txt", "composition.txt"
+		stream << "#define NUM_CLUSTERS_X "
+					 << clusters.GetNumTilesX () << std::endl;
+		stream << "#define NUM_CLUSTERS_Y "
+					 << clusters.GetNumTilesY () << std::endl;
+		stream << "#define NUM_CLUSTER_SLICES "
+					 << clusters.GetNumSlices () << std::endl;
+		stream << "#define CLUSTER_TILE_SIZE "
+					 << clusters.GetTileSize () << std::endl;
+		// the remaining sources are included by composition.txt
+		std::vector<std::string> sources ({
+				MakePath ("shaders", "composition", "composition.txt") });
+		// all variants are loaded up front,
+		// so that switching between them is cheap
+		const GLuint features[LightCulling::Count] = {
+			0, ShaderFeatures::TileBased, ShaderFeatures::Clustered
 		};
-		for (auto i = 0; i < sizeof (sourcefiles) / sizeof (sourcefiles[0]); i++)
+		for (GLuint i = 0; i < LightCulling::Count; i++)
 		{
-			sources.push_back (MakePath ("shaders", "composition",
-																	 sourcefiles[i]));
+			if (!LoadProgram (fprograms[i], MakePath ("shaders", "bin",
+																								"composition.bin"),
+												GL_FRAGMENT_SHADER, stream.str (), sources,
+												features[i]))
+				 return false;
 		}
-		if (!LoadProgram (fprogram, MakePath ("shaders", "bin", "composition.bin"),
-											GL_FRAGMENT_SHADER, stream.str (), sources))
-			 return false;
 	}
 
 	{
@@ -82,12 +119,11 @@ bool Composition::Init (void)
 
 	if (!LoadProgram (minmaxdepthprog, MakePath ("shaders", "bin",
 																							 "minmaxdepth.bin"),
-										GL_FRAGMENT_SHADER, std::string (), {
+										GL_COMPUTE_SHADER, std::string (), {
 											MakePath ("shaders", "minmaxdepth.txt") }))
 		 return false;
 
-	tile_based = gl::SmartUniform<bool>
-		 (fprogram["tile_based"], true);
+	const gl::Program &fprogram = fprograms[lightculling];
 	luminance_threshold = gl::SmartUniform<GLfloat>
 		 (fprogram["glow.threshold"], 0.75);
 	screenlimit = gl::SmartUniform<GLfloat>
@@ -119,12 +155,10 @@ bool Composition::Init (void)
 	SetupSunPosition ();
 	GeneratePerezCoefficients ();
 
-	fprogram["invviewport"]
-		 = glm::vec2 (1.0f / float (r->gbuffer.GetWidth ()),
-									1.0f / float (r->gbuffer.GetHeight ()));
-	minmaxdepthprog["invviewport"]
-		 = glm::vec2 (1.0f / float (r->gbuffer.GetWidth ()),
-									1.0f / float (r->gbuffer.GetHeight ()));
+	for (gl::Program &program : fprograms)
+		 program["invviewport"]
+				= glm::vec2 (1.0f / float (r->gbuffer.GetWidth ()),
+										 1.0f / float (r->gbuffer.GetHeight ()));
 	lightcullprog["invviewport"]
 		 = glm::vec2 (1.0f / float (r->gbuffer.GetWidth ()),
 									1.0f / float (r->gbuffer.GetHeight ()));
@@ -132,11 +166,9 @@ bool Composition::Init (void)
 	pipeline.UseProgramStages (GL_VERTEX_SHADER_BIT,
 														 r->windowgrid.vprogram);
 	pipeline.UseProgramStages (GL_FRAGMENT_SHADER_BIT,
-														 fprogram);
+														 fprograms[lightculling]);
 
-	minmaxdepthpipeline.UseProgramStages (GL_VERTEX_SHADER_BIT,
-																				r->windowgrid.vprogram);
-	minmaxdepthpipeline.UseProgramStages (GL_FRAGMENT_SHADER_BIT,
+	minmaxdepthpipeline.UseProgramStages (GL_COMPUTE_SHADER_BIT,
 																				minmaxdepthprog);
 
 	lightcullpipeline.UseProgramStages (GL_VERTEX_SHADER_BIT,
@@ -152,16 +184,16 @@ bool Composition::Init (void)
 	r->memory += r->gbuffer.GetWidth () * r->gbuffer.GetHeight () * 4 * 2;
 #endif
 
-	glowmap.Image2D (GL_TEXTURE_2D, 0, GL_RGBA16F,
-								r->gbuffer.GetWidth (),
-								r->gbuffer.GetHeight (),
-								0, GL_RGBA, GL_FLOAT, NULL);
-	glowmap.GenerateMipmap (GL_TEXTURE_2D);
-#ifdef DEBUG
-	for (size_t mem = r->gbuffer.GetWidth () * r->gbuffer.GetHeight () * 4 * 2;
-			 mem > 1; mem >>= 2)
-		 r->memory += mem;
-#endif
+	{
+		RenderGraph::TextureDesc desc;
+		desc.width = r->gbuffer.GetWidth ();
+		desc.height = r->gbuffer.GetHeight ();
+		desc.format = GL_RGBA16F;
+		desc.levels = 1;
+		while ((std::max (desc.width, desc.height) >> desc.levels) > 0)
+			 desc.levels++;
+		glowmap = r->graph.GetResource ("glowmap", desc);
+	}
 
 	if (!glow.Init (screen, glowmap,
 									config["glow"]["mipmaplevel"].as<unsigned int> (2)))
@@ -170,9 +202,6 @@ bool Composition::Init (void)
 	framebuffer.Texture2D (GL_COLOR_ATTACHMENT0,
 												 GL_TEXTURE_2D,
 												 screen, 0);
-	framebuffer.Texture2D (GL_COLOR_ATTACHMENT1,
-												 GL_TEXTURE_2D,
-												 glowmap, 0);
 	framebuffer.DrawBuffers ({ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 });
 
 	lighttex.Image2D (GL_TEXTURE_2D, 0, GL_R16UI, r->gbuffer.GetWidth (),
@@ -187,16 +216,11 @@ bool Composition::Init (void)
 									* (r->gbuffer.GetHeight () >> 5),
 									NULL,	GL_DYNAMIC_DRAW);
 
-	dummy.Image2D (GL_TEXTURE_2D, 0, GL_R8, r->gbuffer.GetWidth (),
-								 r->gbuffer.GetHeight (), 0, GL_RED,
-								 GL_UNSIGNED_BYTE, NULL);
-#ifdef DEBUG
-	r->memory += r->gbuffer.GetWidth () * r->gbuffer.GetHeight ();
-#endif
-
-	lightcullfb.Texture2D (GL_COLOR_ATTACHMENT0,
-												 GL_TEXTURE_2D,
-												 dummy, 0);
+	// the light culling pass only writes to images
+	lightcullfb.Parameter (GL_FRAMEBUFFER_DEFAULT_WIDTH,
+												 r->gbuffer.GetWidth ());
+	lightcullfb.Parameter (GL_FRAMEBUFFER_DEFAULT_HEIGHT,
+												 r->gbuffer.GetHeight ());
 	lightcullfb.DrawBuffers ({ });
 
 	mindepthtex.Image2D (GL_TEXTURE_2D, 0, GL_R32F,
@@ -219,25 +243,8 @@ bool Composition::Init (void)
 		 * (r->gbuffer.GetHeight () >> 5) * 4;
 #endif
 
-	minmaxdepthfb.Texture2D (GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-													 mindepthtex, 0);
-	minmaxdepthfb.Texture2D (GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
-													 maxdepthtex, 0);
-	minmaxdepthfb.DrawBuffers ({ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 });
-
 	lightbuffertex.Buffer (GL_RGBA32F, r->GetLightBuffer ());
 
-	clearfb.Texture2D (GL_COLOR_ATTACHMENT0,
-										 GL_TEXTURE_2D,
-										 mindepthtex, 0);
-	clearfb.Texture2D (GL_COLOR_ATTACHMENT1,
-										 GL_TEXTURE_2D,
-										 maxdepthtex, 0);
-
-	
-	clearfb.DrawBuffers ({ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1,
-				 GL_COLOR_ATTACHMENT2 });
-
 	glow.SetSize (0);
 
 	GeneratePerezCoefficients ();
@@ -245,14 +252,50 @@ bool Composition::Init (void)
 	return true;
 }
 
-void Composition::SetTileBased (bool tb)
+namespace {
+
+/** Rebind a smart uniform.
+ * Moves a smart uniform to another program, keeping its value.
+ * \param uniform Smart uniform.
+ * \param program Program to move the uniform to.
+ * \param name Name of the uniform.
+ */
+template<typename T>
+void Rebind (gl::SmartUniform<T> &uniform, const gl::Program &program,
+						 const char *name)
 {
-	tile_based.Set (tb);
+	uniform = gl::SmartUniform<T> (program[name], uniform.Get ());
 }
 
-bool Composition::GetTileBased (void)
+} /* anonymous namespace */
+
+void Composition::SetLightCulling (GLuint mode)
 {
-	return tile_based.Get ();
+	if (mode >= LightCulling::Count || mode == lightculling)
+		 return;
+	lightculling = mode;
+
+	const gl::Program &fprogram = fprograms[lightculling];
+	Rebind (luminance_threshold, fprogram, "glow.threshold");
+	Rebind (screenlimit, fprogram, "screenlimit");
+	Rebind (shadow_alpha, fprogram, "shadow_alpha");
+	Rebind (shadowmat, fprogram, "shadowmat");
+	Rebind (eye, fprogram, "eye");
+	Rebind (sun.theta, fprogram, "sun.theta");
+	Rebind (sun.cos_theta, fprogram, "sun.cos_theta");
+	Rebind (sun.direction, fprogram, "sun.direction");
+	Rebind (sky.perezY, fprogram, "sky.perezY");
+	Rebind (sky.perezx, fprogram, "sky.perezx");
+	Rebind (sky.perezy, fprogram, "sky.perezy");
+	Rebind (sky.zenithYxy, fprogram, "sky.zenithYxy");
+	Rebind (sky.luminosity, fprogram, "sky.luminosity");
+
+	pipeline.UseProgramStages (GL_FRAGMENT_SHADER_BIT, fprogram);
+}
+
+GLuint Composition::GetLightCulling (void)
+{
+	return lightculling;
 }
 
 void Composition::GeneratePerezCoefficients (void)
@@ -327,6 +370,11 @@ Glow &Composition::GetGlow (void)
 	return glow;
 }
 
+LightClusters &Composition::GetLightClusters (void)
+{
+	return clusters;
+}
+
 void Composition::SetLuminanceThreshold (float threshold)
 {
 	luminance_threshold.Set (threshold);
@@ -500,6 +548,59 @@ void Composition::SetSkyLuminosity (GLfloat l)
 	sky.luminosity.Set (l);
 }
 
+void Composition::CullLights (void)
+{
+	if (lightculling == LightCulling::Clustered)
+	{
+		clusters.Build (r->camera, r->GetNumLights ()
+										? &r->GetLight (0) : NULL, r->GetNumLights ());
+		return;
+	}
+
+	// a single dispatch with one work group per tile, each tile
+	// writes its depth range, so the textures need no clearing
+	minmaxdepthpipeline.Bind ();
+
+	r->gbuffer.depthbuffer.Bind (GL_TEXTURE0, GL_TEXTURE_2D);
+	r->gbuffer.fragidx.Bind (GL_TEXTURE1, GL_TEXTURE_2D);
+	r->gbuffer.fraglisttex.Bind (GL_TEXTURE2, GL_TEXTURE_BUFFER);
+	mindepthtex.BindImage (0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+	maxdepthtex.BindImage (1, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+	gl::DispatchCompute (r->gbuffer.GetWidth () >> 5,
+											 r->gbuffer.GetHeight () >> 5, 1);
+	gl::MemoryBarrier (GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	lightcullfb.Bind (GL_FRAMEBUFFER);
+	gl::Viewport (0, 0, r->gbuffer.GetWidth (),
+								r->gbuffer.GetHeight ());
+
+	GLuint *ptr = (GLuint*) numlights.MapRange
+		 (0, sizeof (GLuint) * (r->gbuffer.GetWidth () >> 5)
+			* (r->gbuffer.GetHeight () >> 5),
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT
+			| GL_MAP_UNSYNCHRONIZED_BIT);
+	for (auto i = 0; i < (r->gbuffer.GetWidth () >> 5)
+					* (r->gbuffer.GetHeight () >> 5); i++)
+	{
+		ptr[i] = 0;
+	}
+	numlights.Unmap ();
+	lightcullpipeline.Bind ();
+
+	lightcullprog["vmatinv"] = glm::inverse (r->camera.GetViewMatrix ());
+	lightcullprog["projinfo"] = r->camera.GetProjInfo ();
+
+	numlights.BindBase (GL_ATOMIC_COUNTER_BUFFER, 0);
+	mindepthtex.Bind (GL_TEXTURE0, GL_TEXTURE_2D);
+	maxdepthtex.Bind (GL_TEXTURE1, GL_TEXTURE_2D);
+	lightbuffertex.Bind (GL_TEXTURE2, GL_TEXTURE_BUFFER);
+	lighttex.BindImage (0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R16UI);
+	r->windowgrid.Render ();
+
+	gl::Framebuffer::Unbind (GL_FRAMEBUFFER);
+}
+
 void Composition::Frame (float timefactor)
 {
 /*
@@ -513,76 +614,13 @@ void Composition::Frame (float timefactor)
 	shadowmat.Set (r->shadowmap.GetMat ());
 	eye.Set (r->camera.GetEye ());
 
-	if (GetTileBased ())
-	{
-		clearfb.Bind (GL_FRAMEBUFFER);
-		gl::ClearBufferfv (GL_COLOR, 0, (const GLfloat[]) { 1.0f, 0, 0, 0 });
-		gl::ClearBufferfv (GL_COLOR, 1, (const GLfloat[]) { 0.0f, 0, 0, 0 });
-		
-		minmaxdepthfb.Bind (GL_FRAMEBUFFER);
-		gl::Viewport (0, 0, r->gbuffer.GetWidth () >> 5,
-									r->gbuffer.GetHeight () >> 5);
-		minmaxdepthpipeline.Bind ();
-
-		r->windowgrid.sampler.Bind (0);
-		r->gbuffer.depthbuffer.Bind (GL_TEXTURE0, GL_TEXTURE_2D);
-
-		r->windowgrid.sampler.Bind (1);
-		r->gbuffer.fragidx.Bind (GL_TEXTURE1, GL_TEXTURE_2D);
-
-		r->windowgrid.sampler.Bind (2);
-		r->gbuffer.fraglisttex.Bind (GL_TEXTURE2, GL_TEXTURE_BUFFER);
-
-		gl::BlendFunc (GL_SRC_COLOR, GL_DST_COLOR);
-		gl::BlendEquationi (0, GL_MIN);
-		gl::BlendEquationi (1, GL_MAX);
-		gl::Enable (GL_BLEND);
-
-		for (auto y = 0; y < 32; y++)
-		{
-			for (auto x = 0; x < 32; x++)
-			{
-				minmaxdepthprog["offset"] = glm::uvec2 (x, y);
-				r->windowgrid.Render ();
-			}
-		}
-
-		gl::Disable (GL_BLEND);
-
-		lightcullfb.Bind (GL_FRAMEBUFFER);
-		gl::Viewport (0, 0, r->gbuffer.GetWidth (),
-									r->gbuffer.GetHeight ());
-		
-		GLuint *ptr = (GLuint*) numlights.MapRange
-			 (0, sizeof (GLuint) * (r->gbuffer.GetWidth () >> 5)
-				* (r->gbuffer.GetHeight () >> 5),
-				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT
-				| GL_MAP_UNSYNCHRONIZED_BIT);
-		for (auto i = 0; i < (r->gbuffer.GetWidth () >> 5)
-						* (r->gbuffer.GetHeight () >> 5); i++)
-		{
-			ptr[i] = 0;
-		}
-		numlights.Unmap ();
-		lightcullpipeline.Bind ();
-
-		lightcullprog["vmatinv"] = glm::inverse (r->camera.GetViewMatrix ());
-		lightcullprog["projinfo"] = r->camera.GetProjInfo ();
-
-		numlights.BindBase (GL_ATOMIC_COUNTER_BUFFER, 0);
-		mindepthtex.Bind (GL_TEXTURE0, GL_TEXTURE_2D);
-		maxdepthtex.Bind (GL_TEXTURE1, GL_TEXTURE_2D);
-		lightbuffertex.Bind (GL_TEXTURE2, GL_TEXTURE_BUFFER);
-		lighttex.BindImage (0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R16UI);
-		r->windowgrid.Render ();
-	}
-
-
+	r->graph.Attach (framebuffer, GL_COLOR_ATTACHMENT1, glowmap);
 	framebuffer.Bind (GL_FRAMEBUFFER);
 	pipeline.Bind ();
 
-	fprogram["vmatinv"] = glm::inverse (r->camera.GetViewMatrix ());
-	fprogram["projinfo"] = r->camera.GetProjInfo ();
+	fprograms[lightculling]["vmatinv"]
+		 = glm::inverse (r->camera.GetViewMatrix ());
+	fprograms[lightculling]["projinfo"] = r->camera.GetProjInfo ();
 
 	gl::Viewport (0, 0, r->gbuffer.GetWidth (),
 								r->gbuffer.GetHeight ());
@@ -617,13 +655,31 @@ void Composition::Frame (float timefactor)
 	r->windowgrid.sampler.Bind (9);
 	r->GetParameterTexture ().Bind (GL_TEXTURE9, GL_TEXTURE_BUFFER);
 
+	if (lightculling == LightCulling::Clustered)
+	{
+		r->windowgrid.sampler.Bind (10);
+		clusters.GetGridTexture ().Bind (GL_TEXTURE10, GL_TEXTURE_BUFFER);
+
+		r->windowgrid.sampler.Bind (11);
+		clusters.GetIndexTexture ().Bind (GL_TEXTURE11, GL_TEXTURE_BUFFER);
+	}
+
 	r->windowgrid.Render ();
 
 	gl::Framebuffer::Unbind (GL_FRAMEBUFFER);
+}
 
+void Composition::DownsampleGlow (void)
+{
 	if (glow.GetSize () > 0)
 	{
-		glowmap.GenerateMipmap (GL_TEXTURE_2D);
-		glow.Apply ();
+		r->graph.GetTexture (glowmap).GenerateMipmap (GL_TEXTURE_2D);
+		glow.Downsample ();
 	}
 }
+
+void Composition::ApplyGlow (void)
+{
+	if (glow.GetSize () > 0)
+		 glow.Apply ();
+}
@@ -16,9 +16,11 @@
  */
 #include "culling.h"
 #include "renderer.h"
+#include <algorithm>
 
 Culling::Culling (void)
 {
+	receivers.enabled = false;
 }
 
 Culling::~Culling (void)
@@ -28,13 +30,13 @@ Culling::~Culling (void)
 void Culling::Frame (void)
 {
 	projmat = mvmat = glm::mat4 (1.0f);
+	receivers.enabled = false;
 	culled = 0;
 }
 
 void Culling::SetProjMatrix (const glm::mat4 &mat)
 {
 	projmat = mat;
-	r->geometry.SetProjMatrix (mat);
 }
 
 const glm::mat4 &Culling::GetProjMatrix (void)
@@ -52,6 +54,31 @@ const glm::mat4 &Culling::GetModelViewMatrix (void)
 	return mvmat;
 }
 
+void Culling::SetReceiverFrustum (const glm::mat4 &mat, bool perspective,
+																	float range)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		// left, right, bottom, top, near and far plane
+		float sign = (i & 1) ? -1.0f : 1.0f;
+		int axis = i >> 1;
+		glm::vec4 &plane = receivers.planes[i];
+		plane.x = mat[0].w + sign * mat[0][axis];
+		plane.y = mat[1].w + sign * mat[1][axis];
+		plane.z = mat[2].w + sign * mat[2][axis];
+		plane.w = mat[3].w + sign * mat[3][axis];
+		plane /= glm::length (glm::vec3 (plane));
+	}
+	receivers.perspective = perspective;
+	receivers.range = range;
+	receivers.enabled = true;
+}
+
+void Culling::ClearReceiverFrustum (void)
+{
+	receivers.enabled = false;
+}
+
 bool Culling::IsVisible (const glm::vec3 &center, float radius)
 {
 	glm::mat4 mvpmat;
@@ -145,5 +172,35 @@ bool Culling::IsVisible (const glm::vec3 &center, float radius)
 		return false;
 	}
 
+	if (receivers.enabled)
+	{
+		// sweep the sphere away from the light up to the far plane;
+		// model view matrices are rigid, so the radius is unchanged
+		glm::vec3 start = glm::vec3 (mvmat * glm::vec4 (center, 1.0f));
+		glm::vec3 end = start;
+		if (receivers.perspective)
+		{
+			float length = glm::length (start);
+			if (length > 0.0f && length < receivers.range)
+				 end *= receivers.range / length;
+		}
+		else
+		{
+			end.z = std::min (end.z, -receivers.range);
+		}
+
+		// the capsule can only be rejected, if both of its ends
+		// lie outside of the same plane of the receiver frustum
+		for (const glm::vec4 &plane : receivers.planes)
+		{
+			if (glm::dot (glm::vec3 (plane), start) + plane.w <= -radius
+					&& glm::dot (glm::vec3 (plane), end) + plane.w <= -radius)
+			{
+				culled++;
+				return false;
+			}
+		}
+	}
+
 	return true;
 }
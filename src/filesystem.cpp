@@ -0,0 +1,395 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "filesystem.h"
+#include "profiler.h"
+#include <cstring>
+#include <zlib.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char magic[8] = { 'P', 'C', 'H', 'P', 'A', 'C', 'K', 0x00 };
+const uint32_t version = 1;
+
+} /* anonymous namespace */
+
+constexpr uint32_t FileSystem::Flags::Compressed;
+constexpr uint32_t FileSystem::None;
+constexpr uint64_t FileSystem::PackAlignment;
+
+MappedFile::MappedFile (void) : data (NULL), size (0)
+#ifdef _WIN32
+	,file (INVALID_HANDLE_VALUE), mapping (NULL)
+#endif
+{
+}
+
+MappedFile::~MappedFile (void)
+{
+	Close ();
+}
+
+bool MappedFile::Open (const std::string &filename)
+{
+	Close ();
+
+#ifdef _WIN32
+	file = CreateFileA (filename.c_str (), GENERIC_READ, FILE_SHARE_READ,
+											NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		 return false;
+	LARGE_INTEGER filesize;
+	if (!GetFileSizeEx (file, &filesize))
+	{
+		Close ();
+		return false;
+	}
+	// empty files can't be mapped
+	if (filesize.QuadPart == 0)
+		 return true;
+	mapping = CreateFileMapping (file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+	{
+		Close ();
+		return false;
+	}
+	data = reinterpret_cast<const char*>
+		 (MapViewOfFile (mapping, FILE_MAP_READ, 0, 0, 0));
+	if (data == NULL)
+	{
+		Close ();
+		return false;
+	}
+	size = filesize.QuadPart;
+#else
+	int fd = open (filename.c_str (), O_RDONLY);
+	if (fd < 0)
+		 return false;
+	struct stat st;
+	if (fstat (fd, &st) || !S_ISREG (st.st_mode))
+	{
+		close (fd);
+		return false;
+	}
+	// empty files can't be mapped
+	if (st.st_size == 0)
+	{
+		close (fd);
+		return true;
+	}
+	void *ptr = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close (fd);
+	if (ptr == MAP_FAILED)
+		 return false;
+	data = reinterpret_cast<const char*> (ptr);
+	size = st.st_size;
+#endif
+	return true;
+}
+
+void MappedFile::Close (void)
+{
+#ifdef _WIN32
+	if (data != NULL)
+		 UnmapViewOfFile (data);
+	if (mapping != NULL)
+		 CloseHandle (mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		 CloseHandle (file);
+	mapping = NULL;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if (data != NULL)
+		 munmap (const_cast<char*> (data), size);
+#endif
+	data = NULL;
+	size = 0;
+}
+
+const char *MappedFile::GetData (void) const
+{
+	return data;
+}
+
+size_t MappedFile::GetSize (void) const
+{
+	return size;
+}
+
+void FileSystem::File::Buffer::Set (const char *data, size_t size)
+{
+	char *ptr = const_cast<char*> (data);
+	setg (ptr, ptr, ptr + size);
+}
+
+std::streambuf::pos_type
+FileSystem::File::Buffer::seekoff (off_type off, std::ios_base::seekdir dir,
+																	 std::ios_base::openmode which)
+{
+	if (!(which & std::ios_base::in))
+		 return pos_type (off_type (-1));
+	off_type pos;
+	if (dir == std::ios_base::beg)
+		 pos = off;
+	else if (dir == std::ios_base::cur)
+		 pos = (gptr () - eback ()) + off;
+	else
+		 pos = (egptr () - eback ()) + off;
+	if (pos < 0 || pos > egptr () - eback ())
+		 return pos_type (off_type (-1));
+	setg (eback (), eback () + pos, egptr ());
+	return pos_type (pos);
+}
+
+std::streambuf::pos_type
+FileSystem::File::Buffer::seekpos (pos_type pos, std::ios_base::openmode which)
+{
+	return seekoff (off_type (pos), std::ios_base::beg, which);
+}
+
+FileSystem::File::File (void) : data (""), size (0), stream (&streambuffer)
+{
+}
+
+FileSystem::File::~File (void)
+{
+}
+
+void FileSystem::File::Set (const char *d, size_t s)
+{
+	data = (d != NULL) ? d : "";
+	size = s;
+	streambuffer.Set (data, size);
+	stream.clear ();
+}
+
+void FileSystem::File::Close (void)
+{
+	Set (NULL, 0);
+	mapping.Close ();
+	buffer.clear ();
+	buffer.shrink_to_fit ();
+}
+
+const char *FileSystem::File::GetData (void) const
+{
+	return data;
+}
+
+size_t FileSystem::File::GetSize (void) const
+{
+	return size;
+}
+
+std::istream &FileSystem::File::GetStream (void)
+{
+	return stream;
+}
+
+FileSystem::FileSystem (void)
+	: directory (NULL), numbuckets (0), strings (NULL), stringsize (0),
+		packtime (0)
+{
+}
+
+FileSystem::~FileSystem (void)
+{
+}
+
+uint64_t FileSystem::Hash (const std::string &path)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (unsigned char c : path)
+	{
+		hash ^= c;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+bool FileSystem::Init (void)
+{
+	basedir = MakePath ("");
+
+	if (!config["pack"])
+		 return true;
+
+	std::string filename = config["pack"].as<std::string> ();
+	if (!pack.Open (filename))
+	{
+		(*logstream) << "Cannot open the pack file " << filename
+								 << "." << std::endl;
+		return false;
+	}
+
+	const char *data = pack.GetData ();
+	size_t size = pack.GetSize ();
+	if (size < sizeof (PackHeader))
+	{
+		(*logstream) << filename << " is no valid pack file." << std::endl;
+		pack.Close ();
+		return false;
+	}
+
+	const PackHeader &header = *reinterpret_cast<const PackHeader*> (data);
+	if (memcmp (header.magic, magic, 8) || header.version != version
+			|| header.numbuckets == 0
+			|| (header.numbuckets & (header.numbuckets - 1))
+			|| header.directory > size
+			|| header.numbuckets > (size - header.directory) / sizeof (PackEntry)
+			|| header.directory % sizeof (uint64_t)
+			|| header.strings > size || header.stringsize == 0
+			|| header.stringsize > size - header.strings
+			|| data[header.strings + header.stringsize - 1] != 0)
+	{
+		(*logstream) << filename << " is no valid pack file." << std::endl;
+		pack.Close ();
+		return false;
+	}
+
+	struct stat st;
+	if (!stat (filename.c_str (), &st))
+		 packtime = st.st_mtime;
+
+	directory = reinterpret_cast<const PackEntry*> (data + header.directory);
+	numbuckets = header.numbuckets;
+	strings = data + header.strings;
+	stringsize = header.stringsize;
+
+	GLuint numfiles = 0;
+	for (uint32_t i = 0; i < numbuckets; i++)
+	{
+		if (directory[i].name != None)
+			 numfiles++;
+	}
+	(*logstream) << "Opened the pack file " << filename << " containing "
+							 << numfiles << " files." << std::endl;
+
+	return true;
+}
+
+const FileSystem::PackEntry *FileSystem::Find (const std::string &path) const
+{
+	uint64_t hash = Hash (path);
+	for (uint32_t i = 0; i < numbuckets; i++)
+	{
+		const PackEntry &entry = directory[(hash + i) & (numbuckets - 1)];
+		if (entry.name == None)
+			 return NULL;
+		if (entry.hash == hash && entry.name < stringsize
+				&& !path.compare (strings + entry.name))
+			 return &entry;
+	}
+	return NULL;
+}
+
+bool FileSystem::Load (const PackEntry &entry, File &file) const
+{
+	size_t size = pack.GetSize ();
+	if (entry.offset > size || entry.storedsize > size - entry.offset)
+		 return false;
+	const char *data = pack.GetData () + entry.offset;
+
+	if (!(entry.flags & Flags::Compressed))
+	{
+		if (entry.storedsize != entry.size)
+			 return false;
+		file.Set (data, entry.size);
+		return true;
+	}
+
+	Profiler::Scope scope ("decompress", strings + entry.name);
+	file.buffer.resize (entry.size);
+	uLongf length = entry.size;
+	if (uncompress (reinterpret_cast<Bytef*> (file.buffer.data ()), &length,
+									reinterpret_cast<const Bytef*> (data),
+									entry.storedsize) != Z_OK
+			|| length != entry.size)
+	{
+		file.buffer.clear ();
+		return false;
+	}
+	file.Set (file.buffer.data (), entry.size);
+	return true;
+}
+
+bool FileSystem::GetPackPath (const std::string &filename,
+															std::string &path) const
+{
+	if (directory == NULL || filename.compare (0, basedir.length (), basedir))
+		 return false;
+	path.assign (filename, basedir.length (), std::string::npos);
+	// pack files always use forward slashes
+	for (char &c : path)
+	{
+		if (c == DIR_SEPARATOR)
+			 c = '/';
+	}
+	return true;
+}
+
+bool FileSystem::Stat (const std::string &filename, uint64_t &size,
+											 int64_t &mtime) const
+{
+	std::string path;
+	if (GetPackPath (filename, path))
+	{
+		const PackEntry *entry = Find (path);
+		if (entry != NULL)
+		{
+			size = entry->size;
+			mtime = packtime;
+			return true;
+		}
+	}
+
+	struct stat st;
+	if (stat (filename.c_str (), &st))
+		 return false;
+	size = st.st_size;
+	mtime = st.st_mtime;
+	return true;
+}
+
+bool FileSystem::Open (const std::string &filename, File &file) const
+{
+	file.Close ();
+
+	std::string path;
+	if (GetPackPath (filename, path))
+	{
+		const PackEntry *entry = Find (path);
+		if (entry != NULL)
+		{
+			if (Load (*entry, file))
+				 return true;
+			(*logstream) << "The entry " << path << " of the pack file "
+									 << "is corrupt." << std::endl;
+			return false;
+		}
+	}
+
+	if (!file.mapping.Open (filename))
+		 return false;
+	file.Set (file.mapping.GetData (), file.mapping.GetSize ());
+	return true;
+}
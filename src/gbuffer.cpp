@@ -30,62 +30,76 @@ GBuffer::~GBuffer (void)
 
 bool GBuffer::Init (void)
 {
-	if (!LoadProgram (quadtessprog, MakePath ("shaders", "bin",
-																					 "gbuffer_quadtess.bin"),
-										{ {"#version 420 core\n#define NUM_VERTICES 20\n"} },
-										{ std::make_pair (GL_TESS_CONTROL_SHADER,
-																			MakePath ("shaders", "gbuffer",
-																								"tess", "control.txt")),
-												 std::make_pair (GL_TESS_EVALUATION_SHADER,
-																				 MakePath ("shaders", "gbuffer",
-																									 "tess", "quadeval.txt")),
-												 std::make_pair (GL_VERTEX_SHADER,
-																				 MakePath ("shaders", "gbuffer",
-																									 "tess", "vshader.txt")),
-												 std::make_pair (GL_FRAGMENT_SHADER,
-																				 MakePath ("shaders", "gbuffer",
-																									 "tess", "fshader.txt")) }))
+	// the fragment shaders sample the material textures, the
+	// tessellation evaluation shaders the height and displacement maps
+	const GLuint texturemaps = ShaderFeatures::DiffuseMap
+		 | ShaderFeatures::NormalMap | ShaderFeatures::SpecularMap
+		 | ShaderFeatures::ParameterMap;
+	const GLuint displacementmaps = ShaderFeatures::HeightMap
+		 | ShaderFeatures::DisplacementMap;
+	std::set<GLuint> features (r->geometry.GetFeatures ());
+
+	if (!quadtessprog.Load (MakePath ("shaders", "bin", "gbuffer_quadtess.bin"),
+													texturemaps | displacementmaps, features,
+													{ {"#version 420 core\n#define NUM_VERTICES 20\n"} },
+													{ std::make_pair (GL_TESS_CONTROL_SHADER,
+																						MakePath ("shaders", "tess",
+																											"control.txt")),
+															 std::make_pair (GL_TESS_EVALUATION_SHADER,
+																							 MakePath ("shaders", "gbuffer",
+																												 "tess", "quadeval.txt")),
+															 std::make_pair (GL_VERTEX_SHADER,
+																							 MakePath ("shaders", "tess",
+																												 "vshader.txt")),
+															 std::make_pair (GL_FRAGMENT_SHADER,
+																							 MakePath ("shaders", "gbuffer",
+																												 "tess", "fshader.txt")) }))
 		 return false;
-	if (!LoadProgram (triangletessprog, MakePath ("shaders", "bin",
-																					 "gbuffer_triangletess.bin"),
-										{ {"#version 420 core\n#define NUM_VERTICES 15\n"} },
-										{ std::make_pair (GL_TESS_CONTROL_SHADER,
-																			MakePath ("shaders", "gbuffer",
-																								"tess", "control.txt")),
-												 std::make_pair (GL_TESS_EVALUATION_SHADER,
-																				 MakePath ("shaders", "gbuffer",
-																									 "tess", "triangleeval.txt")),
-												 std::make_pair (GL_VERTEX_SHADER,
-																				 MakePath ("shaders", "gbuffer",
-																									 "tess", "vshader.txt")),
-												 std::make_pair (GL_FRAGMENT_SHADER,
-																				 MakePath ("shaders", "gbuffer",
-																									 "tess", "fshader.txt")) }))
+	if (!triangletessprog.Load (MakePath ("shaders", "bin",
+																				"gbuffer_triangletess.bin"),
+															texturemaps | displacementmaps, features,
+															{ {"#version 420 core\n#define NUM_VERTICES 15\n"} },
+															{ std::make_pair (GL_TESS_CONTROL_SHADER,
+																								MakePath ("shaders", "tess",
+																													"control.txt")),
+																	 std::make_pair (GL_TESS_EVALUATION_SHADER,
+																									 MakePath ("shaders", "gbuffer",
+																														 "tess",
+																														 "triangleeval.txt")),
+																	 std::make_pair (GL_VERTEX_SHADER,
+																									 MakePath ("shaders", "tess",
+																														 "vshader.txt")),
+																	 std::make_pair (GL_FRAGMENT_SHADER,
+																									 MakePath ("shaders", "gbuffer",
+																														 "tess", "fshader.txt")) }))
 		 return false;
-	if (!LoadProgram (program, MakePath ("shaders", "bin", "gbuffer.bin"),
-										{}, {	std::make_pair (GL_VERTEX_SHADER,
+	if (!program.Load (MakePath ("shaders", "bin", "gbuffer.bin"),
+										 texturemaps, features,
+										 {}, {	std::make_pair (GL_VERTEX_SHADER,
+																					 MakePath ("shaders", "gbuffer",
+																										 "vshader.txt")),
+													std::make_pair (GL_FRAGMENT_SHADER,
 																					MakePath ("shaders", "gbuffer",
-																										"vshader.txt")),
-												 std::make_pair (GL_FRAGMENT_SHADER,
-																				 MakePath ("shaders", "gbuffer",
-																									 "fshader.txt")) }))
+																										"fshader.txt")) }))
 		 return false;
-	if (!LoadProgram (sraaprog, MakePath ("shaders", "bin", "gbuffer_sraa.bin"),
-										{}, {	std::make_pair (GL_VERTEX_SHADER,
-																					MakePath ("shaders", "gbuffer",
-																										"vshader.txt")),
-												 std::make_pair (GL_FRAGMENT_SHADER,
-																				 MakePath ("shaders", "gbuffer",
-																									 "sraa.txt")) }))
+	if (!sraaprog.Load (MakePath ("shaders", "bin", "gbuffer_sraa.bin"),
+											0, features,
+											{}, {	std::make_pair (GL_VERTEX_SHADER,
+																						MakePath ("shaders", "gbuffer",
+																											"vshader.txt")),
+													 std::make_pair (GL_FRAGMENT_SHADER,
+																					 MakePath ("shaders", "gbuffer",
+																										 "sraa.txt")) }))
 		 return false;
-	if (!LoadProgram (transparencyprog,
-										MakePath ("shaders", "bin", "gbuffer_transparency.bin"),
-										{}, {	std::make_pair (GL_VERTEX_SHADER,
-																					MakePath ("shaders", "gbuffer",
-																										"vshader.txt")),
-												 std::make_pair (GL_FRAGMENT_SHADER,
-																				 MakePath ("shaders", "gbuffer",
-																									 "transparency.txt")) }))
+	if (!transparencyprog.Load (MakePath ("shaders", "bin",
+																				"gbuffer_transparency.bin"),
+															texturemaps, features,
+															{}, {	std::make_pair (GL_VERTEX_SHADER,
+																										MakePath ("shaders", "gbuffer",
+																															"vshader.txt")),
+																	 std::make_pair (GL_FRAGMENT_SHADER,
+																									 MakePath ("shaders", "gbuffer",
+																														 "transparency.txt")) }))
 		 return false;
 
 	width = config["gbuffer"]["width"].as<GLuint> ();
@@ -149,21 +163,21 @@ bool GBuffer::Init (void)
 				 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
 	counter.Data (sizeof (GLuint) * 64, counters, GL_DYNAMIC_DRAW);
 
-	program["viewport"] = glm::uvec2 (width, height);
-	program["farClipPlane"] = r->camera.GetFarClipPlane ();
-	program["nearClipPlane"] = r->camera.GetNearClipPlane ();
-	quadtessprog["viewport"] = glm::uvec2 (width, height);
-	quadtessprog["farClipPlane"] = r->camera.GetFarClipPlane ();
-	quadtessprog["nearClipPlane"] = r->camera.GetNearClipPlane ();
-	triangletessprog["viewport"] = glm::uvec2 (width, height);
-	triangletessprog["farClipPlane"] = r->camera.GetFarClipPlane ();
-	triangletessprog["nearClipPlane"] = r->camera.GetNearClipPlane ();
-	transparencyprog["viewport"] = glm::uvec2 (width, height);
-	transparencyprog["farClipPlane"] = r->camera.GetFarClipPlane ();
-	transparencyprog["nearClipPlane"] = r->camera.GetNearClipPlane ();
-	sraaprog["viewport"] = glm::uvec2 (width, height);
-	sraaprog["farClipPlane"] = r->camera.GetFarClipPlane ();
-	sraaprog["nearClipPlane"] = r->camera.GetNearClipPlane ();
+	program.Set ("viewport", glm::uvec2 (width, height));
+	program.Set ("farClipPlane", r->camera.GetFarClipPlane ());
+	program.Set ("nearClipPlane", r->camera.GetNearClipPlane ());
+	quadtessprog.Set ("viewport", glm::uvec2 (width, height));
+	quadtessprog.Set ("farClipPlane", r->camera.GetFarClipPlane ());
+	quadtessprog.Set ("nearClipPlane", r->camera.GetNearClipPlane ());
+	triangletessprog.Set ("viewport", glm::uvec2 (width, height));
+	triangletessprog.Set ("farClipPlane", r->camera.GetFarClipPlane ());
+	triangletessprog.Set ("nearClipPlane", r->camera.GetNearClipPlane ());
+	transparencyprog.Set ("viewport", glm::uvec2 (width, height));
+	transparencyprog.Set ("farClipPlane", r->camera.GetFarClipPlane ());
+	transparencyprog.Set ("nearClipPlane", r->camera.GetNearClipPlane ());
+	sraaprog.Set ("viewport", glm::uvec2 (width, height));
+	sraaprog.Set ("farClipPlane", r->camera.GetFarClipPlane ());
+	sraaprog.Set ("nearClipPlane", r->camera.GetNearClipPlane ());
 
 	wireframe = false;
 
@@ -221,11 +235,11 @@ GLuint GBuffer::GetHeight (void)
 
 void GBuffer::SetProjMatrix (const glm::mat4 &projmat)
 {
-	program["projmat"] = projmat;
-	quadtessprog["projmat"] = projmat;	
-	triangletessprog["projmat"] = projmat;	
-	transparencyprog["projmat"] = projmat;
-	sraaprog["projmat"] = projmat;	
+	program.Set ("projmat", projmat);
+	quadtessprog.Set ("projmat", projmat);	
+	triangletessprog.Set ("projmat", projmat);	
+	transparencyprog.Set ("projmat", projmat);
+	sraaprog.Set ("projmat", projmat);	
 }
 
 void GBuffer::Render (Geometry &geometry)
@@ -239,8 +253,6 @@ void GBuffer::Render (Geometry &geometry)
 	gl::DepthMask (GL_TRUE);
 	gl::DepthFunc (GL_LESS);
 
-	program.Use ();
-
 	framebuffer.Bind (GL_FRAMEBUFFER);
 	gl::Viewport (0, 0, width, height);
 		
@@ -249,18 +261,32 @@ void GBuffer::Render (Geometry &geometry)
 	gl::ClearBufferfv (GL_COLOR, 2, (const float[]) {0.0f, 0.0f, 0.0f, 0.0f} );
 	gl::ClearBufferfv (GL_DEPTH, 0, (const float[]) {1.0f});
 
-	geometry.Render (Geometry::Pass::GBuffer,
-									 program, r->camera.GetViewMatrix ());
+	geometry.Enqueue (Geometry::Pass::GBuffer,
+										program, r->camera.GetViewMatrix (),
+										r->culling);
+	geometry.Enqueue (Geometry::Pass::GBufferQuadTess,
+										quadtessprog, r->camera.GetViewMatrix (),
+										r->culling);
+	geometry.Enqueue (Geometry::Pass::GBufferTriangleTess,
+										triangletessprog, r->camera.GetViewMatrix (),
+										r->culling);
+	geometry.Flush ();
 
-	quadtessprog.Use ();
-	geometry.Render (Geometry::Pass::GBufferQuadTess,
-									 quadtessprog, r->camera.GetViewMatrix ());
+	gl::Framebuffer::Unbind (GL_FRAMEBUFFER);
 
-	triangletessprog.Use ();
-	geometry.Render (Geometry::Pass::GBufferTriangleTess,
-									 triangletessprog, r->camera.GetViewMatrix ());
+	if (wireframe)
+		 gl::PolygonMode (GL_FRONT_AND_BACK, GL_FILL);
 
-	transparencyprog.Use ();
+	GL_CHECK_ERROR;
+}
+
+void GBuffer::RenderTransparency (Geometry &geometry)
+{
+	if (wireframe)
+		 gl::PolygonMode (GL_FRONT_AND_BACK, GL_LINE);
+
+	gl::Enable (GL_DEPTH_TEST);
+	gl::DepthFunc (GL_LESS);
 
 	gl::DepthMask (GL_FALSE);
 
@@ -276,24 +302,41 @@ void GBuffer::Render (Geometry &geometry)
 	fragidx.BindImage (1, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32I);
 	counter.BindBase (GL_ATOMIC_COUNTER_BUFFER, 0);
 	geometry.Render (Geometry::Pass::GBufferTransparency,
-									 transparencyprog, r->camera.GetViewMatrix ());
+									 transparencyprog, r->camera.GetViewMatrix (),
+									 r->culling);
 
 	GLuint data = 0;
 	counter.ClearData (GL_R32UI, GL_RED, GL_UNSIGNED_INT, &data);
 
-	sraaprog.Use ();
+	gl::Framebuffer::Unbind (GL_FRAMEBUFFER);
+	gl::Program::UseNone ();
 
-	if (r->GetAntialiasing ())
-	{
-		gl::DepthMask (GL_TRUE);
-		multisamplefb.Bind (GL_FRAMEBUFFER);
-		gl::Viewport (0, 0, width, height);
-		gl::ClearBufferfv (GL_DEPTH, 0, (const float[]) {1.0f});
-			
-		geometry.Render (Geometry::Pass::GBufferSRAA,
-										 sraaprog, r->camera.GetViewMatrix ());
-		gl::DepthMask (GL_FALSE);
-	}
+	if (wireframe)
+		 gl::PolygonMode (GL_FRONT_AND_BACK, GL_FILL);
+
+	GL_CHECK_ERROR;
+}
+
+void GBuffer::RenderSRAA (Geometry &geometry)
+{
+	if (!r->GetAntialiasing ())
+		 return;
+
+	if (wireframe)
+		 gl::PolygonMode (GL_FRONT_AND_BACK, GL_LINE);
+
+	gl::Enable (GL_DEPTH_TEST);
+	gl::DepthFunc (GL_LESS);
+	gl::DepthMask (GL_TRUE);
+
+	multisamplefb.Bind (GL_FRAMEBUFFER);
+	gl::Viewport (0, 0, width, height);
+	gl::ClearBufferfv (GL_DEPTH, 0, (const float[]) {1.0f});
+
+	geometry.Render (Geometry::Pass::GBufferSRAA,
+									 sraaprog, r->camera.GetViewMatrix (),
+									 r->culling);
+	gl::DepthMask (GL_FALSE);
 
 	gl::Framebuffer::Unbind (GL_FRAMEBUFFER);
 	gl::Program::UseNone ();
@@ -16,9 +16,37 @@
  */
 #include "geometry.h"
 #include "renderer.h"
+#include "profiler.h"
 #include <fstream>
-
-Geometry::Geometry (void)
+#include <algorithm>
+
+const Geometry::Pass Geometry::Pass::GBuffer = {
+	Model::Meshes::Opaque, RenderQueue::Layout::Triangles, false, true
+};
+const Geometry::Pass Geometry::Pass::GBufferTransparency = {
+	Model::Meshes::Transparent, RenderQueue::Layout::Triangles, false, true
+};
+const Geometry::Pass Geometry::Pass::GBufferSRAA = {
+	Model::Meshes::Opaque, RenderQueue::Layout::DepthOnly, false, true
+};
+const Geometry::Pass Geometry::Pass::GBufferQuadTess = {
+	Model::Meshes::Patches, RenderQueue::Layout::QuadPatches, false, true
+};
+const Geometry::Pass Geometry::Pass::GBufferTriangleTess = {
+	Model::Meshes::Patches, RenderQueue::Layout::TrianglePatches, false, true
+};
+const Geometry::Pass Geometry::Pass::ShadowMap = {
+	Model::Meshes::Opaque | Model::Meshes::Transparent,
+	RenderQueue::Layout::DepthOnly, true, false
+};
+const Geometry::Pass Geometry::Pass::ShadowMapQuadTess = {
+	Model::Meshes::Patches, RenderQueue::Layout::QuadPatches, true, false
+};
+const Geometry::Pass Geometry::Pass::ShadowMapTriangleTess = {
+	Model::Meshes::Patches, RenderQueue::Layout::TrianglePatches, true, false
+};
+
+Geometry::Geometry (void) : pass (&Pass::GBuffer)
 {
 }
 
@@ -41,51 +69,124 @@ const glm::vec3 &Geometry::GetBoxMax (void)
 	return boxmax;
 }
 
-const Material &Geometry::GetMaterial (const std::string &name)
+const Material *Geometry::GetMaterial (const std::string &name) const
 {
-	Material *material;
 	auto it = materials.find (name);
-	if (it != materials.end ())
+	if (it == materials.end ())
+		 return NULL;
+	return it->second;
+}
+
+bool Geometry::LoadMaterials (const std::set<std::string> &names)
+{
+	// only the description files are parsed on the thread pool,
+	// the materials request their textures on the main thread
+	std::vector<std::string> missing;
+	for (const std::string &name : names)
 	{
-		return *(it->second);
+		if (materials.find (name) == materials.end ())
+			 missing.push_back (name);
 	}
-	material = new Material;
-	if (!material->Load (name))
+
+	std::vector<Material::Description> descs (missing.size ());
+	for (GLuint i = 0; i < missing.size (); i++)
 	{
-		delete material;
-		throw std::runtime_error (std::string ("Cannot load the material ")
-															+ name + ".");
+		Material::Description *desc = &descs[i];
+		std::string name = missing[i];
+		r->threadpool.Run ([desc, name] (void) {
+				Material::Read (name, *desc);
+			});
+	}
+
+	try {
+		r->threadpool.Wait ();
+	} catch (std::exception &e) {
+		(*logstream) << e.what () << std::endl;
+		return false;
 	}
-	auto ret = materials.insert (std::make_pair(name, material));
-	if (!ret.second)
+
+	for (GLuint i = 0; i < missing.size (); i++)
 	{
-		delete material;
-		throw std::runtime_error (std::string ("Cannot add ") + name
-															+ " to the material list.");
+		Material *material = new Material;
+		materials[missing[i]] = material;
+		material->Setup (descs[i]);
 	}
-	return *ret.first->second;
+
+	return true;
 }
 
+std::set<GLuint> Geometry::GetFeatures (void) const
+{
+	std::set<GLuint> features;
+	for (auto it = materials.begin (); it != materials.end (); it++)
+		 features.insert (it->second->GetAllFeatures ());
+	return features;
+}
 
-bool Geometry::Init (void)
+
+bool Geometry::Init (const SceneSnapshot *snapshot)
 {
-	if (!LoadProgram (bboxprogram, MakePath ("shaders", "bin", "bbox.bin"),
-										{}, { std::make_pair (GL_VERTEX_SHADER,
-																					MakePath ("shaders", "bbox",
-																										"vshader.txt")),
-												 std::make_pair (GL_FRAGMENT_SHADER,
-																				 MakePath ("shaders", "bbox",
-																									 "fshader.txt")) }))
-		 return false;
+	if (!glfwExtensionSupported ("GL_ARB_shader_draw_parameters"))
+	{
+		(*logstream) << "GL_ARB_shader_draw_parameters is not supported."
+								 << std::endl;
+		return false;
+	}
 
 	sampler.Parameter (GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	sampler.Parameter (GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	sampler.Parameter (GL_TEXTURE_WRAP_S, GL_REPEAT);
 	sampler.Parameter (GL_TEXTURE_WRAP_T, GL_REPEAT);
 
-	std::ifstream file (MakePath ("scene.yaml"), std::ifstream::in);
+	if (snapshot != NULL)
+	{
+		if (!LoadSnapshot (*snapshot))
+			 return false;
+	}
+	else if (!LoadScene ())
+		 return false;
+
+	for (Model &model : models)
+	{
+		if (!model.Upload ())
+			 return false;
+	}
+
+	{
+		Profiler::Scope scope ("arena upload", "geometry");
+		arena.Upload ();
+	}
+
+	instances.resize (models.size ());
+	if (!queue.Init ())
+		 return false;
+
+	displacement = 0.0f;
+	tessLevel = 1;
+	gl::GetIntegerv (GL_MAX_TESS_GEN_LEVEL, &maxTessLevel);
+
+	{
+		const YAML::Node &tess = config["tessellation"];
+		const char *names[] = { "gbuffer", "shadowmap" };
+		for (int i = 0; i < 2; i++)
+		{
+			adaptivetess[i].enabled = tess[names[i]]["adaptive"].as<bool> (true);
+			SetPixelsPerEdge (i ? Pass::ShadowMap : Pass::GBuffer,
+												tess[names[i]]["pixelsperedge"].as<float>
+												(i ? 16.0f : 8.0f));
+		}
+		SetCurvatureBias (tess["curvaturebias"].as<float> (1.0f));
+		patchculling = tess["patchculling"].as<bool> (true);
+	}
+
+	return true;
+}
+
+bool Geometry::LoadScene (void)
+{
+	FileSystem::File file;
 	std::map<std::string, GLuint> names;
-	if (!file.is_open ())
+	if (!filesystem.Open (MakePath ("scene.yaml"), file))
 	{
 		(*logstream) << "Cannot open " << MakePath ("scene.yaml")
 								 << "." << std::endl;
@@ -93,7 +194,10 @@ bool Geometry::Init (void)
 	}
 
 	std::vector<YAML::Node> streams;
-	streams = YAML::LoadAll (file);
+	{
+		Profiler::Scope scope ("yaml", "scene.yaml");
+		streams = YAML::LoadAll (file.GetStream ());
+	}
 	if (streams.size () != 2)
 	{
 		(*logstream) << MakePath ("scene.yaml")
@@ -111,15 +215,41 @@ bool Geometry::Init (void)
 	{
 		YAML::Node modeldesc;
 		modeldesc = scene["models"];
+		std::vector<std::string> filenames;
 		GLuint id = 0;
 		for (YAML::const_iterator it = modeldesc.begin ();
 				 it != modeldesc.end (); it++)
 		{
 			names[it->first.as<std::string> ()] = id++;
-			models.emplace_back ();
-			if (!models.back ().Load (it->second.as<std::string> ()))
-				 return false;
+			filenames.push_back (it->second.as<std::string> ());
 		}
+
+		// file I/O and decoding run on the thread pool, the models
+		// must not move until they are uploaded
+		models.resize (filenames.size ());
+		for (GLuint i = 0; i < filenames.size (); i++)
+		{
+			Model *model = &models[i];
+			std::string filename = filenames[i];
+			r->threadpool.Run ([model, filename] (void) {
+					model->Read (filename);
+				});
+		}
+
+		try {
+			r->threadpool.Wait ();
+		} catch (std::exception &e) {
+			(*logstream) << e.what () << std::endl;
+			return false;
+		}
+	}
+
+	{
+		std::set<std::string> materialnames;
+		for (const Model &model : models)
+			 model.GetMaterials (materialnames);
+		if (!LoadMaterials (materialnames))
+			 return false;
 	}
 
 	try {
@@ -133,13 +263,93 @@ bool Geometry::Init (void)
 
 	root.Load (names, streams[1]);
 
-	displacement = 0.0f;
-	tessLevel = 1;
-	gl::GetIntegerv (GL_MAX_TESS_GEN_LEVEL, &maxTessLevel);
+	return true;
+}
+
+bool Geometry::LoadSnapshot (const SceneSnapshot &snapshot)
+{
+	const SceneSnapshot::Header &header = snapshot.GetHeader ();
+
+	// the materials are created up front, so that the
+	// models find them without reading the material files
+	{
+		const SceneSnapshot::Material *desc = snapshot.GetMaterials ();
+		for (GLuint i = 0; i < header.materials.count; i++, desc++)
+		{
+			std::string name (snapshot.GetString (desc->name));
+			Material::Description material;
+			material.transparent = desc->flags & SceneSnapshot::Flags::Transparent;
+			material.doublesided = desc->flags & SceneSnapshot::Flags::DoubleSided;
+			for (int j = 0; j < 6; j++)
+			{
+				if (desc->textures[j] != SceneSnapshot::None)
+					 material.textures[j] = snapshot.GetString (desc->textures[j]);
+			}
+			if (materials.find (name) != materials.end ())
+				 continue;
+			materials[name] = new Material;
+			materials[name]->Setup (material);
+		}
+	}
+
+	// only the meshes are read on the thread pool,
+	// the model descriptions are part of the snapshot
+	models.resize (header.models.count);
+	for (GLuint i = 0; i < models.size (); i++)
+	{
+		if (!models[i].Read (snapshot, i))
+			 return false;
+	}
+
+	try {
+		r->threadpool.Wait ();
+	} catch (std::exception &e) {
+		(*logstream) << e.what () << std::endl;
+		return false;
+	}
+
+	boxmin = glm::vec3 (header.boxmin[0], header.boxmin[1], header.boxmin[2]);
+	boxmax = glm::vec3 (header.boxmax[0], header.boxmax[1], header.boxmax[2]);
+
+	if (header.nodes.count > 0)
+		 root.Load (snapshot, 0);
 
 	return true;
 }
 
+void Geometry::Export (SceneSnapshot::Writer &writer) const
+{
+	writer.AddInput ("scene.yaml");
+	writer.boxmin = boxmin;
+	writer.boxmax = boxmax;
+
+	root.Export (writer);
+
+	for (const Model &model : models)
+		 model.Export (writer);
+
+	for (auto it = materials.begin (); it != materials.end (); it++)
+	{
+		const Material *material = it->second;
+		SceneSnapshot::Material desc;
+		writer.AddInput (ConcatPath ("materials", it->first + ".yaml"));
+		desc.name = writer.AddString (it->first);
+		desc.flags = 0;
+		if (material->transparent)
+			 desc.flags |= SceneSnapshot::Flags::Transparent;
+		if (material->doublesided)
+			 desc.flags |= SceneSnapshot::Flags::DoubleSided;
+		for (int i = 0; i < 6; i++)
+		{
+			if (material->textures[i].empty ())
+				 desc.textures[i] = SceneSnapshot::None;
+			else
+				 desc.textures[i] = writer.AddString (material->textures[i]);
+		}
+		writer.materials.push_back (desc);
+	}
+}
+
 void Geometry::SetTessLevel (GLuint l)
 {
 	if (l < maxTessLevel)
@@ -170,6 +380,51 @@ void Geometry::SetDisplacement (float d)
 	}
 }
 
+bool Geometry::GetAdaptiveTessellation (const Pass &pass) const
+{
+	return adaptivetess[pass.shadowmap].enabled;
+}
+
+void Geometry::SetAdaptiveTessellation (const Pass &pass, bool a)
+{
+	adaptivetess[pass.shadowmap].enabled = a;
+}
+
+float Geometry::GetPixelsPerEdge (const Pass &pass) const
+{
+	return adaptivetess[pass.shadowmap].pixelsperedge;
+}
+
+void Geometry::SetPixelsPerEdge (const Pass &pass, float p)
+{
+	if (p < 1.0f)
+		 p = 1.0f;
+	adaptivetess[pass.shadowmap].pixelsperedge = p;
+}
+
+float Geometry::GetCurvatureBias (void) const
+{
+	return curvaturebias;
+}
+
+void Geometry::SetCurvatureBias (float b)
+{
+	if (b >= 0)
+		 curvaturebias = b;
+	else
+		 curvaturebias = 0.0f;
+}
+
+bool Geometry::GetPatchCulling (void) const
+{
+	return patchculling;
+}
+
+void Geometry::SetPatchCulling (bool c)
+{
+	patchculling = c;
+}
+
 Geometry::Node::Node (void)
 {
 }
@@ -226,9 +481,56 @@ void Geometry::Node::Load (std::map<std::string, GLuint> &names,
 	}
 }
 
-void Geometry::Node::Render (Geometry *geometry,
-														 glm::mat4 parentmvmat,
-														 glm::mat3 rotation)
+GLuint Geometry::Node::Load (const SceneSnapshot &snapshot, GLuint index)
+{
+	const SceneSnapshot::Node &desc = snapshot.GetNodes ()[index++];
+
+	// the children directly follow their parent
+	children.resize (desc.numchildren);
+	for (Node &child : children)
+	{
+		if (index >= snapshot.GetHeader ().nodes.count)
+			 throw std::runtime_error ("The scene snapshot contains an invalid "
+																 "node hierarchy.");
+		index = child.Load (snapshot, index);
+	}
+
+	const uint32_t *nodemodels = snapshot.GetNodeModels () + desc.firstmodel;
+	models.assign (nodemodels, nodemodels + desc.nummodels);
+
+	translation = glm::vec3 (desc.translation[0], desc.translation[1],
+													 desc.translation[2]);
+	orientation = glm::quat (desc.orientation[0], desc.orientation[1],
+													 desc.orientation[2], desc.orientation[3]);
+
+	return index;
+}
+
+void Geometry::Node::Export (SceneSnapshot::Writer &writer) const
+{
+	SceneSnapshot::Node desc;
+	desc.numchildren = children.size ();
+	desc.firstmodel = writer.nodemodels.size ();
+	desc.nummodels = models.size ();
+	for (int i = 0; i < 3; i++)
+		 desc.translation[i] = translation[i];
+	desc.orientation[0] = orientation.w;
+	desc.orientation[1] = orientation.x;
+	desc.orientation[2] = orientation.y;
+	desc.orientation[3] = orientation.z;
+
+	writer.nodes.push_back (desc);
+	writer.nodemodels.insert (writer.nodemodels.end (),
+														models.begin (), models.end ());
+
+	for (const Node &child : children)
+		 child.Export (writer);
+}
+
+void Geometry::Node::Traverse (const std::function<void (GLuint, glm::mat4&,
+																												 glm::mat3&)> &func,
+															 glm::mat4 parentmvmat,
+															 glm::mat3 rotation)
 {
 	glm::mat4 mvmat = glm::translate (parentmvmat,
 																		translation)
@@ -238,56 +540,131 @@ void Geometry::Node::Render (Geometry *geometry,
 
 	for (Node &node : children)
 	{
-		node.Render (geometry, mvmat, rotation);
+		node.Traverse (func, mvmat, rotation);
 	}
 
 	for (GLuint &model : models)
 	{
-		geometry->Render (model, mvmat, rotation);
+		func (model, mvmat, rotation);
 	}
 
 }
 
-void Geometry::SetProjMatrix (const glm::mat4 &projmat)
+void Geometry::Render (const Pass &pass, const Permutations &prog,
+											 const glm::mat4 &viewmat, Culling &culling)
+{
+	Enqueue (pass, prog, viewmat, culling);
+	Flush ();
+}
+
+void Geometry::Flush (void)
 {
-			bboxprogram["projmat"] = projmat;
+	queue.Submit (arena);
+	queue.Clear ();
 }
 
-void Geometry::Render (GLuint p,
-											 const gl::Program &prog,
-											 const glm::mat4 &viewmat)
+void Geometry::Enqueue (const Pass &p,
+												const Permutations &prog,
+												const glm::mat4 &viewmat,
+												Culling &culling)
 {
-	program = &prog;
-	switch (p & Pass::Mask)
+	GLuint layout = p.layout;
+	bool patches = (layout == RenderQueue::Layout::QuadPatches
+									|| layout == RenderQueue::Layout::TrianglePatches);
+
+	if (patches)
 	{
-	case Pass::ShadowMapQuadTess:
-	case Pass::ShadowMapTriangleTess:
-	case Pass::GBufferQuadTess:
-	case Pass::GBufferTriangleTess:
-		prog["tessLevel"] = tessLevel;
-		prog["displacement"] = displacement;
+		glm::vec2 viewport;
+		if (p.shadowmap)
+			 viewport = glm::vec2 (r->shadowmap.GetWidth (),
+														 r->shadowmap.GetHeight ());
+		else
+			 viewport = glm::vec2 (r->gbuffer.GetWidth (),
+														 r->gbuffer.GetHeight ());
+		prog.Set ("tessLevel", tessLevel);
+		prog.Set ("displacement", displacement);
+		prog.Set ("adaptive", adaptivetess[p.shadowmap].enabled);
+		prog.Set ("pixelsperedge", adaptivetess[p.shadowmap].pixelsperedge);
+		prog.Set ("curvaturebias", curvaturebias);
+		prog.Set ("patchculling", patchculling);
+		prog.Set ("viewport", viewport);
 		sampler.Bind (4);
 		sampler.Bind (5);
-	case Pass::GBuffer:
-	case Pass::GBufferTransparency:
+	}
+	if (layout != RenderQueue::Layout::DepthOnly)
+	{
 		sampler.Bind (0);
 		sampler.Bind (1);
 		sampler.Bind (2);
 		sampler.Bind (3);
-		break;
 	}
 
-	pass = p;
-	root.Render (this, viewmat, glm::mat3 (1));
+	pass = &p;
+	for (std::vector<RenderQueue::Instance> &list : instances)
+		 list.clear ();
+
+	root.Traverse ([&] (GLuint model, glm::mat4 &mvmat, glm::mat3 &rotation) {
+			AddInstance (culling, model, mvmat, rotation);
+		}, viewmat, glm::mat3 (1));
+
+	std::vector<const Mesh*> meshes;
+	for (GLuint model = 0; model < models.size (); model++)
+	{
+		std::vector<RenderQueue::Instance> &list = instances[model];
+		if (list.empty ())
+			 continue;
+
+		// draw the instances of a model front to back
+		std::sort (list.begin (), list.end (),
+							 [] (const RenderQueue::Instance &a,
+									 const RenderQueue::Instance &b) {
+								 return a.mvmat[3].z > b.mvmat[3].z;
+							 });
+		GLfloat depth = -list.front ().mvmat[3].z;
+		GLint offset = queue.AddInstances (list);
+
+		meshes.clear ();
+		models[model].GetMeshes (pass->meshes, pass->shadowmap, meshes);
+		for (const Mesh *mesh : meshes)
+		{
+			DrawElementsIndirectCommand command;
+			command = mesh->GetDrawCommand (list.size (),
+																			layout == RenderQueue::Layout
+																			::QuadPatches);
+			if (command.count == 0)
+				 continue;
+			// depth only passes don't need any material
+			const Material *material = (layout == RenderQueue::Layout::DepthOnly)
+				 ? NULL : mesh->GetMaterial ();
+			queue.Add (prog.Get (material ? material->GetFeatures () : 0),
+								 layout, material, mesh->GetMaterial ()->IsDoubleSided (),
+								 depth, command, offset,
+								 mesh->GetPatchOffset (layout == RenderQueue::Layout
+																			 ::QuadPatches));
+		}
+	}
+}
+
+void Geometry::RasterizeOccluders (Occlusion &occlusion,
+																	 const glm::mat4 &viewmat)
+{
+	root.Traverse ([&] (GLuint model, glm::mat4 &mvmat, glm::mat3&) {
+			models[model].RasterizeOccluders (occlusion, mvmat);
+		}, viewmat, glm::mat3 (1));
 }
 
-void Geometry::Render (GLuint model, glm::mat4 &mvmat,
-											 glm::mat3 &rotation)
+void Geometry::AddInstance (Culling &culling, GLuint model,
+														glm::mat4 &mvmat, glm::mat3 &rotation)
 {
-	(*program)["mvmat"] = mvmat;
-	(*program)["normalmat"] = rotation;
-	bboxprogram["mvmat"] = mvmat;
-	r->culling.SetModelViewMatrix (mvmat);
-	models[model].Render (pass, *program);
-	pass++;
+	culling.SetModelViewMatrix (mvmat);
+	if (!models[model].IsVisible (culling, pass->occlusion,
+																(pass->meshes & Model::Meshes::Patches)
+																? displacement : 0.0f))
+		 return;
+
+	RenderQueue::Instance instance;
+	instance.mvmat = mvmat;
+	for (int i = 0; i < 3; i++)
+		 instance.normalmat[i] = glm::vec4 (rotation[i], 0.0f);
+	instances[model].push_back (instance);
 }
@@ -27,10 +27,10 @@ Glow::~Glow (void)
 {
 }
 
-bool Glow::Init (gl::Texture &screenmap, gl::Texture &gm,
+bool Glow::Init (gl::Texture &screenmap, GLuint gm,
 								 GLuint mipmap_level)
 {
-	glowmap = &gm;
+	glowmap = gm;
 	if (!LoadProgram (hblur.prog, MakePath ("shaders", "bin", "glow_hblur.bin"),
 										GL_FRAGMENT_SHADER, std::string (),
 										{ MakePath ("shaders", "glow", "hblur.txt") }))
@@ -72,19 +72,17 @@ bool Glow::Init (gl::Texture &screenmap, gl::Texture &gm,
 	sampler2.Parameter (GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	sampler2.Parameter (GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-	map.Image2D (GL_TEXTURE_2D, 0, GL_RGBA16F, width, height,
-							 0, GL_RGBA, GL_FLOAT, NULL);
-	map2.Image2D (GL_TEXTURE_2D, 0, GL_RGBA16F, width, height,
-								0, GL_RGBA, GL_FLOAT, NULL);
-#ifdef DEBUG
-	r->memory += width * height * 4 * 2 * 2;
-#endif
+	{
+		RenderGraph::TextureDesc desc;
+		desc.width = width;
+		desc.height = height;
+		desc.levels = 1;
+		desc.format = GL_RGBA16F;
+		map = r->graph.GetResource ("glowtmp", desc);
+		map2 = r->graph.GetResource ("glow", desc);
+	}
 
-	hblur.fb.Texture2D (GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-											map, 0);
 	hblur.fb.DrawBuffers ({ GL_COLOR_ATTACHMENT0 });
-	vblur.fb.Texture2D (GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-											map2, 0);
 	vblur.fb.DrawBuffers ({ GL_COLOR_ATTACHMENT0 });
 	blendfb.Texture2D (GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
 										 screenmap, 0);
@@ -157,28 +155,43 @@ void Glow::SetLimit (GLfloat l)
 
 const gl::Texture &Glow::GetMap (void)
 {
-	return map2;
+	return r->graph.GetTexture (map2);
 }
 
-void Glow::Apply (void)
+void Glow::Downsample (void)
 {
 	if (GetSize () == 0)
 		 return;
 
 	buffertex.Bind (GL_TEXTURE1, GL_TEXTURE_BUFFER);
 
+	r->graph.Attach (hblur.fb, GL_COLOR_ATTACHMENT0, map);
 	hblur.fb.Bind (GL_FRAMEBUFFER);
 	hblur.pipeline.Bind ();
 	gl::Viewport (0, 0, width, height);
 
-	glowmap->Bind (GL_TEXTURE0, GL_TEXTURE_2D);
+	r->graph.GetTexture (glowmap).Bind (GL_TEXTURE0, GL_TEXTURE_2D);
 	sampler.Bind (0);
 	r->windowgrid.Render ();
 
+	gl::Framebuffer::Unbind (GL_FRAMEBUFFER);
+}
+
+void Glow::Apply (void)
+{
+	if (GetSize () == 0)
+		 return;
+
+	buffertex.Bind (GL_TEXTURE1, GL_TEXTURE_BUFFER);
+
+	// the target may share storage with the glow map, which is no
+	// longer needed after it has been downsampled
+	r->graph.Attach (vblur.fb, GL_COLOR_ATTACHMENT0, map2);
 	vblur.fb.Bind (GL_FRAMEBUFFER);
 	vblur.pipeline.Bind ();
+	gl::Viewport (0, 0, width, height);
 
-	map.Bind (GL_TEXTURE0, GL_TEXTURE_2D);
+	r->graph.GetTexture (map).Bind (GL_TEXTURE0, GL_TEXTURE_2D);
 	sampler2.Bind (0);
 
 	r->windowgrid.Render ();
@@ -191,7 +204,7 @@ void Glow::Apply (void)
 	gl::Enable (GL_BLEND);
 	gl::BlendFunc (GL_ONE, GL_ONE);
 	gl::BlendEquation (GL_FUNC_ADD);
-	map2.Bind (GL_TEXTURE0, GL_TEXTURE_2D);
+	r->graph.GetTexture (map2).Bind (GL_TEXTURE0, GL_TEXTURE_2D);
 	sampler2.Bind (0);
 	r->windowgrid.Render ();
 	gl::Disable (GL_BLEND);
@@ -0,0 +1,221 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <common.h>
+#include "tiger.h"
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const uint64_t secret[16] = {
+	0xE220A8397B1DCDAFULL, 0x6E789E6AA1B965F4ULL,
+	0x06C45D188009454FULL, 0xF88BB8A8724C81ECULL,
+	0x1B39896A51A8749BULL, 0x53CB9F0C747EA2EAULL,
+	0x2C829ABE1F4532E1ULL, 0xC584133AC916AB3CULL,
+	0x3EE5789041C98AC3ULL, 0xF3B8488C368CB0A6ULL,
+	0x657EECDD3CB13D09ULL, 0xC2D326E0055BDEF6ULL,
+	0x8621A03FE0BBDB7BULL, 0x8E1F7555983AA92FULL,
+	0xB54E0F1600CC4D19ULL, 0x84BB3F97971D80ABULL
+};
+
+const uint64_t prime32 = 0x9E3779B1ULL;
+const uint64_t prime64[2] = {
+	0x9E3779B185EBCA87ULL, 0xC2B2AE3D27D4EB4FULL
+};
+
+/** Stripes per block.
+ * The accumulators are scrambled after each block.
+ */
+const uint8_t blockstripes = 16;
+
+/** Multiply and fold.
+ * \returns The xor of the lower and upper half of the 128-bit product.
+ */
+uint64_t MulFold (uint64_t a, uint64_t b)
+{
+	uint64_t alo = a & 0xFFFFFFFF, ahi = a >> 32;
+	uint64_t blo = b & 0xFFFFFFFF, bhi = b >> 32;
+	uint64_t lolo = alo * blo, lohi = alo * bhi;
+	uint64_t hilo = ahi * blo, hihi = ahi * bhi;
+	uint64_t cross = (lolo >> 32) + (hilo & 0xFFFFFFFF) + lohi;
+	uint64_t upper = hihi + (hilo >> 32) + (cross >> 32);
+	uint64_t lower = (cross << 32) | (lolo & 0xFFFFFFFF);
+	return lower ^ upper;
+}
+
+uint64_t Avalanche (uint64_t h)
+{
+	h ^= h >> 37;
+	h *= 0x165667919E3779F9ULL;
+	h ^= h >> 32;
+	return h;
+}
+
+} /* anonymous namespace */
+
+Hash::~Hash (void)
+{
+}
+
+std::unique_ptr<Hash> Hash::Create (void)
+{
+	// only read access, so that it is safe to use from worker threads
+	const YAML::Node &constconfig = config;
+	if (constconfig["hash"].as<std::string> ("fast") == "tiger2")
+		 return std::unique_ptr<Hash> (new Tiger2);
+	return std::unique_ptr<Hash> (new FastHash);
+}
+
+FastHash::FastHash (void)
+{
+	reset ();
+}
+
+FastHash::~FastHash (void)
+{
+}
+
+void FastHash::reset (void)
+{
+	for (int i = 0; i < 8; i++)
+		 acc[i] = secret[15 - i];
+	result[0] = result[1] = 0;
+	templen = 0;
+	stripes = 0;
+	length = 0;
+}
+
+void FastHash::accumulate (const uint8_t *stripe)
+{
+#ifdef __SSE2__
+	for (int i = 0; i < 4; i++)
+	{
+		__m128i data = _mm_loadu_si128 (reinterpret_cast<const __m128i*>
+																		(stripe) + i);
+		__m128i key = _mm_xor_si128 (data, _mm_loadu_si128
+																 (reinterpret_cast<const __m128i*>
+																	(secret) + i));
+		// multiply the lower with the upper half of each key
+		__m128i product = _mm_mul_epu32 (key, _mm_shuffle_epi32
+																		 (key, _MM_SHUFFLE (0, 3, 0, 1)));
+		// add the data of the neighbouring lane
+		__m128i swapped = _mm_shuffle_epi32 (data, _MM_SHUFFLE (1, 0, 3, 2));
+		__m128i *a = reinterpret_cast<__m128i*> (acc) + i;
+		_mm_storeu_si128 (a, _mm_add_epi64 (_mm_loadu_si128 (a),
+																				_mm_add_epi64 (product, swapped)));
+	}
+#else
+	uint64_t data[8];
+	memcpy (data, stripe, 64);
+	for (int i = 0; i < 8; i++)
+	{
+		uint64_t key = data[i] ^ secret[i];
+		acc[i] += data[i ^ 1] + (key & 0xFFFFFFFF) * (key >> 32);
+	}
+#endif
+
+	if (++stripes == blockstripes)
+	{
+		scramble ();
+		stripes = 0;
+	}
+}
+
+void FastHash::scramble (void)
+{
+#ifdef __SSE2__
+	const __m128i prime = _mm_set1_epi32 (prime32);
+	for (int i = 0; i < 4; i++)
+	{
+		__m128i *a = reinterpret_cast<__m128i*> (acc) + i;
+		__m128i x = _mm_loadu_si128 (a);
+		x = _mm_xor_si128 (x, _mm_srli_epi64 (x, 47));
+		x = _mm_xor_si128 (x, _mm_loadu_si128 (reinterpret_cast<const __m128i*>
+																					 (secret + 8) + i));
+		// 64x32 bit multiplication from two 32x32 bit multiplications
+		__m128i lo = _mm_mul_epu32 (x, prime);
+		__m128i hi = _mm_mul_epu32 (_mm_srli_epi64 (x, 32), prime);
+		_mm_storeu_si128 (a, _mm_add_epi64 (lo, _mm_slli_epi64 (hi, 32)));
+	}
+#else
+	for (int i = 0; i < 8; i++)
+	{
+		acc[i] ^= acc[i] >> 47;
+		acc[i] ^= secret[8 + i];
+		acc[i] *= prime32;
+	}
+#endif
+}
+
+void FastHash::consume (const void *p, uint64_t len)
+{
+	const uint8_t *ptr = reinterpret_cast<const uint8_t*> (p);
+	length += len;
+	if (templen)
+	{
+		uint64_t n = 64 - templen;
+		if (len < n)
+		{
+			memcpy (&temp[templen], ptr, len);
+			templen += len;
+			return;
+		}
+		memcpy (&temp[templen], ptr, n);
+		accumulate (temp);
+		templen = 0;
+		ptr += n;
+		len -= n;
+	}
+
+	while (len >= 64)
+	{
+		accumulate (ptr);
+		ptr += 64;
+		len -= 64;
+	}
+
+	memcpy (temp, ptr, len);
+	templen = len;
+}
+
+void FastHash::finalize (void)
+{
+	// the zero padding is disambiguated by the length
+	if (templen)
+	{
+		memset (&temp[templen], 0, 64 - templen);
+		accumulate (temp);
+	}
+
+	for (int j = 0; j < 2; j++)
+	{
+		uint64_t h = (j ? ~length : length) * prime64[j];
+		for (int i = 0; i < 4; i++)
+			 h += MulFold (acc[2 * i] ^ secret[4 * j + 2 * i],
+										 acc[2 * i + 1] ^ secret[4 * j + 2 * i + 1]);
+		result[j] = Avalanche (h);
+	}
+}
+
+void FastHash::get (uint64_t res[3])
+{
+	res[0] = result[0];
+	res[1] = result[1];
+	res[2] = 0;
+}
@@ -0,0 +1,294 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "hiz.h"
+#include "renderer.h"
+#include <algorithm>
+#include <cfloat>
+
+HiZ::HiZ (void) : fence (NULL), valid (false), enabled (true)
+{
+}
+
+HiZ::~HiZ (void)
+{
+	if (fence != NULL)
+		 gl::DeleteSync (fence);
+}
+
+bool HiZ::Init (void)
+{
+	if (!LoadProgram (program, MakePath ("shaders", "bin", "hiz.bin"),
+										GL_FRAGMENT_SHADER, std::string (), {
+											MakePath ("shaders", "hiz.txt") }))
+		 return false;
+
+	pipeline.UseProgramStages (GL_VERTEX_SHADER_BIT,
+														 r->windowgrid.vprogram);
+	pipeline.UseProgramStages (GL_FRAGMENT_SHADER_BIT, program);
+
+	enabled = config["hiz"]["enabled"].as<bool> (true);
+	readbacklevel = config["hiz"]["readbacklevel"].as<GLuint> (3);
+
+	width = r->gbuffer.GetWidth ();
+	height = r->gbuffer.GetHeight ();
+	// there has to be at least one level to read back
+	if (width == 1 && height == 1)
+	{
+		(*logstream) << "The hierarchical depth buffer cannot be built "
+								 << "for a 1x1 G-buffer." << std::endl;
+		return false;
+	}
+	for (GLuint level = 0; level <= readbacklevel; level++)
+	{
+		if (width == 1 && height == 1)
+		{
+			// level is at least 1, as the G-buffer is larger than 1x1
+			readbacklevel = level - 1;
+			break;
+		}
+
+		width = (width + 1) >> 1;
+		height = (height + 1) >> 1;
+
+		levels.emplace_back ();
+		levels.back ().Image2D (GL_TEXTURE_2D, 0, GL_R32F, width, height,
+														0, GL_RED, GL_FLOAT, NULL);
+#ifdef DEBUG
+		r->memory += width * height * 4;
+#endif
+
+		framebuffers.emplace_back ();
+		framebuffers.back ().Texture2D (GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+																		levels.back (), 0);
+		framebuffers.back ().DrawBuffers ({ GL_COLOR_ATTACHMENT0 });
+	}
+
+	readbackbuffer.Data (width * height * sizeof (GLfloat), NULL,
+											 GL_STREAM_READ);
+
+	{
+		GLuint w = width, h = height;
+		hierarchy.emplace_back (w * h);
+		while (w > 1 || h > 1)
+		{
+			w = (w + 1) >> 1;
+			h = (h + 1) >> 1;
+			hierarchy.emplace_back (w * h);
+		}
+	}
+
+	return true;
+}
+
+bool HiZ::GetEnabled (void) const
+{
+	return enabled;
+}
+
+void HiZ::SetEnabled (bool e)
+{
+	enabled = e;
+	if (!enabled)
+		 valid = false;
+}
+
+void HiZ::Frame (void)
+{
+	if (fence != NULL)
+	{
+		GLenum result = gl::ClientWaitSync (fence, 0, 0);
+		if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+		{
+			const GLfloat *ptr = (const GLfloat*) readbackbuffer.MapRange
+				 (0, width * height * sizeof (GLfloat), GL_MAP_READ_BIT);
+			if (ptr != NULL)
+			{
+				depth.assign (ptr, ptr + width * height);
+				invvpmat = glm::inverse (pendingvpmat);
+			}
+			readbackbuffer.Unmap ();
+			gl::DeleteSync (fence);
+			fence = NULL;
+		}
+	}
+
+	valid = false;
+	if (!enabled || depth.empty ())
+		 return;
+
+	Reproject ();
+}
+
+void HiZ::Reproject (void)
+{
+	glm::mat4 vpmat = r->camera.GetProjMatrix () * r->camera.GetViewMatrix ();
+	std::vector<GLfloat> &base = hierarchy.front ();
+
+	std::fill (base.begin (), base.end (), -1.0f);
+
+	for (GLuint y = 0; y < height; y++)
+	{
+		for (GLuint x = 0; x < width; x++)
+		{
+			GLfloat d = depth[y * width + x];
+			if (d >= 1.0f)
+				 continue;
+
+			glm::vec4 p ((2.0f * x + 1.0f) / float (width) - 1.0f,
+									 (2.0f * y + 1.0f) / float (height) - 1.0f,
+									 2.0f * d - 1.0f, 1.0f);
+			p = invvpmat * p;
+			p = vpmat * (p / p.w);
+			if (p.w <= 0.0f)
+				 continue;
+			p /= p.w;
+			if (p.x < -1.0f || p.x >= 1.0f || p.y < -1.0f || p.y >= 1.0f
+					|| p.z < -1.0f || p.z > 1.0f)
+				 continue;
+
+			GLuint tx = GLuint ((0.5f * p.x + 0.5f) * width);
+			GLuint ty = GLuint ((0.5f * p.y + 0.5f) * height);
+			GLfloat &dst = base[ty * width + tx];
+			dst = std::max (dst, 0.5f * p.z + 0.5f);
+		}
+	}
+
+	// texels nobody was reprojected to must not occlude anything
+	for (GLfloat &d : base)
+	{
+		if (d < 0.0f)
+			 d = 1.0f;
+	}
+
+	GLuint w = width, h = height;
+	for (GLuint level = 1; level < hierarchy.size (); level++)
+	{
+		const std::vector<GLfloat> &src = hierarchy[level - 1];
+		std::vector<GLfloat> &dst = hierarchy[level];
+		GLuint dw = (w + 1) >> 1, dh = (h + 1) >> 1;
+		for (GLuint y = 0; y < dh; y++)
+		{
+			GLuint y0 = 2 * y, y1 = std::min (2 * y + 1, h - 1);
+			for (GLuint x = 0; x < dw; x++)
+			{
+				GLuint x0 = 2 * x, x1 = std::min (2 * x + 1, w - 1);
+				dst[y * dw + x] = std::max (std::max (src[y0 * w + x0],
+																							src[y0 * w + x1]),
+																		std::max (src[y1 * w + x0],
+																							src[y1 * w + x1]));
+			}
+		}
+		w = dw;
+		h = dh;
+	}
+
+	valid = true;
+}
+
+bool HiZ::IsOccluded (const glm::mat4 &mvpmat, const glm::vec3 &min,
+											const glm::vec3 &max) const
+{
+	if (!valid)
+		 return false;
+
+	glm::vec2 rectmin (FLT_MAX, FLT_MAX), rectmax (-FLT_MAX, -FLT_MAX);
+	GLfloat nearest = FLT_MAX;
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec4 p (i & 1 ? max.x : min.x, i & 2 ? max.y : min.y,
+								 i & 4 ? max.z : min.z, 1.0f);
+		p = mvpmat * p;
+		// boxes crossing the near plane are always considered visible
+		if (p.w <= 0.0f)
+			 return false;
+		p /= p.w;
+		rectmin = glm::min (rectmin, glm::vec2 (p));
+		rectmax = glm::max (rectmax, glm::vec2 (p));
+		nearest = std::min (nearest, p.z);
+	}
+
+	if (nearest < -1.0f)
+		 return false;
+	nearest = 0.5f * nearest + 0.5f;
+
+	rectmin = glm::clamp (0.5f * rectmin + 0.5f, 0.0f, 1.0f);
+	rectmax = glm::clamp (0.5f * rectmax + 0.5f, 0.0f, 1.0f);
+
+	GLuint w = width, h = height;
+	GLuint x0 = std::min (GLuint (rectmin.x * w), w - 1);
+	GLuint y0 = std::min (GLuint (rectmin.y * h), h - 1);
+	GLuint x1 = std::min (GLuint (rectmax.x * w), w - 1);
+	GLuint y1 = std::min (GLuint (rectmax.y * h), h - 1);
+
+	GLuint level = 0;
+	while (level + 1 < hierarchy.size () && (x1 - x0 > 1 || y1 - y0 > 1))
+	{
+		x0 >>= 1; y0 >>= 1; x1 >>= 1; y1 >>= 1;
+		w = (w + 1) >> 1;
+		h = (h + 1) >> 1;
+		level++;
+	}
+
+	const std::vector<GLfloat> &data = hierarchy[level];
+	for (GLuint y = y0; y <= y1; y++)
+	{
+		for (GLuint x = x0; x <= x1; x++)
+		{
+			if (data[y * w + x] >= nearest)
+				 return false;
+		}
+	}
+
+	return true;
+}
+
+void HiZ::Build (void)
+{
+	if (!enabled || fence != NULL)
+		 return;
+
+	pendingvpmat = r->camera.GetProjMatrix () * r->camera.GetViewMatrix ();
+
+	pipeline.Bind ();
+	r->windowgrid.sampler.Bind (0);
+
+	GLuint w = r->gbuffer.GetWidth (), h = r->gbuffer.GetHeight ();
+	for (GLuint level = 0; level < levels.size (); level++)
+	{
+		w = (w + 1) >> 1;
+		h = (h + 1) >> 1;
+
+		framebuffers[level].Bind (GL_FRAMEBUFFER);
+		gl::Viewport (0, 0, w, h);
+
+		if (level == 0)
+			 r->gbuffer.depthbuffer.Bind (GL_TEXTURE0, GL_TEXTURE_2D);
+		else
+			 levels[level - 1].Bind (GL_TEXTURE0, GL_TEXTURE_2D);
+
+		r->windowgrid.Render ();
+	}
+
+	readbackbuffer.Bind (GL_PIXEL_PACK_BUFFER);
+	gl::ReadPixels (0, 0, width, height, GL_RED, GL_FLOAT, NULL);
+	gl::Buffer::Unbind (GL_PIXEL_PACK_BUFFER);
+	fence = gl::FenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	gl::Framebuffer::Unbind (GL_FRAMEBUFFER);
+
+	GL_CHECK_ERROR;
+}
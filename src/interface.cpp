@@ -114,6 +114,15 @@ void CreateMenus (void)
 		};
 		rendermodeType = TwDefineEnum ("rendermode", rendermodeEV, 7);
 
+		TwType lightcullingType;
+		TwEnumVal lightcullingEV[] = {
+			{ LightCulling::None, "none" },
+			{ LightCulling::TileBased, "tile-based" },
+			{ LightCulling::Clustered, "clustered" }
+		};
+		lightcullingType = TwDefineEnum ("lightculling", lightcullingEV,
+																		 LightCulling::Count);
+
 		TwAddVarCB (bar, "FPS", TW_TYPE_UINT32,
 								NULL, [&] (void *v, void*) {
 									*(unsigned int*)v = fps;
@@ -124,11 +133,29 @@ void CreateMenus (void)
 								}, [&] (void *v, void*) {
 									*(unsigned int*)v = r->postprocess.GetRenderMode ();
 								}, NULL, NULL);
-		TwAddVarCB (bar, "tile-based light culling", TW_TYPE_BOOLCPP,
+		TwAddVarCB (bar, "light culling", lightcullingType,
+								[&] (const void *v, void*) {
+									r->composition.SetLightCulling (*(const unsigned int*)v);
+								}, [&] (void *v, void*) {
+									*(unsigned int*)v = r->composition.GetLightCulling ();
+								}, NULL, NULL);
+		TwAddVarCB (bar, "GPU light clusters", TW_TYPE_BOOLCPP,
+								[&] (const void *v, void*) {
+									r->composition.GetLightClusters ().SetGPU (*(bool*)v);
+								}, [&] (void *v, void*){
+									*(bool*)v = r->composition.GetLightClusters ().GetGPU ();
+								}, NULL, NULL);
+		TwAddVarCB (bar, "hierarchical-z culling", TW_TYPE_BOOLCPP,
+								[&] (const void *v, void*) {
+									r->hiz.SetEnabled (*(bool*)v);
+								}, [&] (void *v, void*){
+									*(bool*)v = r->hiz.GetEnabled ();
+								}, NULL, NULL);
+		TwAddVarCB (bar, "software occlusion culling", TW_TYPE_BOOLCPP,
 								[&] (const void *v, void*) {
-									r->composition.SetTileBased (*(bool*)v);
+									r->occlusion.SetEnabled (*(bool*)v);
 								}, [&] (void *v, void*){
-									*(bool*)v = r->composition.GetTileBased ();
+									*(bool*)v = r->occlusion.GetEnabled ();
 								}, NULL, NULL);
 		TwAddVarCB (bar, "wireframe", TW_TYPE_BOOLCPP,
 								[&] (const void *v, void*) {
@@ -148,6 +175,50 @@ void CreateMenus (void)
 								}, [&] (void *v, void*) {
 									*(float*)v = r->geometry.GetDisplacement ();
 								}, NULL, "label='displacement' min=0 step=0.01");
+		TwAddVarCB (bar, "adaptivetess", TW_TYPE_BOOLCPP,
+								[&] (const void *v, void*) {
+									r->geometry.SetAdaptiveTessellation
+										 (Geometry::Pass::GBuffer, *(bool*)v);
+								}, [&] (void *v, void*) {
+									*(bool*)v = r->geometry.GetAdaptiveTessellation
+										 (Geometry::Pass::GBuffer);
+								}, NULL, "label='adaptive tessellation'");
+		TwAddVarCB (bar, "pixelsperedge", TW_TYPE_FLOAT,
+								[&] (const void *v, void*) {
+									r->geometry.SetPixelsPerEdge
+										 (Geometry::Pass::GBuffer, *(float*)v);
+								}, [&] (void *v, void*) {
+									*(float*)v = r->geometry.GetPixelsPerEdge
+										 (Geometry::Pass::GBuffer);
+								}, NULL, "label='pixels per edge' min=1 step=0.5");
+		TwAddVarCB (bar, "shadowadaptivetess", TW_TYPE_BOOLCPP,
+								[&] (const void *v, void*) {
+									r->geometry.SetAdaptiveTessellation
+										 (Geometry::Pass::ShadowMap, *(bool*)v);
+								}, [&] (void *v, void*) {
+									*(bool*)v = r->geometry.GetAdaptiveTessellation
+										 (Geometry::Pass::ShadowMap);
+								}, NULL, "label='adaptive shadow tessellation'");
+		TwAddVarCB (bar, "shadowpixelsperedge", TW_TYPE_FLOAT,
+								[&] (const void *v, void*) {
+									r->geometry.SetPixelsPerEdge
+										 (Geometry::Pass::ShadowMap, *(float*)v);
+								}, [&] (void *v, void*) {
+									*(float*)v = r->geometry.GetPixelsPerEdge
+										 (Geometry::Pass::ShadowMap);
+								}, NULL, "label='shadow pixels per edge' min=1 step=0.5");
+		TwAddVarCB (bar, "curvaturebias", TW_TYPE_FLOAT,
+								[&] (const void *v, void*) {
+									r->geometry.SetCurvatureBias (*(float*)v);
+								}, [&] (void *v, void*) {
+									*(float*)v = r->geometry.GetCurvatureBias ();
+								}, NULL, "label='curvature bias' min=0 step=0.1");
+		TwAddVarCB (bar, "patchculling", TW_TYPE_BOOLCPP,
+								[&] (const void *v, void*) {
+									r->geometry.SetPatchCulling (*(bool*)v);
+								}, [&] (void *v, void*) {
+									*(bool*)v = r->geometry.GetPatchCulling ();
+								}, NULL, "label='patch culling'");
 	}
 	{
 		TwBar *bar = TwNewBar ("lights");
@@ -0,0 +1,578 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lightclusters.h"
+#include "renderer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+namespace {
+
+/** Get the extent of a froxel along an axis.
+ * \param lo Lower tile boundary at unit depth.
+ * \param hi Upper tile boundary at unit depth.
+ * \param znear View space depth of the near side of the froxel.
+ * \param zfar View space depth of the far side of the froxel.
+ * \param min Returns the minimum coordinate.
+ * \param max Returns the maximum coordinate.
+ */
+void GetExtent (GLfloat lo, GLfloat hi, GLfloat znear, GLfloat zfar,
+								GLfloat &min, GLfloat &max)
+{
+	min = lo * (lo < 0.0f ? zfar : znear);
+	max = hi * (hi > 0.0f ? zfar : znear);
+}
+
+} /* anonymous namespace */
+
+void LightClusters::Bounds::Resize (GLuint n)
+{
+	GLuint size = (n + 3) & ~3;
+	x.resize (size);
+	y.resize (size);
+	z.resize (size);
+	radius.resize (size);
+	dirx.resize (size);
+	diry.resize (size);
+	dirz.resize (size);
+	cosine.resize (size);
+	sine.resize (size);
+	index.resize (size);
+	count = n;
+}
+
+void LightClusters::Bounds::Pad (void)
+{
+	for (GLuint i = count; i & 3; i++)
+	{
+		// too far away to intersect anything
+		x[i] = y[i] = z[i] = FLT_MAX;
+		radius[i] = 0.0f;
+		dirx[i] = diry[i] = dirz[i] = 0.0f;
+		cosine[i] = sine[i] = 0.0f;
+		index[i] = 0;
+	}
+}
+
+void LightClusters::Bounds::Copy (GLuint i, const Bounds &from, GLuint j)
+{
+	x[i] = from.x[j];
+	y[i] = from.y[j];
+	z[i] = from.z[j];
+	radius[i] = from.radius[j];
+	dirx[i] = from.dirx[j];
+	diry[i] = from.diry[j];
+	dirz[i] = from.dirz[j];
+	cosine[i] = from.cosine[j];
+	sine[i] = from.sine[j];
+	index[i] = from.index[j];
+}
+
+LightClusters::LightClusters (void) : tilesize (0), tilesx (0), tilesy (0),
+																			numslices (0), capacity (0),
+																			gpu (false), written (false),
+																			maxlights (0), fence (NULL),
+																			reported (0)
+{
+}
+
+LightClusters::~LightClusters (void)
+{
+	if (fence != NULL)
+		 gl::DeleteSync (fence);
+}
+
+bool LightClusters::Init (void)
+{
+	tilesize = config["lightclusters"]["tilesize"].as<GLuint> (64);
+	numslices = config["lightclusters"]["slices"].as<GLuint> (24);
+	maxlights = config["lightclusters"]["maxlights"].as<GLuint> (512);
+	gpu = config["lightclusters"]["gpu"].as<bool> (true);
+	if (tilesize == 0 || numslices == 0 || maxlights == 0)
+	{
+		(*logstream) << "Invalid light cluster configuration." << std::endl;
+		return false;
+	}
+
+	tilesx = (r->gbuffer.GetWidth () + tilesize - 1) / tilesize;
+	tilesy = (r->gbuffer.GetHeight () + tilesize - 1) / tilesize;
+
+	slices.resize (numslices);
+	for (Slice &slice : slices)
+		 slice.counts.resize (tilesx * tilesy);
+
+	grid.Data (sizeof (GLuint) * 2 * tilesx * tilesy * numslices,
+						 NULL, GL_STREAM_DRAW);
+#ifdef DEBUG
+	r->memory += sizeof (GLuint) * 2 * tilesx * tilesy * numslices;
+#endif
+	gridtex.Buffer (GL_RG32UI, grid);
+
+	// a first guess, the buffer grows to the number of indices needed
+	capacity = 1024;
+	while (capacity < tilesx * tilesy * numslices * 16)
+		 capacity <<= 1;
+	indices.Data (sizeof (GLuint) * capacity, NULL, GL_STREAM_DRAW);
+	indextex.Buffer (GL_R32UI, indices);
+
+	counter.Data (sizeof (GLuint) * 3, NULL, GL_DYNAMIC_DRAW);
+	readback.Data (sizeof (GLuint) * 3, NULL, GL_STREAM_READ);
+	lighttex.Buffer (GL_RGBA32F, r->GetLightBuffer ());
+
+	{
+		std::stringstream stream;
+		stream << "#version 430 core" << std::endl;
+		stream << "#define SIZEOF_LIGHT "
+					 << sizeof (Light) / sizeof (glm::vec4) << std::endl;
+		stream << "#define NUM_CLUSTERS_X " << tilesx << std::endl;
+		stream << "#define NUM_CLUSTERS_Y " << tilesy << std::endl;
+		stream << "#define NUM_CLUSTER_SLICES " << numslices << std::endl;
+		stream << "#define CLUSTER_TILE_SIZE " << tilesize << std::endl;
+		stream << "#define MAX_CLUSTER_LIGHTS " << maxlights << std::endl;
+		if (!LoadProgram (program, MakePath ("shaders", "bin",
+																				 "lightclusters.bin"),
+											GL_COMPUTE_SHADER, stream.str (), {
+												MakePath ("shaders", "lightclusters.txt") }))
+			 return false;
+	}
+
+	program["invviewport"]
+		 = glm::vec2 (1.0f / float (r->gbuffer.GetWidth ()),
+									1.0f / float (r->gbuffer.GetHeight ()));
+	pipeline.UseProgramStages (GL_COMPUTE_SHADER_BIT, program);
+
+	return true;
+}
+
+bool LightClusters::GetGPU (void) const
+{
+	return gpu;
+}
+
+void LightClusters::SetGPU (bool g)
+{
+	gpu = g;
+}
+
+GLuint LightClusters::GetTileSize (void) const
+{
+	return tilesize;
+}
+
+GLuint LightClusters::GetNumTilesX (void) const
+{
+	return tilesx;
+}
+
+GLuint LightClusters::GetNumTilesY (void) const
+{
+	return tilesy;
+}
+
+GLuint LightClusters::GetNumSlices (void) const
+{
+	return numslices;
+}
+
+const gl::Texture &LightClusters::GetGridTexture (void) const
+{
+	return gridtex;
+}
+
+const gl::Texture &LightClusters::GetIndexTexture (void) const
+{
+	return indextex;
+}
+
+void LightClusters::Build (const Camera &camera, const Light *lightarray,
+													 GLuint numlights)
+{
+	if (gpu)
+	{
+		Dispatch (camera);
+		return;
+	}
+
+	const glm::mat4 vmat = camera.GetViewMatrix ();
+	const glm::vec4 projinfo = camera.GetProjInfo ();
+	const GLuint width = r->gbuffer.GetWidth ();
+	const GLuint height = r->gbuffer.GetHeight ();
+
+	boundsx.resize (tilesx + 1);
+	for (GLuint x = 0; x <= tilesx; x++)
+		 boundsx[x] = (2.0f * std::min (x * tilesize, width) / width - 1.0f)
+				* projinfo.x;
+	boundsy.resize (tilesy + 1);
+	for (GLuint y = 0; y <= tilesy; y++)
+		 boundsy[y] = (2.0f * std::min (y * tilesize, height) / height - 1.0f)
+				* projinfo.y;
+
+	// exponential slices, so that froxels
+	// keep their proportions with depth
+	depths.resize (numslices + 1);
+	for (GLuint z = 0; z <= numslices; z++)
+		 depths[z] = projinfo.z * powf (projinfo.w / projinfo.z,
+																		float (z) / float (numslices));
+
+	lights.Resize (numlights);
+	for (GLuint i = 0; i < numlights; i++)
+	{
+		const Light &light = lightarray[i];
+		glm::vec3 pos (vmat * glm::vec4 (glm::vec3 (light.position), 1.0f));
+		glm::vec3 dir (glm::mat3 (vmat) * glm::vec3 (light.direction));
+		lights.x[i] = pos.x;
+		lights.y[i] = pos.y;
+		lights.z[i] = pos.z;
+		lights.radius[i] = light.attenuation.w;
+		// cones wider than a half space are only tested against their range
+		if (light.spot.cosine > 0.0f && glm::length (dir) > 0.0f)
+		{
+			dir = glm::normalize (dir);
+			lights.dirx[i] = dir.x;
+			lights.diry[i] = dir.y;
+			lights.dirz[i] = dir.z;
+			lights.cosine[i] = light.spot.cosine;
+			lights.sine[i] = sqrtf (1.0f - light.spot.cosine * light.spot.cosine);
+		}
+		else
+		{
+			lights.dirx[i] = lights.diry[i] = lights.dirz[i] = 0.0f;
+			lights.cosine[i] = lights.sine[i] = 0.0f;
+		}
+		lights.index[i] = i;
+	}
+	lights.Pad ();
+
+	for (GLuint z = 0; z < numslices; z++)
+	{
+		r->threadpool.Run ([this, z] (void) {
+				BuildSlice (z);
+			});
+	}
+	r->threadpool.Wait ();
+
+	GLuint total = 0;
+	for (const Slice &slice : slices)
+		 total += slice.indices.size ();
+	if (total > capacity)
+	{
+		while (capacity < total)
+			 capacity <<= 1;
+		indices.Data (sizeof (GLuint) * capacity, NULL, GL_STREAM_DRAW);
+		indextex.Buffer (GL_R32UI, indices);
+	}
+
+	if (written)
+	{
+		gl::MemoryBarrier (GL_BUFFER_UPDATE_BARRIER_BIT);
+		written = false;
+	}
+
+	GLuint *gridptr = (GLuint*) grid.MapRange
+		 (0, sizeof (GLuint) * 2 * tilesx * tilesy * numslices,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	GLuint *indexptr = NULL;
+	if (total > 0)
+		 indexptr = (GLuint*) indices.MapRange
+				(0, sizeof (GLuint) * total,
+				 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+	GLuint offset = 0;
+	for (const Slice &slice : slices)
+	{
+		if (!slice.indices.empty ())
+			 memcpy (indexptr + offset, &slice.indices[0],
+							 sizeof (GLuint) * slice.indices.size ());
+		for (GLuint count : slice.counts)
+		{
+			*gridptr++ = offset;
+			*gridptr++ = count;
+			offset += count;
+		}
+	}
+
+	grid.Unmap ();
+	if (total > 0)
+		 indices.Unmap ();
+}
+
+void LightClusters::ReadBack (void)
+{
+	if (fence == NULL)
+		 return;
+	GLenum result = gl::ClientWaitSync (fence, 0, 0);
+	if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+		 return;
+	gl::DeleteSync (fence);
+	fence = NULL;
+
+	const GLuint *ptr = (const GLuint*) readback.MapRange
+		 (0, sizeof (GLuint) * 3, GL_MAP_READ_BIT);
+	if (ptr == NULL)
+		 return;
+	GLuint total = ptr[0], overflows = ptr[1], maxcount = ptr[2];
+	readback.Unmap ();
+
+	// light lists that didn't fit were truncated,
+	// the next frames get enough space
+	if (total > capacity)
+	{
+		while (capacity < total)
+			 capacity <<= 1;
+		indices.Data (sizeof (GLuint) * capacity, NULL, GL_STREAM_DRAW);
+		indextex.Buffer (GL_R32UI, indices);
+	}
+
+	// only log new maxima, so that the log isn't flooded every frame
+	if (overflows > 0 && maxcount > reported)
+	{
+		(*logstream) << overflows << " light clusters exceed the limit of "
+								 << maxlights << " lights with up to " << maxcount
+								 << " lights, further lights are dropped. Increase "
+								 << "lightclusters.maxlights to avoid this." << std::endl;
+		reported = maxcount;
+	}
+}
+
+void LightClusters::Dispatch (const Camera &camera)
+{
+	// the counter is still written by the last dispatch
+	if (written)
+		 gl::MemoryBarrier (GL_BUFFER_UPDATE_BARRIER_BIT);
+	ReadBack ();
+	const GLuint zero[3] = { 0, 0, 0 };
+	counter.SubData (0, sizeof (GLuint) * 3, zero);
+
+	program["vmat"] = camera.GetViewMatrix ();
+	program["projinfo"] = camera.GetProjInfo ();
+
+	pipeline.Bind ();
+	lighttex.Bind (GL_TEXTURE0, GL_TEXTURE_BUFFER);
+	grid.BindBase (GL_SHADER_STORAGE_BUFFER, 0);
+	indices.BindBase (GL_SHADER_STORAGE_BUFFER, 1);
+	counter.BindBase (GL_SHADER_STORAGE_BUFFER, 2);
+	gl::DispatchCompute (tilesx, tilesy, numslices);
+	written = true;
+
+	// copy the counter while no earlier copy is pending, so that it
+	// can be read back without waiting for the dispatch
+	if (fence == NULL)
+	{
+		gl::MemoryBarrier (GL_BUFFER_UPDATE_BARRIER_BIT);
+		counter.Bind (GL_COPY_READ_BUFFER);
+		readback.Bind (GL_COPY_WRITE_BUFFER);
+		gl::CopyBufferSubData (GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+													 0, 0, sizeof (GLuint) * 3);
+		gl::Buffer::Unbind (GL_COPY_READ_BUFFER);
+		gl::Buffer::Unbind (GL_COPY_WRITE_BUFFER);
+		fence = gl::FenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
+
+void LightClusters::BuildSlice (GLuint z)
+{
+	Slice &slice = slices[z];
+	const GLfloat znear = depths[z];
+	const GLfloat zfar = depths[z + 1];
+	slice.indices.clear ();
+
+	// the camera looks along the negative z axis
+	glm::vec3 min, max;
+	min.z = -zfar;
+	max.z = -znear;
+	GetExtent (boundsx[0], boundsx[tilesx], znear, zfar, min.x, max.x);
+	GetExtent (boundsy[0], boundsy[tilesy], znear, zfar, min.y, max.y);
+	Filter (lights, min, max, slice.lights);
+
+	for (GLuint y = 0; y < tilesy; y++)
+	{
+		GLuint *counts = &slice.counts[y * tilesx];
+		if (slice.lights.count == 0)
+		{
+			std::fill (counts, counts + tilesx, 0);
+			continue;
+		}
+
+		GetExtent (boundsx[0], boundsx[tilesx], znear, zfar, min.x, max.x);
+		GetExtent (boundsy[y], boundsy[y + 1], znear, zfar, min.y, max.y);
+		Filter (slice.lights, min, max, slice.row);
+
+		for (GLuint x = 0; x < tilesx; x++)
+		{
+			if (slice.row.count == 0)
+			{
+				counts[x] = 0;
+				continue;
+			}
+			GetExtent (boundsx[x], boundsx[x + 1], znear, zfar, min.x, max.x);
+			counts[x] = Assign (slice.row, min, max, slice.indices);
+		}
+	}
+}
+
+void LightClusters::Filter (const Bounds &in, const glm::vec3 &min,
+														const glm::vec3 &max, Bounds &out)
+{
+	GLuint n = 0;
+	out.Resize (in.count);
+#ifdef __SSE__
+	const __m128 zero = _mm_setzero_ps ();
+	const __m128 minx = _mm_set1_ps (min.x);
+	const __m128 miny = _mm_set1_ps (min.y);
+	const __m128 minz = _mm_set1_ps (min.z);
+	const __m128 maxx = _mm_set1_ps (max.x);
+	const __m128 maxy = _mm_set1_ps (max.y);
+	const __m128 maxz = _mm_set1_ps (max.z);
+
+	for (GLuint i = 0; i < in.count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps (&in.x[i]);
+		__m128 y = _mm_loadu_ps (&in.y[i]);
+		__m128 z = _mm_loadu_ps (&in.z[i]);
+		__m128 radius = _mm_loadu_ps (&in.radius[i]);
+		// distance of the center to the box along each axis
+		__m128 dx = _mm_max_ps (_mm_max_ps (_mm_sub_ps (minx, x),
+																				_mm_sub_ps (x, maxx)), zero);
+		__m128 dy = _mm_max_ps (_mm_max_ps (_mm_sub_ps (miny, y),
+																				_mm_sub_ps (y, maxy)), zero);
+		__m128 dz = _mm_max_ps (_mm_max_ps (_mm_sub_ps (minz, z),
+																				_mm_sub_ps (z, maxz)), zero);
+		__m128 dist = _mm_add_ps (_mm_add_ps (_mm_mul_ps (dx, dx),
+																					_mm_mul_ps (dy, dy)),
+															_mm_mul_ps (dz, dz));
+		int mask = _mm_movemask_ps (_mm_cmple_ps (dist,
+																							_mm_mul_ps (radius, radius)));
+		for (GLuint j = 0; mask != 0; j++, mask >>= 1)
+		{
+			if (mask & 1)
+				 out.Copy (n++, in, i + j);
+		}
+	}
+#else
+	for (GLuint i = 0; i < in.count; i++)
+	{
+		glm::vec3 c (in.x[i], in.y[i], in.z[i]);
+		glm::vec3 d (glm::max (glm::max (min - c, c - max), glm::vec3 (0.0f)));
+		if (glm::dot (d, d) <= in.radius[i] * in.radius[i])
+			 out.Copy (n++, in, i);
+	}
+#endif
+	out.count = n;
+	out.Pad ();
+}
+
+GLuint LightClusters::Assign (const Bounds &in, const glm::vec3 &min,
+															const glm::vec3 &max,
+															std::vector<GLuint> &indices)
+{
+	// the spot cones are tested against the bounding sphere of the froxel
+	const glm::vec3 center = (min + max) * 0.5f;
+	const GLfloat size = glm::length (max - min) * 0.5f;
+	GLuint n = 0;
+#ifdef __SSE__
+	const __m128 zero = _mm_setzero_ps ();
+	const __m128 minx = _mm_set1_ps (min.x);
+	const __m128 miny = _mm_set1_ps (min.y);
+	const __m128 minz = _mm_set1_ps (min.z);
+	const __m128 maxx = _mm_set1_ps (max.x);
+	const __m128 maxy = _mm_set1_ps (max.y);
+	const __m128 maxz = _mm_set1_ps (max.z);
+	const __m128 cx = _mm_set1_ps (center.x);
+	const __m128 cy = _mm_set1_ps (center.y);
+	const __m128 cz = _mm_set1_ps (center.z);
+	const __m128 extent = _mm_set1_ps (size);
+	const __m128 nextent = _mm_set1_ps (-size);
+
+	for (GLuint i = 0; i < in.count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps (&in.x[i]);
+		__m128 y = _mm_loadu_ps (&in.y[i]);
+		__m128 z = _mm_loadu_ps (&in.z[i]);
+		__m128 radius = _mm_loadu_ps (&in.radius[i]);
+		__m128 dx = _mm_max_ps (_mm_max_ps (_mm_sub_ps (minx, x),
+																				_mm_sub_ps (x, maxx)), zero);
+		__m128 dy = _mm_max_ps (_mm_max_ps (_mm_sub_ps (miny, y),
+																				_mm_sub_ps (y, maxy)), zero);
+		__m128 dz = _mm_max_ps (_mm_max_ps (_mm_sub_ps (minz, z),
+																				_mm_sub_ps (z, maxz)), zero);
+		__m128 dist = _mm_add_ps (_mm_add_ps (_mm_mul_ps (dx, dx),
+																					_mm_mul_ps (dy, dy)),
+															_mm_mul_ps (dz, dz));
+		__m128 mask = _mm_cmple_ps (dist, _mm_mul_ps (radius, radius));
+		if (!_mm_movemask_ps (mask))
+			 continue;
+
+		// vector from the apex of the cone to the center of the froxel
+		__m128 vx = _mm_sub_ps (cx, x);
+		__m128 vy = _mm_sub_ps (cy, y);
+		__m128 vz = _mm_sub_ps (cz, z);
+		__m128 len2 = _mm_add_ps (_mm_add_ps (_mm_mul_ps (vx, vx),
+																					_mm_mul_ps (vy, vy)),
+															_mm_mul_ps (vz, vz));
+		__m128 along = _mm_add_ps
+			 (_mm_add_ps (_mm_mul_ps (vx, _mm_loadu_ps (&in.dirx[i])),
+										_mm_mul_ps (vy, _mm_loadu_ps (&in.diry[i]))),
+				_mm_mul_ps (vz, _mm_loadu_ps (&in.dirz[i])));
+		__m128 across = _mm_sqrt_ps (_mm_max_ps (_mm_sub_ps
+																						 (len2, _mm_mul_ps (along, along)),
+																						 zero));
+		// distance of the center to the surface of the cone
+		__m128 closest = _mm_sub_ps
+			 (_mm_mul_ps (_mm_loadu_ps (&in.cosine[i]), across),
+				_mm_mul_ps (along, _mm_loadu_ps (&in.sine[i])));
+		mask = _mm_and_ps (mask, _mm_cmple_ps (closest, extent));
+		mask = _mm_and_ps (mask, _mm_cmple_ps (along,
+																					 _mm_add_ps (radius, extent)));
+		mask = _mm_and_ps (mask, _mm_cmpge_ps (along, nextent));
+
+		int bits = _mm_movemask_ps (mask);
+		for (GLuint j = 0; bits != 0; j++, bits >>= 1)
+		{
+			if (bits & 1)
+			{
+				indices.push_back (in.index[i + j]);
+				n++;
+			}
+		}
+	}
+#else
+	for (GLuint i = 0; i < in.count; i++)
+	{
+		glm::vec3 c (in.x[i], in.y[i], in.z[i]);
+		glm::vec3 d (glm::max (glm::max (min - c, c - max), glm::vec3 (0.0f)));
+		if (glm::dot (d, d) > in.radius[i] * in.radius[i])
+			 continue;
+
+		glm::vec3 v (center - c);
+		GLfloat along = glm::dot (v, glm::vec3 (in.dirx[i], in.diry[i],
+																						in.dirz[i]));
+		GLfloat across = sqrtf (std::max (glm::dot (v, v) - along * along,
+																			0.0f));
+		GLfloat closest = in.cosine[i] * across - along * in.sine[i];
+		if (closest > size || along > in.radius[i] + size || along < -size)
+			 continue;
+
+		indices.push_back (in.index[i]);
+		n++;
+	}
+#endif
+	return n;
+}
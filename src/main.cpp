@@ -16,6 +16,9 @@
  */
 #include "renderer.h"
 #include "interface.h"
+#include "filesystem.h"
+#include "profiler.h"
+#include "shadercache.h"
 #include <iostream>
 #include <fstream>
 #include <yaml-cpp/yaml.h>
@@ -24,6 +27,9 @@
 
 std::unique_ptr<Renderer> r;
 YAML::Node config;
+FileSystem filesystem;
+Profiler profiler;
+ShaderCache shadercache;
 bool running;
 
 void GLFWCALL resizecb (int w, int h)
@@ -215,6 +221,11 @@ int main (int argc, char *argv[])
 			logstream = &logfile;
 		}
 
+		profiler.Init ();
+
+		if (!filesystem.Init ())
+			 return -1;
+
 		int w, h;
 		if (glfwInit () != GL_TRUE)
 		{
@@ -0,0 +1,170 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "model/arena.h"
+#include "renderer.h"
+
+Arena::Arena (void)
+{
+}
+
+Arena::~Arena (void)
+{
+}
+
+GLint Arena::AddTriangleVertices (GLuint count, const glm::vec3 *positions,
+																	const glm::vec3 *normals,
+																	const glm::vec3 *tangents,
+																	const glm::vec2 *texcoords)
+{
+	GLint basevertex = triangles.positions.size ();
+	triangles.positions.insert (triangles.positions.end (),
+															positions, positions + count);
+	triangles.normals.insert (triangles.normals.end (),
+														normals, normals + count);
+	triangles.tangents.insert (triangles.tangents.end (),
+														 tangents, tangents + count);
+	triangles.texcoords.insert (triangles.texcoords.end (),
+															texcoords, texcoords + count);
+	return basevertex;
+}
+
+GLint Arena::AddPatchVertices (GLuint count, const glm::vec3 *positions,
+															 const glm::vec2 *texcoords)
+{
+	GLint basevertex = patches.positions.size ();
+	patches.positions.insert (patches.positions.end (),
+														positions, positions + count);
+	patches.texcoords.insert (patches.texcoords.end (),
+														texcoords, texcoords + count);
+	return basevertex;
+}
+
+GLint Arena::AddPatchData (GLuint count, const GLfloat *curvature,
+													 const glm::vec4 *cones)
+{
+	GLint firstpatch = patches.curvature.size ();
+	if (curvature == NULL)
+		 patches.curvature.resize (patches.curvature.size () + count, 0.0f);
+	else
+		 patches.curvature.insert (patches.curvature.end (),
+															 curvature, curvature + count);
+	// a cone with a half angle of pi is never culled
+	if (cones == NULL)
+		 patches.cones.resize (patches.cones.size () + count,
+													 glm::vec4 (0, 0, 1, 3.14159265f));
+	else
+		 patches.cones.insert (patches.cones.end (), cones, cones + count);
+	return firstpatch;
+}
+
+GLuint Arena::AddIndices (GLuint count, const GLuint *data)
+{
+	GLuint firstindex = indices.size ();
+	indices.insert (indices.end (), data, data + count);
+	return firstindex;
+}
+
+void Arena::Upload (void)
+{
+	buffers[0].Data (triangles.positions.size () * sizeof (glm::vec3),
+									 triangles.positions.data (), GL_STATIC_DRAW);
+	buffers[1].Data (triangles.normals.size () * sizeof (glm::vec3),
+									 triangles.normals.data (), GL_STATIC_DRAW);
+	buffers[2].Data (triangles.tangents.size () * sizeof (glm::vec3),
+									 triangles.tangents.data (), GL_STATIC_DRAW);
+	buffers[3].Data (triangles.texcoords.size () * sizeof (glm::vec2),
+									 triangles.texcoords.data (), GL_STATIC_DRAW);
+	buffers[4].Data (patches.positions.size () * sizeof (glm::vec3),
+									 patches.positions.data (), GL_STATIC_DRAW);
+	buffers[5].Data (patches.texcoords.size () * sizeof (glm::vec2),
+									 patches.texcoords.data (), GL_STATIC_DRAW);
+	indexbuffer.Data (indices.size () * sizeof (GLuint),
+										indices.data (), GL_STATIC_DRAW);
+	// buffer textures must not be empty
+	if (patches.curvature.empty ())
+		 AddPatchData (1, NULL, NULL);
+	patchbuffer.Data (patches.curvature.size () * sizeof (GLfloat),
+										patches.curvature.data (), GL_STATIC_DRAW);
+	patchtex.Buffer (GL_R32F, patchbuffer);
+	conebuffer.Data (patches.cones.size () * sizeof (glm::vec4),
+									 patches.cones.data (), GL_STATIC_DRAW);
+	conetex.Buffer (GL_RGBA32F, conebuffer);
+
+#ifdef DEBUG
+	r->memory += triangles.positions.size () * (3 * sizeof (glm::vec3)
+																							+ sizeof (glm::vec2));
+	r->memory += patches.positions.size () * (sizeof (glm::vec3)
+																						+ sizeof (glm::vec2));
+	r->memory += indices.size () * sizeof (GLuint);
+	r->memory += patches.curvature.size () * (sizeof (GLfloat)
+																						+ sizeof (glm::vec4));
+#endif
+
+	for (auto i = 0; i < 3; i++)
+	{
+		trianglearray.VertexAttribOffset (buffers[i], i, 3, GL_FLOAT,
+																			GL_FALSE, 0, 0);
+		trianglearray.EnableVertexAttrib (i);
+	}
+	trianglearray.VertexAttribOffset (buffers[3], 3, 2, GL_FLOAT,
+																		GL_FALSE, 0, 0);
+	trianglearray.EnableVertexAttrib (3);
+
+	depthonlyarray.VertexAttribOffset (buffers[0], 0, 3, GL_FLOAT,
+																		 GL_FALSE, 0, 0);
+	depthonlyarray.EnableVertexAttrib (0);
+
+	patcharray.VertexAttribOffset (buffers[4], 0, 3, GL_FLOAT,
+																 GL_FALSE, 0, 0);
+	patcharray.EnableVertexAttrib (0);
+	patcharray.VertexAttribOffset (buffers[5], 1, 2, GL_FLOAT,
+																 GL_FALSE, 0, 0);
+	patcharray.EnableVertexAttrib (1);
+
+	// the data is not needed on the CPU anymore
+	std::vector<glm::vec3> ().swap (triangles.positions);
+	std::vector<glm::vec3> ().swap (triangles.normals);
+	std::vector<glm::vec3> ().swap (triangles.tangents);
+	std::vector<glm::vec2> ().swap (triangles.texcoords);
+	std::vector<glm::vec3> ().swap (patches.positions);
+	std::vector<glm::vec2> ().swap (patches.texcoords);
+	std::vector<GLfloat> ().swap (patches.curvature);
+	std::vector<glm::vec4> ().swap (patches.cones);
+	std::vector<GLuint> ().swap (indices);
+
+	GL_CHECK_ERROR;
+}
+
+void Arena::BindTriangles (void) const
+{
+	trianglearray.Bind ();
+	indexbuffer.Bind (GL_ELEMENT_ARRAY_BUFFER);
+}
+
+void Arena::BindDepthOnly (void) const
+{
+	depthonlyarray.Bind ();
+	indexbuffer.Bind (GL_ELEMENT_ARRAY_BUFFER);
+}
+
+void Arena::BindPatches (void) const
+{
+	patcharray.Bind ();
+	indexbuffer.Bind (GL_ELEMENT_ARRAY_BUFFER);
+	patchtex.Bind (GL_TEXTURE8, GL_TEXTURE_BUFFER);
+	conetex.Bind (GL_TEXTURE9, GL_TEXTURE_BUFFER);
+}
@@ -15,41 +15,30 @@
  * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "model/material.h"
+#include "renderer.h"
+#include "profiler.h"
 #include <fstream>
-#include <cstring>
 
 GLenum TranslateFormat (const std::string &str);
 
 Material::Material (void)
-	: diffuse_enabled (false), normalmap_enabled (false),
-		specularmap_enabled (false), transparent (false),
-		heightmap_enabled (false), parametermap_enabled (false),
-		displacementmap_enabled (false), doublesided (false)
+	: features (0), transparent (false), doublesided (false)
 {
 }
 
 Material::Material (Material &&material)
 	: diffuse (std::move (material.diffuse)),
-		diffuse_enabled (material.diffuse_enabled),
 		normalmap (std::move (material.normalmap)),
-		normalmap_enabled (material.normalmap_enabled),
 		specularmap (std::move (material.specularmap)),
-		specularmap_enabled (material.specularmap_enabled),
 		parametermap (std::move (material.parametermap)),
-		parametermap_enabled (material.parametermap_enabled),
 		heightmap (std::move (material.heightmap)),
-		heightmap_enabled (material.heightmap_enabled),
-    displacementmap (std::move (material.displacementmap)),
-    displacementmap_enabled (material.displacementmap_enabled),
+		displacementmap (std::move (material.displacementmap)),
+		textures (std::move (material.textures)),
+		features (material.features),
 		transparent (material.transparent),
 		doublesided (material.doublesided)
 {
-	material.diffuse_enabled = false;
-	material.normalmap_enabled = false;
-	material.specularmap_enabled = false;
-	material.parametermap_enabled = false;
-	material.heightmap_enabled = false;
-	material.displacementmap_enabled = false;
+	material.features = 0;
 	material.transparent = false;
 	material.doublesided = false;
 }
@@ -61,158 +50,84 @@ Material::~Material (void)
 Material &Material::operator= (Material &&material)
 {
 	diffuse = std::move (material.diffuse);
-	diffuse_enabled = material.diffuse_enabled;
-	material.diffuse_enabled = false;
 	normalmap = std::move (material.normalmap);
-	normalmap_enabled = material.normalmap_enabled;
-	material.normalmap_enabled = false;
 	specularmap = std::move (material.specularmap);
-	specularmap_enabled = material.specularmap_enabled;
-	material.specularmap_enabled = false;
 	parametermap = std::move (material.parametermap);
-	parametermap_enabled = material.parametermap_enabled;
-	material.parametermap_enabled = false;
 	heightmap = std::move (material.heightmap);
-	heightmap_enabled = material.heightmap_enabled;
-	material.heightmap_enabled = false;
 	displacementmap = std::move (material.displacementmap);
-	displacementmap_enabled = material.displacementmap_enabled;
-	material.displacementmap_enabled = false;
+	textures = std::move (material.textures);
+	features = material.features;
+	material.features = 0;
 	transparent = material.transparent;
 	material.transparent = false;
 	doublesided = material.doublesided;
 	material.doublesided = false;
+	return *this;
 }
 
-typedef struct {
-	 uint8_t identifier[12];
-	 uint32_t endianness;
-	 uint32_t glType;
-	 uint32_t glTypeSize;
-	 uint32_t glFormat;
-	 uint32_t glInternalFormat;
-	 uint32_t glBaseInternalFormat;
-	 uint32_t pixelWidth;
-	 uint32_t pixelHeight;
-	 uint32_t pixelDepth;
-	 uint32_t numberOfArrayElements;
-	 uint32_t numberOfFaces;
-	 uint32_t numberOfMipmapLevels;
-	 uint32_t bytesOfKeyValueData;
-} ktx_header_t;
-
-bool LoadTex (gl::Texture &texture, bool &result,
-							const YAML::Node node)
+void Material::RequestTex (TextureCache::Handle &texture,
+													 const std::string &filename)
 {
-	std::string filename;
-	if (!node.IsScalar ())
-	{
-		result = false;
-		return true;
-	}
-
-	result = true;
-
-	filename = MakePath ("textures", node.as<std::string> ());
+	texture.reset ();
+	if (filename.empty ())
+		 return;
 
-	ktx_header_t header;
-	std::ifstream file (filename, std::ios_base::in|std::ios_base::binary);
-	if (!file.is_open ())
-		 return false;
+	texture = r->textures.Get (MakePath ("textures", filename));
+}
 
-	file.read (reinterpret_cast<char*> (&header), sizeof (ktx_header_t));
+void Material::Setup (const Description &desc)
+{
+	transparent = desc.transparent;
+	doublesided = desc.doublesided;
+	textures = desc.textures;
 
-	const uint8_t id[12] = {
-		0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+	const GLuint bits[] = {
+		ShaderFeatures::DiffuseMap, ShaderFeatures::NormalMap,
+		ShaderFeatures::SpecularMap, ShaderFeatures::ParameterMap,
+		ShaderFeatures::HeightMap, ShaderFeatures::DisplacementMap
 	};
-	if (file.gcount () != sizeof (ktx_header_t)
-			|| memcmp (header.identifier, id, 12))
-		 return false;
-	if (header.endianness != 0x04030201)
-		 return false;
-	if (header.pixelDepth != 0)
-		 return false;
-	if (header.numberOfArrayElements)
-		 return false;
-	if (header.numberOfFaces != 1)
-		 return false;
-	if (header.numberOfMipmapLevels != 1)
-		 return false;
-
-	file.ignore (header.bytesOfKeyValueData);
-
-	uint32_t size;
-	file.read (reinterpret_cast<char*> (&size), sizeof (uint32_t));
-	if (file.gcount () != sizeof (uint32_t))
-		 return false;
-
-	gl::Buffer data;
-	data.Data (size, NULL, GL_STREAM_DRAW);
-
-	void *ptr = data.Map (GL_WRITE_ONLY);
-	file.read (reinterpret_cast<char*> (ptr), size);
-	data.Unmap ();
-
-	data.Bind (GL_PIXEL_UNPACK_BUFFER);
-	if (header.glType == 0)
+	features = 0;
+	for (int i = 0; i < 6; i++)
 	{
-		texture.CompressedImage2D (GL_TEXTURE_2D, 0, header.glInternalFormat,
-															 header.pixelWidth, header.pixelHeight, 0,
-															 size, NULL);
+		if (!textures[i].empty ())
+			 features |= bits[i];
 	}
-	else
-	{
-		texture.Image2D (GL_TEXTURE_2D, 0, header.glInternalFormat,
-										 header.pixelWidth, header.pixelHeight, 0,
-										 header.glFormat, header.glType, NULL);
-	}
-	texture.GenerateMipmap (GL_TEXTURE_2D);
-	gl::Buffer::Unbind (GL_PIXEL_UNPACK_BUFFER);
 
-	return true;
+	RequestTex (diffuse, textures[0]);
+	RequestTex (normalmap, textures[1]);
+	RequestTex (specularmap, textures[2]);
+	RequestTex (parametermap, textures[3]);
+	RequestTex (heightmap, textures[4]);
+	RequestTex (displacementmap, textures[5]);
 }
 
-bool Material::Load (const std::string &name)
+void Material::Read (const std::string &name, Description &desc)
 {
-	YAML::Node desc;
+	YAML::Node node;
 	std::string filename = name + ".yaml";
-	std::ifstream file (MakePath ("materials", filename), std::ifstream::in);
-	if (!file.is_open ())
+	FileSystem::File file;
+	if (!filesystem.Open (MakePath ("materials", filename), file))
+		 throw std::runtime_error (std::string ("Cannot open material file ")
+															 + filename + ".");
 	{
-		(*logstream) << "Cannot open material file " << filename << std::endl;
-		return false;
+		Profiler::Scope scope ("yaml", filename);
+		node = YAML::Load (file.GetStream ());
 	}
-	desc = YAML::Load (file);
-	if (!desc.IsMap ())
+	if (!node.IsMap ())
+		 throw std::runtime_error (std::string ("The material file ") + filename
+															 + " has an invalid format.");
+
+	const char *names[] = { "diffuse", "normalmap", "specularmap",
+													"parametermap", "heightmap", "displacementmap" };
+	for (int i = 0; i < 6; i++)
 	{
-		(*logstream) << "The material file " << filename
-								 << " has an invalid format." << std::endl;
-		return false;
+		const YAML::Node &texture = node["textures"][names[i]];
+		desc.textures[i].clear ();
+		if (texture.IsScalar ())
+			 desc.textures[i] = texture.as<std::string> ();
 	}
-
-	transparent = desc["transparent"].as<bool> (false);
-	doublesided = desc["doublesided"].as<bool> (false);
-
-	if (!LoadTex (diffuse, diffuse_enabled,
-								desc["textures"]["diffuse"]))
-		 return false;
-	if (!LoadTex (normalmap, normalmap_enabled,
-								desc["textures"]["normalmap"]))
-		 return false;
-	if (!LoadTex (specularmap, specularmap_enabled,
-								desc["textures"]["specularmap"]))
-		 return false;
-	if (!LoadTex (parametermap, parametermap_enabled,
-								desc["textures"]["parametermap"]))
-		 return false;
-	if (!LoadTex (heightmap, heightmap_enabled,
-								desc["textures"]["heightmap"]))
-		 return false;
-	if (!LoadTex (displacementmap, displacementmap_enabled,
-								desc["textures"]["displacementmap"]))
-		 return false;
-
-	return true;
+	desc.transparent = node["transparent"].as<bool> (false);
+	desc.doublesided = node["doublesided"].as<bool> (false);
 }
 
 bool Material::IsTransparent (void) const
@@ -225,37 +140,43 @@ bool Material::IsDoubleSided (void) const
 	return doublesided;
 }
 
-void Material::Use (const gl::Program &program) const
+bool Material::IsResident (const TextureCache::Handle &texture)
 {
-	program["diffuse_enabled"] = diffuse_enabled;
-	if (diffuse_enabled)
-	{
-		diffuse.Bind (GL_TEXTURE0, GL_TEXTURE_2D);
-	}
-	program["normalmap_enabled"] = normalmap_enabled;
-	if (normalmap_enabled)
-	{
-		normalmap.Bind (GL_TEXTURE1, GL_TEXTURE_2D);
-	}
-	program["specularmap_enabled"] = specularmap_enabled;
-	if (specularmap_enabled)
-	{
-		specularmap.Bind (GL_TEXTURE2, GL_TEXTURE_2D);
-	}
-	program["parametermap_enabled"] = parametermap_enabled;
-	if (parametermap_enabled)
-	{
-		parametermap.Bind (GL_TEXTURE3, GL_TEXTURE_2D);
-	}
-	program["heightmap_enabled"] = heightmap_enabled;
-	if (heightmap_enabled)
+	return texture && texture->resident;
+}
+
+GLuint Material::GetAllFeatures (void) const
+{
+	return features;
+}
+
+GLuint Material::GetFeatures (void) const
+{
+	const TextureCache::Handle *handles[] = {
+		&diffuse, &normalmap, &specularmap, &parametermap, &heightmap,
+		&displacementmap
+	};
+	for (const TextureCache::Handle *handle : handles)
 	{
-		heightmap.Bind (GL_TEXTURE4, GL_TEXTURE_2D);
+		if (*handle && !IsResident (*handle))
+			 return 0;
 	}
-	program["displacementmap_enabled"] = displacementmap_enabled;
-	if (displacementmap_enabled)
+	return features;
+}
+
+void Material::Use (void) const
+{
+	if (GetFeatures () == 0)
+		 return;
+
+	const TextureCache::Handle *handles[] = {
+		&diffuse, &normalmap, &specularmap, &parametermap, &heightmap,
+		&displacementmap
+	};
+	for (GLuint i = 0; i < 6; i++)
 	{
-		displacementmap.Bind (GL_TEXTURE5, GL_TEXTURE_2D);
+		if (*handles[i])
+			 (*handles[i])->texture->Bind (GL_TEXTURE0 + i, GL_TEXTURE_2D);
 	}
 }
 
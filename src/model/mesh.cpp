@@ -20,32 +20,49 @@
 #include "model/model.h"
 #include "geometry.h"
 #include "renderer.h"
+#include "occlusion.h"
+#include "profiler.h"
 #include <pchm.h>
+#include <cfloat>
 
 Mesh::Mesh (Model &model) : trianglecount (0), quadcount (0),
 														patches (false), vertexcount (0),
+														basevertex (0), firsttriangle (0),
+														firstquad (0), firsttrianglepatch (0),
+														firstquadpatch (0),
 														parent (model), material (NULL),
 														bsphere ({ glm::vec3 (0, 0, 0), 0.0f }),
+														bbox ({ glm::vec3 (0, 0, 0), glm::vec3 (0, 0, 0) }),
 														shadows (true)
 {
+	occluder.requested = false;
 }
 
 Mesh::Mesh (Mesh &&mesh)
-	: vertexarray (std::move (mesh.vertexarray)),
-		depthonlyarray (std::move (mesh.depthonlyarray)),
-		quadcount (mesh.quadcount),
+	: quadcount (mesh.quadcount),
 		trianglecount (mesh.trianglecount),
 		patches (mesh.patches),
 		vertexcount (mesh.vertexcount),
-		buffers (std::move (mesh.buffers)),
-		triangleindices (std::move (mesh.triangleindices)),
-		quadindices (std::move (mesh.quadindices)),
+		basevertex (mesh.basevertex),
+		firsttriangle (mesh.firsttriangle),
+		firstquad (mesh.firstquad),
+		firsttrianglepatch (mesh.firsttrianglepatch),
+		firstquadpatch (mesh.firstquadpatch),
 		material (mesh.material),
 		parent (mesh.parent),
 		bsphere ({ mesh.bsphere.center, mesh.bsphere.radius }),
+		bbox ({ mesh.bbox.min, mesh.bbox.max }),
+		data (std::move (mesh.data)),
+		filename (std::move (mesh.filename)),
 		shadows (mesh.shadows)
 {
+	occluder.requested = mesh.occluder.requested;
+	occluder.vertices = std::move (mesh.occluder.vertices);
+	occluder.indices = std::move (mesh.occluder.indices);
 	mesh.trianglecount = mesh.quadcount = mesh.vertexcount = 0;
+	mesh.basevertex = 0;
+	mesh.firsttriangle = mesh.firstquad = 0;
+	mesh.firsttrianglepatch = mesh.firstquadpatch = 0;
 	mesh.patches = false;
 	mesh.bsphere.center = glm::vec3 (0, 0, 0);
 	mesh.bsphere.radius = 0.0f;
@@ -59,21 +76,31 @@ Mesh::~Mesh (void)
 
 Mesh &Mesh::operator= (Mesh &&mesh)
 {
-	vertexarray = std::move (mesh.vertexarray);
-	depthonlyarray = std::move (mesh.depthonlyarray);
 	trianglecount = mesh.trianglecount;
 	quadcount = mesh.quadcount;
 	patches = mesh.patches;
 	vertexcount = mesh.vertexcount;
-	buffers = std::move (mesh.buffers);
-	triangleindices = std::move (triangleindices);
-	quadindices = std::move (quadindices);
+	basevertex = mesh.basevertex;
+	firsttriangle = mesh.firsttriangle;
+	firstquad = mesh.firstquad;
+	firsttrianglepatch = mesh.firsttrianglepatch;
+	firstquadpatch = mesh.firstquadpatch;
 	material = mesh.material;
 	bsphere.center = mesh.bsphere.center;
 	bsphere.radius = mesh.bsphere.radius;
+	bbox.min = mesh.bbox.min;
+	bbox.max = mesh.bbox.max;
+	data = std::move (mesh.data);
+	filename = std::move (mesh.filename);
 	shadows = mesh.shadows;
+	occluder.requested = mesh.occluder.requested;
+	occluder.vertices = std::move (mesh.occluder.vertices);
+	occluder.indices = std::move (mesh.occluder.indices);
 	parent = std::move (mesh.parent);
 	mesh.trianglecount = mesh.quadcount = mesh.vertexcount = 0;
+	mesh.basevertex = 0;
+	mesh.firsttriangle = mesh.firstquad = 0;
+	mesh.firsttrianglepatch = mesh.firstquadpatch = 0;
 	mesh.patches = false;
 	mesh.material = NULL;
 	mesh.bsphere.center = glm::vec3 (0, 0, 0);
@@ -86,6 +113,18 @@ bool Mesh::CastsShadow (void) const
 	return shadows;
 }
 
+bool Mesh::IsOccluder (void) const
+{
+	return !occluder.indices.empty ();
+}
+
+void Mesh::RasterizeOccluder (Occlusion &occlusion,
+															const glm::mat4 &mvmat) const
+{
+	occlusion.Rasterize (mvmat, &occluder.vertices[0], &occluder.indices[0],
+											 occluder.indices.size () / 3);
+}
+
 bool Mesh::IsTransparent (void) const
 {
 	return material->IsTransparent ();
@@ -96,18 +135,26 @@ bool Mesh::IsTessellated (void) const
 	return patches;
 }
 
-bool Mesh::Load (const std::string &filename, const Material *mat,
-								 glm::vec3 &min, glm::vec3 &max,
-								 bool s)
+const Material *Mesh::GetMaterial (void) const
 {
+	return material;
+}
+
+void Mesh::Read (const std::string &fname, bool s, bool o)
+{
+	filename = fname;
 	shadows = s;
-	material = mat;
+	occluder.requested = o;
 
-	pchm::model model;
-	if (!model.Load (filename))
+	data.reset (new pchm::model);
+	pchm::model &model = *data;
 	{
-		(*logstream) << "Cannot load " << filename << "." << std::endl;
-		return false;
+		Profiler::Scope scope ("mesh read", filename);
+		FileSystem::File file;
+		if (!filesystem.Open (filename, file)
+				|| !model.Load (file.GetStream ()))
+			 throw std::runtime_error (std::string ("Cannot load the mesh ")
+																 + filename + ".");
 	}
 
 
@@ -119,119 +166,102 @@ bool Mesh::Load (const std::string &filename, const Material *mat,
 
 	const glm::vec3 *vertices = model.GetPositions ();
 
-	// calculate the center of the bounding sphere
-	// and calculate the bounding box
 	{
-		float factor = 1.0f / float (vertexcount);
-		bsphere.center = glm::vec3 (0, 0, 0);
-		for (auto i = 0; i < vertexcount; i++)
+		Profiler::Scope scope ("bounds", filename);
+
+		// calculate the center of the bounding sphere
+		// and calculate the bounding box
 		{
-			glm::vec3 vertex = vertices[i];
-			bsphere.center += factor * vertex;
-			if (vertex.x < min.x)
-				 min.x = vertex.x;
-			if (vertex.y < min.y)
-				 min.y = vertex.y;
-			if (vertex.z < min.z)
-				 min.z = vertex.z;
-			if (vertex.x > max.x)
-				 max.x = vertex.x;
-			if (vertex.y > max.y)
-				 max.y = vertex.y;
-			if (vertex.z > max.z)
-				 max.z = vertex.z;
+			float factor = 1.0f / float (vertexcount);
+			bsphere.center = glm::vec3 (0, 0, 0);
+			bbox.min = glm::vec3 (FLT_MAX, FLT_MAX, FLT_MAX);
+			bbox.max = glm::vec3 (-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			for (auto i = 0; i < vertexcount; i++)
+			{
+				glm::vec3 vertex = vertices[i];
+				bsphere.center += factor * vertex;
+				bbox.min = glm::min (bbox.min, vertex);
+				bbox.max = glm::max (bbox.max, vertex);
+			}
 		}
-	}
 
-	// calculate the radius of the bounding sphere
-	{
-		bsphere.radius = 0;
-		for (auto i = 0; i < vertexcount; i++)
+		// calculate the radius of the bounding sphere
 		{
-			glm::vec3 vertex = vertices[i];
-			float distance = glm::distance (bsphere.center, vertex);
-			if (distance > bsphere.radius)
-				 bsphere.radius = distance;
+			bsphere.radius = 0;
+			for (auto i = 0; i < vertexcount; i++)
+			{
+				glm::vec3 vertex = vertices[i];
+				float distance = glm::distance (bsphere.center, vertex);
+				if (distance > bsphere.radius)
+					 bsphere.radius = distance;
+			}
 		}
 	}
 
 	if (model.GetNumTexcoords () != 1)
-	{
-		(*logstream) << "Invalid number of texture coordinates in "
-								 << filename << std::endl;
-		return false;
-	}
+		 throw std::runtime_error (std::string ("Invalid number of texture "
+																						"coordinates in ") + filename
+															 + ".");
 
-	if (patches)
-	{
-		buffers.emplace_back ();
-		buffers.back ().Data (vertexcount * sizeof (glm::vec3),
-													vertices, GL_STATIC_DRAW);
-		
-		depthonlyarray.VertexAttribOffset(buffers[0], 0, 3, GL_FLOAT,
-																			GL_FALSE, 0, 0);
-		depthonlyarray.EnableVertexAttrib (0);
-		
-		vertexarray.VertexAttribOffset (buffers[0], 0, 3, GL_FLOAT,
-																		GL_FALSE, 0, 0);
-		vertexarray.EnableVertexAttrib (0);
-		
-		buffers.emplace_back ();
-		buffers.back ().Data (vertexcount * sizeof (glm::vec2),
-													model.GetTexcoords (0), GL_STATIC_DRAW);
-		vertexarray.VertexAttribOffset (buffers.back (), 1, 2, GL_FLOAT,
-																		GL_FALSE, 0, 0);
-		vertexarray.EnableVertexAttrib (1);
+	if (!patches && quadcount)
+		 throw std::runtime_error (filename + " contains quads.");
+}
 
-		if (trianglecount)
-			 triangleindices.Data (trianglecount * sizeof (GLuint) * 15,
-														 model.GetTriangleIndices (), GL_STATIC_DRAW);
-		if (quadcount)
-			 quadindices.Data (quadcount * sizeof (GLuint) * 20,
-												 model.GetQuadIndices (), GL_STATIC_DRAW);
-	}
-	else
+bool Mesh::Upload (const Material *mat, glm::vec3 &min, glm::vec3 &max)
+{
+	if (!data)
+		 return false;
+
+	material = mat;
+
+	Profiler::Scope scope ("mesh upload", filename);
+	pchm::model &model = *data;
+	const glm::vec3 *vertices = model.GetPositions ();
+
+	min = glm::min (min, bbox.min);
+	max = glm::max (max, bbox.max);
+
+	Arena &arena = r->geometry.arena;
+	if (patches)
 	{
+		basevertex = arena.AddPatchVertices (vertexcount, vertices,
+																				 model.GetTexcoords (0));
 		if (trianglecount)
 		{
-			buffers.emplace_back ();
-			buffers.back ().Data (vertexcount * sizeof (glm::vec3),
-														vertices, GL_STATIC_DRAW);
-
-			buffers.emplace_back ();
-			buffers.back ().Data (vertexcount * sizeof (glm::vec3),
-														model.GetNormals (), GL_STATIC_DRAW);
-			buffers.emplace_back ();
-			buffers.back ().Data (vertexcount * sizeof (glm::vec3),
-														model.GetTangents (), GL_STATIC_DRAW);
-
-			depthonlyarray.VertexAttribOffset(buffers[0], 0, 3, GL_FLOAT,
-																				GL_FALSE, 0, 0);
-			depthonlyarray.EnableVertexAttrib (0);
-	
-			for (auto i = 0; i < 3; i++)
-			{
-				vertexarray.VertexAttribOffset (buffers[i], i, 3, GL_FLOAT,
-																				GL_FALSE, 0, 0);
-				vertexarray.EnableVertexAttrib (i);
-			}
-
-			buffers.emplace_back ();
-			buffers.back ().Data (vertexcount * sizeof (glm::vec2),
-														model.GetTexcoords (0), GL_STATIC_DRAW);
-			vertexarray.VertexAttribOffset (buffers.back (), 3, 2, GL_FLOAT,
-																			GL_FALSE, 0, 0);
-			vertexarray.EnableVertexAttrib (3);
-
-			triangleindices.Data (trianglecount * sizeof (GLuint) * 3,
-														model.GetTriangleIndices (), GL_STATIC_DRAW);
+			firsttriangle = arena.AddIndices (trianglecount * 15,
+																				model.GetTriangleIndices ());
+			firsttrianglepatch = arena.AddPatchData
+				 (trianglecount, model.GetTriangleCurvature (),
+					material->IsDoubleSided () ? NULL : model.GetTriangleCones ());
 		}
 		if (quadcount)
 		{
-			(*logstream) << filename << " contains quads." << std::endl;
-			return false;
+			firstquad = arena.AddIndices (quadcount * 20,
+																		model.GetQuadIndices ());
+			firstquadpatch = arena.AddPatchData
+				 (quadcount, model.GetQuadCurvature (),
+					material->IsDoubleSided () ? NULL : model.GetQuadCones ());
 		}
 	}
+	else if (trianglecount)
+	{
+		basevertex = arena.AddTriangleVertices (vertexcount, vertices,
+																						model.GetNormals (),
+																						model.GetTangents (),
+																						model.GetTexcoords (0));
+		firsttriangle = arena.AddIndices (trianglecount * 3,
+																			model.GetTriangleIndices ());
+
+		if (occluder.requested && !material->IsTransparent ())
+		{
+			occluder.vertices.assign (vertices, vertices + vertexcount);
+			occluder.indices.assign (model.GetTriangleIndices (),
+															 model.GetTriangleIndices ()
+															 + trianglecount * 3);
+		}
+	}
+
+	data.reset ();
 	return true;
 }
 
@@ -333,84 +363,38 @@ bool Mesh::LoadTriangles (std::ifstream &file, unsigned int num_texcoords,
 		}
 	}
 
-	buffers.emplace_back ();
-	buffers.back ().Data (vertexcount * sizeof (glm::vec3),
-												&vertices[0], GL_STATIC_DRAW);
+	basevertex = r->geometry.arena.AddTriangleVertices (vertexcount,
+																											&vertices[0],
+																											&normals[0],
+																											&tangents[0],
+																											&texcoords[0]);
+	firsttriangle = r->geometry.arena.AddIndices (trianglecount * 3,
+																								&indexarray[0]);
 
-	buffers.emplace_back ();
-	buffers.back ().Data (vertexcount * sizeof (glm::vec3),
-												&normals[0], GL_STATIC_DRAW);
-	buffers.emplace_back ();
-	buffers.back ().Data (vertexcount * sizeof (glm::vec3),
-												&tangents[0], GL_STATIC_DRAW);
-
-	depthonlyarray.VertexAttribOffset(buffers[0], 0, 3, GL_FLOAT,
-																		GL_FALSE, 0, 0);
-	depthonlyarray.EnableVertexAttrib (0);
-
-	for (auto i = 0; i < 3; i++)
-	{
-		vertexarray.VertexAttribOffset (buffers[i], i, 3, GL_FLOAT,
-																		GL_FALSE, 0, 0);
-		vertexarray.EnableVertexAttrib (i);
-	}
-
-	buffers.emplace_back ();
-	buffers.back ().Data (vertexcount * sizeof (glm::vec2),
-												&texcoords[0], GL_STATIC_DRAW);
-	vertexarray.VertexAttribOffset (buffers.back (), 3, 2, GL_FLOAT,
-																	GL_FALSE, 0, 0);
-	vertexarray.EnableVertexAttrib (3);
-
-	triangleindices.Data (trianglecount * sizeof (GLuint) * 3,
-												&indexarray[0], GL_STATIC_DRAW);
-
-	GL_CHECK_ERROR;
 	return true;
 }
 
-void Mesh::Render (const gl::Program &program, bool depthonly,
-									 bool quads) const
+GLint Mesh::GetPatchOffset (bool quads) const
 {
-	if (!r->culling.IsVisible
-			(bsphere.center, bsphere.radius))
-		return;
-
-	material->Use (program);
-	if (depthonly)
-		 depthonlyarray.Bind ();
-	else
-	 vertexarray.Bind ();
-
-	if (material->IsDoubleSided ())
-		 gl::Disable (GL_CULL_FACE);
+	return quads ? firstquadpatch : firsttrianglepatch;
+}
 
-	if (patches)
+DrawElementsIndirectCommand Mesh::GetDrawCommand (GLuint instancecount,
+																									bool quads) const
+{
+	DrawElementsIndirectCommand command;
+	if (patches && quads)
 	{
-		if (quads)
-		{
-			quadindices.Bind (GL_ELEMENT_ARRAY_BUFFER);
-			gl::PatchParameteri (GL_PATCH_VERTICES, 20);
-			gl::DrawElements (GL_PATCHES, quadcount * 20,
-												GL_UNSIGNED_INT, NULL);
-		}
-		else
-		{
-			triangleindices.Bind (GL_ELEMENT_ARRAY_BUFFER);
-			gl::PatchParameteri (GL_PATCH_VERTICES, 15);
-			gl::DrawElements (GL_PATCHES, trianglecount * 15,
-												GL_UNSIGNED_INT, NULL);
-		}
+		command.count = quadcount * 20;
+		command.firstIndex = firstquad;
 	}
 	else
 	{
-		triangleindices.Bind (GL_ELEMENT_ARRAY_BUFFER);
-		gl::DrawElements (GL_TRIANGLES, trianglecount * 3,
-											GL_UNSIGNED_INT, NULL);
+		command.count = trianglecount * (patches ? 15 : 3);
+		command.firstIndex = firsttriangle;
 	}
-
-	if (material->IsDoubleSided ())
-		 gl::Enable (GL_CULL_FACE);
-
-	GL_CHECK_ERROR;
+	command.instanceCount = instancecount;
+	command.baseVertex = basevertex;
+	command.baseInstance = 0;
+	return command;
 }
@@ -20,22 +20,22 @@
 #include <fstream>
 #include <algorithm>
 #include "renderer.h"
+#include "profiler.h"
 
 Model::Model (void)
 {
 }
 
-Model::Model (Model &&model) : meshes (std::move (model.meshes)),
+Model::Model (Model &&model) : filename (std::move (model.filename)),
+															 sources (std::move (model.sources)),
+															 meshes (std::move (model.meshes)),
 															 patches (std::move (model.patches)),
 															 transparent (std::move (model.transparent)),
 															 materials (std::move (model.materials)),
-															 queries (std::move (model.queries))
+															 pending (std::move (model.pending))
 {
 	bbox.min = model.bbox.min;
 	bbox.max = model.bbox.max;
-	bbox.buffer = std::move (model.bbox.buffer);
-	bbox.indices = std::move (model.bbox.indices);
-	bbox.array = std::move (model.bbox.array);
 	bsphere.center = model.bsphere.center;
 	bsphere.radius = model.bsphere.radius;
 }
@@ -46,75 +46,150 @@ Model::~Model (void)
 
 Model &Model::operator= (Model &&model)
 {
+	filename = std::move (model.filename);
+	sources = std::move (model.sources);
 	meshes = std::move (model.meshes);
 	patches = std::move (model.patches);
 	transparent = std::move (model.transparent);
 	materials = std::move (model.materials);
+	pending = std::move (model.pending);
 	bbox.min = model.bbox.min;
 	bbox.max = model.bbox.max;
-	bbox.buffer = std::move (model.bbox.buffer);
-	bbox.indices = std::move (model.bbox.indices);
-	bbox.array = std::move (model.bbox.array);
 	bsphere.center = model.bsphere.center;
 	bsphere.radius = model.bsphere.radius;
 }
 
-bool Model::Load (const std::string &filename)
+void Model::Read (const std::string &fname)
 {
-#ifdef DEBUG
-	debug.filename = filename;
-#endif /* DEBUG */
+	filename = fname;
 
 	YAML::Node desc;
-	std::ifstream file (MakePath ("models", filename), std::ifstream::in);
-	if (!file.is_open ())
+	FileSystem::File file;
+	if (!filesystem.Open (MakePath ("models", filename), file))
+		 throw std::runtime_error (std::string ("Cannot open ") + filename + ".");
+
+	{
+		Profiler::Scope scope ("yaml", filename);
+		desc = YAML::Load (file.GetStream ());
+	}
+	if (!desc.IsMap () || !desc["meshes"].IsSequence ())
+		 throw std::runtime_error (std::string ("The model file ") + filename
+															 + " has an invalid format.");
+
+	if (desc["meshes"].size () < 1)
+		 throw std::runtime_error (filename + " contains no meshes.");
+
+	for (const YAML::Node &node : desc["meshes"])
 	{
-		(*logstream) << "Cannot open " << filename << std::endl;
-		return false;
+		Source source;
+		source.filename = node["filename"].as<std::string> ();
+		source.material = node["material"].as<std::string> ();
+		source.shadows = node["shadows"].as<bool> (true);
+		source.occluder = node["occluder"].as<bool> (false);
+		sources.push_back (source);
 	}
 
-	desc = YAML::Load (file);
-	if (!desc.IsMap ())
+	ReadMeshes ();
+}
+
+bool Model::Read (const SceneSnapshot &snapshot, GLuint index)
+{
+	const SceneSnapshot::Model &model = snapshot.GetModels ()[index];
+	filename = snapshot.GetString (model.filename);
+
+	const SceneSnapshot::Mesh *mesh = snapshot.GetMeshes () + model.firstmesh;
+	for (GLuint i = 0; i < model.nummeshes; i++, mesh++)
 	{
-		(*logstream) << "The model file " << filename
-								 << " has an invalid format." << std::endl;
-		return false;
+		Source source;
+		source.filename = snapshot.GetString (mesh->filename);
+		source.material = snapshot.GetString (mesh->material);
+		source.shadows = mesh->flags & SceneSnapshot::Flags::Shadows;
+		source.occluder = mesh->flags & SceneSnapshot::Flags::Occluder;
+		sources.push_back (source);
 	}
 
-	if (!desc["meshes"].IsSequence ())
+	ReadMeshes ();
+	return true;
+}
+
+void Model::ReadMeshes (void)
+{
+	// the meshes are read in parallel, so they must not move
+	pending.reserve (sources.size ());
+	for (const Source &source : sources)
 	{
-		(*logstream) << filename << " has an invalid format." << std::endl;
-		(*logstream) << desc["meshes"].Type () << std::endl;
-		return false;
+		std::string path = MakePath ("models", source.filename);
+		bool shadows = source.shadows;
+		bool occluder = source.occluder;
+
+		pending.emplace_back (*this);
+		Mesh *mesh = &pending.back ();
+		r->threadpool.Run ([=] (void) {
+				mesh->Read (path, shadows, occluder);
+			});
 	}
+}
 
+void Model::GetMaterials (std::set<std::string> &names) const
+{
+	for (const Source &source : sources)
+		 names.insert (source.material);
+}
+
+void Model::Export (SceneSnapshot::Writer &writer) const
+{
+	SceneSnapshot::Model model;
+	writer.AddInput (ConcatPath ("models", filename));
+	model.filename = writer.AddString (filename);
+	model.firstmesh = writer.meshes.size ();
+	model.nummeshes = sources.size ();
+	for (const Source &source : sources)
+	{
+		SceneSnapshot::Mesh mesh;
+		mesh.filename = writer.AddString (source.filename);
+		mesh.material = writer.AddString (source.material);
+		mesh.flags = 0;
+		if (source.shadows)
+			 mesh.flags |= SceneSnapshot::Flags::Shadows;
+		if (source.occluder)
+			 mesh.flags |= SceneSnapshot::Flags::Occluder;
+		writer.meshes.push_back (mesh);
+	}
+	writer.models.push_back (model);
+}
+
+bool Model::Upload (void)
+{
 	bbox.min = glm::vec3 (FLT_MAX, FLT_MAX, FLT_MAX);
 	bbox.max = glm::vec3 (-FLT_MAX, -FLT_MAX, -FLT_MAX);
 
-	GLuint num_meshes = 0;
-	for (const YAML::Node &node : desc["meshes"])
+	// the meshes are read in the order of their sources
+	for (GLuint i = 0; i < pending.size (); i++)
 	{
-		std::string filename = MakePath ("models",
-																		 node["filename"].as<std::string> ());
-		const Material &material = r->geometry.GetMaterial
-			 (node["material"].as<std::string> ());
+		Mesh &mesh = pending[i];
+		const Material *material = r->geometry.GetMaterial (sources[i].material);
+		if (material == NULL)
+		{
+			(*logstream) << "The material " << sources[i].material
+									 << " of " << mesh.filename << " is not loaded."
+									 << std::endl;
+			return false;
+		}
 
-		Mesh mesh (*this);
-		mesh.Load (filename, &material, bbox.min, bbox.max,
-							 node["shadows"].as<bool> (true));
+		if (!mesh.Upload (material, bbox.min, bbox.max))
+			 return false;
 
 		if (mesh.IsTransparent ())
 		{
 			if (mesh.IsTessellated ())
 			{
-				(*logstream) << "Mesh " << filename
+				(*logstream) << "Mesh " << mesh.filename
 										 << " has an invalid type." << std::endl;
 				return false;
 			}
 			else
 			{
 				transparent.emplace_back (std::move (mesh));
-				num_meshes++;
 			}
 		}
 		else
@@ -122,56 +197,14 @@ bool Model::Load (const std::string &filename)
 			if (mesh.IsTessellated ())
 			{
 				patches.emplace_back (std::move (mesh));
-				num_meshes++;
 			}
 			else
 			{
 				meshes.emplace_back (std::move (mesh));
-				num_meshes++;
 			}
 		}
 	}
-
-	if (num_meshes < 1)
-	{
-		(*logstream) << filename << " contains no meshes." << std::endl;
-		return false;
-	}
-
-	{
-		glm::vec3 bboxvertex[8];
-		bboxvertex[0] = glm::vec3 (bbox.min.x, bbox.min.y, bbox.min.z);
-		bboxvertex[1] = glm::vec3 (bbox.max.x, bbox.min.y, bbox.min.z);
-		bboxvertex[2] = glm::vec3 (bbox.max.x, bbox.max.y, bbox.min.z);
-		bboxvertex[3] = glm::vec3 (bbox.min.x, bbox.max.y, bbox.min.z);
-		bboxvertex[4] = glm::vec3 (bbox.min.x, bbox.min.y, bbox.max.z);
-		bboxvertex[5] = glm::vec3 (bbox.max.x, bbox.min.y, bbox.max.z);
-		bboxvertex[6] = glm::vec3 (bbox.max.x, bbox.max.y, bbox.max.z);
-		bboxvertex[7] = glm::vec3 (bbox.min.x, bbox.max.y, bbox.max.z);
-		bbox.buffer.Data (8 * sizeof (glm::vec3), &bboxvertex[0], GL_STATIC_DRAW);
-
-		glm::detail::tvec3<GLubyte> bboxindices[12];
-
-		bboxindices[0] = glm::detail::tvec3<GLubyte> (0, 1, 2);
-		bboxindices[1] = glm::detail::tvec3<GLubyte> (2, 3, 0);
-		bboxindices[2] = glm::detail::tvec3<GLubyte> (1, 5, 6);
-		bboxindices[3] = glm::detail::tvec3<GLubyte> (1, 6, 2);
-		bboxindices[4] = glm::detail::tvec3<GLubyte> (5, 4, 6);
-		bboxindices[5] = glm::detail::tvec3<GLubyte> (4, 7, 6);
-		bboxindices[6] = glm::detail::tvec3<GLubyte> (4, 0, 3);
-		bboxindices[7] = glm::detail::tvec3<GLubyte> (4, 3, 7);
-		bboxindices[8] = glm::detail::tvec3<GLubyte> (3, 2, 6);
-		bboxindices[9] = glm::detail::tvec3<GLubyte> (3, 6, 7);
-		bboxindices[10] = glm::detail::tvec3<GLubyte> (0, 4, 1);
-		bboxindices[11] = glm::detail::tvec3<GLubyte> (4, 5, 1);
-
-		bbox.indices.Data (12 * sizeof (glm::detail::tvec3<GLubyte>),
-											 &bboxindices[0], GL_STATIC_DRAW);
-	}
-
-	bbox.array.VertexAttribOffset (bbox.buffer, 0, 3, GL_FLOAT,
-																 GL_FALSE, 0, 0);
-	bbox.array.EnableVertexAttrib (0);
+	pending.clear ();
 
 // TODO: Calculate a decent bounding sphere.
 //       This is a very rough approximation.
@@ -183,155 +216,65 @@ bool Model::Load (const std::string &filename)
 	return true;
 }
 
-void Model::Render (GLuint pass, const gl::Program &program)
+bool Model::IsVisible (Culling &culling, bool occlusion,
+											 float displacement) const
 {
-	GLuint result = GL_TRUE;
-	GLuint passtype;
-
-  if (!r->culling.IsVisible
-			(bsphere.center, bsphere.radius))
-		return;
+	if (!culling.IsVisible (bsphere.center, bsphere.radius))
+		 return false;
 
-	passtype = pass & Geometry::Pass::Mask;
-
-	bool shadowpass = (passtype == Geometry::Pass::ShadowMap)
-		 || (passtype == Geometry::Pass::ShadowMapTriangleTess)
-		 || (passtype == Geometry::Pass::ShadowMapQuadTess);
-
-	std::map<GLuint, gl::Query>::iterator query;
-	switch (passtype)
+	if (occlusion)
 	{
-	case Geometry::Pass::GBuffer:
-	case Geometry::Pass::GBufferTransparency:
-		query = queries.find (pass);
-		if (query == queries.end ())
+		glm::mat4 mvpmat = culling.GetProjMatrix ()
+			 * culling.GetModelViewMatrix ();
+		// displacement may move the surface out of the bounding box
+		glm::vec3 min = bbox.min - glm::vec3 (displacement);
+		glm::vec3 max = bbox.max + glm::vec3 (displacement);
+		if (r->occlusion.IsOccluded (mvpmat, min, max)
+				|| r->hiz.IsOccluded (mvpmat, min, max))
 		{
-			auto ret = queries.insert (std::pair<GLuint, gl::Query>
-																 (pass, gl::Query ()));
-			if (ret.second == false)
-				 throw std::runtime_error ("Cannot insert element to map.");
-			query = ret.first;
+			culled++;
+			return false;
 		}
+	}
 
-		if (query->second.IsValid ())
-		{
-			do
-			{
-				query->second.Get (GL_QUERY_RESULT_AVAILABLE, &result);
-			} while (result == GL_FALSE);
-			if (result == GL_TRUE)
-			{
-				query->second.Get (GL_QUERY_RESULT, &result);
-			}
-			else
-			{
-				(*logstream) << "Query result not yet available" << std::endl;
-			}
-		}
+	return true;
+}
 
-		query->second.Begin (GL_ANY_SAMPLES_PASSED);
-		break;
-	case Geometry::Pass::GBufferSRAA:
-		GLuint p;
-		p = (pass & (~Geometry::Pass::Mask)) | Geometry::Pass::GBuffer;
-		query = queries.find (pass);
-		if (query != queries.end ())
+void Model::GetMeshes (GLuint categories, bool shadowcasters,
+											 std::vector<const Mesh*> &list) const
+{
+	if (categories & Meshes::Patches)
+	{
+		for (const Mesh &mesh : patches)
 		{
-			if (query->second.IsValid ())
-			{
-				query->second.Get (GL_QUERY_RESULT_AVAILABLE, &result);
-				if (result == GL_TRUE)
-				{
-					query->second.Get (GL_QUERY_RESULT, &result);
-				}
-				else result = GL_TRUE;
-			}
+			if (!shadowcasters || mesh.CastsShadow ())
+				 list.push_back (&mesh);
 		}
-		break;
 	}
-
-	if (result == GL_TRUE)
+	if (categories & Meshes::Transparent)
 	{
-		switch (passtype)
+		for (const Mesh &mesh : transparent)
 		{
-		case Geometry::Pass::GBufferTriangleTess:
-			for (Mesh &mesh : patches)
-			{
-				mesh.Render (program, false, false);
-			}
-			break;
-		case Geometry::Pass::GBufferQuadTess:
-			for (Mesh &mesh : patches)
-			{
-				mesh.Render (program, false, true);
-			}
-			break;
-		case Geometry::Pass::ShadowMapTriangleTess:
-			for (Mesh &mesh : patches)
-			{
-				if (mesh.CastsShadow ())
-					 mesh.Render (program, false, false);
-			}
-			break;
-		case Geometry::Pass::ShadowMapQuadTess:
-			for (Mesh &mesh : patches)
-			{
-				if (mesh.CastsShadow ())
-					 mesh.Render (program, false, true);
-			}
-			break;
-		case Geometry::Pass::GBufferTransparency:
-			for (Mesh &mesh : transparent)
-			{
-				mesh.Render (program, false);
-			}
-			break;
-		case Geometry::Pass::ShadowMap:
-			for (Mesh &mesh : transparent)
-			{
-				if (mesh.CastsShadow ())
-					 mesh.Render (program, true);
-			}
-		case Geometry::Pass::GBuffer:
-			for (Mesh &mesh : meshes)
-			{
-				mesh.Render (program, false);
-			}
-			break;
-		case Geometry::Pass::GBufferSRAA:
-			for (Mesh &mesh : meshes)
-			{
-				mesh.Render (program, true);
-			}
-			break;
+			if (!shadowcasters || mesh.CastsShadow ())
+				 list.push_back (&mesh);
 		}
 	}
-	else if (passtype != Geometry::Pass::GBufferSRAA)
+	if (categories & Meshes::Opaque)
 	{
-		if (passtype != Geometry::Pass::GBufferTransparency)
+		for (const Mesh &mesh : meshes)
 		{
-			gl::ColorMask (GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-			gl::DepthMask (GL_FALSE);
+			list.push_back (&mesh);
 		}
-		r->geometry.bboxprogram.Use ();
-		bbox.array.Bind ();
-		bbox.indices.Bind (GL_ELEMENT_ARRAY_BUFFER);
-		gl::DrawElements (GL_TRIANGLES, 36,
-											GL_UNSIGNED_BYTE, NULL);
-		program.Use ();
-		if (passtype != Geometry::Pass::GBufferTransparency)
-		{
-			gl::DepthMask (GL_TRUE);
-			gl::ColorMask (GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-		}
-		culled++;
 	}
-	switch (passtype)
+}
+
+void Model::RasterizeOccluders (Occlusion &occlusion,
+																const glm::mat4 &mvmat) const
+{
+	for (const Mesh &mesh : meshes)
 	{
-	case Geometry::Pass::GBuffer:
-	case Geometry::Pass::GBufferTransparency:
-		 gl::Query::End (GL_ANY_SAMPLES_PASSED);
-		 break;
+		if (mesh.IsOccluder ())
+			 mesh.RasterizeOccluder (occlusion, mvmat);
 	}
 }
 
@@ -0,0 +1,76 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "occlusion.h"
+#include "renderer.h"
+
+Occlusion::Occlusion (void) : valid (false), enabled (true)
+{
+}
+
+Occlusion::~Occlusion (void)
+{
+}
+
+bool Occlusion::Init (void)
+{
+	enabled = config["occlusion"]["enabled"].as<bool> (true);
+	if (!buffer.Init (config["occlusion"]["width"].as<GLuint> (256),
+										config["occlusion"]["height"].as<GLuint> (192)))
+	{
+		(*logstream) << "Invalid size of the occlusion buffer." << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool Occlusion::GetEnabled (void) const
+{
+	return enabled;
+}
+
+void Occlusion::SetEnabled (bool e)
+{
+	enabled = e;
+	if (!enabled)
+		 valid = false;
+}
+
+void Occlusion::Frame (Geometry &geometry)
+{
+	valid = false;
+	if (!enabled)
+		 return;
+
+	buffer.Clear (r->camera.GetProjMatrix ());
+	geometry.RasterizeOccluders (*this, r->camera.GetViewMatrix ());
+	buffer.Finish ();
+	valid = true;
+}
+
+void Occlusion::Rasterize (const glm::mat4 &mvmat, const glm::vec3 *vertices,
+													 const GLuint *indices, GLuint trianglecount)
+{
+	buffer.Rasterize (mvmat, vertices, indices, trianglecount);
+}
+
+bool Occlusion::IsOccluded (const glm::mat4 &mvpmat, const glm::vec3 &min,
+														const glm::vec3 &max) const
+{
+	return valid && buffer.IsOccluded (mvpmat, min, max);
+}
+
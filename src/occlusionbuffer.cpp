@@ -0,0 +1,264 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "occlusionbuffer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+constexpr GLuint OcclusionBuffer::TileSize;
+
+OcclusionBuffer::OcclusionBuffer (void) : width (0), height (0), tilesx (0),
+																					tilesy (0)
+{
+}
+
+OcclusionBuffer::~OcclusionBuffer (void)
+{
+}
+
+bool OcclusionBuffer::Init (GLuint w, GLuint h)
+{
+	width = (w + TileSize - 1) & ~(TileSize - 1);
+	height = (h + TileSize - 1) & ~(TileSize - 1);
+	if (width == 0 || height == 0)
+		 return false;
+
+	tilesx = width / TileSize;
+	tilesy = height / TileSize;
+
+	depth.resize (width * height);
+	tiles.resize (tilesx * tilesy);
+
+	return true;
+}
+
+void OcclusionBuffer::Clear (const glm::mat4 &p)
+{
+	projmat = p;
+	std::fill (depth.begin (), depth.end (), 1.0f);
+}
+
+void OcclusionBuffer::Rasterize (const glm::mat4 &mvmat,
+																 const glm::vec3 *vertices,
+																 const GLuint *indices, GLuint trianglecount)
+{
+	glm::mat4 mvpmat = projmat * mvmat;
+
+	for (GLuint i = 0; i < trianglecount; i++)
+	{
+		glm::vec3 v[3];
+		bool clipped = false;
+		for (int j = 0; j < 3; j++)
+		{
+			glm::vec4 p = mvpmat * glm::vec4 (vertices[indices[3 * i + j]], 1.0f);
+			// triangles crossing the near plane are skipped, which only
+			// results in less occlusion, never in wrongly culled objects
+			if (p.z < -p.w || p.w <= 0.0f)
+			{
+				clipped = true;
+				break;
+			}
+			p /= p.w;
+			v[j] = glm::vec3 ((0.5f * p.x + 0.5f) * width,
+												(0.5f * p.y + 0.5f) * height,
+												0.5f * p.z + 0.5f);
+		}
+		if (!clipped)
+			 RasterizeTriangle (v[0], v[1], v[2]);
+	}
+}
+
+void OcclusionBuffer::RasterizeTriangle (const glm::vec3 &v0,
+																				 const glm::vec3 &a,
+																				 const glm::vec3 &b)
+{
+	float area = (a.x - v0.x) * (b.y - v0.y) - (b.x - v0.x) * (a.y - v0.y);
+	if (fabsf (area) < 1e-6f)
+		 return;
+
+	// occluders are rasterized regardless of their orientation
+	const glm::vec3 &v1 = (area > 0.0f) ? a : b;
+	const glm::vec3 &v2 = (area > 0.0f) ? b : a;
+	area = fabsf (area);
+
+	float minx = std::min (v0.x, std::min (v1.x, v2.x));
+	float maxx = std::max (v0.x, std::max (v1.x, v2.x));
+	float miny = std::min (v0.y, std::min (v1.y, v2.y));
+	float maxy = std::max (v0.y, std::max (v1.y, v2.y));
+	if (maxx < 0.0f || maxy < 0.0f || minx >= width || miny >= height)
+		 return;
+
+	GLint x0 = std::max (GLint (floorf (minx)), 0) & ~3;
+	GLint x1 = std::min (GLint (ceilf (maxx)), GLint (width) - 1);
+	GLint y0 = std::max (GLint (floorf (miny)), 0);
+	GLint y1 = std::min (GLint (ceilf (maxy)), GLint (height) - 1);
+
+	// edge functions e(x,y) = A x + B y + C, positive inside the triangle
+	float A[3], B[3], C[3];
+	const glm::vec3 *v[3] = { &v0, &v1, &v2 };
+	for (int i = 0; i < 3; i++)
+	{
+		const glm::vec3 &p = *v[(i + 1) % 3];
+		const glm::vec3 &q = *v[(i + 2) % 3];
+		A[i] = p.y - q.y;
+		B[i] = q.x - p.x;
+		C[i] = -(A[i] * p.x + B[i] * p.y);
+	}
+
+	// depth plane z(x,y) = zA x + zB y + zC
+	float zA = (A[0] * v0.z + A[1] * v1.z + A[2] * v2.z) / area;
+	float zB = (B[0] * v0.z + B[1] * v1.z + B[2] * v2.z) / area;
+	float zC = (C[0] * v0.z + C[1] * v1.z + C[2] * v2.z) / area;
+
+#ifdef __SSE__
+	const __m128 offset = _mm_setr_ps (0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps ();
+	const __m128 eA0 = _mm_set1_ps (A[0]);
+	const __m128 eA1 = _mm_set1_ps (A[1]);
+	const __m128 eA2 = _mm_set1_ps (A[2]);
+	const __m128 dzdx = _mm_set1_ps (zA);
+
+	for (GLint y = y0; y <= y1; y++)
+	{
+		float py = y + 0.5f;
+		__m128 eB0 = _mm_set1_ps (B[0] * py + C[0]);
+		__m128 eB1 = _mm_set1_ps (B[1] * py + C[1]);
+		__m128 eB2 = _mm_set1_ps (B[2] * py + C[2]);
+		__m128 zrow = _mm_set1_ps (zB * py + zC);
+		GLfloat *row = &depth[y * width];
+
+		for (GLint x = x0; x <= x1; x += 4)
+		{
+			__m128 px = _mm_add_ps (_mm_set1_ps (float (x)), offset);
+			__m128 e0 = _mm_add_ps (_mm_mul_ps (eA0, px), eB0);
+			__m128 e1 = _mm_add_ps (_mm_mul_ps (eA1, px), eB1);
+			__m128 e2 = _mm_add_ps (_mm_mul_ps (eA2, px), eB2);
+			__m128 mask = _mm_and_ps (_mm_and_ps (_mm_cmpgt_ps (e0, zero),
+																						_mm_cmpgt_ps (e1, zero)),
+																_mm_cmpgt_ps (e2, zero));
+			if (!_mm_movemask_ps (mask))
+				 continue;
+			__m128 z = _mm_add_ps (_mm_mul_ps (dzdx, px), zrow);
+			__m128 old = _mm_loadu_ps (&row[x]);
+			z = _mm_min_ps (old, z);
+			_mm_storeu_ps (&row[x], _mm_or_ps (_mm_and_ps (mask, z),
+																				 _mm_andnot_ps (mask, old)));
+		}
+	}
+#else
+	for (GLint y = y0; y <= y1; y++)
+	{
+		float py = y + 0.5f;
+		GLfloat *row = &depth[y * width];
+		for (GLint x = x0; x <= x1; x++)
+		{
+			float px = x + 0.5f;
+			if (A[0] * px + B[0] * py + C[0] <= 0.0f
+					|| A[1] * px + B[1] * py + C[1] <= 0.0f
+					|| A[2] * px + B[2] * py + C[2] <= 0.0f)
+				 continue;
+			row[x] = std::min (row[x], zA * px + zB * py + zC);
+		}
+	}
+#endif
+}
+
+void OcclusionBuffer::Finish (void)
+{
+	for (GLuint ty = 0; ty < tilesy; ty++)
+	{
+		for (GLuint tx = 0; tx < tilesx; tx++)
+		{
+			const GLfloat *ptr = &depth[ty * TileSize * width + tx * TileSize];
+#ifdef __SSE__
+			__m128 m = _mm_setzero_ps ();
+			for (GLuint y = 0; y < TileSize; y++, ptr += width)
+			{
+				for (GLuint x = 0; x < TileSize; x += 4)
+					 m = _mm_max_ps (m, _mm_loadu_ps (&ptr[x]));
+			}
+			m = _mm_max_ps (m, _mm_shuffle_ps (m, m, _MM_SHUFFLE (2, 3, 0, 1)));
+			m = _mm_max_ps (m, _mm_shuffle_ps (m, m, _MM_SHUFFLE (1, 0, 3, 2)));
+			_mm_store_ss (&tiles[ty * tilesx + tx], m);
+#else
+			GLfloat m = 0.0f;
+			for (GLuint y = 0; y < TileSize; y++, ptr += width)
+			{
+				for (GLuint x = 0; x < TileSize; x++)
+					 m = std::max (m, ptr[x]);
+			}
+			tiles[ty * tilesx + tx] = m;
+#endif
+		}
+	}
+}
+
+bool OcclusionBuffer::IsOccluded (const glm::mat4 &mvpmat,
+																	const glm::vec3 &min,
+																	const glm::vec3 &max) const
+{
+	glm::vec2 rectmin (FLT_MAX, FLT_MAX), rectmax (-FLT_MAX, -FLT_MAX);
+	GLfloat nearest = FLT_MAX;
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec4 p (i & 1 ? max.x : min.x, i & 2 ? max.y : min.y,
+								 i & 4 ? max.z : min.z, 1.0f);
+		p = mvpmat * p;
+		if (p.z < -p.w || p.w <= 0.0f)
+			 return false;
+		p /= p.w;
+		rectmin = glm::min (rectmin, glm::vec2 (p));
+		rectmax = glm::max (rectmax, glm::vec2 (p));
+		nearest = std::min (nearest, p.z);
+	}
+	nearest = 0.5f * nearest + 0.5f;
+
+	rectmin = glm::clamp (0.5f * rectmin + 0.5f, 0.0f, 1.0f);
+	rectmax = glm::clamp (0.5f * rectmax + 0.5f, 0.0f, 1.0f);
+
+	GLuint x0 = std::min (GLuint (rectmin.x * width), width - 1);
+	GLuint y0 = std::min (GLuint (rectmin.y * height), height - 1);
+	GLuint x1 = std::min (GLuint (rectmax.x * width), width - 1);
+	GLuint y1 = std::min (GLuint (rectmax.y * height), height - 1);
+
+	for (GLuint ty = y0 / TileSize; ty <= y1 / TileSize; ty++)
+	{
+		for (GLuint tx = x0 / TileSize; tx <= x1 / TileSize; tx++)
+		{
+			if (tiles[ty * tilesx + tx] < nearest)
+				 continue;
+
+			GLuint ystart = std::max (ty * TileSize, y0);
+			GLuint yend = std::min (ty * TileSize + TileSize - 1, y1);
+			GLuint xstart = std::max (tx * TileSize, x0);
+			GLuint xend = std::min (tx * TileSize + TileSize - 1, x1);
+			for (GLuint y = ystart; y <= yend; y++)
+			{
+				for (GLuint x = xstart; x <= xend; x++)
+				{
+					if (depth[y * width + x] >= nearest)
+						 return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,55 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "permutations.h"
+
+Permutations::Permutations (void) : supported (0)
+{
+}
+
+Permutations::~Permutations (void)
+{
+}
+
+bool Permutations::Load (const std::string &filename, GLuint s,
+												 const std::set<GLuint> &features,
+												 const std::vector<std::string> &definitions,
+												 const std::vector<std::pair<GLenum, std::string>>
+												 &filenames)
+{
+	supported = s;
+	variants.clear ();
+
+	std::set<GLuint> masks = { 0 };
+	for (GLuint mask : features)
+		 masks.insert (mask & supported);
+
+	for (GLuint mask : masks)
+	{
+		if (!LoadProgram (variants[mask], filename, definitions, filenames,
+											mask))
+			 return false;
+	}
+	return true;
+}
+
+const gl::Program &Permutations::Get (GLuint features) const
+{
+	auto it = variants.find (features & supported);
+	if (it == variants.end ())
+		 throw std::runtime_error ("The program variant is not loaded.");
+	return it->second;
+}
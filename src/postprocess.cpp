@@ -174,17 +174,22 @@ bool PostProcess::Init (void)
 		"pp_shadowmap.bin", "pp_glow.bin", "pp_depth.bin", "pp_edge.bin",
 		"pp_luminance.bin"
 	};
+	// the shader cache keeps references to the programs
+	// until their builds are finished
+	fprograms.resize (fprogram_sources.size ());
 	for (auto i = 0; i < fprogram_sources.size (); i++)
 	{
-		fprograms.emplace_back ();
-		if (!LoadProgram (fprograms.back (), MakePath ("shaders", "bin",
-																									 fprogram_binaries[i]),
+		if (!LoadProgram (fprograms[i], MakePath ("shaders", "bin",
+																							fprogram_binaries[i]),
 											GL_FRAGMENT_SHADER, std::string (),
 											{ MakePath ("shaders", "postprocess",
 																	fprogram_sources[i]) }))
 			 return false;
+	}
 
-		gl::SmartUniform<glm::uvec2> uniform (fprograms.back ()["viewport"],
+	for (gl::Program &fprogram : fprograms)
+	{
+		gl::SmartUniform<glm::uvec2> uniform (fprogram["viewport"],
 																					r->camera.GetViewport ());
 		viewport_uniforms.push_back (uniform);
 	}
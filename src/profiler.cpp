@@ -0,0 +1,265 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "profiler.h"
+#include <fstream>
+#include <algorithm>
+#include <iomanip>
+#include <cstdio>
+
+Profiler::Scope::Scope (const char *c, const std::string &a) : category (c)
+{
+	if (!profiler.IsEnabled ())
+		 return;
+	asset = a;
+	start = std::chrono::steady_clock::now ();
+}
+
+Profiler::Scope::~Scope (void)
+{
+	if (!profiler.IsEnabled ())
+		 return;
+	profiler.Record (category, asset, start,
+									 std::chrono::steady_clock::now ());
+}
+
+Profiler::Profiler (void)
+	: origin (std::chrono::steady_clock::now ()), enabled (false),
+		numassets (20)
+{
+}
+
+Profiler::~Profiler (void)
+{
+}
+
+void Profiler::Init (void)
+{
+	const YAML::Node &constconfig = config;
+	const YAML::Node &desc = constconfig["profiler"];
+	enabled = desc["enabled"].as<bool> (false);
+	tracefile = desc["trace"].as<std::string> ("");
+	numassets = desc["assets"].as<GLuint> (20);
+	origin = std::chrono::steady_clock::now ();
+	mainthread = std::this_thread::get_id ();
+}
+
+bool Profiler::IsEnabled (void) const
+{
+	return enabled;
+}
+
+void Profiler::Record (const char *category, const std::string &asset,
+											 std::chrono::steady_clock::time_point start,
+											 std::chrono::steady_clock::time_point end)
+{
+	typedef std::chrono::duration<double, std::micro> microseconds;
+	Event event;
+	event.category = category;
+	event.asset = asset;
+	event.start = std::chrono::duration_cast<microseconds>
+		 (start - origin).count ();
+	event.duration = std::chrono::duration_cast<microseconds>
+		 (end - start).count ();
+	event.thread = std::this_thread::get_id ();
+
+	std::unique_lock<std::mutex> lock (mutex);
+	if (enabled)
+		 events.push_back (event);
+}
+
+void Profiler::Finish (void)
+{
+	{
+		std::unique_lock<std::mutex> lock (mutex);
+		if (!enabled)
+			 return;
+		enabled = false;
+	}
+
+	Report (*logstream);
+	if (!tracefile.empty ())
+	{
+		if (WriteTrace (tracefile))
+			 (*logstream) << "Wrote the loading trace to " << tracefile
+										<< "." << std::endl;
+		else
+			 (*logstream) << "Cannot write the loading trace to " << tracefile
+										<< "." << std::endl;
+	}
+}
+
+void Profiler::Report (std::ostream &stream)
+{
+	struct Total
+	{
+		 std::string name;
+		 const char *category;
+		 GLuint count;
+		 double time;
+		 double max;
+	};
+
+	std::unique_lock<std::mutex> lock (mutex);
+
+	// steps of different categories may overlap, so the wall clock
+	// time is the span of all steps
+	double end = 0.0;
+	std::map<std::string, Total> categories;
+	std::map<std::pair<std::string, const char*>, Total> assets;
+	for (const Event &event : events)
+	{
+		end = std::max (end, event.start + event.duration);
+		Total *totals[] = {
+			&categories[event.category],
+			&assets[std::make_pair (event.asset, event.category)]
+		};
+		for (Total *total : totals)
+		{
+			if (total->name.empty ())
+			{
+				total->name = (total == totals[0]) ? event.category : event.asset;
+				total->category = event.category;
+				total->count = 0;
+				total->time = 0.0;
+				total->max = 0.0;
+			}
+			total->count++;
+			total->time += event.duration;
+			total->max = std::max (total->max, event.duration);
+		}
+	}
+
+	auto sorted = [] (std::vector<Total> &list) {
+		std::sort (list.begin (), list.end (),
+							 [] (const Total &a, const Total &b) {
+								 return a.time > b.time;
+							 });
+	};
+	std::vector<Total> categorylist, assetlist;
+	for (auto &it : categories)
+		 categorylist.push_back (it.second);
+	for (auto &it : assets)
+		 assetlist.push_back (it.second);
+	sorted (categorylist);
+	sorted (assetlist);
+
+	std::ios_base::fmtflags flags = stream.flags ();
+	std::streamsize precision = stream.precision ();
+	stream << std::fixed << std::setprecision (2)
+				 << "Loading profile, " << events.size () << " steps within "
+				 << end / 1000.0 << " ms:" << std::endl;
+	stream << std::setw (16) << "category" << std::setw (8) << "count"
+				 << std::setw (12) << "total ms" << std::setw (12) << "max ms"
+				 << std::endl;
+	for (const Total &total : categorylist)
+	{
+		stream << std::setw (16) << total.name << std::setw (8) << total.count
+					 << std::setw (12) << total.time / 1000.0
+					 << std::setw (12) << total.max / 1000.0 << std::endl;
+	}
+
+	stream << "Most expensive assets:" << std::endl;
+	for (GLuint i = 0; i < assetlist.size () && i < numassets; i++)
+	{
+		const Total &total = assetlist[i];
+		stream << std::setw (12) << total.time / 1000.0 << " ms  "
+					 << std::setw (16) << std::left << total.category
+					 << std::right << " " << total.name;
+		if (total.count > 1)
+			 stream << " (" << total.count << " times)";
+		stream << std::endl;
+	}
+	stream.flags (flags);
+	stream.precision (precision);
+}
+
+namespace {
+
+std::string EscapeJSON (const std::string &str)
+{
+	std::string result;
+	for (char c : str)
+	{
+		switch (c)
+		{
+		case '"':
+			result += "\\\"";
+			break;
+		case '\\':
+			result += "\\\\";
+			break;
+		default:
+			if ((unsigned char) c < 0x20)
+			{
+				char buffer[8];
+				snprintf (buffer, sizeof (buffer), "\\u%04x", c);
+				result += buffer;
+			}
+			else
+				 result += c;
+			break;
+		}
+	}
+	return result;
+}
+
+} /* anonymous namespace */
+
+bool Profiler::WriteTrace (const std::string &filename)
+{
+	std::ofstream file (filename, std::ios_base::out|std::ios_base::trunc);
+	if (!file.is_open ())
+		 return false;
+
+	std::unique_lock<std::mutex> lock (mutex);
+
+	// the trace format wants numerical thread ids
+	std::map<std::thread::id, GLuint> threads;
+	threads[mainthread] = 0;
+	for (const Event &event : events)
+	{
+		if (threads.find (event.thread) == threads.end ())
+		{
+			GLuint id = threads.size ();
+			threads[event.thread] = id;
+		}
+	}
+
+	file << std::fixed << std::setprecision (3) << "{\"traceEvents\":[";
+	for (size_t i = 0; i < events.size (); i++)
+	{
+		const Event &event = events[i];
+		file << (i ? ",\n" : "\n")
+				 << "{\"name\":\"" << EscapeJSON (event.asset)
+				 << "\",\"cat\":\"" << EscapeJSON (event.category)
+				 << "\",\"ph\":\"X\",\"ts\":" << event.start
+				 << ",\"dur\":" << event.duration
+				 << ",\"pid\":1,\"tid\":" << threads[event.thread] << "}";
+	}
+	for (auto &it : threads)
+	{
+		file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+				 << it.second << ",\"args\":{\"name\":\""
+				 << (it.second ? "worker " : "main") ;
+		if (it.second)
+			 file << it.second;
+		file << "\"}}";
+	}
+	file << "\n],\"displayTimeUnit\":\"ms\"}" << std::endl;
+
+	return file.good ();
+}
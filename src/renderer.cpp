@@ -15,10 +15,12 @@
  * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "renderer.h"
+#include "profiler.h"
+#include "shadercache.h"
 #include <fstream>
 
 Renderer::Renderer (void)
-	: antialiasing (0)
+	: antialiasing (0), timefactor (0.0f)
 #ifdef DEBUG
 	,memory (0)
 #endif
@@ -39,18 +41,55 @@ bool Renderer::Init (void)
 
 	gl::Hint (GL_FRAGMENT_SHADER_DERIVATIVE_HINT, GL_NICEST);
 
+	threadpool.Init (config["threads"].as<GLuint> (0));
+	(*logstream) << glfwGetTime () << " Started " << threadpool.GetNumThreads ()
+							 << " worker threads." << std::endl;
+
+	shadercache.Init ();
+
 	(*logstream) << glfwGetTime ()  << " Initialize Window Grid..." << std::endl;
 	if (!windowgrid.Init ())
 		 return false;
 
+	(*logstream) << glfwGetTime () << " Initialize Texture Streamer..."
+							 << std::endl;
+	if (!streamer.Init ())
+		 return false;
+
+	// a scene snapshot is used if it matches the scene description
+	SceneSnapshot snapshot;
+	std::string snapshotfile (MakePath ("scene.bin"));
+	bool usesnapshot = false;
+	if (config["scenesnapshot"].as<bool> (true))
+	{
+		Profiler::Scope scope ("snapshot", "scene.bin");
+		usesnapshot = snapshot.Load (snapshotfile);
+	}
+	if (usesnapshot)
+		 (*logstream) << glfwGetTime () << " Using scene snapshot "
+									<< snapshotfile << "." << std::endl;
+
 	(*logstream) << glfwGetTime () << " Initialize Geometry..." << std::endl;
-	if (!geometry.Init ())
+	if (!geometry.Init (usesnapshot ? &snapshot : NULL))
 		 return false;
+	(*logstream) << glfwGetTime () << " Requested "
+							 << textures.GetNumTextures () << " unique textures."
+							 << std::endl;
 
 	(*logstream) << glfwGetTime () << " Initialize GBuffer..." << std::endl;
 	if (!gbuffer.Init ())
 		 return false;
 
+	(*logstream) << glfwGetTime () << " Initialize Hierarchical-Z..."
+							 << std::endl;
+	if (!hiz.Init ())
+		 return false;
+
+	(*logstream) << glfwGetTime () << " Initialize Occlusion Culling..."
+							 << std::endl;
+	if (!occlusion.Init ())
+		 return false;
+
 	(*logstream) << glfwGetTime () << " Initialize Shadow Map..." << std::endl;
 	if (!shadowmap.Init ())
 		 return false;
@@ -105,73 +144,22 @@ bool Renderer::Init (void)
 		lightbuffer.Data (sizeof (glm::vec4),	NULL, GL_STATIC_DRAW);
 	}
 
+	if (usesnapshot)
 	{
-		std::vector<YAML::Node> parameterlist;
-		std::string filename (MakePath ("materials", "parameters.yaml"));
-		std::ifstream file (filename, std::ifstream::in);
-		if (!file.is_open ())
-		{
-			(*logstream) << "Cannot open " << filename << std::endl;
-			return false;
-		}
-
-		parameterlist = YAML::LoadAll (file);
-
-		for (const YAML::Node &node : parameterlist)
-		{
-			Parameter parameter;
-			{
-				YAML::Node specular = node["specular"];
-				std::string model = specular["model"].as<std::string> ("none");
-				if (!model.compare ("gaussian"))
-				{
-					parameter.specular.model = 1;
-					parameter.specular.smoothness
-						 = specular["smoothness"].as<float> (0.25f);
-					parameter.specular.gaussfactor
-						 = specular["gaussfactor"].as<float> (1.0f);
-				}
-				else if (!model.compare ("phong"))
-				{
-					parameter.specular.model = 2;
-					parameter.specular.shininess
-						 = specular["shininess"].as<float> (2.0f);
-					parameter.specular.param2 = 1.0f;
-				}
-				else if (!model.compare ("beckmann"))
-				{
-					parameter.specular.model = 3;
-					parameter.specular.smoothness
-						 = specular["smoothness"].as<float> (0.25);
-					parameter.specular.param2 = 1.0f;
-				}
-				else
-				{
-					if (model.compare ("none"))
-						 (*logstream) << "The parameter file " << filename
-													<< " contains an unknown specular model:"
-													<< model << std::endl;
-					parameter.specular.model = 0;
-					parameter.specular.param1 = 0.25f;
-					parameter.specular.param2 = 1.0f;
-				}
-				parameter.specular.fresnel.n
-					 = specular["fresnel"]["n"].as<float> (0.0f);
-				parameter.specular.fresnel.k
-					 = specular["fresnel"]["k"].as<float> (0.0f);
-			}
-			{
-				YAML::Node reflection = node["reflection"];
-				parameter.reflection.factor
-					 = reflection["factor"].as<float> (0.0f);
-				parameter.reflection.fresnel.n
-					 = reflection["fresnel"]["n"].as<float> (0.0f);
-				parameter.reflection.fresnel.k
-					 = reflection["fresnel"]["k"].as<float> (0.0f);
-			}
-			parameters.push_back (parameter);
-			parameter_names.push_back (node["name"].as<std::string> ("unnamed"));
-		}
+		const SceneSnapshot::Header &header = snapshot.GetHeader ();
+		parameters.assign (snapshot.GetParameters (), snapshot.GetParameters ()
+											 + header.parameters.count);
+		for (GLuint i = 0; i < header.parameternames.count; i++)
+			 parameter_names.push_back (snapshot.GetString
+																	(snapshot.GetParameterNames ()[i]));
+		snapshot.Close ();
+	}
+	else
+	{
+		if (!LoadParameters ())
+			 return false;
+		if (config["scenesnapshot"].as<bool> (true))
+			 SaveSnapshot (snapshotfile);
 	}
 	parameterbuffer.Data (sizeof (Parameter) * parameters.size (),
 												&parameters[0], GL_STATIC_DRAW);
@@ -186,11 +174,105 @@ bool Renderer::Init (void)
 	if (!postprocess.Init ())
 		 return false;
 
+	(*logstream) << glfwGetTime () << " Finish shader builds..." << std::endl;
+	if (!shadercache.Finish ())
+		 return false;
+
+	SetupRenderGraph ();
+
 	(*logstream) << glfwGetTime () << " Initialization complete." << std::endl;
 
 	return true;
 }
 
+bool Renderer::LoadParameters (void)
+{
+	std::vector<YAML::Node> parameterlist;
+	std::string filename (MakePath ("materials", "parameters.yaml"));
+	FileSystem::File file;
+	if (!filesystem.Open (filename, file))
+	{
+		(*logstream) << "Cannot open " << filename << std::endl;
+		return false;
+	}
+
+	{
+		Profiler::Scope scope ("yaml", "parameters.yaml");
+		parameterlist = YAML::LoadAll (file.GetStream ());
+	}
+
+	for (const YAML::Node &node : parameterlist)
+	{
+		Parameter parameter;
+		{
+			YAML::Node specular = node["specular"];
+			std::string model = specular["model"].as<std::string> ("none");
+			if (!model.compare ("gaussian"))
+			{
+				parameter.specular.model = 1;
+				parameter.specular.smoothness
+					 = specular["smoothness"].as<float> (0.25f);
+				parameter.specular.gaussfactor
+					 = specular["gaussfactor"].as<float> (1.0f);
+			}
+			else if (!model.compare ("phong"))
+			{
+				parameter.specular.model = 2;
+				parameter.specular.shininess
+					 = specular["shininess"].as<float> (2.0f);
+				parameter.specular.param2 = 1.0f;
+			}
+			else if (!model.compare ("beckmann"))
+			{
+				parameter.specular.model = 3;
+				parameter.specular.smoothness
+					 = specular["smoothness"].as<float> (0.25);
+				parameter.specular.param2 = 1.0f;
+			}
+			else
+			{
+				if (model.compare ("none"))
+					 (*logstream) << "The parameter file " << filename
+												<< " contains an unknown specular model:"
+												<< model << std::endl;
+				parameter.specular.model = 0;
+				parameter.specular.param1 = 0.25f;
+				parameter.specular.param2 = 1.0f;
+			}
+			parameter.specular.fresnel.n
+				 = specular["fresnel"]["n"].as<float> (0.0f);
+			parameter.specular.fresnel.k
+				 = specular["fresnel"]["k"].as<float> (0.0f);
+		}
+		{
+			YAML::Node reflection = node["reflection"];
+			parameter.reflection.factor
+				 = reflection["factor"].as<float> (0.0f);
+			parameter.reflection.fresnel.n
+				 = reflection["fresnel"]["n"].as<float> (0.0f);
+			parameter.reflection.fresnel.k
+				 = reflection["fresnel"]["k"].as<float> (0.0f);
+		}
+		parameters.push_back (parameter);
+		parameter_names.push_back (node["name"].as<std::string> ("unnamed"));
+	}
+
+	return true;
+}
+
+void Renderer::SaveSnapshot (const std::string &filename)
+{
+	SceneSnapshot::Writer writer;
+	geometry.Export (writer);
+	writer.AddInput (ConcatPath ("materials", "parameters.yaml"));
+	writer.parameters = parameters;
+	for (const std::string &name : parameter_names)
+		 writer.parameternames.push_back (writer.AddString (name));
+	if (!writer.Save (filename))
+		 (*logstream) << "Cannot write the scene snapshot " << filename
+									<< "." << std::endl;
+}
+
 void Renderer::Resize (int w, int h)
 {
 	camera.Resize (w, h);
@@ -299,10 +381,150 @@ gl::Buffer &Renderer::GetLightBuffer (void)
 
 extern bool running;
 
+void Renderer::SetupRenderGraph (void)
+{
+	typedef RenderGraph::Access Access;
+	GLuint gbufferres = graph.GetResource ("gbuffer");
+	GLuint fragments = graph.GetResource ("fragments");
+	GLuint msdepth = graph.GetResource ("msdepth");
+	GLuint shadowmapres = graph.GetResource ("shadowmap");
+	GLuint lightgrid = graph.GetResource ("lightgrid");
+	GLuint screen = graph.GetResource ("screen");
+	GLuint glowmap = graph.GetResource ("glowmap");
+	GLuint glowtmp = graph.GetResource ("glowtmp");
+	GLuint glowres = graph.GetResource ("glow");
+	GLuint shadowtmp = graph.GetResource ("shadowtmp");
+	GLuint backbuffer = graph.GetResource ("backbuffer");
+
+	graph.AddPass ("gbuffer", [=] (RenderGraph::Builder &builder) {
+			builder.Write (gbufferres);
+		}, [&] (void) {
+			gbuffer.Render (geometry);
+		});
+
+	graph.AddPass ("transparency", [=] (RenderGraph::Builder &builder) {
+			// depth testing against the opaque geometry
+			builder.Read (gbufferres, Access::RenderTarget);
+			builder.Write (fragments, Access::Image);
+		}, [&] (void) {
+			gbuffer.RenderTransparency (geometry);
+		});
+
+	graph.AddPass ("sraa", [=] (RenderGraph::Builder &builder) {
+			builder.Write (msdepth);
+		}, [&] (void) {
+			gbuffer.RenderSRAA (geometry);
+		});
+
+	graph.AddPass ("hiz", [&] (RenderGraph::Builder &builder) {
+			if (!hiz.GetEnabled ())
+				 return;
+			builder.Read (gbufferres);
+			// the depth pyramid is read back for the next frame
+			builder.SideEffect ();
+		}, [&] (void) {
+			hiz.Build ();
+		});
+
+	graph.AddPass ("shadowmap", [=] (RenderGraph::Builder &builder) {
+			builder.Write (shadowtmp);
+			builder.Write (shadowmapres);
+		}, [&] (void) {
+			Shadow sunshadow;
+			sunshadow.direction = -glm::vec4 (composition.sun.direction.Get (),
+																				 0.0f);
+			sunshadow.position = -sunshadow.direction * 25;
+
+			if (composition.sun.cos_theta.Get () < 0.05)
+				 shadowmap.Clear ();
+			else
+				 shadowmap.Render (0, geometry, sunshadow);
+		});
+
+	graph.AddPass ("lightculling", [=] (RenderGraph::Builder &builder) {
+			switch (composition.GetLightCulling ())
+			{
+			case LightCulling::TileBased:
+				builder.Read (gbufferres);
+				builder.Read (fragments);
+				builder.Write (lightgrid, Access::Image);
+				break;
+			case LightCulling::Clustered:
+				if (composition.GetLightClusters ().GetGPU ())
+					 builder.Write (lightgrid, Access::ShaderStorage);
+				else
+					 builder.Write (lightgrid);
+				break;
+			}
+		}, [&] (void) {
+			composition.CullLights ();
+		});
+
+	graph.AddPass ("composition", [=] (RenderGraph::Builder &builder) {
+			builder.Read (gbufferres);
+			builder.Read (fragments);
+			builder.Read (shadowmapres);
+			if (composition.GetLightCulling () != LightCulling::None)
+				 builder.Read (lightgrid);
+			builder.Write (screen);
+			builder.Write (glowmap);
+		}, [&] (void) {
+			composition.Frame (timefactor);
+		});
+
+	graph.AddPass ("glowdownsample", [=] (RenderGraph::Builder &builder) {
+			if (composition.GetGlow ().GetSize () == 0)
+				 return;
+			builder.Read (glowmap);
+			builder.Write (glowtmp);
+		}, [&] (void) {
+			composition.DownsampleGlow ();
+		});
+
+	graph.AddPass ("glow", [=] (RenderGraph::Builder &builder) {
+			if (composition.GetGlow ().GetSize () == 0)
+				 return;
+			builder.Read (glowtmp);
+			// the blurred glow is blended onto the screen
+			builder.Read (screen, Access::RenderTarget);
+			builder.Write (screen);
+			builder.Write (glowres);
+		}, [&] (void) {
+			composition.ApplyGlow ();
+		});
+
+	graph.AddPass ("postprocess", [=] (RenderGraph::Builder &builder) {
+			builder.Read (screen);
+			switch (postprocess.GetRenderMode ())
+			{
+			case 0:
+				if (GetAntialiasing ())
+				{
+					builder.Read (msdepth);
+					builder.Read (gbufferres);
+				}
+				break;
+			case 5:
+				builder.Read (glowres);
+				break;
+			case 6:
+				builder.Read (shadowmapres);
+				break;
+			default:
+				builder.Read (gbufferres);
+				break;
+			}
+			builder.Write (backbuffer);
+		}, [&] (void) {
+			postprocess.Frame ();
+		});
+
+	graph.SetOutput (backbuffer);
+}
+
 void Renderer::Frame (void)
 {
 	static float last_time = 0;
-	float timefactor;
 
 	Model::culled = 0;
 
@@ -314,26 +536,16 @@ void Renderer::Frame (void)
 		last_time += timefactor;
 	}
 
+	streamer.Update ();
+	// the loading profile is complete once all textures arrived
+	if (profiler.IsEnabled () && streamer.IsIdle ())
+		 profiler.Finish ();
 	camera.Frame (timefactor);
 	culling.Frame ();
+	hiz.Frame ();
+	occlusion.Frame (geometry);
 
-	gbuffer.Render (geometry);
-	
-	{
-		Shadow sunshadow;
-		sunshadow.direction = -glm::vec4 (composition.sun.direction.Get (),
-																			 0.0f);
-		sunshadow.position = -sunshadow.direction * 25;
-		
-		if (composition.sun.cos_theta.Get () < 0.05)
-			 shadowmap.Clear ();
-		else
-			 shadowmap.Render (0, geometry, sunshadow);
-	}
-
-	composition.Frame (timefactor);
-
-	postprocess.Frame ();
+	graph.Execute ();
 
 	GL_CHECK_ERROR;
 }
@@ -0,0 +1,517 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "rendergraph.h"
+#include "renderer.h"
+#include <algorithm>
+
+RenderGraph::Builder::Builder (RenderGraph &g, GLuint p)
+	: graph (g), pass (p)
+{
+}
+
+void RenderGraph::Builder::Read (GLuint resource, GLuint access)
+{
+	graph.passes[pass].reads.push_back ({ resource, access });
+}
+
+void RenderGraph::Builder::Write (GLuint resource, GLuint access)
+{
+	graph.passes[pass].writes.push_back ({ resource, access });
+}
+
+void RenderGraph::Builder::SideEffect (void)
+{
+	graph.passes[pass].sideeffect = true;
+}
+
+RenderGraph::RenderGraph (void)
+{
+}
+
+RenderGraph::~RenderGraph (void)
+{
+}
+
+GLuint RenderGraph::GetResource (const std::string &name)
+{
+	auto it = std::find (resources.begin (), resources.end (), name);
+	if (it != resources.end ())
+		 return it - resources.begin ();
+	resources.push_back (name);
+	return resources.size () - 1;
+}
+
+GLuint RenderGraph::GetResource (const std::string &name,
+																 const TextureDesc &desc)
+{
+	GLuint resource = GetResource (name);
+	Transient &transient = transients[resource];
+	transient.desc = desc;
+	transient.texture = NULL;
+	return resource;
+}
+
+gl::Texture &RenderGraph::GetTexture (GLuint resource) const
+{
+	auto it = transients.find (resource);
+	if (it == transients.end () || it->second.texture == NULL)
+		 throw std::runtime_error ("No texture is assigned to the resource "
+															 + resources[resource] + ".");
+	return *it->second.texture;
+}
+
+void RenderGraph::Attach (gl::Framebuffer &framebuffer, GLenum attachment,
+													GLuint resource)
+{
+	const gl::Texture &texture = GetTexture (resource);
+	const gl::Texture *&attached = attachments[std::make_pair (&framebuffer,
+																														 attachment)];
+	if (attached == &texture)
+		 return;
+	framebuffer.Texture2D (attachment, GL_TEXTURE_2D, texture, 0);
+	attached = &texture;
+}
+
+void RenderGraph::AddPass (const std::string &name,
+													 const std::function<void (Builder&)> &setup,
+													 const std::function<void (void)> &execute)
+{
+	Pass pass;
+	pass.name = name;
+	pass.setup = setup;
+	pass.execute = execute;
+	pass.sideeffect = false;
+	pass.barriers = 0;
+	pass.used = false;
+	passes.push_back (pass);
+}
+
+void RenderGraph::SetOutput (GLuint resource)
+{
+	if (std::find (outputs.begin (), outputs.end (), resource) == outputs.end ())
+		 outputs.push_back (resource);
+}
+
+GLbitfield RenderGraph::GetBarrierBits (GLuint access)
+{
+	switch (access)
+	{
+	case Access::Texture:
+		return GL_TEXTURE_FETCH_BARRIER_BIT;
+	case Access::RenderTarget:
+		return GL_FRAMEBUFFER_BARRIER_BIT;
+	case Access::Image:
+		return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+	case Access::AtomicCounter:
+		return GL_ATOMIC_COUNTER_BARRIER_BIT;
+	case Access::PixelPack:
+		return GL_PIXEL_BUFFER_BARRIER_BIT;
+	case Access::ShaderStorage:
+		return GL_SHADER_STORAGE_BARRIER_BIT;
+	default:
+		throw std::runtime_error ("Invalid resource access type.");
+	}
+}
+
+bool RenderGraph::IsIncoherent (GLuint access)
+{
+	return access == Access::Image || access == Access::AtomicCounter
+		 || access == Access::ShaderStorage;
+}
+
+GLuint RenderGraph::GetViewClass (GLenum format)
+{
+	switch (format)
+	{
+	case GL_RGBA32F:
+	case GL_RGBA32I:
+	case GL_RGBA32UI:
+		return 128;
+	case GL_RGBA16F:
+	case GL_RGBA16I:
+	case GL_RGBA16UI:
+	case GL_RGBA16:
+	case GL_RG32F:
+	case GL_RG32I:
+	case GL_RG32UI:
+		return 64;
+	case GL_RGBA8:
+	case GL_RGBA8I:
+	case GL_RGBA8UI:
+	case GL_RG16F:
+	case GL_RG16I:
+	case GL_RG16UI:
+	case GL_R32F:
+	case GL_R32I:
+	case GL_R32UI:
+	case GL_R11F_G11F_B10F:
+	case GL_RGB10_A2:
+		return 32;
+	case GL_RG8:
+	case GL_R16F:
+	case GL_R16I:
+	case GL_R16UI:
+		return 16;
+	case GL_R8:
+	case GL_R8I:
+	case GL_R8UI:
+		return 8;
+	default:
+		// depth formats can only be viewed in their own format
+		return 0;
+	}
+}
+
+GLuint RenderGraph::GetTexelSize (GLenum format)
+{
+	switch (format)
+	{
+	case GL_DEPTH_COMPONENT32:
+	case GL_DEPTH_COMPONENT32F:
+	case GL_DEPTH24_STENCIL8:
+		return 4;
+	default:
+		if (GetViewClass (format) == 0)
+			 throw std::runtime_error ("Unsupported transient texture format.");
+		return GetViewClass (format) >> 3;
+	}
+}
+
+unsigned long RenderGraph::GetSize (const TextureDesc &desc)
+{
+	unsigned long size = 0;
+	for (GLuint level = 0; level < desc.levels; level++)
+	{
+		size += std::max (desc.width >> level, 1U)
+			 * std::max (desc.height >> level, 1U);
+	}
+	return size * GetTexelSize (desc.format);
+}
+
+bool RenderGraph::GetLevel (const PooledTexture &pooled,
+														const TextureDesc &desc, GLuint &level)
+{
+	if (pooled.desc.format != desc.format)
+	{
+		GLuint viewclass = GetViewClass (desc.format);
+		if (viewclass == 0 || viewclass != GetViewClass (pooled.desc.format))
+			 return false;
+	}
+
+	// a smaller texture can be served by a mipmap level of a larger one
+	for (level = 0; level + desc.levels <= pooled.desc.levels; level++)
+	{
+		if (std::max (pooled.desc.width >> level, 1U) == desc.width
+				&& std::max (pooled.desc.height >> level, 1U) == desc.height)
+			 return true;
+	}
+	return false;
+}
+
+gl::Texture &RenderGraph::GetView (PooledTexture &pooled, GLenum format,
+																	 GLuint level, GLuint levels)
+{
+	if (format == pooled.desc.format && level == 0
+			&& levels == pooled.desc.levels)
+		 return pooled.texture;
+
+	for (View &view : pooled.views)
+	{
+		if (view.format == format && view.level == level
+				&& view.levels == levels)
+			 return view.texture;
+	}
+
+	pooled.views.emplace_back ();
+	View &view = pooled.views.back ();
+	view.format = format;
+	view.level = level;
+	view.levels = levels;
+	view.texture.View (GL_TEXTURE_2D, pooled.texture, format,
+										 level, levels, 0, 1);
+	return view.texture;
+}
+
+void RenderGraph::AssignTransients (void)
+{
+	struct Interval
+	{
+		 GLuint resource;
+		 GLint first;
+		 GLint last;
+	};
+	std::vector<Interval> intervals;
+
+	for (auto &transient : transients)
+	{
+		transient.second.texture = NULL;
+		intervals.push_back ({ transient.first, -1, -1 });
+	}
+
+	// determine the range of executed passes each transient is used in
+	for (GLuint pos = 0; pos < order.size (); pos++)
+	{
+		const Pass &pass = passes[order[pos]];
+		for (Interval &interval : intervals)
+		{
+			auto accesses = [&] (const std::vector<Usage> &usages) {
+				for (const Usage &usage : usages)
+				{
+					if (usage.resource == interval.resource)
+						 return true;
+				}
+				return false;
+			};
+			if (accesses (pass.reads) || accesses (pass.writes))
+			{
+				if (interval.first < 0)
+					 interval.first = pos;
+				interval.last = pos;
+			}
+		}
+	}
+
+	intervals.erase (std::remove_if (intervals.begin (), intervals.end (),
+																	 [] (const Interval &interval) {
+																		 return interval.first < 0;
+																	 }), intervals.end ());
+	std::stable_sort (intervals.begin (), intervals.end (),
+										[] (const Interval &a, const Interval &b) {
+											return a.first < b.first;
+										});
+
+	for (PooledTexture &pooled : pool)
+		 pooled.busy = -1;
+
+	bool allocated = false;
+	for (const Interval &interval : intervals)
+	{
+		Transient &transient = transients[interval.resource];
+		PooledTexture *texture = NULL;
+		GLuint level = 0;
+
+		// prefer a texture that matches exactly, then one whose storage
+		// can be viewed as the requested texture
+		for (PooledTexture &pooled : pool)
+		{
+			GLuint l;
+			if (pooled.busy >= interval.first
+					|| !GetLevel (pooled, transient.desc, l))
+				 continue;
+			if (texture == NULL || l < level)
+			{
+				texture = &pooled;
+				level = l;
+			}
+		}
+
+		if (texture == NULL)
+		{
+			pool.emplace_back ();
+			texture = &pool.back ();
+			texture->desc = transient.desc;
+			texture->texture.Storage2D (GL_TEXTURE_2D, transient.desc.levels,
+																	transient.desc.format,
+																	transient.desc.width,
+																	transient.desc.height);
+			level = 0;
+			allocated = true;
+#ifdef DEBUG
+			r->memory += GetSize (transient.desc);
+#endif
+		}
+
+		texture->busy = interval.last;
+		transient.texture = &GetView (*texture, transient.desc.format,
+																	level, transient.desc.levels);
+	}
+
+	if (allocated)
+	{
+		unsigned long requested = 0, used = 0;
+		for (const Interval &interval : intervals)
+			 requested += GetSize (transients[interval.resource].desc);
+		for (const PooledTexture &pooled : pool)
+			 used += GetSize (pooled.desc);
+		(*logstream) << glfwGetTime () << " Transient textures: "
+								 << requested << " bytes in " << used
+								 << " bytes of pooled storage." << std::endl;
+	}
+}
+
+void RenderGraph::MarkUsed (GLuint pass)
+{
+	if (passes[pass].used)
+		 return;
+	passes[pass].used = true;
+	for (GLuint dependency : passes[pass].dependencies)
+		 MarkUsed (dependency);
+}
+
+void RenderGraph::Compile (void)
+{
+	for (GLuint i = 0; i < passes.size (); i++)
+	{
+		Pass &pass = passes[i];
+		pass.reads.clear ();
+		pass.writes.clear ();
+		pass.dependencies.clear ();
+		pass.predecessors.clear ();
+		pass.sideeffect = false;
+		pass.barriers = 0;
+		pass.used = false;
+		Builder builder (*this, i);
+		pass.setup (builder);
+	}
+
+	// track the current version of each resource in declaration order
+	struct State
+	{
+		 GLint writer;
+		 GLuint access;
+		 std::vector<GLuint> readers;
+	};
+	std::vector<State> state (resources.size (), { -1, 0, {} });
+
+	for (GLuint i = 0; i < passes.size (); i++)
+	{
+		Pass &pass = passes[i];
+		for (const Usage &read : pass.reads)
+		{
+			const State &s = state[read.resource];
+			if (s.writer < 0)
+				 continue;
+			pass.dependencies.push_back (s.writer);
+			pass.predecessors.push_back (s.writer);
+			if (IsIncoherent (s.access))
+				 pass.barriers |= GetBarrierBits (read.access);
+		}
+		for (const Usage &write : pass.writes)
+		{
+			const State &s = state[write.resource];
+			// earlier readers and writers have to finish first
+			if (s.writer >= 0 && s.writer != GLint (i))
+			{
+				pass.predecessors.push_back (s.writer);
+				if (IsIncoherent (s.access))
+					 pass.barriers |= GetBarrierBits (write.access);
+			}
+			for (GLuint reader : s.readers)
+			{
+				if (reader != i)
+					 pass.predecessors.push_back (reader);
+			}
+		}
+		for (const Usage &read : pass.reads)
+			 state[read.resource].readers.push_back (i);
+		for (const Usage &write : pass.writes)
+		{
+			State &s = state[write.resource];
+			s.writer = i;
+			s.access = write.access;
+			s.readers.clear ();
+		}
+	}
+
+	// cull all passes that neither contribute to an output
+	// nor have side effects
+	for (GLuint output : outputs)
+	{
+		if (state[output].writer >= 0)
+			 MarkUsed (state[output].writer);
+	}
+	for (GLuint i = 0; i < passes.size (); i++)
+	{
+		if (passes[i].sideeffect)
+			 MarkUsed (i);
+	}
+
+	// topological sort of the remaining passes, preferring the
+	// declaration order among passes that are ready
+	std::vector<GLuint> pending (passes.size (), 0);
+	for (GLuint i = 0; i < passes.size (); i++)
+	{
+		if (!passes[i].used)
+			 continue;
+		for (GLuint p : passes[i].predecessors)
+		{
+			if (passes[p].used)
+				 pending[i]++;
+		}
+	}
+
+	order.clear ();
+	std::vector<bool> scheduled (passes.size (), false);
+	while (true)
+	{
+		GLint next = -1;
+		for (GLuint i = 0; i < passes.size (); i++)
+		{
+			if (passes[i].used && !scheduled[i] && pending[i] == 0)
+			{
+				next = i;
+				break;
+			}
+		}
+		if (next < 0)
+			 break;
+		scheduled[next] = true;
+		order.push_back (next);
+		for (GLuint i = 0; i < passes.size (); i++)
+		{
+			if (!passes[i].used || scheduled[i])
+				 continue;
+			for (GLuint p : passes[i].predecessors)
+			{
+				if (p == GLuint (next))
+					 pending[i]--;
+			}
+		}
+	}
+
+	for (GLuint i = 0; i < passes.size (); i++)
+	{
+		if (passes[i].used && !scheduled[i])
+			 throw std::runtime_error ("The render graph contains a cycle.");
+	}
+
+	AssignTransients ();
+}
+
+void RenderGraph::Execute (void)
+{
+	Compile ();
+
+	for (GLuint i : order)
+	{
+		if (passes[i].barriers)
+			 gl::MemoryBarrier (passes[i].barriers);
+		passes[i].execute ();
+	}
+
+	GL_CHECK_ERROR;
+}
+
+bool RenderGraph::IsExecuted (const std::string &name) const
+{
+	for (GLuint i : order)
+	{
+		if (!passes[i].name.compare (name))
+			 return true;
+	}
+	return false;
+}
@@ -0,0 +1,216 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "renderqueue.h"
+#include <algorithm>
+#include <cstring>
+
+RenderQueue::RenderQueue (void)
+{
+}
+
+RenderQueue::~RenderQueue (void)
+{
+}
+
+bool RenderQueue::Init (void)
+{
+	instancebuffer.Data (sizeof (Instance), NULL, GL_STREAM_DRAW);
+	instancetex.Buffer (GL_RGBA32F, instancebuffer);
+
+	indirectbuffer.Data (sizeof (DrawElementsIndirectCommand), NULL,
+											 GL_STREAM_DRAW);
+	drawbuffer.Data (2 * sizeof (GLint), NULL, GL_STREAM_DRAW);
+	drawtex.Buffer (GL_RG32I, drawbuffer);
+
+	return true;
+}
+
+void RenderQueue::Clear (void)
+{
+	items.clear ();
+	instances.clear ();
+	programs.clear ();
+	materials.clear ();
+}
+
+GLint RenderQueue::AddInstances (const std::vector<Instance> &list)
+{
+	GLint offset = instances.size ();
+	instances.insert (instances.end (), list.begin (), list.end ());
+	return offset;
+}
+
+void RenderQueue::Add (const gl::Program &program, GLuint layout,
+											 const Material *material, bool doublesided,
+											 GLfloat depth,
+											 const DrawElementsIndirectCommand &command,
+											 GLint instanceoffset, GLint patchoffset)
+{
+	Item item;
+	item.program = &program;
+	item.material = material;
+	item.layout = layout;
+	item.doublesided = doublesided;
+	item.command = command;
+	item.instanceoffset = instanceoffset;
+	item.patchoffset = patchoffset;
+
+	uint64_t programid;
+	programid = std::find (programs.begin (), programs.end (), &program)
+		 - programs.begin ();
+	if (programid == programs.size ())
+		 programs.push_back (&program);
+
+	// index 0 is reserved for draws without a material
+	uint64_t materialid = 0;
+	if (material != NULL)
+	{
+		auto it = materials.find (material);
+		if (it == materials.end ())
+			 it = materials.insert (std::make_pair (material,
+																							materials.size () + 1)).first;
+		materialid = it->second;
+	}
+
+	// the bit pattern of a non-negative float sorts like the float itself
+	uint32_t depthbits;
+	depth = std::max (depth, 0.0f);
+	memcpy (&depthbits, &depth, sizeof (depthbits));
+
+	// the material index gets all 21 bits between the culling
+	// bit and the depth, larger indices only sort less well
+	item.key = (programid << 56) | (uint64_t (layout & 0x3) << 54)
+		 | (uint64_t (doublesided) << 53) | ((materialid & 0x1FFFFF) << 32)
+		 | depthbits;
+
+	items.push_back (item);
+}
+
+void RenderQueue::Submit (const Arena &arena)
+{
+	if (items.empty ())
+		 return;
+
+	std::sort (items.begin (), items.end (),
+						 [] (const Item &a, const Item &b) {
+							 return a.key < b.key;
+						 });
+
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<GLint> drawdata;
+	commands.reserve (items.size ());
+	drawdata.reserve (2 * items.size ());
+	for (const Item &item : items)
+	{
+		commands.push_back (item.command);
+		drawdata.push_back (item.instanceoffset);
+		drawdata.push_back (item.patchoffset);
+	}
+
+	instancebuffer.Data (instances.size () * sizeof (Instance),
+											 &instances[0], GL_STREAM_DRAW);
+	indirectbuffer.Data (commands.size ()
+											 * sizeof (DrawElementsIndirectCommand),
+											 &commands[0], GL_STREAM_DRAW);
+	drawbuffer.Data (drawdata.size () * sizeof (GLint), &drawdata[0],
+									 GL_STREAM_DRAW);
+
+	instancetex.Bind (GL_TEXTURE6, GL_TEXTURE_BUFFER);
+	drawtex.Bind (GL_TEXTURE7, GL_TEXTURE_BUFFER);
+	indirectbuffer.Bind (GL_DRAW_INDIRECT_BUFFER);
+
+	const gl::Program *program = NULL;
+	const Material *material = NULL;
+	GLuint layout = GLuint (-1);
+	GLenum mode = GL_TRIANGLES;
+	bool culling = true;
+
+	for (GLuint begin = 0; begin < items.size ();)
+	{
+		// draws that only differ in depth are submitted together,
+		// the material is compared as its index may be truncated
+		GLuint end = begin + 1;
+		while (end < items.size ()
+					 && (items[end].key >> 32) == (items[begin].key >> 32)
+					 && items[end].material == items[begin].material)
+			 end++;
+
+		const Item &item = items[begin];
+
+		if (item.program != program)
+		{
+			program = item.program;
+			program->Use ();
+			// the material state may depend on the program
+			material = NULL;
+		}
+
+		if (item.layout != layout)
+		{
+			layout = item.layout;
+			switch (layout)
+			{
+			case Layout::Triangles:
+				arena.BindTriangles ();
+				mode = GL_TRIANGLES;
+				break;
+			case Layout::DepthOnly:
+				arena.BindDepthOnly ();
+				mode = GL_TRIANGLES;
+				break;
+			case Layout::TrianglePatches:
+				arena.BindPatches ();
+				gl::PatchParameteri (GL_PATCH_VERTICES, 15);
+				mode = GL_PATCHES;
+				break;
+			case Layout::QuadPatches:
+				arena.BindPatches ();
+				gl::PatchParameteri (GL_PATCH_VERTICES, 20);
+				mode = GL_PATCHES;
+				break;
+			}
+		}
+
+		if (item.material != NULL && item.material != material)
+		{
+			material = item.material;
+			material->Use ();
+		}
+
+		if (culling == item.doublesided)
+		{
+			culling = !culling;
+			if (culling)
+				 gl::Enable (GL_CULL_FACE);
+			else
+				 gl::Disable (GL_CULL_FACE);
+		}
+
+		(*program)["drawoffset"] = GLint (begin);
+		gl::MultiDrawElementsIndirect (mode, GL_UNSIGNED_INT,
+																	 reinterpret_cast<const GLvoid*>
+																	 (begin * sizeof
+																		(DrawElementsIndirectCommand)),
+																	 end - begin, 0);
+		begin = end;
+	}
+
+	if (!culling)
+		 gl::Enable (GL_CULL_FACE);
+
+	GL_CHECK_ERROR;
+}
@@ -0,0 +1,287 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "scenesnapshot.h"
+#include <fstream>
+#include <cstring>
+
+namespace {
+
+const char magic[8] = { 'P', 'C', 'H', 'S', 'C', 'E', 'N', 'E' };
+const uint32_t version = 1;
+
+} /* anonymous namespace */
+
+constexpr uint32_t SceneSnapshot::Flags::Shadows;
+constexpr uint32_t SceneSnapshot::Flags::Occluder;
+constexpr uint32_t SceneSnapshot::Flags::Transparent;
+constexpr uint32_t SceneSnapshot::Flags::DoubleSided;
+constexpr uint32_t SceneSnapshot::None;
+
+SceneSnapshot::SceneSnapshot (void) : data (NULL), length (0)
+{
+}
+
+SceneSnapshot::~SceneSnapshot (void)
+{
+	Close ();
+}
+
+void SceneSnapshot::Close (void)
+{
+	file.Close ();
+	data = NULL;
+	length = 0;
+}
+
+bool SceneSnapshot::ComputeHash (const std::vector<std::string> &inputs,
+																 uint64_t hash[3])
+{
+	std::unique_ptr<Hash> hashfn (Hash::Create ());
+	for (const std::string &input : inputs)
+	{
+		std::string content;
+		if (!ReadFile (MakePath (input), content))
+			 return false;
+		// the path is hashed, so that renaming a file invalidates the snapshot
+		hashfn->consume (input.c_str (), input.length () + 1);
+		hashfn->consume (content.data (), content.length ());
+	}
+	hashfn->finalize ();
+	hashfn->get (hash);
+	return true;
+}
+
+bool SceneSnapshot::CheckTable (const Table &table, size_t size) const
+{
+	return table.offset <= length
+		 && table.count <= (length - table.offset) / size;
+}
+
+bool SceneSnapshot::Load (const std::string &filename)
+{
+	Close ();
+
+	if (!filesystem.Open (filename, file) || file.GetSize () < sizeof (Header))
+	{
+		Close ();
+		return false;
+	}
+	data = file.GetData ();
+	length = file.GetSize ();
+
+	const Header &header = GetHeader ();
+	if (memcmp (header.magic, magic, 8) || header.version != version
+			|| !CheckTable (header.inputs, sizeof (uint32_t))
+			|| !CheckTable (header.strings, sizeof (char))
+			|| !CheckTable (header.nodes, sizeof (Node))
+			|| !CheckTable (header.nodemodels, sizeof (uint32_t))
+			|| !CheckTable (header.models, sizeof (Model))
+			|| !CheckTable (header.meshes, sizeof (Mesh))
+			|| !CheckTable (header.materials, sizeof (Material))
+			|| !CheckTable (header.parameters, sizeof (Parameter))
+			|| !CheckTable (header.parameternames, sizeof (uint32_t))
+			|| header.strings.count == 0
+			|| data[header.strings.offset + header.strings.count - 1] != 0)
+	{
+		Close ();
+		return false;
+	}
+
+	// the records are used without further checks, so the
+	// references between the tables are validated here
+	for (uint32_t i = 0; i < header.models.count; i++)
+	{
+		const Model &model = GetModels ()[i];
+		if (model.firstmesh > header.meshes.count
+				|| model.nummeshes > header.meshes.count - model.firstmesh)
+		{
+			Close ();
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < header.nodes.count; i++)
+	{
+		const Node &node = GetNodes ()[i];
+		if (node.firstmodel > header.nodemodels.count
+				|| node.nummodels > header.nodemodels.count - node.firstmodel)
+		{
+			Close ();
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < header.nodemodels.count; i++)
+	{
+		if (GetNodeModels ()[i] >= header.models.count)
+		{
+			Close ();
+			return false;
+		}
+	}
+
+	std::vector<std::string> inputs;
+	const uint32_t *input = GetTable<uint32_t> (header.inputs);
+	for (uint32_t i = 0; i < header.inputs.count; i++)
+		 inputs.push_back (GetString (input[i]));
+
+	uint64_t hash[3];
+	if (!ComputeHash (inputs, hash) || hash[0] != header.hash[0]
+			|| hash[1] != header.hash[1] || hash[2] != header.hash[2])
+	{
+		Close ();
+		return false;
+	}
+
+	return true;
+}
+
+const SceneSnapshot::Header &SceneSnapshot::GetHeader (void) const
+{
+	return *reinterpret_cast<const Header*> (data);
+}
+
+const char *SceneSnapshot::GetString (uint32_t offset) const
+{
+	const Table &strings = GetHeader ().strings;
+	if (offset >= strings.count)
+		 throw std::runtime_error ("Invalid string in the scene snapshot.");
+	return data + strings.offset + offset;
+}
+
+const SceneSnapshot::Node *SceneSnapshot::GetNodes (void) const
+{
+	return GetTable<Node> (GetHeader ().nodes);
+}
+
+const uint32_t *SceneSnapshot::GetNodeModels (void) const
+{
+	return GetTable<uint32_t> (GetHeader ().nodemodels);
+}
+
+const SceneSnapshot::Model *SceneSnapshot::GetModels (void) const
+{
+	return GetTable<Model> (GetHeader ().models);
+}
+
+const SceneSnapshot::Mesh *SceneSnapshot::GetMeshes (void) const
+{
+	return GetTable<Mesh> (GetHeader ().meshes);
+}
+
+const SceneSnapshot::Material *SceneSnapshot::GetMaterials (void) const
+{
+	return GetTable<Material> (GetHeader ().materials);
+}
+
+const Parameter *SceneSnapshot::GetParameters (void) const
+{
+	return GetTable<Parameter> (GetHeader ().parameters);
+}
+
+const uint32_t *SceneSnapshot::GetParameterNames (void) const
+{
+	return GetTable<uint32_t> (GetHeader ().parameternames);
+}
+
+SceneSnapshot::Writer::Writer (void)
+	: boxmin (0.0f, 0.0f, 0.0f), boxmax (0.0f, 0.0f, 0.0f)
+{
+}
+
+SceneSnapshot::Writer::~Writer (void)
+{
+}
+
+uint32_t SceneSnapshot::Writer::AddString (const std::string &str)
+{
+	auto it = offsets.find (str);
+	if (it != offsets.end ())
+		 return it->second;
+	uint32_t offset = strings.length ();
+	strings.append (str.c_str (), str.length () + 1);
+	offsets[str] = offset;
+	return offset;
+}
+
+void SceneSnapshot::Writer::AddInput (const std::string &path)
+{
+	uint32_t offset = AddString (path);
+	for (uint32_t input : inputs)
+	{
+		if (input == offset)
+			 return;
+	}
+	inputs.push_back (offset);
+}
+
+namespace {
+
+template<typename T>
+void WriteTable (std::string &output, SceneSnapshot::Table &table,
+								 const T *data, size_t count)
+{
+	// align each table to 16 bytes, so that the
+	// records can be used in place after mapping
+	output.resize ((output.length () + 15) & ~size_t (15), 0);
+	table.offset = output.length ();
+	table.count = count;
+	output.append (reinterpret_cast<const char*> (data), count * sizeof (T));
+}
+
+} /* anonymous namespace */
+
+bool SceneSnapshot::Writer::Save (const std::string &filename) const
+{
+	Header header;
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, magic, 8);
+	header.version = version;
+
+	std::vector<std::string> paths;
+	for (uint32_t input : inputs)
+		 paths.push_back (strings.c_str () + input);
+	if (!ComputeHash (paths, header.hash))
+		 return false;
+
+	for (int i = 0; i < 3; i++)
+	{
+		header.boxmin[i] = boxmin[i];
+		header.boxmax[i] = boxmax[i];
+	}
+
+	std::string output (sizeof (Header), 0);
+	WriteTable (output, header.inputs, inputs.data (), inputs.size ());
+	WriteTable (output, header.strings, strings.data (), strings.length ());
+	WriteTable (output, header.nodes, nodes.data (), nodes.size ());
+	WriteTable (output, header.nodemodels, nodemodels.data (),
+							nodemodels.size ());
+	WriteTable (output, header.models, models.data (), models.size ());
+	WriteTable (output, header.meshes, meshes.data (), meshes.size ());
+	WriteTable (output, header.materials, materials.data (),
+							materials.size ());
+	WriteTable (output, header.parameters, parameters.data (),
+							parameters.size ());
+	WriteTable (output, header.parameternames, parameternames.data (),
+							parameternames.size ());
+	memcpy (&output[0], &header, sizeof (Header));
+
+	std::ofstream file (filename, std::ios_base::out|std::ios_base::binary
+											|std::ios_base::trunc);
+	if (!file.is_open ())
+		 return false;
+	file.write (output.data (), output.length ());
+	return file.good ();
+}
@@ -0,0 +1,409 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "shadercache.h"
+#include "filesystem.h"
+#include "profiler.h"
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+
+namespace {
+
+const char magic[8] = { 'G', 'L', 'S', 'L', 'M', 'A', 'N', 0x00 };
+const uint32_t version = 2;
+
+typedef void (APIENTRY *MaxShaderCompilerThreadsProc) (GLuint count);
+
+template<typename T>
+bool Read (std::istream &stream, T &value)
+{
+	stream.read (reinterpret_cast<char*> (&value), sizeof (T));
+	return stream.gcount () == sizeof (T);
+}
+
+bool Read (std::istream &stream, std::string &str)
+{
+	uint32_t length;
+	if (!Read (stream, length) || length > 4096)
+		 return false;
+	str.resize (length);
+	stream.read (&str[0], length);
+	return stream.gcount () == length;
+}
+
+template<typename T>
+void Write (std::ostream &stream, const T &value)
+{
+	stream.write (reinterpret_cast<const char*> (&value), sizeof (T));
+}
+
+void Write (std::ostream &stream, const std::string &str)
+{
+	uint32_t length = str.length ();
+	Write (stream, length);
+	stream.write (str.data (), length);
+}
+
+template<typename T>
+bool ReadSources (std::istream &stream, std::vector<T> &sources)
+{
+	uint32_t count;
+	if (!Read (stream, count) || count > 64)
+		 return false;
+	sources.resize (count);
+	for (T &source : sources)
+	{
+		if (!Read (stream, source.filename) || !Read (stream, source.size)
+				|| !Read (stream, source.mtime))
+			 return false;
+	}
+	return true;
+}
+
+template<typename T>
+void WriteSources (std::ostream &stream, const std::vector<T> &sources)
+{
+	Write (stream, uint32_t (sources.size ()));
+	for (const T &source : sources)
+	{
+		Write (stream, source.filename);
+		Write (stream, source.size);
+		Write (stream, source.mtime);
+	}
+}
+
+} /* anonymous namespace */
+
+ShaderCache::ShaderCache (void) : dirty (false)
+{
+}
+
+ShaderCache::~ShaderCache (void)
+{
+}
+
+void ShaderCache::Init (void)
+{
+	manifestfile = MakePath ("shaders", "bin", "manifest.bin");
+	if (!ReadManifest ())
+		 manifest.clear ();
+	dirty = false;
+
+	// let the driver use as many threads as it likes
+	const char *extensions[][2] = {
+		{ "GL_KHR_parallel_shader_compile", "glMaxShaderCompilerThreadsKHR" },
+		{ "GL_ARB_parallel_shader_compile", "glMaxShaderCompilerThreadsARB" }
+	};
+	for (auto &extension : extensions)
+	{
+		if (!glfwExtensionSupported (extension[0]))
+			 continue;
+		MaxShaderCompilerThreadsProc MaxShaderCompilerThreads
+			 = reinterpret_cast<MaxShaderCompilerThreadsProc>
+			 (glfwGetProcAddress (extension[1]));
+		if (MaxShaderCompilerThreads == NULL)
+			 continue;
+		MaxShaderCompilerThreads (0xFFFFFFFF);
+		(*logstream) << "Using " << extension[0] << "." << std::endl;
+		break;
+	}
+}
+
+bool ShaderCache::ReadManifest (void)
+{
+	std::ifstream file (manifestfile, std::ios_base::in|std::ios_base::binary);
+	if (!file.is_open ())
+		 return false;
+
+	char filemagic[8];
+	uint32_t fileversion, count;
+	file.read (filemagic, 8);
+	if (file.gcount () != 8 || memcmp (filemagic, magic, 8)
+			|| !Read (file, fileversion) || fileversion != version
+			|| !Read (file, count))
+		 return false;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		std::string filename;
+		Entry entry;
+		if (!Read (file, filename) || !Read (file, entry.definitions)
+				|| !Read (file, entry.hash) || !ReadSources (file, entry.sources)
+				|| !ReadSources (file, entry.includes))
+			 return false;
+		manifest[filename] = std::move (entry);
+	}
+	return true;
+}
+
+void ShaderCache::WriteManifest (void)
+{
+	std::ofstream file (manifestfile, std::ios_base::out|std::ios_base::binary
+											|std::ios_base::trunc);
+	if (!file.is_open ())
+		 return;
+
+	file.write (magic, 8);
+	Write (file, version);
+	Write (file, uint32_t (manifest.size ()));
+	for (auto &it : manifest)
+	{
+		const Entry &entry = it.second;
+		Write (file, it.first);
+		Write (file, entry.definitions);
+		Write (file, entry.hash);
+		WriteSources (file, entry.sources);
+		WriteSources (file, entry.includes);
+	}
+}
+
+void ShaderCache::Stat (const std::string &filename, Source &source)
+{
+	auto it = stats.find (filename);
+	if (it == stats.end ())
+	{
+		Source &status = stats[filename];
+		status.filename = filename;
+		// a file that can't be checked never matches
+		if (!filesystem.Stat (filename, status.size, status.mtime))
+		{
+			status.size = 0;
+			status.mtime = -1;
+		}
+		source = status;
+	}
+	else
+		 source = it->second;
+}
+
+bool ShaderCache::Check (const Source &source)
+{
+	Source status;
+	Stat (source.filename, status);
+	return status.mtime != -1 && source.size == status.size
+		 && source.mtime == status.mtime;
+}
+
+const ShaderCache::File *ShaderCache::Parse (const std::string &filename)
+{
+	auto it = files.find (filename);
+	if (it != files.end ())
+		 return &it->second;
+
+	std::string text;
+	if (!ReadFile (filename, text))
+		 return NULL;
+
+	File file;
+	std::unique_ptr<Hash> hashfn (Hash::Create ());
+	hashfn->consume (text.data (), text.length ());
+	hashfn->finalize ();
+	hashfn->get (file.hash);
+
+	std::string::size_type begin = 0, pos = 0;
+	while (pos < text.length ())
+	{
+		std::string::size_type end = text.find ('\n', pos);
+		if (end == std::string::npos)
+			 end = text.length ();
+
+		// look for a line of the form: #include "path"
+		std::string::size_type p = text.find_first_not_of (" \t", pos);
+		if (p < end && text[p] == '#')
+		{
+			p = text.find_first_not_of (" \t", p + 1);
+			if (p < end && !text.compare (p, 7, "include"))
+			{
+				std::string::size_type first, last;
+				first = text.find_first_not_of (" \t", p + 7);
+				last = first < end && text[first] == '"'
+					 ? text.find ('"', first + 1) : std::string::npos;
+				if (last < end)
+				{
+					std::string path (text, first + 1, last - first - 1);
+					for (char &c : path)
+					{
+						if (c == '/')
+							 c = DIR_SEPARATOR;
+					}
+					file.parts.emplace_back (text, begin, pos - begin);
+					file.includes.push_back (MakePath ("shaders", path));
+					// keep the line break of the directive
+					begin = end;
+				}
+			}
+		}
+		pos = end + 1;
+	}
+	file.parts.emplace_back (text, begin, std::string::npos);
+
+	return &(files[filename] = std::move (file));
+}
+
+bool ShaderCache::Expand (const std::string &filename, std::string &source,
+													std::set<std::string> &included,
+													std::vector<std::string> &includes, Hash &hash)
+{
+	if (!included.insert (filename).second)
+		 return true;
+
+	const File *file = Parse (filename);
+	if (file == NULL)
+		 return false;
+	hash.consume (file->hash, sizeof (file->hash));
+
+	for (size_t i = 0; i < file->includes.size (); i++)
+	{
+		const std::string &include = file->includes[i];
+		source += file->parts[i];
+		if (std::find (includes.begin (), includes.end (), include)
+				== includes.end ())
+			 includes.push_back (include);
+		if (!Expand (include, source, included, includes, hash))
+		{
+			(*logstream) << "Included from " << filename << std::endl;
+			return false;
+		}
+	}
+	source += file->parts.back ();
+	return true;
+}
+
+bool ShaderCache::Resolve (const std::vector<std::string> &filenames,
+													 std::vector<std::string> &sources,
+													 std::vector<std::string> &includes, Hash &hash)
+{
+	std::set<std::string> included;
+	for (const std::string &filename : filenames)
+	{
+		sources.emplace_back ();
+		if (!Expand (filename, sources.back (), included, includes, hash))
+			 return false;
+	}
+	return true;
+}
+
+bool ShaderCache::Lookup (const std::string &filename,
+													const uint64_t *definitions,
+													const std::vector<std::string> &sources,
+													uint64_t *hash)
+{
+	auto it = manifest.find (filename);
+	if (it == manifest.end ())
+		 return false;
+
+	const Entry &entry = it->second;
+	if (memcmp (entry.definitions, definitions, sizeof (entry.definitions))
+			|| entry.sources.size () != sources.size ())
+		 return false;
+
+	for (size_t i = 0; i < sources.size (); i++)
+	{
+		if (entry.sources[i].filename != sources[i]
+				|| !Check (entry.sources[i]))
+			 return false;
+	}
+	// the includes can only change, if one of the files changed
+	for (const Source &include : entry.includes)
+	{
+		if (!Check (include))
+			 return false;
+	}
+
+	memcpy (hash, entry.hash, sizeof (entry.hash));
+	return true;
+}
+
+void ShaderCache::Update (const std::string &filename,
+													const uint64_t *definitions,
+													const std::vector<std::string> &sources,
+													const std::vector<std::string> &includes,
+													const uint64_t *hash)
+{
+	Entry entry;
+	memcpy (entry.definitions, definitions, sizeof (entry.definitions));
+	memcpy (entry.hash, hash, sizeof (entry.hash));
+	entry.sources.resize (sources.size ());
+	for (size_t i = 0; i < sources.size (); i++)
+		 Stat (sources[i], entry.sources[i]);
+	entry.includes.resize (includes.size ());
+	for (size_t i = 0; i < includes.size (); i++)
+		 Stat (includes[i], entry.includes[i]);
+	manifest[filename] = std::move (entry);
+	dirty = true;
+}
+
+void ShaderCache::Submit (gl::Program &program, const std::string &filename,
+													const uint64_t *hash, std::vector<Shader> &&shaders)
+{
+	Pending p;
+	p.program = &program;
+	p.filename = filename;
+	memcpy (p.hash, hash, sizeof (p.hash));
+	p.shaders = std::move (shaders);
+	pending.push_back (std::move (p));
+}
+
+bool ShaderCache::Finish (void)
+{
+	bool result = true;
+	for (Pending &p : pending)
+	{
+		Profiler::Scope scope ("shader compile", p.filename);
+		GLint status;
+		// querying the link status waits for the driver to finish
+		gl::GetProgramiv (p.program->get (), GL_LINK_STATUS, &status);
+		if (status == GL_TRUE)
+		{
+			SaveProgramBinary (*p.program, p.filename, p.hash);
+			continue;
+		}
+
+		bool compiled = true;
+		for (Shader &shader : p.shaders)
+		{
+			gl::GetShaderiv (shader.second->get (), GL_COMPILE_STATUS, &status);
+			if (status != GL_TRUE)
+			{
+				(*logstream) << "Could not compile " << shader.first << ": "
+										 << shader.second->GetInfoLog () << std::endl;
+				compiled = false;
+			}
+		}
+		if (compiled)
+			 (*logstream) << "Could not link " << p.filename << ": "
+										<< p.program->GetInfoLog () << std::endl;
+		// don't keep a manifest entry for a broken program
+		manifest.erase (p.filename);
+		dirty = true;
+		result = false;
+	}
+	pending.clear ();
+	// files may change until the next programs are loaded
+	files.clear ();
+	stats.clear ();
+
+	if (dirty)
+		 WriteManifest ();
+	dirty = false;
+
+	return result;
+}
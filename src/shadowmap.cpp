@@ -34,45 +34,55 @@ bool ShadowMap::Init (void)
 								 &weightoffsets[0], GL_STATIC_DRAW);
 		buffertex.Buffer (GL_RG32F, buffer);
 	}
-	if (!LoadProgram (program, MakePath ("shaders", "bin", "shadowmap.bin"),
-										{}, {	std::make_pair (GL_VERTEX_SHADER,
+	// only the tessellated geometry depends on the material,
+	// through its height and displacement maps
+	const GLuint displacementmaps = ShaderFeatures::HeightMap
+		 | ShaderFeatures::DisplacementMap;
+	std::set<GLuint> features (r->geometry.GetFeatures ());
+
+	if (!program.Load (MakePath ("shaders", "bin", "shadowmap.bin"),
+										 0, features,
+										 {}, {	std::make_pair (GL_VERTEX_SHADER,
+																					 MakePath ("shaders", "shadowmap",
+																										 "vshader.txt")),
+													std::make_pair (GL_FRAGMENT_SHADER,
 																					MakePath ("shaders", "shadowmap",
-																										"vshader.txt")),
-												 std::make_pair (GL_FRAGMENT_SHADER,
-																				 MakePath ("shaders", "shadowmap",
-																									 "fshader.txt")) }))
+																										"fshader.txt")) }))
 		 return false;
-	if (!LoadProgram (quadtessprog, MakePath ("shaders", "bin",
-																					 "shadowmap_quadtess.bin"),
-										{ { "#version 420 core\n#define NUM_VERTICES 20\n" } },
-										{	std::make_pair (GL_TESS_CONTROL_SHADER,
-																			MakePath ("shaders", "shadowmap",
-																								"tess", "control.txt")),
-												 std::make_pair (GL_TESS_EVALUATION_SHADER,
-																				 MakePath ("shaders", "shadowmap",
-																									 "tess", "quadeval.txt")),
-												 std::make_pair (GL_VERTEX_SHADER,
-																				 MakePath ("shaders", "shadowmap",
-																									 "tess", "vshader.txt")),
-												 std::make_pair (GL_FRAGMENT_SHADER,
-																				 MakePath ("shaders", "shadowmap",
-																									 "tess", "fshader.txt")) }))
+	if (!quadtessprog.Load (MakePath ("shaders", "bin",
+																		"shadowmap_quadtess.bin"),
+													displacementmaps, features,
+													{ { "#version 420 core\n#define NUM_VERTICES 20\n" } },
+													{	std::make_pair (GL_TESS_CONTROL_SHADER,
+																						MakePath ("shaders", "tess",
+																											"control.txt")),
+															 std::make_pair (GL_TESS_EVALUATION_SHADER,
+																							 MakePath ("shaders", "shadowmap",
+																												 "tess", "quadeval.txt")),
+															 std::make_pair (GL_VERTEX_SHADER,
+																							 MakePath ("shaders", "tess",
+																												 "vshader.txt")),
+															 std::make_pair (GL_FRAGMENT_SHADER,
+																							 MakePath ("shaders", "shadowmap",
+																												 "tess", "fshader.txt")) }))
 		 return false;
-	if (!LoadProgram (triangletessprog, MakePath ("shaders", "bin",
-																					 "shadowmap_triangletess.bin"),
-										{ { "#version 420 core\n#define NUM_VERTICES 15\n" } },
-										{	std::make_pair (GL_TESS_CONTROL_SHADER,
-																			MakePath ("shaders", "shadowmap",
-																								"tess", "control.txt")),
-												 std::make_pair (GL_TESS_EVALUATION_SHADER,
-																				 MakePath ("shaders", "shadowmap",
-																									 "tess", "triangleeval.txt")),
-												 std::make_pair (GL_VERTEX_SHADER,
-																				 MakePath ("shaders", "shadowmap",
-																									 "tess", "vshader.txt")),
-												 std::make_pair (GL_FRAGMENT_SHADER,
-																				 MakePath ("shaders", "shadowmap",
-																									 "tess", "fshader.txt")) }))
+	if (!triangletessprog.Load (MakePath ("shaders", "bin",
+																				"shadowmap_triangletess.bin"),
+															displacementmaps, features,
+															{ { "#version 420 core\n#define NUM_VERTICES 15\n" } },
+															{	std::make_pair (GL_TESS_CONTROL_SHADER,
+																								MakePath ("shaders", "tess",
+																													"control.txt")),
+																	 std::make_pair (GL_TESS_EVALUATION_SHADER,
+																									 MakePath ("shaders", "shadowmap",
+																														 "tess",
+																														 "triangleeval.txt")),
+																	 std::make_pair (GL_VERTEX_SHADER,
+																									 MakePath ("shaders", "tess",
+																														 "vshader.txt")),
+																	 std::make_pair (GL_FRAGMENT_SHADER,
+																									 MakePath ("shaders", "shadowmap",
+																														 "tess", "fshader.txt")) }))
 		 return false;
 	if (!LoadProgram (hblurprog, MakePath ("shaders", "bin",
 																				 "shadowmap_hblur.bin"),
@@ -106,31 +116,33 @@ bool ShadowMap::Init (void)
 
 	shadowmap.Image2D (GL_TEXTURE_2D, 0, GL_RG32F, width, height,
 										 0, GL_RG, GL_FLOAT, NULL);
-	tmpstore.Image2D (GL_TEXTURE_2D, 0, GL_RG32F, width, height,
-										0, GL_RG, GL_FLOAT, NULL);
 	depthbuffer.Image2D (GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32,
 											 width, height, 0, GL_DEPTH_COMPONENT,
 											 GL_FLOAT, NULL);
 #ifdef DEBUG
-	r->memory += width * height * (2 * 4 + 2 * 4 + 4);
+	r->memory += width * height * (2 * 4 + 4);
 #endif
 
 	framebuffer.Texture2D (GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
 												 depthbuffer, 0);
 	framebuffer.DrawBuffers ({ });
 
-	hblurfb.Texture2D (GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-										 tmpstore, 0);
+	{
+		RenderGraph::TextureDesc desc;
+		desc.width = width;
+		desc.height = height;
+		desc.levels = 1;
+		desc.format = GL_RG32F;
+		tmpstore = r->graph.GetResource ("shadowtmp", desc);
+	}
+
 	hblurfb.DrawBuffers ({ GL_COLOR_ATTACHMENT0 });
 	vblurfb.Texture2D (GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
 										 shadowmap, 0);
 	vblurfb.DrawBuffers ({ GL_COLOR_ATTACHMENT0 });
 
-	projmat = gl::SmartUniform<glm::mat4> (program["projmat"], glm::mat4(1));
-	quadtessprojmat = gl::SmartUniform<glm::mat4>
-		 (quadtessprog["projmat"], glm::mat4(1));
-	triangletessprojmat = gl::SmartUniform<glm::mat4>
-		 (triangletessprog["projmat"], glm::mat4(1));
+	projmat = gl::SmartUniform<glm::mat4> (program.Get (0)["projmat"],
+																				 glm::mat4(1));
 
 	return true;
 }
@@ -159,6 +171,8 @@ void ShadowMap::Clear (void)
 void ShadowMap::Render (GLuint shadowid, Geometry &geometry,
 												const Shadow &shadow)
 {
+	float range;
+
 	vmat = glm::lookAt (glm::vec3 (shadow.position),
 											glm::vec3 (shadow.position + shadow.direction),
 											glm::vec3 (1, 0, 0));
@@ -168,8 +182,9 @@ void ShadowMap::Render (GLuint shadowid, Geometry &geometry,
 																	 * 180.0f / float (PCH_PI),
 																	 (float) width / (float) height,
 																	 3.0f, 500.0f));
-		quadtessprojmat.Set (projmat.Get ());
-		triangletessprojmat.Set (projmat.Get ());
+		quadtessprog.Set ("projmat", projmat.Get ());
+		triangletessprog.Set ("projmat", projmat.Get ());
+		range = 500.0f;
 	}
 	else
 	{
@@ -227,14 +242,19 @@ void ShadowMap::Render (GLuint shadowid, Geometry &geometry,
 		projmat.Set (glm::ortho (mins.x, maxes.x,
 														 mins.y, maxes.y,
 														 -maxes.z, -mins.z));
-		quadtessprojmat.Set (projmat.Get ());
-		triangletessprojmat.Set (projmat.Get ());
+		quadtessprog.Set ("projmat", projmat.Get ());
+		triangletessprog.Set ("projmat", projmat.Get ());
+		range = -mins.z;
 	}
-	r->culling.SetProjMatrix (projmat.Get ());
 
-	framebuffer.Bind (GL_FRAMEBUFFER);
+	culling.Frame ();
+	culling.SetProjMatrix (projmat.Get ());
+	culling.SetReceiverFrustum (r->camera.GetProjMatrix ()
+															* r->camera.GetViewMatrix ()
+															* glm::inverse (vmat),
+															shadow.direction.w != 0.0f, range);
 
-	program.Use ();
+	framebuffer.Bind (GL_FRAMEBUFFER);
 
 	gl::DepthMask (GL_TRUE);
 
@@ -245,17 +265,12 @@ void ShadowMap::Render (GLuint shadowid, Geometry &geometry,
 
 	GL_CHECK_ERROR;
 
-	geometry.Render (Geometry::Pass::ShadowMap + shadowid * 0x00010000,
-									 program, vmat);
-
-	quadtessprog.Use ();
-	geometry.Render (Geometry::Pass::ShadowMapQuadTess + shadowid * 0x00010000,
-									 quadtessprog, vmat);
-
-	triangletessprog.Use ();
-	geometry.Render (Geometry::Pass::ShadowMapTriangleTess
-									 + shadowid * 0x00010000,
-									 triangletessprog, vmat);
+	geometry.Enqueue (Geometry::Pass::ShadowMap, program, vmat, culling);
+	geometry.Enqueue (Geometry::Pass::ShadowMapQuadTess,
+										quadtessprog, vmat, culling);
+	geometry.Enqueue (Geometry::Pass::ShadowMapTriangleTess,
+										triangletessprog, vmat, culling);
+	geometry.Flush ();
 
 	gl::DepthMask (GL_FALSE);
 
@@ -264,6 +279,7 @@ void ShadowMap::Render (GLuint shadowid, Geometry &geometry,
 	buffertex.Bind (GL_TEXTURE1, GL_TEXTURE_BUFFER);
 	sampler.Bind (1);
 
+	r->graph.Attach (hblurfb, GL_COLOR_ATTACHMENT0, tmpstore);
 	hblurfb.Bind (GL_FRAMEBUFFER);
 	hblurpipeline.Bind ();
 
@@ -276,7 +292,7 @@ void ShadowMap::Render (GLuint shadowid, Geometry &geometry,
 	vblurfb.Bind (GL_FRAMEBUFFER);
 	vblurpipeline.Bind ();
 		
-	tmpstore.Bind (GL_TEXTURE0, GL_TEXTURE_2D);
+	r->graph.GetTexture (tmpstore).Bind (GL_TEXTURE0, GL_TEXTURE_2D);
 	sampler.Bind (0);
 	r->windowgrid.Render ();
 		
@@ -0,0 +1,98 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "texturecache.h"
+#include "renderer.h"
+
+TextureCache::TextureCache (void)
+{
+}
+
+TextureCache::~TextureCache (void)
+{
+}
+
+std::string TextureCache::NormalizePath (const std::string &path)
+{
+	std::vector<std::string> components;
+	std::string::size_type start = 0;
+	while (start <= path.size ())
+	{
+		std::string::size_type end = path.find_first_of ("/\\", start);
+		if (end == std::string::npos)
+			 end = path.size ();
+		std::string component = path.substr (start, end - start);
+		if (component == "..")
+		{
+			if (!components.empty () && !components.back ().empty ()
+					&& components.back () != "..")
+				 components.pop_back ();
+			else
+				 components.push_back (component);
+		}
+		// keep an empty first component for absolute paths
+		else if (component != "." && (!component.empty ()
+																	|| components.empty ()))
+			 components.push_back (component);
+		start = end + 1;
+	}
+
+	std::string result;
+	for (const std::string &component : components)
+	{
+		if (&component != &components.front ())
+			 result += DIR_SEPARATOR;
+		result += component;
+	}
+	return result;
+}
+
+TextureCache::Handle TextureCache::Get (const std::string &filename)
+{
+	std::string key = NormalizePath (filename);
+	std::unique_lock<std::mutex> lock (mutex);
+
+	Handle texture = textures[key].lock ();
+	if (texture)
+		 return texture;
+
+	texture = Handle (new Texture);
+	texture->resident = false;
+	textures[key] = texture;
+	lock.unlock ();
+
+	// the streamer keeps the texture alive until it is loaded
+	r->streamer.Request (texture->texture, filename, texture->resident,
+											 texture);
+	return texture;
+}
+
+GLuint TextureCache::GetNumTextures (void)
+{
+	std::unique_lock<std::mutex> lock (mutex);
+	GLuint count = 0;
+	for (auto it = textures.begin (); it != textures.end ();)
+	{
+		if (it->second.expired ())
+			 it = textures.erase (it);
+		else
+		{
+			count++;
+			it++;
+		}
+	}
+	return count;
+}
@@ -0,0 +1,470 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "texturestreamer.h"
+#include "filesystem.h"
+#include "profiler.h"
+#include <cstring>
+#include <algorithm>
+
+typedef struct {
+	 uint8_t identifier[12];
+	 uint32_t endianness;
+	 uint32_t glType;
+	 uint32_t glTypeSize;
+	 uint32_t glFormat;
+	 uint32_t glInternalFormat;
+	 uint32_t glBaseInternalFormat;
+	 uint32_t pixelWidth;
+	 uint32_t pixelHeight;
+	 uint32_t pixelDepth;
+	 uint32_t numberOfArrayElements;
+	 uint32_t numberOfFaces;
+	 uint32_t numberOfMipmapLevels;
+	 uint32_t bytesOfKeyValueData;
+} ktx_header_t;
+
+TextureStreamer::TextureStreamer (void)
+	: ringptr (NULL), ringsize (0), head (0), tail (0), budget (0),
+		loading (0), stop (false)
+{
+}
+
+TextureStreamer::~TextureStreamer (void)
+{
+	{
+		std::unique_lock<std::mutex> lock (mutex);
+		stop = true;
+	}
+	requested.notify_all ();
+	reclaimed.notify_all ();
+	for (std::thread &thread : threads)
+		 thread.join ();
+
+	for (Fence &fence : fences)
+		 gl::DeleteSync (fence.sync);
+}
+
+bool TextureStreamer::Init (void)
+{
+	if (!glfwExtensionSupported ("GL_ARB_buffer_storage"))
+	{
+		(*logstream) << "GL_ARB_buffer_storage is not supported."
+								 << std::endl;
+		return false;
+	}
+
+	const YAML::Node &streaming = config["streaming"];
+	ringsize = streaming["ringsize"].as<GLuint> (32) << 20;
+	budget = streaming["budget"].as<GLuint> (8) << 20;
+	GLuint numthreads = std::max (streaming["threads"].as<GLuint> (1), 1U);
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT
+		 | GL_MAP_COHERENT_BIT;
+	ring.Storage (ringsize, NULL, flags);
+	ringptr = reinterpret_cast<char*> (ring.MapRange (0, ringsize, flags));
+	if (ringptr == NULL)
+	{
+		(*logstream) << "Cannot map the texture streaming buffer."
+								 << std::endl;
+		return false;
+	}
+
+	for (GLuint i = 0; i < numthreads; i++)
+		 threads.emplace_back (&TextureStreamer::Stream, this);
+
+	return true;
+}
+
+void TextureStreamer::Request (std::unique_ptr<gl::Texture> &texture,
+															 const std::string &filename, bool &resident,
+															 const std::shared_ptr<void> &owner)
+{
+	std::shared_ptr<Texture> request (new Texture);
+	request->texture = &texture;
+	request->filename = filename;
+	request->resident = &resident;
+	request->owner = owner;
+	request->allocated = false;
+	request->generatemipmap = false;
+
+	{
+		std::unique_lock<std::mutex> lock (mutex);
+		requests.push_back (request);
+	}
+	requested.notify_one ();
+}
+
+bool TextureStreamer::IsIdle (void)
+{
+	std::unique_lock<std::mutex> lock (mutex);
+	return requests.empty () && loading == 0 && uploads.empty ();
+}
+
+void TextureStreamer::Stream (void)
+{
+	std::unique_lock<std::mutex> lock (mutex);
+	while (true)
+	{
+		requested.wait (lock, [this] (void) {
+				return stop || !requests.empty ();
+			});
+		if (stop)
+			 return;
+
+		std::shared_ptr<Texture> texture = requests.front ();
+		requests.pop_front ();
+		loading++;
+		lock.unlock ();
+
+		bool result = Load (texture);
+
+		lock.lock ();
+		loading--;
+		if (!result)
+			 failed.push_back (texture);
+	}
+}
+
+TextureStreamer::Upload *TextureStreamer::Allocate
+(const std::shared_ptr<Texture> &texture, GLuint level, GLuint size)
+{
+	std::unique_lock<std::mutex> lock (mutex);
+	GLuint aligned = (size + 15) & ~15;
+	GLuint offset = 0;
+
+	if (aligned < ringsize)
+	{
+		// head == tail means the ring is empty, so the head
+		// must never catch up with the tail from behind
+		while (true)
+		{
+			if (stop)
+				 return NULL;
+			if (head >= tail)
+			{
+				if (ringsize - head >= aligned)
+				{
+					offset = head;
+					break;
+				}
+				if (aligned < tail)
+				{
+					offset = 0;
+					break;
+				}
+			}
+			else if (tail - head > aligned)
+			{
+				offset = head;
+				break;
+			}
+			reclaimed.wait (lock);
+		}
+		head = offset + aligned;
+	}
+
+	uploads.emplace_back ();
+	Upload &upload = uploads.back ();
+	upload.texture = texture;
+	upload.level = level;
+	upload.width = std::max (texture->width >> level, 1);
+	upload.height = std::max (texture->height >> level, 1);
+	upload.size = size;
+	upload.offset = offset;
+	upload.end = head;
+	upload.ready = false;
+	if (aligned >= ringsize)
+		 upload.overflow.resize (size);
+	return &upload;
+}
+
+char *TextureStreamer::GetData (Upload *upload)
+{
+	if (!upload->overflow.empty ())
+		 return &upload->overflow[0];
+	return ringptr + upload->offset;
+}
+
+void TextureStreamer::Finish (Upload *upload)
+{
+	std::unique_lock<std::mutex> lock (mutex);
+	upload->ready = true;
+}
+
+bool TextureStreamer::Load (const std::shared_ptr<Texture> &texture)
+{
+	ktx_header_t header;
+	FileSystem::File input;
+	if (!filesystem.Open (texture->filename, input))
+		 return false;
+	std::istream &file = input.GetStream ();
+
+	file.read (reinterpret_cast<char*> (&header), sizeof (ktx_header_t));
+
+	const uint8_t id[12] = {
+		0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+	};
+	if (file.gcount () != sizeof (ktx_header_t)
+			|| memcmp (header.identifier, id, 12))
+		 return false;
+	if (header.endianness != 0x04030201)
+		 return false;
+	if (header.pixelWidth == 0 || header.pixelHeight == 0)
+		 return false;
+	if (header.pixelDepth != 0)
+		 return false;
+	if (header.numberOfFaces != 1 && header.numberOfFaces != 6)
+		 return false;
+
+	if (header.numberOfFaces == 6)
+		 texture->target = header.numberOfArrayElements
+				? GL_TEXTURE_CUBE_MAP_ARRAY : GL_TEXTURE_CUBE_MAP;
+	else
+		 texture->target = header.numberOfArrayElements
+				? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+	texture->internalformat = header.glInternalFormat;
+	texture->format = header.glFormat;
+	texture->type = header.glType;
+	texture->width = header.pixelWidth;
+	texture->height = header.pixelHeight;
+	texture->depth = header.numberOfArrayElements * header.numberOfFaces;
+
+	GLuint fulllevels = 1;
+	while ((std::max (texture->width, texture->height) >> fulllevels) > 0)
+		 fulllevels++;
+	if (header.numberOfMipmapLevels > fulllevels)
+		 return false;
+
+	// files with a single level, or none specified, get their
+	// mipmaps generated once level 0 is uploaded
+	GLuint filelevels = std::max (header.numberOfMipmapLevels, 1U);
+	texture->generatemipmap = (filelevels == 1);
+	texture->levels = texture->generatemipmap ? fulllevels : filelevels;
+
+	file.ignore (header.bytesOfKeyValueData);
+
+	// the levels are stored largest first, so find all of them
+	// before streaming them in reverse order
+	std::vector<std::pair<std::streamoff, GLuint>> levels;
+	for (GLuint level = 0; level < filelevels; level++)
+	{
+		uint32_t imagesize;
+		file.read (reinterpret_cast<char*> (&imagesize), sizeof (uint32_t));
+		if (file.gcount () != sizeof (uint32_t))
+			 return false;
+
+		// the image size of non-array cube maps covers a single face;
+		// faces are padded to four bytes, which valid data always is
+		GLuint size = imagesize;
+		if (texture->target == GL_TEXTURE_CUBE_MAP)
+		{
+			if (imagesize & 3)
+				 return false;
+			size *= 6;
+		}
+		levels.push_back (std::make_pair (file.tellg (), size));
+		file.seekg ((size + 3) & ~3, std::ios_base::cur);
+		if (!file)
+			 return false;
+	}
+
+	for (GLint level = filelevels - 1; level >= 0; level--)
+	{
+		Upload *upload = Allocate (texture, level, levels[level].second);
+		if (upload == NULL)
+			 return false;
+		char *data = GetData (upload);
+		bool result;
+		{
+			// only the copy is timed, not waiting for ring buffer space
+			Profiler::Scope scope ("texture read", texture->filename);
+			file.seekg (levels[level].first);
+			file.read (data, levels[level].second);
+			result = (file.gcount () == levels[level].second);
+		}
+		// the upload has to be finished in any case to
+		// keep the ring buffer going
+		if (!result)
+			 memset (data, 0, levels[level].second);
+		Finish (upload);
+		if (!result)
+			 return false;
+	}
+
+	return true;
+}
+
+void TextureStreamer::Issue (const Upload &upload, const GLvoid *data)
+{
+	const Texture &texture = *upload.texture;
+	gl::Texture &object = **texture.texture;
+	Profiler::Scope scope ("texture upload", texture.filename);
+	switch (texture.target)
+	{
+	case GL_TEXTURE_2D:
+		if (texture.type == 0)
+			 object.CompressedSubImage2D
+					(GL_TEXTURE_2D, upload.level, 0, 0, upload.width, upload.height,
+					 texture.internalformat, upload.size, data);
+		else
+			 object.SubImage2D
+					(GL_TEXTURE_2D, upload.level, 0, 0, upload.width, upload.height,
+					 texture.format, texture.type, data);
+		break;
+	case GL_TEXTURE_CUBE_MAP:
+		for (GLuint face = 0; face < 6; face++)
+		{
+			GLuint size = upload.size / 6;
+			const GLvoid *facedata = reinterpret_cast<const char*> (data)
+				 + face * size;
+			if (texture.type == 0)
+				 object.CompressedSubImage2D
+						(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, upload.level, 0, 0,
+						 upload.width, upload.height, texture.internalformat,
+						 size, facedata);
+			else
+				 object.SubImage2D
+						(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, upload.level, 0, 0,
+						 upload.width, upload.height, texture.format, texture.type,
+						 facedata);
+		}
+		break;
+	default:
+		// array layers and the faces of cube map arrays
+		// are stored in the same order as in the file
+		if (texture.type == 0)
+			 object.CompressedSubImage3D
+					(texture.target, upload.level, 0, 0, 0, upload.width,
+					 upload.height, texture.depth, texture.internalformat,
+					 upload.size, data);
+		else
+			 object.SubImage3D
+					(texture.target, upload.level, 0, 0, 0, upload.width,
+					 upload.height, texture.depth, texture.format, texture.type,
+					 data);
+		break;
+	}
+}
+
+void TextureStreamer::Update (void)
+{
+	std::unique_lock<std::mutex> lock (mutex);
+
+	for (const std::shared_ptr<Texture> &texture : failed)
+		 (*logstream) << "Cannot load the texture " << texture->filename << "."
+									<< std::endl;
+	failed.clear ();
+
+	GLuint uploaded = 0;
+	bool bound = false;
+	bool usedring = false;
+	GLuint end = 0;
+	while (!uploads.empty () && uploads.front ().ready)
+	{
+		Upload &upload = uploads.front ();
+		if (uploaded > 0 && uploaded + upload.size > budget)
+			 break;
+
+		Texture &texture = *upload.texture;
+		if (!texture.allocated)
+		{
+			// the texture object is only created here, as requests
+			// may come from threads without an OpenGL context
+			texture.texture->reset (new gl::Texture);
+			gl::Texture &object = **texture.texture;
+			if (texture.target == GL_TEXTURE_2D
+					|| texture.target == GL_TEXTURE_CUBE_MAP)
+				 object.Storage2D (texture.target, texture.levels,
+													 texture.internalformat,
+													 texture.width, texture.height);
+			else
+				 object.Storage3D (texture.target, texture.levels,
+													 texture.internalformat,
+													 texture.width, texture.height,
+													 texture.depth);
+			object.Parameter (texture.target, GL_TEXTURE_MAX_LEVEL,
+												texture.levels - 1);
+			texture.allocated = true;
+		}
+
+		const GLvoid *data;
+		if (upload.overflow.empty ())
+		{
+			if (!bound)
+			{
+				ring.Bind (GL_PIXEL_UNPACK_BUFFER);
+				bound = true;
+			}
+			data = reinterpret_cast<const GLvoid*> (upload.offset);
+			usedring = true;
+			end = upload.end;
+		}
+		else
+		{
+			if (bound)
+			{
+				gl::Buffer::Unbind (GL_PIXEL_UNPACK_BUFFER);
+				bound = false;
+			}
+			data = &upload.overflow[0];
+		}
+
+		Issue (upload, data);
+
+		// restrict sampling to the levels that are resident
+		gl::Texture &object = **texture.texture;
+		if (texture.generatemipmap)
+			 object.GenerateMipmap (texture.target);
+		object.Parameter (texture.target, GL_TEXTURE_BASE_LEVEL,
+											texture.generatemipmap ? 0 : upload.level);
+		*texture.resident = true;
+		// level 0 is uploaded last
+		if (upload.level == 0)
+			 texture.owner.reset ();
+
+		uploaded += upload.size;
+		uploads.pop_front ();
+	}
+	if (bound)
+		 gl::Buffer::Unbind (GL_PIXEL_UNPACK_BUFFER);
+
+	if (usedring)
+		 fences.push_back ({ gl::FenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0),
+					 end });
+
+	bool freed = false;
+	while (!fences.empty ())
+	{
+		GLenum result = gl::ClientWaitSync (fences.front ().sync, 0, 0);
+		if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+			 break;
+		tail = fences.front ().end;
+		gl::DeleteSync (fences.front ().sync);
+		fences.pop_front ();
+		freed = true;
+	}
+
+	if (freed)
+	{
+		// start over at the beginning of an empty ring
+		if (head == tail)
+			 head = tail = 0;
+		reclaimed.notify_all ();
+	}
+
+	GL_CHECK_ERROR;
+}
@@ -0,0 +1,116 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "threadpool.h"
+
+ThreadPool::ThreadPool (void) : active (0), stop (false)
+{
+}
+
+ThreadPool::~ThreadPool (void)
+{
+	{
+		std::unique_lock<std::mutex> lock (mutex);
+		stop = true;
+	}
+	available.notify_all ();
+	for (std::thread &thread : threads)
+		 thread.join ();
+}
+
+void ThreadPool::Init (GLuint numthreads)
+{
+	if (numthreads == 0)
+	{
+		numthreads = std::thread::hardware_concurrency ();
+		if (numthreads > 0)
+			 numthreads--;
+	}
+
+	for (GLuint i = 0; i < numthreads; i++)
+		 threads.emplace_back (&ThreadPool::Work, this);
+}
+
+GLuint ThreadPool::GetNumThreads (void) const
+{
+	return threads.size ();
+}
+
+void ThreadPool::Run (const std::function<void (void)> &task)
+{
+	{
+		std::unique_lock<std::mutex> lock (mutex);
+		tasks.push_back (task);
+	}
+	available.notify_one ();
+	// threads waiting for the pool help with new tasks
+	finished.notify_all ();
+}
+
+void ThreadPool::Execute (std::unique_lock<std::mutex> &lock)
+{
+	std::function<void (void)> task (std::move (tasks.front ()));
+	tasks.pop_front ();
+	active++;
+	lock.unlock ();
+
+	try {
+		task ();
+	} catch (...) {
+		lock.lock ();
+		if (!error)
+			 error = std::current_exception ();
+		lock.unlock ();
+	}
+
+	lock.lock ();
+	active--;
+	if (active == 0 && tasks.empty ())
+		 finished.notify_all ();
+}
+
+void ThreadPool::Work (void)
+{
+	std::unique_lock<std::mutex> lock (mutex);
+	while (true)
+	{
+		available.wait (lock, [this] (void) {
+				return stop || !tasks.empty ();
+			});
+		if (tasks.empty ())
+			 return;
+		Execute (lock);
+	}
+}
+
+void ThreadPool::Wait (void)
+{
+	std::unique_lock<std::mutex> lock (mutex);
+	while (!tasks.empty () || active > 0)
+	{
+		if (!tasks.empty ())
+			 Execute (lock);
+		else
+			 finished.wait (lock);
+	}
+
+	if (error)
+	{
+		std::exception_ptr e = error;
+		error = nullptr;
+		std::rethrow_exception (e);
+	}
+}
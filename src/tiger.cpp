@@ -141,11 +141,12 @@ void Tiger2::consume (const void *p, uint64_t len)
 		}
 		else
 		{
-			memcpy (&temp[templen], ptr, 64 - templen);
+			uint64_t n = 64 - templen;
+			memcpy (&temp[templen], ptr, n);
 			tiger_compress (reinterpret_cast<const uint64_t*> (temp), result);
 			templen = 0;
-			ptr += 64 - templen;
-			len -= 64 - templen;
+			ptr += n;
+			len -= n;
 		}
 	}
 
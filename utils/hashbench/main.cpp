@@ -0,0 +1,99 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <hash.h>
+#include <tiger.h>
+#include <yaml-cpp/yaml.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+/** Configuration.
+ * Referenced by Hash::Create, which is not used here.
+ */
+YAML::Node config;
+
+/** Benchmark a hash.
+ * Hashes a buffer repeatedly and prints the throughput and the digest.
+ * \param name Name of the hash.
+ * \param hash Hash to benchmark.
+ * \param data Buffer to hash.
+ * \param chunksize Number of bytes passed to each consume call.
+ * \param iterations Number of times the buffer is hashed.
+ */
+static void Run (const char *name, Hash &hash, const std::vector<uint8_t> &data,
+								 size_t chunksize, unsigned int iterations)
+{
+	typedef std::chrono::steady_clock clock;
+	uint64_t digest[3];
+	clock::time_point start = clock::now ();
+	for (unsigned int i = 0; i < iterations; i++)
+	{
+		hash.reset ();
+		for (size_t offset = 0; offset < data.size (); offset += chunksize)
+			 hash.consume (&data[offset], std::min (chunksize,
+																							data.size () - offset));
+		hash.finalize ();
+		hash.get (digest);
+	}
+	std::chrono::duration<double> seconds = clock::now () - start;
+
+	double gbs = double (data.size ()) * iterations / seconds.count () / 1e9;
+	std::cout << std::left << std::setw (8) << name << std::right
+						<< std::setw (10) << chunksize << " bytes per call: "
+						<< std::fixed << std::setprecision (2) << std::setw (6)
+						<< gbs << " GB/s, digest " << std::hex << std::setfill ('0')
+						<< std::setw (16) << digest[0] << std::setw (16) << digest[1]
+						<< std::setw (16) << digest[2] << std::dec << std::setfill (' ')
+						<< std::endl;
+}
+
+int main (int argc, char **argv)
+{
+	unsigned int iterations = 8;
+	if (argc > 1)
+		 iterations = strtoul (argv[1], NULL, 10);
+	if (iterations == 0)
+	{
+		std::cerr << "Usage: " << argv[0] << " [iterations]" << std::endl;
+		return -1;
+	}
+
+	// a fixed pseudo random buffer, so that the digests are reproducible
+	std::vector<uint8_t> data (64 << 20);
+	uint32_t state = 1;
+	for (uint8_t &byte : data)
+	{
+		state = state * 1103515245 + 12345;
+		byte = state >> 24;
+	}
+
+	std::cout << "hashing " << (data.size () >> 20) << " MB "
+						<< iterations << " times" << std::endl;
+
+	FastHash fasthash;
+	Tiger2 tiger2;
+	// one call for the whole buffer and calls of the size of typical
+	// shader sources, which exercises the buffering of partial stripes
+	for (size_t chunksize : { data.size (), size_t (1000) })
+	{
+		Run ("fast", fasthash, data, chunksize, iterations);
+		Run ("tiger2", tiger2, data, chunksize, iterations);
+	}
+	return 0;
+}
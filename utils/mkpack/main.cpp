@@ -0,0 +1,287 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <zlib.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/** Pack file header.
+ * Has to match FileSystem::PackHeader.
+ */
+struct PackHeader
+{
+	 char magic[8];
+	 uint32_t version;
+	 uint32_t numbuckets;
+	 uint64_t directory;
+	 uint64_t strings;
+	 uint64_t stringsize;
+};
+
+/** Pack file directory entry.
+ * Has to match FileSystem::PackEntry.
+ */
+struct PackEntry
+{
+	 uint64_t hash;
+	 uint64_t offset;
+	 uint64_t size;
+	 uint64_t storedsize;
+	 uint32_t name;
+	 uint32_t flags;
+};
+
+const uint32_t Compressed = 0x1;
+const uint32_t None = 0xFFFFFFFF;
+const uint64_t Alignment = 4096;
+
+static void Usage (const char *name)
+{
+	std::cerr << "Usage: " << name << " [options] [directory] [output]"
+						<< std::endl
+						<< "Packs all files of a data directory into a pack file."
+						<< std::endl
+						<< "  -exclude P   skip the file or directory P, relative to"
+						<< " the data directory" << std::endl
+						<< "  -store       don't compress any files" << std::endl;
+}
+
+/** Hash a path.
+ * 64 bit FNV-1a, has to match FileSystem::Hash.
+ */
+static uint64_t Hash (const std::string &path)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (unsigned char c : path)
+	{
+		hash ^= c;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/** Collect files.
+ * Recursively lists the regular files of a directory.
+ * \param root Data directory.
+ * \param path Path of the directory relative to the data directory.
+ * \param excludes Paths to skip.
+ * \param files Returns the paths of the files relative to the data
+ *              directory.
+ * \returns Whether the directory could be read.
+ */
+static bool Collect (const std::string &root, const std::string &path,
+										 const std::vector<std::string> &excludes,
+										 std::vector<std::string> &files)
+{
+	std::string dirname = path.empty () ? root : root + "/" + path;
+	DIR *dir = opendir (dirname.c_str ());
+	if (dir == NULL)
+	{
+		std::cerr << "Cannot open " << dirname << "." << std::endl;
+		return false;
+	}
+	bool result = true;
+	while (struct dirent *entry = readdir (dir))
+	{
+		std::string name (entry->d_name);
+		if (name == "." || name == "..")
+			 continue;
+		std::string file = path.empty () ? name : path + "/" + name;
+		if (std::find (excludes.begin (), excludes.end (), file)
+				!= excludes.end ())
+			 continue;
+		struct stat st;
+		if (stat ((root + "/" + file).c_str (), &st))
+			 continue;
+		if (S_ISDIR (st.st_mode))
+			 result = Collect (root, file, excludes, files) && result;
+		else if (S_ISREG (st.st_mode))
+			 files.push_back (file);
+	}
+	closedir (dir);
+	return result;
+}
+
+static bool ReadFile (const std::string &filename, std::vector<char> &data)
+{
+	std::ifstream file (filename, std::ios_base::in|std::ios_base::binary);
+	if (!file.is_open ())
+		 return false;
+	std::stringstream stream;
+	stream << file.rdbuf ();
+	std::string str = stream.str ();
+	data.assign (str.begin (), str.end ());
+	return !file.bad ();
+}
+
+static void Pad (std::ofstream &file, uint64_t &offset, uint64_t alignment)
+{
+	static const char zeros[Alignment] = { 0 };
+	uint64_t padding = (alignment - (offset % alignment)) % alignment;
+	file.write (zeros, padding);
+	offset += padding;
+}
+
+int main (int argc, char *argv[])
+{
+	std::vector<std::string> excludes;
+	bool store = false;
+
+	int arg;
+	for (arg = 1; arg < argc && argv[arg][0] == '-'; arg++)
+	{
+		if (!strcmp (argv[arg], "-store"))
+			 store = true;
+		else if (!strcmp (argv[arg], "-exclude") && arg + 1 < argc)
+			 excludes.push_back (argv[++arg]);
+		else
+		{
+			std::cerr << "Invalid option " << argv[arg] << "." << std::endl;
+			Usage (argv[0]);
+			return -1;
+		}
+	}
+
+	if (argc - arg != 2)
+	{
+		Usage (argv[0]);
+		return -1;
+	}
+	std::string root (argv[arg]), output (argv[arg + 1]);
+	while (root.size () > 1 && root[root.size () - 1] == '/')
+		 root.erase (root.size () - 1);
+
+	std::vector<std::string> files;
+	if (!Collect (root, std::string (), excludes, files))
+		 return -1;
+	// a deterministic order, so that equal inputs give equal packs
+	std::sort (files.begin (), files.end ());
+
+	std::ofstream file (output, std::ios_base::out|std::ios_base::binary
+											|std::ios_base::trunc);
+	if (!file.is_open ())
+	{
+		std::cerr << "Cannot open " << output << "." << std::endl;
+		return -1;
+	}
+
+	PackHeader header;
+	memset (&header, 0, sizeof (header));
+	file.write (reinterpret_cast<const char*> (&header), sizeof (header));
+	uint64_t offset = sizeof (header);
+
+	std::string strings;
+	std::vector<PackEntry> entries;
+	uint64_t totalsize = 0, totalstored = 0;
+	for (const std::string &path : files)
+	{
+		std::vector<char> data;
+		if (!ReadFile (root + "/" + path, data))
+		{
+			std::cerr << "Cannot read " << path << "." << std::endl;
+			return -1;
+		}
+
+		PackEntry entry;
+		entry.hash = Hash (path);
+		entry.size = data.size ();
+		entry.name = strings.size ();
+		entry.flags = 0;
+		strings.append (path.c_str (), path.size () + 1);
+
+		// entries are only compressed if that saves a considerable
+		// amount, as compressed entries can't be used in place
+		std::vector<char> compressed;
+		if (!store && !data.empty ())
+		{
+			uLongf length = compressBound (data.size ());
+			compressed.resize (length);
+			if (compress2 (reinterpret_cast<Bytef*> (compressed.data ()), &length,
+										 reinterpret_cast<const Bytef*> (data.data ()),
+										 data.size (), Z_BEST_COMPRESSION) == Z_OK
+					&& length < data.size () - data.size () / 8)
+			{
+				compressed.resize (length);
+				entry.flags |= Compressed;
+			}
+		}
+		const std::vector<char> &stored = (entry.flags & Compressed)
+			 ? compressed : data;
+		entry.storedsize = stored.size ();
+
+		Pad (file, offset, Alignment);
+		entry.offset = offset;
+		file.write (stored.data (), stored.size ());
+		offset += stored.size ();
+		entries.push_back (entry);
+
+		totalsize += entry.size;
+		totalstored += entry.storedsize;
+	}
+
+	// at least twice as many buckets as entries keeps the probe
+	// sequences short
+	uint32_t numbuckets = 1;
+	while (numbuckets < 2 * entries.size ())
+		 numbuckets <<= 1;
+	std::vector<PackEntry> directory (numbuckets);
+	for (PackEntry &bucket : directory)
+	{
+		memset (&bucket, 0, sizeof (PackEntry));
+		bucket.name = None;
+	}
+	for (const PackEntry &entry : entries)
+	{
+		uint32_t i = entry.hash & (numbuckets - 1);
+		while (directory[i].name != None)
+			 i = (i + 1) & (numbuckets - 1);
+		directory[i] = entry;
+	}
+
+	Pad (file, offset, Alignment);
+	header.directory = offset;
+	file.write (reinterpret_cast<const char*> (directory.data ()),
+							directory.size () * sizeof (PackEntry));
+	offset += directory.size () * sizeof (PackEntry);
+
+	header.strings = offset;
+	header.stringsize = strings.size () + 1;
+	file.write (strings.c_str (), strings.size () + 1);
+
+	memcpy (header.magic, "PCHPACK", 8);
+	header.version = 1;
+	header.numbuckets = numbuckets;
+	file.seekp (0);
+	file.write (reinterpret_cast<const char*> (&header), sizeof (header));
+
+	if (!file.good ())
+	{
+		std::cerr << "Cannot write " << output << "." << std::endl;
+		return -1;
+	}
+
+	std::cout << "Packed " << entries.size () << " files, " << totalsize
+						<< " bytes stored in " << totalstored << " bytes." << std::endl;
+	return 0;
+}
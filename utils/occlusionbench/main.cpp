@@ -0,0 +1,159 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <occlusionbuffer.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+
+/** Random number generator.
+ * A fixed linear congruential generator, so that every run
+ * uses the same scene.
+ */
+class Random
+{
+public:
+	 Random (void) : state (1)
+	 {
+	 }
+	 /** Get a random number.
+		* \param min Lower bound.
+		* \param max Upper bound.
+		* \returns A number between min and max.
+		*/
+	 float Get (float min, float max)
+	 {
+		 state = state * 1103515245 + 12345;
+		 return min + (max - min) * float ((state >> 8) & 0xFFFF) / 65535.0f;
+	 }
+private:
+	 uint32_t state;
+};
+
+/** Add a box.
+ * Appends the twelve triangles of an axis aligned box.
+ */
+static void AddBox (std::vector<glm::vec3> &vertices,
+										std::vector<GLuint> &indices,
+										const glm::vec3 &min, const glm::vec3 &max)
+{
+	const GLuint faces[36] = {
+		0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5,
+		0, 4, 5, 0, 5, 1, 2, 3, 7, 2, 7, 6,
+		0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3
+	};
+	GLuint base = vertices.size ();
+	for (int i = 0; i < 8; i++)
+		 vertices.push_back (glm::vec3 (i & 4 ? max.x : min.x,
+																		i & 2 ? max.y : min.y,
+																		i & 1 ? max.z : min.z));
+	for (int i = 0; i < 36; i++)
+		 indices.push_back (base + faces[i]);
+}
+
+int main (int argc, char **argv)
+{
+	unsigned int frames = 100;
+	if (argc > 1)
+		 frames = strtoul (argv[1], NULL, 10);
+	if (frames == 0)
+	{
+		std::cerr << "Usage: " << argv[0] << " [frames]" << std::endl;
+		return -1;
+	}
+
+	const GLuint width = 256, height = 192;
+	OcclusionBuffer buffer;
+	if (!buffer.Init (width, height))
+	{
+		std::cerr << "Cannot initialize the occlusion buffer." << std::endl;
+		return -1;
+	}
+
+	// the camera looks along the negative z axis from the origin
+	glm::mat4 projmat = glm::perspective (45.0f, 4.0f / 3.0f, 0.1f, 200.0f);
+	glm::mat4 viewmat (1.0f);
+
+	// occluders: a row of walls and a field of pillars in front of them
+	Random random;
+	std::vector<glm::vec3> vertices;
+	std::vector<GLuint> indices;
+	for (int i = 0; i < 8; i++)
+	{
+		float x = -28.0f + 8.0f * i;
+		AddBox (vertices, indices, glm::vec3 (x, -10.0f, -42.0f),
+						glm::vec3 (x + random.Get (4.0f, 7.5f), random.Get (0.0f, 10.0f),
+											 -40.0f));
+	}
+	for (int i = 0; i < 256; i++)
+	{
+		glm::vec3 pos (random.Get (-20.0f, 20.0f), random.Get (-8.0f, 4.0f),
+									 random.Get (-35.0f, -8.0f));
+		glm::vec3 size (random.Get (0.5f, 2.0f), random.Get (1.0f, 4.0f),
+										random.Get (0.5f, 2.0f));
+		AddBox (vertices, indices, pos, pos + size);
+	}
+	GLuint trianglecount = indices.size () / 3;
+
+	// queries: boxes of all sizes, most of them behind the occluders
+	const unsigned int numqueries = 16384;
+	std::vector<glm::vec3> queries;
+	for (unsigned int i = 0; i < numqueries; i++)
+	{
+		glm::vec3 pos (random.Get (-60.0f, 60.0f), random.Get (-40.0f, 40.0f),
+									 random.Get (-150.0f, -10.0f));
+		glm::vec3 size (random.Get (0.2f, 4.0f));
+		queries.push_back (pos);
+		queries.push_back (pos + size);
+	}
+	glm::mat4 mvpmat = projmat * viewmat;
+
+	typedef std::chrono::steady_clock clock;
+	clock::duration rasterization (0), querying (0);
+	unsigned int occluded = 0;
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		clock::time_point start = clock::now ();
+		buffer.Clear (projmat);
+		buffer.Rasterize (viewmat, &vertices[0], &indices[0], trianglecount);
+		buffer.Finish ();
+		clock::time_point mid = clock::now ();
+		occluded = 0;
+		for (unsigned int i = 0; i < numqueries; i++)
+		{
+			if (buffer.IsOccluded (mvpmat, queries[2 * i], queries[2 * i + 1]))
+				 occluded++;
+		}
+		clock::time_point end = clock::now ();
+		rasterization += mid - start;
+		querying += end - mid;
+	}
+
+	typedef std::chrono::duration<double, std::milli> ms;
+	typedef std::chrono::duration<double, std::nano> ns;
+	std::cout << "occlusion buffer: " << width << "x" << height << ", "
+						<< trianglecount << " occluder triangles, "
+						<< numqueries << " queries, " << frames << " frames"
+						<< std::endl;
+	std::cout << "rasterization: "
+						<< ms (rasterization).count () / frames << " ms per frame"
+						<< std::endl;
+	std::cout << "queries: "
+						<< ns (querying).count () / (double (frames) * numqueries)
+						<< " ns per query, " << occluded << " occluded"
+						<< std::endl;
+	return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef COMMON_H
+#define COMMON_H
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <iostream>
+
+/* OpenGL enumerants used in KTX headers */
+enum
+{
+	GL_UNSIGNED_BYTE = 0x1401,
+	GL_RED = 0x1903,
+	GL_RGB = 0x1907,
+	GL_RGBA = 0x1908,
+	GL_BGR = 0x80E0,
+	GL_BGRA = 0x80E1,
+	GL_RG = 0x8227,
+	GL_R8 = 0x8229,
+	GL_RG8 = 0x822B,
+	GL_RGB8 = 0x8051,
+	GL_RGBA8 = 0x8058,
+	GL_SRGB8 = 0x8C41,
+	GL_SRGB8_ALPHA8 = 0x8C43,
+	GL_COMPRESSED_RGB_S3TC_DXT1_EXT = 0x83F0,
+	GL_COMPRESSED_RGBA_S3TC_DXT5_EXT = 0x83F3,
+	GL_COMPRESSED_SRGB_S3TC_DXT1_EXT = 0x8C4C,
+	GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT = 0x8C4F,
+	GL_COMPRESSED_RED_RGTC1 = 0x8DBB,
+	GL_COMPRESSED_RG_RGTC2 = 0x8DBD,
+	GL_COMPRESSED_RGBA_BPTC_UNORM_ARB = 0x8E8C,
+	GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_ARB = 0x8E8D
+};
+
+#endif /* !defined COMMON_H */
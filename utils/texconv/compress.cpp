@@ -0,0 +1,576 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "compress.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cstring>
+
+/** Block of 4x4 RGBA pixels.
+ */
+typedef uint8_t Block[16][4];
+
+/** Fit endpoints.
+ * Fits a line through the pixels of a block using the principal axis
+ * of their covariance and returns the extent of their projections.
+ * \param block Pixels.
+ * \param dims Number of channels to consider.
+ * \param e0 Returns the first endpoint.
+ * \param e1 Returns the second endpoint.
+ */
+static void FitEndpoints (const Block &block, int dims, float e0[4],
+													float e1[4])
+{
+	float mean[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < 16; i++)
+		 for (int c = 0; c < dims; c++)
+				mean[c] += block[i][c] / 16.0f;
+
+	float cov[4][4];
+	memset (cov, 0, sizeof (cov));
+	for (int i = 0; i < 16; i++)
+		 for (int a = 0; a < dims; a++)
+				for (int b = 0; b < dims; b++)
+					 cov[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+
+	// power iteration
+	float axis[4] = { 1, 1, 1, 1 };
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[4] = { 0, 0, 0, 0 };
+		float length = 0.0f;
+		for (int a = 0; a < dims; a++)
+		{
+			for (int b = 0; b < dims; b++)
+				 next[a] += cov[a][b] * axis[b];
+			length = std::max (length, fabsf (next[a]));
+		}
+		if (length < 1e-6f)
+			 break;
+		for (int a = 0; a < dims; a++)
+			 axis[a] = next[a] / length;
+	}
+	float length = 0.0f;
+	for (int c = 0; c < dims; c++)
+		 length += axis[c] * axis[c];
+	length = sqrtf (length);
+	for (int c = 0; c < dims; c++)
+		 axis[c] /= length;
+
+	float min = 0.0f, max = 0.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		float t = 0.0f;
+		for (int c = 0; c < dims; c++)
+			 t += (block[i][c] - mean[c]) * axis[c];
+		min = std::min (min, t);
+		max = std::max (max, t);
+	}
+	for (int c = 0; c < dims; c++)
+	{
+		e0[c] = mean[c] + axis[c] * min;
+		e1[c] = mean[c] + axis[c] * max;
+	}
+}
+
+/** Refine endpoints.
+ * Computes the endpoints minimizing the squared error for the given
+ * interpolation weights of the pixels, using least squares.
+ * \returns Whether the system could be solved.
+ */
+static bool RefineEndpoints (const Block &block, int dims,
+														 const float weights[16], float e0[4],
+														 float e1[4])
+{
+	float a = 0, b = 0, c = 0;
+	float x0[4] = { 0, 0, 0, 0 }, x1[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < 16; i++)
+	{
+		float t = weights[i];
+		a += (1 - t) * (1 - t);
+		b += (1 - t) * t;
+		c += t * t;
+		for (int d = 0; d < dims; d++)
+		{
+			x0[d] += (1 - t) * block[i][d];
+			x1[d] += t * block[i][d];
+		}
+	}
+	float det = a * c - b * b;
+	if (fabsf (det) < 1e-6f)
+		 return false;
+	for (int d = 0; d < dims; d++)
+	{
+		e0[d] = std::min (std::max ((c * x0[d] - b * x1[d]) / det, 0.0f),
+											255.0f);
+		e1[d] = std::min (std::max ((a * x1[d] - b * x0[d]) / det, 0.0f),
+											255.0f);
+	}
+	return true;
+}
+
+static int Distance (const uint8_t *a, const uint8_t *b, int dims)
+{
+	int distance = 0;
+	for (int c = 0; c < dims; c++)
+		 distance += (int (a[c]) - int (b[c])) * (int (a[c]) - int (b[c]));
+	return distance;
+}
+
+/** Assign indices.
+ * Chooses the closest palette entry for each pixel.
+ * \returns The total squared error.
+ */
+static int AssignIndices (const Block &block, int dims,
+													const uint8_t palette[][4], int count,
+													uint8_t indices[16])
+{
+	int error = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		int best = Distance (block[i], palette[0], dims);
+		indices[i] = 0;
+		for (int j = 1; j < count; j++)
+		{
+			int distance = Distance (block[i], palette[j], dims);
+			if (distance < best)
+			{
+				best = distance;
+				indices[i] = j;
+			}
+		}
+		error += best;
+	}
+	return error;
+}
+
+static uint16_t Pack565 (const float color[4])
+{
+	int r = std::min (std::max (int (color[0] * 31.0f / 255.0f + 0.5f), 0), 31);
+	int g = std::min (std::max (int (color[1] * 63.0f / 255.0f + 0.5f), 0), 63);
+	int b = std::min (std::max (int (color[2] * 31.0f / 255.0f + 0.5f), 0), 31);
+	return (r << 11) | (g << 5) | b;
+}
+
+static void Unpack565 (uint16_t color, uint8_t out[4])
+{
+	int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+	out[0] = (r << 3) | (r >> 2);
+	out[1] = (g << 2) | (g >> 4);
+	out[2] = (b << 3) | (b >> 2);
+	out[3] = 255;
+}
+
+/** Encode a BC1 color block.
+ * Always uses the four color mode, so that the
+ * block can be used in BC3 blocks as well.
+ */
+static void EncodeColor (const Block &block, uint8_t *out)
+{
+	// interpolation weights of the palette entries
+	const float weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+	float e0[4], e1[4];
+	FitEndpoints (block, 3, e0, e1);
+
+	int besterror = -1;
+	uint16_t best0 = 0, best1 = 0;
+	uint8_t bestindices[16];
+	for (int iteration = 0; iteration < 2; iteration++)
+	{
+		// the endpoint with the larger value has to come first
+		uint16_t c0 = Pack565 (e1), c1 = Pack565 (e0);
+		if (c0 < c1)
+			 std::swap (c0, c1);
+
+		uint8_t palette[4][4];
+		Unpack565 (c0, palette[0]);
+		Unpack565 (c1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+		}
+
+		uint8_t indices[16];
+		int error = (c0 == c1) ? AssignIndices (block, 3, palette, 1, indices)
+			 : AssignIndices (block, 3, palette, 4, indices);
+		if (besterror < 0 || error < besterror)
+		{
+			besterror = error;
+			best0 = c0;
+			best1 = c1;
+			memcpy (bestindices, indices, 16);
+		}
+
+		float t[16];
+		for (int i = 0; i < 16; i++)
+			 t[i] = weights[indices[i]];
+		if (c0 == c1 || !RefineEndpoints (block, 3, t, e1, e0))
+			 break;
+	}
+
+	out[0] = best0 & 0xFF;
+	out[1] = best0 >> 8;
+	out[2] = best1 & 0xFF;
+	out[3] = best1 >> 8;
+	uint32_t bits = 0;
+	for (int i = 0; i < 16; i++)
+		 bits |= uint32_t (bestindices[i]) << (2 * i);
+	memcpy (out + 4, &bits, 4);
+}
+
+/** Encode a BC4 block.
+ * Encodes a single channel of a block using the eight value mode.
+ * \param block Pixels.
+ * \param channel Channel to encode.
+ * \param out Returns the encoded block.
+ */
+static void EncodeChannel (const Block &block, int channel, uint8_t *out)
+{
+	uint8_t min = 255, max = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		min = std::min (min, block[i][channel]);
+		max = std::max (max, block[i][channel]);
+	}
+
+	uint8_t palette[8][4];
+	palette[0][0] = max;
+	palette[1][0] = min;
+	for (int i = 1; i < 7; i++)
+		 palette[i + 1][0] = ((7 - i) * max + i * min + 3) / 7;
+
+	Block values;
+	for (int i = 0; i < 16; i++)
+		 values[i][0] = block[i][channel];
+	uint8_t indices[16];
+	AssignIndices (values, 1, palette, (max == min) ? 1 : 8, indices);
+
+	out[0] = max;
+	out[1] = min;
+	uint64_t bits = 0;
+	for (int i = 0; i < 16; i++)
+		 bits |= uint64_t (indices[i]) << (3 * i);
+	for (int i = 0; i < 6; i++)
+		 out[2 + i] = (bits >> (8 * i)) & 0xFF;
+}
+
+/** Bit writer for BC7 blocks.
+ */
+class BitWriter
+{
+public:
+	 BitWriter (uint8_t *out) : data (out), position (0)
+	 {
+		 memset (data, 0, 16);
+	 }
+	 void Write (uint32_t value, int bits)
+	 {
+		 for (int i = 0; i < bits; i++, position++)
+				data[position >> 3] |= ((value >> i) & 1) << (position & 7);
+	 }
+private:
+	 uint8_t *data;
+	 int position;
+};
+
+/** Quantize a BC7 mode 6 endpoint.
+ * Finds the seven bit components and the shared parity bit
+ * closest to an endpoint.
+ */
+static void QuantizeEndpoint (const float endpoint[4], uint8_t components[4],
+															uint8_t &pbit)
+{
+	float besterror = -1.0f;
+	for (int p = 0; p < 2; p++)
+	{
+		uint8_t candidate[4];
+		float error = 0.0f;
+		for (int c = 0; c < 4; c++)
+		{
+			int value = int (floorf ((endpoint[c] - p) / 2.0f + 0.5f));
+			candidate[c] = std::min (std::max (value, 0), 127);
+			float difference = (candidate[c] * 2 + p) - endpoint[c];
+			error += difference * difference;
+		}
+		if (besterror < 0.0f || error < besterror)
+		{
+			besterror = error;
+			memcpy (components, candidate, 4);
+			pbit = p;
+		}
+	}
+}
+
+/** Encode a BC7 block.
+ * Uses mode 6, a single subset with RGBA endpoints and
+ * four bit indices.
+ */
+static void EncodeBC7 (const Block &block, uint8_t *out)
+{
+	const int weights[16] = {
+		0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64
+	};
+	float e0[4], e1[4];
+	FitEndpoints (block, 4, e0, e1);
+
+	int besterror = -1;
+	uint8_t best[2][4], bestp[2], bestindices[16];
+	for (int iteration = 0; iteration < 2; iteration++)
+	{
+		uint8_t q[2][4], p[2];
+		QuantizeEndpoint (e0, q[0], p[0]);
+		QuantizeEndpoint (e1, q[1], p[1]);
+
+		uint8_t palette[16][4];
+		for (int i = 0; i < 16; i++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				int a = q[0][c] * 2 + p[0], b = q[1][c] * 2 + p[1];
+				palette[i][c] = ((64 - weights[i]) * a + weights[i] * b + 32) >> 6;
+			}
+		}
+
+		uint8_t indices[16];
+		int error = AssignIndices (block, 4, palette, 16, indices);
+		if (besterror < 0 || error < besterror)
+		{
+			besterror = error;
+			memcpy (best, q, sizeof (best));
+			memcpy (bestp, p, sizeof (bestp));
+			memcpy (bestindices, indices, 16);
+		}
+
+		float t[16];
+		for (int i = 0; i < 16; i++)
+			 t[i] = weights[indices[i]] / 64.0f;
+		if (!RefineEndpoints (block, 4, t, e0, e1))
+			 break;
+	}
+
+	// the most significant bit of the first index is implicitly zero
+	if (bestindices[0] & 8)
+	{
+		std::swap (best[0], best[1]);
+		std::swap (bestp[0], bestp[1]);
+		for (int i = 0; i < 16; i++)
+			 bestindices[i] = 15 - bestindices[i];
+	}
+
+	BitWriter writer (out);
+	writer.Write (1 << 6, 7);
+	for (int c = 0; c < 4; c++)
+	{
+		writer.Write (best[0][c], 7);
+		writer.Write (best[1][c], 7);
+	}
+	writer.Write (bestp[0], 1);
+	writer.Write (bestp[1], 1);
+	writer.Write (bestindices[0], 3);
+	for (int i = 1; i < 16; i++)
+		 writer.Write (bestindices[i], 4);
+}
+
+static uint32_t GetBlockSize (Compression compression)
+{
+	switch (compression)
+	{
+	case COMPRESSION_BC1:
+	case COMPRESSION_BC4:
+		return 8;
+	default:
+		return 16;
+	}
+}
+
+static void EncodeBlock (const Block &block, Compression compression,
+												 uint8_t *out)
+{
+	switch (compression)
+	{
+	case COMPRESSION_BC1:
+		EncodeColor (block, out);
+		break;
+	case COMPRESSION_BC3:
+		EncodeChannel (block, 3, out);
+		EncodeColor (block, out + 8);
+		break;
+	case COMPRESSION_BC4:
+		EncodeChannel (block, 0, out);
+		break;
+	case COMPRESSION_BC5:
+		EncodeChannel (block, 0, out);
+		EncodeChannel (block, 1, out + 8);
+		break;
+	case COMPRESSION_BC7:
+		EncodeBC7 (block, out);
+		break;
+	default:
+		break;
+	}
+}
+
+/** Row of blocks.
+ * A unit of work for the encoding threads.
+ */
+struct BlockRow
+{
+	 const uint8_t *image;
+	 uint8_t *out;
+	 uint32_t width;
+	 uint32_t height;
+	 uint32_t y;
+};
+
+bool Compress (Texture &texture, Compression compression, bool srgb,
+							 unsigned int numthreads)
+{
+	uint32_t components = GetComponents (texture.format);
+	if (texture.type != GL_UNSIGNED_BYTE || components == 0)
+	{
+		std::cerr << "Only uncompressed textures with 8 bit components "
+							<< "can be compressed." << std::endl;
+		return false;
+	}
+	bool bgr = (texture.format == GL_BGR || texture.format == GL_BGRA);
+
+	uint32_t count = std::max (texture.arrays, 1U) * texture.faces;
+	uint32_t blocksize = GetBlockSize (compression);
+
+	// expand all images to RGBA and collect the rows of blocks
+	std::vector<std::vector<uint8_t>> images;
+	std::vector<std::vector<uint8_t>> levels (texture.levels.size ());
+	std::vector<BlockRow> rows;
+	for (uint32_t level = 0; level < texture.levels.size (); level++)
+	{
+		uint32_t width = std::max (texture.width >> level, 1U);
+		uint32_t height = std::max (texture.height >> level, 1U);
+		uint32_t imagesize = GetRowSize (width, components) * height;
+		uint32_t blocksx = (width + 3) / 4, blocksy = (height + 3) / 4;
+		if (texture.levels[level].size () != count * imagesize)
+		{
+			std::cerr << "The texture data has an invalid size." << std::endl;
+			return false;
+		}
+		levels[level].resize (count * blocksx * blocksy * blocksize);
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const uint8_t *in = &texture.levels[level][i * imagesize];
+			std::vector<uint8_t> image (width * height * 4);
+			for (uint32_t y = 0; y < height; y++)
+			{
+				for (uint32_t x = 0; x < width; x++)
+				{
+					const uint8_t *pixel = in + y * GetRowSize (width, components)
+						 + x * components;
+					uint8_t *rgba = &image[(y * width + x) * 4];
+					rgba[0] = pixel[0];
+					rgba[1] = (components > 1) ? pixel[1] : 0;
+					rgba[2] = (components > 2) ? pixel[2] : 0;
+					rgba[3] = (components > 3) ? pixel[3] : 255;
+					if (bgr)
+						 std::swap (rgba[0], rgba[2]);
+				}
+			}
+			images.push_back (std::move (image));
+		}
+	}
+
+	uint32_t image = 0;
+	for (uint32_t level = 0; level < texture.levels.size (); level++)
+	{
+		uint32_t width = std::max (texture.width >> level, 1U);
+		uint32_t height = std::max (texture.height >> level, 1U);
+		uint32_t blocksx = (width + 3) / 4, blocksy = (height + 3) / 4;
+		for (uint32_t i = 0; i < count; i++, image++)
+		{
+			for (uint32_t y = 0; y < blocksy; y++)
+			{
+				BlockRow row;
+				row.image = &images[image][0];
+				row.out = &levels[level][((i * blocksy) + y) * blocksx * blocksize];
+				row.width = width;
+				row.height = height;
+				row.y = y;
+				rows.push_back (row);
+			}
+		}
+	}
+
+	std::atomic<size_t> next (0);
+	auto encode = [&] (void) {
+		for (size_t i = next++; i < rows.size (); i = next++)
+		{
+			const BlockRow &row = rows[i];
+			for (uint32_t x = 0; x < (row.width + 3) / 4; x++)
+			{
+				// replicate the edges of blocks crossing the border
+				Block block;
+				for (uint32_t j = 0; j < 16; j++)
+				{
+					uint32_t px = std::min (x * 4 + (j & 3), row.width - 1);
+					uint32_t py = std::min (row.y * 4 + (j >> 2), row.height - 1);
+					memcpy (block[j], row.image + (py * row.width + px) * 4, 4);
+				}
+				EncodeBlock (block, compression, row.out + x * blocksize);
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < std::max (numthreads, 1U); i++)
+		 threads.emplace_back (encode);
+	encode ();
+	for (std::thread &thread : threads)
+		 thread.join ();
+
+	texture.type = 0;
+	texture.typesize = 1;
+	texture.format = 0;
+	switch (compression)
+	{
+	case COMPRESSION_BC1:
+		texture.internalformat = srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+			 : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		texture.baseinternalformat = GL_RGB;
+		break;
+	case COMPRESSION_BC3:
+		texture.internalformat = srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+			 : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		texture.baseinternalformat = GL_RGBA;
+		break;
+	case COMPRESSION_BC4:
+		texture.internalformat = GL_COMPRESSED_RED_RGTC1;
+		texture.baseinternalformat = GL_RED;
+		break;
+	case COMPRESSION_BC5:
+		texture.internalformat = GL_COMPRESSED_RG_RGTC2;
+		texture.baseinternalformat = GL_RG;
+		break;
+	case COMPRESSION_BC7:
+		texture.internalformat = srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_ARB
+			 : GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
+		texture.baseinternalformat = GL_RGBA;
+		break;
+	default:
+		break;
+	}
+	texture.levels = std::move (levels);
+	return true;
+}
@@ -0,0 +1,52 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include "ktx.h"
+
+/** Block compression formats.
+ */
+enum Compression
+{
+	COMPRESSION_NONE,
+	/** RGB, 4 bits per pixel. */
+	COMPRESSION_BC1,
+	/** RGBA, 8 bits per pixel. */
+	COMPRESSION_BC3,
+	/** Single channel, 4 bits per pixel. */
+	COMPRESSION_BC4,
+	/** Two channels, 8 bits per pixel. */
+	COMPRESSION_BC5,
+	/** High quality RGBA, 8 bits per pixel. */
+	COMPRESSION_BC7
+};
+
+/** Compress a texture.
+ * Encodes all mipmap levels, layers and faces of an uncompressed
+ * texture with 8 bit components. The blocks are encoded in parallel.
+ * BC7 blocks are encoded using mode 6 only.
+ * \param texture Texture to compress.
+ * \param compression Block compression format.
+ * \param srgb Whether the color data is in sRGB space.
+ * \param numthreads Number of encoding threads.
+ * \returns Whether the texture was compressed successfully.
+ */
+bool Compress (Texture &texture, Compression compression, bool srgb,
+							 unsigned int numthreads);
+
+#endif /* !defined COMPRESS_H */
@@ -0,0 +1,194 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "image.h"
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <png.h>
+
+static void InitTexture (Texture &texture, uint32_t width, uint32_t height)
+{
+	texture.type = GL_UNSIGNED_BYTE;
+	texture.typesize = 1;
+	texture.format = GL_RGBA;
+	texture.internalformat = GL_RGBA8;
+	texture.baseinternalformat = GL_RGBA;
+	texture.width = width;
+	texture.height = height;
+	texture.arrays = 0;
+	texture.faces = 1;
+	texture.keyvalues.clear ();
+	texture.levels.assign (1, std::vector<uint8_t> (width * height * 4));
+}
+
+static bool LoadPNG (const std::string &filename, Texture &texture)
+{
+	FILE *file = fopen (filename.c_str (), "rb");
+	if (file == NULL)
+	{
+		std::cerr << "Cannot open " << filename << "." << std::endl;
+		return false;
+	}
+
+	png_structp png = png_create_read_struct (PNG_LIBPNG_VER_STRING,
+																						NULL, NULL, NULL);
+	png_infop info = png ? png_create_info_struct (png) : NULL;
+	if (info == NULL || setjmp (png_jmpbuf (png)))
+	{
+		std::cerr << "Cannot read " << filename << "." << std::endl;
+		png_destroy_read_struct (&png, &info, NULL);
+		fclose (file);
+		return false;
+	}
+
+	png_init_io (png, file);
+	png_read_info (png, info);
+
+	// convert everything to RGBA with 8 bit components
+	png_set_expand (png);
+	png_set_strip_16 (png);
+	png_set_gray_to_rgb (png);
+	png_set_add_alpha (png, 0xFF, PNG_FILLER_AFTER);
+	png_set_interlace_handling (png);
+	png_read_update_info (png, info);
+
+	InitTexture (texture, png_get_image_width (png, info),
+							 png_get_image_height (png, info));
+	std::vector<png_bytep> rows (texture.height);
+	for (uint32_t y = 0; y < texture.height; y++)
+		 rows[y] = &texture.levels[0][y * texture.width * 4];
+	png_read_image (png, &rows[0]);
+	png_read_end (png, NULL);
+
+	png_destroy_read_struct (&png, &info, NULL);
+	fclose (file);
+	return true;
+}
+
+static bool LoadTGA (const std::string &filename, Texture &texture)
+{
+	std::ifstream file (filename, std::ios_base::in|std::ios_base::binary);
+	if (!file.is_open ())
+	{
+		std::cerr << "Cannot open " << filename << "." << std::endl;
+		return false;
+	}
+
+	uint8_t header[18];
+	file.read (reinterpret_cast<char*> (header), 18);
+	if (file.gcount () != 18)
+	{
+		std::cerr << filename << " is truncated." << std::endl;
+		return false;
+	}
+	uint8_t idlength = header[0];
+	uint8_t colormaptype = header[1];
+	uint8_t imagetype = header[2];
+	uint32_t width = header[12] | (header[13] << 8);
+	uint32_t height = header[14] | (header[15] << 8);
+	uint8_t pixeldepth = header[16];
+	uint8_t descriptor = header[17];
+
+	// uncompressed and run length encoded true color
+	// and grayscale images are supported
+	bool rle = (imagetype & 8);
+	bool gray = ((imagetype & 7) == 3);
+	uint32_t bytes = pixeldepth / 8;
+	if (colormaptype != 0
+			|| ((imagetype & 7) != 2 && !gray)
+			|| (gray && bytes != 1)
+			|| (!gray && bytes != 3 && bytes != 4))
+	{
+		std::cerr << filename << " has an unsupported TGA format."
+							<< std::endl;
+		return false;
+	}
+	file.ignore (idlength);
+
+	InitTexture (texture, width, height);
+	uint32_t count = texture.width * texture.height;
+	std::vector<uint8_t> pixels (count * bytes);
+	for (uint32_t i = 0; i < count && file;)
+	{
+		uint8_t packet = 0x7F;
+		if (rle)
+			 packet = file.get ();
+		uint32_t length = std::min (uint32_t (packet & 0x7F) + 1, count - i);
+		if (rle && (packet & 0x80))
+		{
+			file.read (reinterpret_cast<char*> (&pixels[i * bytes]), bytes);
+			for (uint32_t j = 1; j < length; j++)
+				 memcpy (&pixels[(i + j) * bytes], &pixels[i * bytes], bytes);
+		}
+		else
+			 file.read (reinterpret_cast<char*> (&pixels[i * bytes]),
+									length * bytes);
+		i += length;
+	}
+	if (!file)
+	{
+		std::cerr << filename << " is truncated." << std::endl;
+		return false;
+	}
+
+	// TGA images are stored bottom up, unless bit 5 of the descriptor is set
+	bool topdown = (descriptor & 0x20);
+	for (uint32_t y = 0; y < texture.height; y++)
+	{
+		uint32_t row = topdown ? y : texture.height - 1 - y;
+		for (uint32_t x = 0; x < texture.width; x++)
+		{
+			const uint8_t *in = &pixels[(row * texture.width + x) * bytes];
+			uint8_t *out = &texture.levels[0][(y * texture.width + x) * 4];
+			if (gray)
+			{
+				out[0] = out[1] = out[2] = in[0];
+				out[3] = 0xFF;
+			}
+			else
+			{
+				out[0] = in[2];
+				out[1] = in[1];
+				out[2] = in[0];
+				out[3] = (bytes == 4) ? in[3] : 0xFF;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool LoadImage (const std::string &filename, Texture &texture)
+{
+	std::string extension;
+	size_t dot = filename.rfind ('.');
+	if (dot != std::string::npos)
+		 extension = filename.substr (dot + 1);
+	for (char &c : extension)
+		 c = tolower (c);
+
+	if (extension == "png")
+		 return LoadPNG (filename, texture);
+	if (extension == "tga")
+		 return LoadTGA (filename, texture);
+	if (extension == "ktx")
+		 return ReadKTX (filename, texture);
+
+	std::cerr << "Unknown image format of " << filename << "." << std::endl;
+	return false;
+}
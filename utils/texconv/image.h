@@ -0,0 +1,32 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "ktx.h"
+
+/** Load a source image.
+ * Loads a PNG, TGA or KTX file, depending on the file extension.
+ * PNG and TGA images are converted to RGBA with 8 bit components,
+ * with the first row being the top of the image.
+ * \param filename Filename of the image.
+ * \param texture Texture to load the image into.
+ * \returns Whether the image was loaded successfully.
+ */
+bool LoadImage (const std::string &filename, Texture &texture);
+
+#endif /* !defined IMAGE_H */
@@ -0,0 +1,250 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ktx.h"
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+typedef struct {
+	 uint8_t identifier[12];
+	 uint32_t endianness;
+	 uint32_t glType;
+	 uint32_t glTypeSize;
+	 uint32_t glFormat;
+	 uint32_t glInternalFormat;
+	 uint32_t glBaseInternalFormat;
+	 uint32_t pixelWidth;
+	 uint32_t pixelHeight;
+	 uint32_t pixelDepth;
+	 uint32_t numberOfArrayElements;
+	 uint32_t numberOfFaces;
+	 uint32_t numberOfMipmapLevels;
+	 uint32_t bytesOfKeyValueData;
+} ktx_header_t;
+
+static const uint8_t ktx_identifier[12] = {
+	0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+};
+
+uint32_t GetComponents (uint32_t format)
+{
+	switch (format)
+	{
+	case GL_RED:
+		return 1;
+	case GL_RG:
+		return 2;
+	case GL_RGB:
+	case GL_BGR:
+		return 3;
+	case GL_RGBA:
+	case GL_BGRA:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+uint32_t GetRowSize (uint32_t width, uint32_t components)
+{
+	return (width * components + 3) & ~3;
+}
+
+/* non-array cube maps store the image size of a single face */
+static bool IsCubeMap (const Texture &texture)
+{
+	return texture.faces == 6 && texture.arrays == 0;
+}
+
+bool ReadKTX (const std::string &filename, Texture &texture)
+{
+	ktx_header_t header;
+	std::ifstream file (filename, std::ios_base::in|std::ios_base::binary);
+	if (!file.is_open ())
+	{
+		std::cerr << "Cannot open " << filename << "." << std::endl;
+		return false;
+	}
+
+	file.read (reinterpret_cast<char*> (&header), sizeof (ktx_header_t));
+	if (file.gcount () != sizeof (ktx_header_t)
+			|| memcmp (header.identifier, ktx_identifier, 12))
+	{
+		std::cerr << filename << " is no KTX file." << std::endl;
+		return false;
+	}
+	if (header.endianness != 0x04030201)
+	{
+		std::cerr << filename << " has an unsupported endianness."
+							<< std::endl;
+		return false;
+	}
+	if (header.pixelHeight == 0 || header.pixelDepth != 0
+			|| (header.numberOfFaces != 1 && header.numberOfFaces != 6))
+	{
+		std::cerr << filename << " is no two dimensional texture, "
+							<< "array texture or cube map." << std::endl;
+		return false;
+	}
+
+	texture.type = header.glType;
+	texture.typesize = header.glTypeSize;
+	texture.format = header.glFormat;
+	texture.internalformat = header.glInternalFormat;
+	texture.baseinternalformat = header.glBaseInternalFormat;
+	texture.width = header.pixelWidth;
+	texture.height = header.pixelHeight;
+	texture.arrays = header.numberOfArrayElements;
+	texture.faces = header.numberOfFaces;
+
+	texture.keyvalues.clear ();
+	std::vector<char> keyvalues (header.bytesOfKeyValueData);
+	if (!keyvalues.empty ())
+	{
+		file.read (&keyvalues[0], keyvalues.size ());
+		if (static_cast<size_t> (file.gcount ()) != keyvalues.size ())
+		{
+			std::cerr << filename << " is truncated." << std::endl;
+			return false;
+		}
+	}
+	for (size_t offset = 0; offset + 4 <= keyvalues.size ();)
+	{
+		uint32_t size;
+		memcpy (&size, &keyvalues[offset], 4);
+		offset += 4;
+		if (size > keyvalues.size () - offset)
+			 break;
+		std::string keyvalue (&keyvalues[offset], size);
+		size_t separator = keyvalue.find ('\0');
+		if (separator != std::string::npos)
+		{
+			std::string value = keyvalue.substr (separator + 1);
+			// values written by this tool are null terminated
+			if (!value.empty () && value[value.size () - 1] == '\0')
+				 value.resize (value.size () - 1);
+			texture.keyvalues[keyvalue.substr (0, separator)] = value;
+		}
+		offset += (size + 3) & ~3;
+	}
+
+	texture.levels.resize (std::max (header.numberOfMipmapLevels, 1U));
+	for (std::vector<uint8_t> &level : texture.levels)
+	{
+		uint32_t imagesize;
+		file.read (reinterpret_cast<char*> (&imagesize), sizeof (uint32_t));
+		if (file.gcount () != sizeof (uint32_t))
+		{
+			std::cerr << filename << " is truncated." << std::endl;
+			return false;
+		}
+
+		uint32_t padded = imagesize;
+		uint32_t count = 1;
+		if (IsCubeMap (texture))
+		{
+			padded = (imagesize + 3) & ~3;
+			count = 6;
+		}
+
+		level.resize (imagesize * count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			file.read (reinterpret_cast<char*> (&level[i * imagesize]),
+								 imagesize);
+			if (file.gcount () != imagesize)
+			{
+				std::cerr << filename << " is truncated." << std::endl;
+				return false;
+			}
+			file.ignore (padded - imagesize);
+		}
+		if (count == 1)
+			 file.ignore (((imagesize + 3) & ~3) - imagesize);
+	}
+
+	return true;
+}
+
+bool WriteKTX (const std::string &filename, const Texture &texture)
+{
+	std::ofstream file (filename, std::ios_base::out|std::ios_base::binary
+											|std::ios_base::trunc);
+	if (!file.is_open ())
+	{
+		std::cerr << "Cannot open " << filename << " for writing."
+							<< std::endl;
+		return false;
+	}
+
+	ktx_header_t header;
+	memcpy (header.identifier, ktx_identifier, 12);
+	header.endianness = 0x04030201;
+	header.glType = texture.type;
+	header.glTypeSize = texture.typesize;
+	header.glFormat = texture.format;
+	header.glInternalFormat = texture.internalformat;
+	header.glBaseInternalFormat = texture.baseinternalformat;
+	header.pixelWidth = texture.width;
+	header.pixelHeight = texture.height;
+	header.pixelDepth = 0;
+	header.numberOfArrayElements = texture.arrays;
+	header.numberOfFaces = texture.faces;
+	header.numberOfMipmapLevels = texture.levels.size ();
+	header.bytesOfKeyValueData = 0;
+	for (const auto &keyvalue : texture.keyvalues)
+	{
+		uint32_t size = keyvalue.first.size () + keyvalue.second.size () + 2;
+		header.bytesOfKeyValueData += 4 + ((size + 3) & ~3);
+	}
+	file.write (reinterpret_cast<const char*> (&header),
+							sizeof (ktx_header_t));
+
+	const char padding[4] = { 0, 0, 0, 0 };
+	for (const auto &keyvalue : texture.keyvalues)
+	{
+		uint32_t size = keyvalue.first.size () + keyvalue.second.size () + 2;
+		file.write (reinterpret_cast<const char*> (&size), sizeof (uint32_t));
+		file.write (keyvalue.first.c_str (), keyvalue.first.size () + 1);
+		file.write (keyvalue.second.c_str (), keyvalue.second.size () + 1);
+		file.write (padding, ((size + 3) & ~3) - size);
+	}
+
+	for (const std::vector<uint8_t> &level : texture.levels)
+	{
+		uint32_t count = IsCubeMap (texture) ? 6 : 1;
+		uint32_t imagesize = level.size () / count;
+		file.write (reinterpret_cast<const char*> (&imagesize),
+								sizeof (uint32_t));
+		for (uint32_t i = 0; i < count; i++)
+		{
+			file.write (reinterpret_cast<const char*> (&level[i * imagesize]),
+									imagesize);
+			if (count > 1)
+				 file.write (padding, ((imagesize + 3) & ~3) - imagesize);
+		}
+		if (count == 1)
+			 file.write (padding, ((imagesize + 3) & ~3) - imagesize);
+	}
+
+	if (!file)
+	{
+		std::cerr << "Cannot write " << filename << "." << std::endl;
+		return false;
+	}
+	return true;
+}
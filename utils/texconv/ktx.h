@@ -0,0 +1,70 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef KTX_H
+#define KTX_H
+
+#include "common.h"
+#include <map>
+
+/** KTX texture.
+ * Contents of a KTX file. The data of each mipmap level contains all
+ * array elements and faces in file order, with rows padded to four
+ * bytes, but without any level or cube padding. Key/value pairs are
+ * limited to string values.
+ */
+struct Texture
+{
+	 uint32_t type;
+	 uint32_t typesize;
+	 uint32_t format;
+	 uint32_t internalformat;
+	 uint32_t baseinternalformat;
+	 uint32_t width;
+	 uint32_t height;
+	 uint32_t arrays;
+	 uint32_t faces;
+	 std::map<std::string, std::string> keyvalues;
+	 std::vector<std::vector<uint8_t>> levels;
+};
+
+/** Number of components.
+ * \param format Pixel format of an uncompressed texture.
+ * \returns The number of components, or zero for unsupported formats.
+ */
+uint32_t GetComponents (uint32_t format);
+/** Row size.
+ * Rows of uncompressed KTX image data are padded to four bytes.
+ * \param width Width of the image.
+ * \param components Number of 8 bit components.
+ * \returns The size of a row in bytes.
+ */
+uint32_t GetRowSize (uint32_t width, uint32_t components);
+/** Read a KTX file.
+ * Reads a two dimensional texture, array texture or cube map.
+ * \param filename Filename of the KTX file.
+ * \param texture Texture to read the file into.
+ * \returns Whether the file was read successfully.
+ */
+bool ReadKTX (const std::string &filename, Texture &texture);
+/** Write a KTX file.
+ * \param filename Filename of the KTX file.
+ * \param texture Texture to write.
+ * \returns Whether the file was written successfully.
+ */
+bool WriteKTX (const std::string &filename, const Texture &texture);
+
+#endif /* !defined KTX_H */
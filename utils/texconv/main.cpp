@@ -0,0 +1,223 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ktx.h"
+#include "image.h"
+#include "mipmap.h"
+#include "compress.h"
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <thread>
+#include <sys/stat.h>
+
+static void Usage (const char *name)
+{
+	std::cerr << "Usage: " << name << " [options] [input] [output]" << std::endl
+						<< "Converts a PNG, TGA or KTX image into a KTX texture with a "
+						<< "full mipmap chain." << std::endl
+						<< "  -semantic S  diffuse, normalmap, specularmap, parametermap,"
+						<< std::endl
+						<< "               heightmap or displacementmap; chooses the"
+						<< " compression" << std::endl
+						<< "  -format F    none, bc1, bc3, bc4, bc5 or bc7; overrides the"
+						<< " semantic" << std::endl
+						<< "  -fast        use BC1/BC3 instead of BC7 for color data"
+						<< std::endl
+						<< "  -srgb        the color data is in sRGB space" << std::endl
+						<< "  -wrap        the texture repeats" << std::endl
+						<< "  -normalmap   renormalize the normals of each level"
+						<< std::endl
+						<< "  -threads N   number of encoding threads" << std::endl
+						<< "  -force       convert even if the output is up to date"
+						<< std::endl;
+}
+
+/** Check for transparency.
+ * \returns Whether any pixel of level 0 isn't fully opaque.
+ */
+static bool HasAlpha (const Texture &texture)
+{
+	if (GetComponents (texture.format) != 4)
+		 return false;
+	for (size_t i = 3; i < texture.levels[0].size (); i += 4)
+	{
+		if (texture.levels[0][i] != 255)
+			 return true;
+	}
+	return false;
+}
+
+/** Compression for a semantic.
+ * Chooses the compression for a texture slot of the materials,
+ * based on the channels the shaders read from it.
+ */
+static bool GetCompression (const std::string &semantic, bool fast,
+														bool alpha, Compression &compression)
+{
+	if (semantic == "diffuse")
+		 compression = fast ? (alpha ? COMPRESSION_BC3 : COMPRESSION_BC1)
+				: COMPRESSION_BC7;
+	else if (semantic == "normalmap")
+		 // the z component is reconstructed in the shaders
+		 compression = COMPRESSION_BC5;
+	else if (semantic == "specularmap")
+		 compression = COMPRESSION_BC1;
+	else if (semantic == "parametermap" || semantic == "heightmap")
+		 compression = COMPRESSION_BC4;
+	else if (semantic == "displacementmap")
+		 compression = fast ? COMPRESSION_BC1 : COMPRESSION_BC7;
+	else
+		 return false;
+	return true;
+}
+
+static bool GetCompression (const std::string &format,
+														Compression &compression)
+{
+	const struct {
+		 const char *name;
+		 Compression compression;
+	} formats[] = {
+		{ "none", COMPRESSION_NONE },
+		{ "bc1", COMPRESSION_BC1 },
+		{ "bc3", COMPRESSION_BC3 },
+		{ "bc4", COMPRESSION_BC4 },
+		{ "bc5", COMPRESSION_BC5 },
+		{ "bc7", COMPRESSION_BC7 }
+	};
+	for (const auto &entry : formats)
+	{
+		if (format == entry.name)
+		{
+			compression = entry.compression;
+			return true;
+		}
+	}
+	return false;
+}
+
+int main (int argc, char *argv[])
+{
+	MipmapOptions options;
+	options.wrap = false;
+	options.normalmap = false;
+	std::string semantic, format;
+	bool fast = false, srgb = false, force = false;
+	unsigned int numthreads = std::thread::hardware_concurrency ();
+
+	int arg;
+	for (arg = 1; arg < argc && argv[arg][0] == '-'; arg++)
+	{
+		if (!strcmp (argv[arg], "-wrap"))
+			 options.wrap = true;
+		else if (!strcmp (argv[arg], "-normalmap"))
+			 options.normalmap = true;
+		else if (!strcmp (argv[arg], "-fast"))
+			 fast = true;
+		else if (!strcmp (argv[arg], "-srgb"))
+			 srgb = true;
+		else if (!strcmp (argv[arg], "-force"))
+			 force = true;
+		else if (!strcmp (argv[arg], "-semantic") && arg + 1 < argc)
+			 semantic = argv[++arg];
+		else if (!strcmp (argv[arg], "-format") && arg + 1 < argc)
+			 format = argv[++arg];
+		else if (!strcmp (argv[arg], "-threads") && arg + 1 < argc)
+			 numthreads = atoi (argv[++arg]);
+		else
+		{
+			std::cerr << "Invalid option " << argv[arg] << "." << std::endl;
+			Usage (argv[0]);
+			return -1;
+		}
+	}
+
+	if (argc - arg != 2)
+	{
+		Usage (argv[0]);
+		return -1;
+	}
+	std::string input (argv[arg]), output (argv[arg + 1]);
+
+	if (semantic == "normalmap")
+		 options.normalmap = true;
+
+	// the output is up to date, if it was converted from the same
+	// input file with the same options
+	struct stat st;
+	if (stat (input.c_str (), &st))
+	{
+		std::cerr << "Cannot open " << input << "." << std::endl;
+		return -1;
+	}
+	std::stringstream source;
+	source << st.st_size << " " << st.st_mtime << " semantic=" << semantic
+				 << " format=" << format << " fast=" << fast << " srgb=" << srgb
+				 << " wrap=" << options.wrap << " normalmap=" << options.normalmap;
+	if (!force)
+	{
+		Texture previous;
+		if (!stat (output.c_str (), &st))
+		{
+			if (ReadKTX (output, previous)
+					&& previous.keyvalues["texconv.source"] == source.str ())
+			{
+				std::cout << output << " is up to date." << std::endl;
+				return 0;
+			}
+		}
+	}
+
+	Texture texture;
+	if (!LoadImage (input, texture))
+		 return -1;
+
+	Compression compression = COMPRESSION_NONE;
+	if (!format.empty ())
+	{
+		if (!GetCompression (format, compression))
+		{
+			std::cerr << "Unknown format " << format << "." << std::endl;
+			return -1;
+		}
+	}
+	else if (!semantic.empty ())
+	{
+		if (!GetCompression (semantic, fast, HasAlpha (texture), compression))
+		{
+			std::cerr << "Unknown semantic " << semantic << "." << std::endl;
+			return -1;
+		}
+	}
+
+	if (srgb && GetComponents (texture.format) >= 3)
+		 texture.internalformat = (GetComponents (texture.format) == 4)
+				? GL_SRGB8_ALPHA8 : GL_SRGB8;
+
+	if (!GenerateMipmaps (texture, options))
+		 return -1;
+	if (compression != COMPRESSION_NONE
+			&& !Compress (texture, compression, srgb, numthreads))
+		 return -1;
+
+	texture.keyvalues.clear ();
+	texture.keyvalues["texconv.source"] = source.str ();
+	if (!WriteKTX (output, texture))
+		 return -1;
+
+	return 0;
+}
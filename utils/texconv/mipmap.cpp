@@ -0,0 +1,249 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "mipmap.h"
+#include <algorithm>
+
+/** Floating point image.
+ * A single layer or face of a mipmap level.
+ */
+struct Image
+{
+	 uint32_t width;
+	 uint32_t height;
+	 std::vector<float> data;
+};
+
+/** Filter tap.
+ */
+struct Tap
+{
+	 uint32_t index;
+	 float weight;
+};
+
+static float ToLinear (float value)
+{
+	if (value <= 0.04045f)
+		 return value / 12.92f;
+	return powf ((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float FromLinear (float value)
+{
+	if (value <= 0.0031308f)
+		 return value * 12.92f;
+	return 1.055f * powf (value, 1.0f / 2.4f) - 0.055f;
+}
+
+static float Lanczos (float x)
+{
+	const float pi = 3.14159265358979f;
+	x = fabsf (x);
+	if (x < 1e-6f)
+		 return 1.0f;
+	if (x >= 3.0f)
+		 return 0.0f;
+	return 3.0f * sinf (pi * x) * sinf (pi * x / 3.0f) / (pi * pi * x * x);
+}
+
+/** Compute filter taps.
+ * Computes the taps of a Lanczos filter scaled to the
+ * ratio between the source and the destination size.
+ */
+static std::vector<std::vector<Tap>> ComputeTaps (uint32_t src, uint32_t dst,
+																									bool wrap)
+{
+	std::vector<std::vector<Tap>> taps (dst);
+	float scale = float (src) / float (dst);
+	float support = 3.0f * scale;
+	for (uint32_t i = 0; i < dst; i++)
+	{
+		float center = (float (i) + 0.5f) * scale;
+		int first = int (floorf (center - support));
+		int last = int (ceilf (center + support));
+		float sum = 0.0f;
+		for (int j = first; j <= last; j++)
+		{
+			float weight = Lanczos ((float (j) + 0.5f - center) / scale);
+			if (weight == 0.0f)
+				 continue;
+			Tap tap;
+			if (wrap)
+				 tap.index = ((j % int (src)) + src) % src;
+			else
+				 tap.index = std::min (std::max (j, 0), int (src) - 1);
+			tap.weight = weight;
+			taps[i].push_back (tap);
+			sum += weight;
+		}
+		for (Tap &tap : taps[i])
+			 tap.weight /= sum;
+	}
+	return taps;
+}
+
+static Image Downsample (const Image &src, uint32_t width, uint32_t height,
+												 uint32_t components, bool wrap)
+{
+	std::vector<std::vector<Tap>> htaps = ComputeTaps (src.width, width, wrap);
+	std::vector<std::vector<Tap>> vtaps = ComputeTaps (src.height, height,
+																										 wrap);
+
+	std::vector<float> tmp (width * src.height * components, 0.0f);
+	for (uint32_t y = 0; y < src.height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			float *out = &tmp[(y * width + x) * components];
+			for (const Tap &tap : htaps[x])
+			{
+				const float *in = &src.data[(y * src.width + tap.index)
+																		* components];
+				for (uint32_t c = 0; c < components; c++)
+					 out[c] += tap.weight * in[c];
+			}
+		}
+	}
+
+	Image dst;
+	dst.width = width;
+	dst.height = height;
+	dst.data.resize (width * height * components, 0.0f);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (const Tap &tap : vtaps[y])
+		{
+			const float *in = &tmp[tap.index * width * components];
+			float *out = &dst.data[y * width * components];
+			for (uint32_t i = 0; i < width * components; i++)
+				 out[i] += tap.weight * in[i];
+		}
+	}
+
+	// the negative lobes of the filter can overshoot
+	for (float &value : dst.data)
+		 value = std::min (std::max (value, 0.0f), 1.0f);
+	return dst;
+}
+
+static void Renormalize (Image &image, uint32_t components)
+{
+	for (uint32_t i = 0; i < image.width * image.height; i++)
+	{
+		float *n = &image.data[i * components];
+		float x = n[0] * 2.0f - 1.0f;
+		float y = n[1] * 2.0f - 1.0f;
+		float z = n[2] * 2.0f - 1.0f;
+		float length = sqrtf (x * x + y * y + z * z);
+		if (length < 1e-6f)
+			 continue;
+		n[0] = x / length * 0.5f + 0.5f;
+		n[1] = y / length * 0.5f + 0.5f;
+		n[2] = z / length * 0.5f + 0.5f;
+	}
+}
+
+static Image Decode (const uint8_t *data, uint32_t width, uint32_t height,
+										 uint32_t components, bool srgb)
+{
+	Image image;
+	image.width = width;
+	image.height = height;
+	image.data.resize (width * height * components);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const uint8_t *row = data + y * GetRowSize (width, components);
+		for (uint32_t i = 0; i < width * components; i++)
+		{
+			float value = float (row[i]) / 255.0f;
+			// the alpha channel is always linear
+			if (srgb && (i % components) < 3)
+				 value = ToLinear (value);
+			image.data[y * width * components + i] = value;
+		}
+	}
+	return image;
+}
+
+static void Encode (const Image &image, uint32_t components, bool srgb,
+										std::vector<uint8_t> &data)
+{
+	uint32_t rowsize = GetRowSize (image.width, components);
+	size_t offset = data.size ();
+	data.resize (offset + rowsize * image.height, 0);
+	for (uint32_t y = 0; y < image.height; y++)
+	{
+		uint8_t *row = &data[offset + y * rowsize];
+		for (uint32_t i = 0; i < image.width * components; i++)
+		{
+			float value = image.data[y * image.width * components + i];
+			if (srgb && (i % components) < 3)
+				 value = FromLinear (value);
+			row[i] = uint8_t (value * 255.0f + 0.5f);
+		}
+	}
+}
+
+bool GenerateMipmaps (Texture &texture, const MipmapOptions &options)
+{
+	uint32_t components = GetComponents (texture.format);
+	if (texture.type != GL_UNSIGNED_BYTE || components == 0)
+	{
+		std::cerr << "Only uncompressed textures with 8 bit components "
+							<< "are supported." << std::endl;
+		return false;
+	}
+
+	bool srgb = (texture.internalformat == GL_SRGB8
+							 || texture.internalformat == GL_SRGB8_ALPHA8);
+	uint32_t count = std::max (texture.arrays, 1U) * texture.faces;
+	uint32_t imagesize = GetRowSize (texture.width, components)
+		 * texture.height;
+	if (texture.levels.empty () || texture.levels[0].size () != count * imagesize)
+	{
+		std::cerr << "The texture data has an invalid size." << std::endl;
+		return false;
+	}
+
+	std::vector<Image> images;
+	for (uint32_t i = 0; i < count; i++)
+		 images.push_back (Decode (&texture.levels[0][i * imagesize],
+															 texture.width, texture.height,
+															 components, srgb));
+
+	texture.levels.resize (1);
+	uint32_t width = texture.width;
+	uint32_t height = texture.height;
+	while (width > 1 || height > 1)
+	{
+		width = std::max (width >> 1, 1U);
+		height = std::max (height >> 1, 1U);
+
+		std::vector<uint8_t> level;
+		for (Image &image : images)
+		{
+			// filter the previous level in full precision
+			image = Downsample (image, width, height, components, options.wrap);
+			if (options.normalmap && components >= 3)
+				 Renormalize (image, components);
+			Encode (image, components, srgb, level);
+		}
+		texture.levels.push_back (std::move (level));
+	}
+
+	return true;
+}
@@ -0,0 +1,44 @@
+/*
+ * This file is part of Pentachoron.
+ *
+ * Pentachoron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pentachoron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Pentachoron.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include "ktx.h"
+
+/** Mipmap generation options.
+ */
+struct MipmapOptions
+{
+	 /** Whether the texture repeats, otherwise its edges are clamped. */
+	 bool wrap;
+	 /** Whether the texture is a normal map, whose
+	  * normals are renormalized on each level. */
+	 bool normalmap;
+};
+
+/** Generate mipmaps.
+ * Replaces all mipmap levels but level 0 by a full mipmap chain. Each
+ * level is computed from the previous one in floating point precision
+ * using a separable Lanczos filter, in linear space for sRGB textures.
+ * Only uncompressed textures with 8 bit components are supported.
+ * \param texture Texture to generate the mipmaps for.
+ * \param options Mipmap generation options.
+ * \returns Whether the mipmaps were generated successfully.
+ */
+bool GenerateMipmaps (Texture &texture, const MipmapOptions &options);
+
+#endif /* !defined MIPMAP_H */